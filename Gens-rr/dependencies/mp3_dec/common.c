@@ -24,8 +24,8 @@ long freqs[9] = { 44100, 48000, 32000,
                   22050, 24000, 16000 ,
                   11025 , 12000 , 8000 };
 
-int bitindex;
-unsigned char *wordpointer;
+MP3_THREAD_LOCAL int bitindex;
+MP3_THREAD_LOCAL unsigned char *wordpointer;
 unsigned char *pcm_sample;
 int pcm_point = 0;
 
@@ -17,7 +17,7 @@
 #include "mpg123.h"
 #include "mpglib.h"
 
-extern struct mpstr *gmp;
+extern MP3_THREAD_LOCAL struct mpstr *gmp;
 
  /* old WRITE_SAMPLE */
 #define WRITE_SAMPLE(samples,sum,clip) \
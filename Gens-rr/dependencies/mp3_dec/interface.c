@@ -6,7 +6,7 @@
 #include "mpglib.h"
 
 /* Global mp .. it's a hack */
-struct mpstr *gmp;
+MP3_THREAD_LOCAL struct mpstr *gmp;
 
 extern int fatal_mp3_error; // Modif N.
 
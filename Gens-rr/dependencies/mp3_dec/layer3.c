@@ -10,7 +10,7 @@
 #include "mpglib.h"
 #include "huffman.h"
 
-extern struct mpstr *gmp;
+extern MP3_THREAD_LOCAL struct mpstr *gmp;
 
 #define MPEG1
 
@@ -1911,8 +1911,8 @@ int do_layer3(struct frame *fr,unsigned char *pcm_sample,int *pcm_point)
 
   for (gr=0;gr<granules;gr++) 
   {
-    static real hybridIn[2][SBLIMIT][SSLIMIT];
-    static real hybridOut[2][SSLIMIT][SBLIMIT];
+    static MP3_THREAD_LOCAL real hybridIn[2][SBLIMIT][SSLIMIT];
+    static MP3_THREAD_LOCAL real hybridOut[2][SSLIMIT][SBLIMIT];
 
     {
       struct gr_info_s *gr_info = &(sideinfo.ch[0].gr[gr]);
@@ -23,6 +23,13 @@
 
 #endif
 
+/* Modif -- decoder state that has to be per thread, so that several MP3s can be decoded at once */
+#ifdef _MSC_VER
+#  define MP3_THREAD_LOCAL __declspec(thread)
+#else
+#  define MP3_THREAD_LOCAL __thread
+#endif
+
 #ifdef REAL_IS_FLOAT
 #  define real float
 #elif defined(REAL_IS_LONG_DOUBLE)
@@ -103,8 +110,8 @@ extern unsigned int   getbits(int);
 extern unsigned int   getbits_fast(int);
 extern int set_pointer(long);
 
-extern unsigned char *wordpointer;
-extern int bitindex;
+extern MP3_THREAD_LOCAL unsigned char *wordpointer;
+extern MP3_THREAD_LOCAL int bitindex;
 
 extern void make_decode_tables(long scaleval);
 extern int do_layer3(struct frame *fr,unsigned char *,int *);
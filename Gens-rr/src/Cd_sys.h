@@ -141,6 +141,7 @@ int CDD_Def(void);
 
 void Write_CD_Audio(short *Buf, int rate, int channel, int length);
 void Update_CD_Audio(int **Buf, int length);
+int CD_Audio_Benchmark(char *summary);
 //void Start_CD_Timer(void);
 //void Stop_CD_Timer(void);
 //void Update_CD_Timer(void);
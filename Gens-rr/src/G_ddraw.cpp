@@ -23,6 +23,9 @@
 #include "hackscommon.h"
 #include "drawutil.h"
 #include "luascript.h"
+#include "rewind.h"
+#include "synclog.h"
+#include "coverage.h"
 
 LPDIRECTDRAW lpDD_Init;
 LPDIRECTDRAW4 lpDD;
@@ -60,6 +63,8 @@ static unsigned int Info_Time = 0;
 
 void (*Blit_FS)(unsigned char *Dest, int pitch, int x, int y, int offset);
 void (*Blit_W)(unsigned char *Dest, int pitch, int x, int y, int offset);
+unsigned short *MD_Screen_Blit = MD_Screen;
+unsigned int *MD_Screen32_Blit = MD_Screen32;
 int (*Update_Frame)();
 int (*Update_Frame_Fast)();
 
@@ -417,6 +422,8 @@ int Init_DDraw(HWND hWnd)
 
 void End_DDraw()
 {
+	Present_Wait();
+
 	if (lpDDC_Clipper)
 	{
 		lpDDC_Clipper->Release();
@@ -470,6 +477,8 @@ int Clear_Primary_Screen(HWND hWnd)
 	if(!lpDD)
 		return 0; // bail if directdraw hasn't been initialized yet or if we're still in the middle of initializing it
 
+	Present_Wait();
+
 	DDSURFACEDESC2 ddsd;
 	DDBLTFX ddbltfx;
 	RECT RD;
@@ -515,6 +524,8 @@ int Clear_Back_Screen(HWND hWnd)
 	if(!lpDD)
 		return 0; // bail if directdraw hasn't been initialized yet or if we're still in the middle of initializing it
 
+	Present_Wait();
+
 	DDSURFACEDESC2 ddsd;
 	DDBLTFX ddbltfx;
 
@@ -533,6 +544,8 @@ int Clear_Back_Screen(HWND hWnd)
 
 void Restore_Primary(void)
 {
+	Present_Wait();
+
 	if (lpDD && Full_Screen && FS_VSync)
 	{
 		while (lpDDS_Primary->GetFlipStatus(DDGFS_ISFLIPDONE) == DDERR_SURFACEBUSY);
@@ -993,6 +1006,8 @@ void DrawInformationOnTheScreen()
 				{					
 					FPS = (float) (freq_cpu[0]) * 16.0f / (float) (new_time[0] - old_time);
 					sprintf(Info_String, "%.1f", FPS);
+					if (Sound_Mix_Segments)
+						sprintf(Info_String + strlen(Info_String), " (mix %.1f us)", (double) Sound_Mix_Ticks * 1000000.0 / freq_cpu[0] / Sound_Mix_Segments);
 				}
 				else
 				{
@@ -1001,6 +1016,8 @@ void DrawInformationOnTheScreen()
 
 				old_time = new_time[0];
 				view_fps = 0;
+				Sound_Mix_Ticks = 0;
+				Sound_Mix_Segments = 0;
 			}
 		}
 		else if (freq_cpu[0] == 1)			// accurate timer not supported
@@ -1046,53 +1063,18 @@ void DrawInformationOnTheScreen()
 #endif
 }
 
-int Flip(HWND hWnd)
+// DirectDraw blit or flip of the current frame, with the software blit of the render mode, which
+// reads MD_Screen_Blit/MD_Screen32_Blit
+static HRESULT Flip_Surface(HWND hWnd, RECT RectDest, RECT RectSrc)
 {
-	if(!lpDD)
-		return 0; // bail if directdraw hasn't been initialized yet or if we're still in the middle of initializing it
-
 	HRESULT rval = DD_OK;
 	DDSURFACEDESC2 ddsd;
 	ddsd.dwSize = sizeof(ddsd);
-	RECT RectDest, RectSrc;
 	int bpp = Bits32 ? 4 : 2; // Modif N. -- added: bytes per pixel
 
-	DrawInformationOnTheScreen(); // Modif N. -- moved all this stuff out to its own function
-
-	if (Fast_Blur) Half_Blur();
-	
-	CalculateDrawArea(hWnd, RectDest, RectSrc);
-
 	int Src_X = (RectSrc.right - RectSrc.left);
 	int Src_Y = (RectSrc.bottom - RectSrc.top);
 
-	int Clr_Cmp_Val  = IS_FULL_X_RESOLUTION ? 4 : 8;
-		Clr_Cmp_Val |= IS_FULL_Y_RESOLUTION ? 16 : 32;
-
-	if (Flag_Clr_Scr & 0x100) // need clear second buffer
-	{
-		Clear_Primary_Screen(hWnd);
-		Flag_Clr_Scr ^= 0x300; // already cleared
-	}
-
-	if ((Flag_Clr_Scr & 0xFF) != (Clr_Cmp_Val & 0xFF))
-	{
-		if (!Full_Screen && W_VSync)
-			lpDD->WaitForVerticalBlank(DDWAITVB_BLOCKBEGIN, 0);
-		if (!(Flag_Clr_Scr & 0x200))
-			Clear_Primary_Screen(hWnd); // already cleared
-		if ((!Full_Screen && Render_W >= 2)
-		 || ( Full_Screen && Render_FS >= 2))
-			Clear_Back_Screen(hWnd);
-		
-		if (Full_Screen && FS_VSync)
-			Flag_Clr_Scr = Clr_Cmp_Val | 0x100; // need to clear second buffer
-		else
-			Flag_Clr_Scr = Clr_Cmp_Val;
-	}
-
-	Flag_Clr_Scr &= 0x1FF; // remove "already cleared"
-
 	if (Full_Screen)
 	{
 		if (Render_FS < 2)
@@ -1120,7 +1102,7 @@ int Flip(HWND hWnd)
 
 			rval = curBlit->Lock(NULL, &ddsd, DDLOCK_WAIT, NULL);
 
-			if (FAILED(rval)) goto cleanup_flip;
+			if (FAILED(rval)) return rval;
 
 			if (curBlit == lpDDS_Back) // note: this can happen in windowed fullscreen, or if Correct_256_Aspect_Ratio is defined and the current display mode is 256 pixels across
 			{
@@ -1161,7 +1143,7 @@ int Flip(HWND hWnd)
 		{
 			rval = lpDDS_Blit->Lock(NULL, &ddsd, DDLOCK_WAIT, NULL);
 
-			if (FAILED(rval)) goto cleanup_flip;
+			if (FAILED(rval)) return rval;
 
 			Blit_W((unsigned char *) ddsd.lpSurface + ddsd.lPitch * RectSrc.top + RectSrc.left * bpp, ddsd.lPitch, Src_X / 2, Src_Y / 2, (16 + 320 - Src_X / 2) * bpp);
 
@@ -1184,7 +1166,161 @@ int Flip(HWND hWnd)
 		}
 	}
 
-cleanup_flip:
+	return rval;
+}
+
+
+// Threaded presentation : with a software render mode, Flip hands a copy of the finished frame to a
+// worker thread, which does the blit/filter and the DirectDraw blit or flip (and its VSync wait) while
+// the next frame is emulated. At most one frame waits behind the one being presented, so no frame is
+// dropped. Everything else that touches DirectDraw calls Present_Wait first.
+
+int Present_Threaded = 0;
+
+struct Present_Frame
+{
+	unsigned short Screen[336 * 240];
+	unsigned int Screen32[336 * 240];
+	HWND hWnd;
+	RECT RectDest, RectSrc;
+};
+
+static Present_Frame Present_Frames[2];
+static int Present_Next = 0;
+static volatile LONG Present_Pending = 0;
+static volatile LONG Present_Queued = 0, Present_Shown = 0;
+static volatile LONG Present_Lost = 0;
+static HANDLE Present_Thread = NULL;
+static DWORD Present_Thread_Id = 0;
+static HANDLE Present_Ready = NULL;		// a frame is waiting
+static HANDLE Present_Free = NULL;		// the waiting frame was taken
+static HANDLE Present_Done = NULL;		// a frame was presented
+
+static DWORD WINAPI Present_Thread_Proc(LPVOID)
+{
+	for(;;)
+	{
+		WaitForSingleObject(Present_Ready, INFINITE);
+
+		Present_Frame *frame = &Present_Frames[Present_Pending];
+		SetEvent(Present_Free);
+
+		MD_Screen_Blit = frame->Screen;
+		MD_Screen32_Blit = frame->Screen32;
+		if (Flip_Surface(frame->hWnd, frame->RectDest, frame->RectSrc) == DDERR_SURFACELOST)
+			Present_Lost = 1; // restored by the next Flip, not from this thread
+		MD_Screen_Blit = MD_Screen;
+		MD_Screen32_Blit = MD_Screen32;
+
+		InterlockedIncrement(&Present_Shown);
+		SetEvent(Present_Done);
+	}
+}
+
+static int Present_Start(void)
+{
+	if (Present_Thread)
+		return 1;
+
+	Present_Ready = CreateEvent(NULL, FALSE, FALSE, NULL);
+	Present_Free = CreateEvent(NULL, FALSE, TRUE, NULL);
+	Present_Done = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if (!Present_Ready || !Present_Free || !Present_Done)
+		return 0;
+
+	Present_Thread = CreateThread(NULL, 0, Present_Thread_Proc, NULL, 0, &Present_Thread_Id);
+	return Present_Thread != NULL;
+}
+
+static void Present_Queue(HWND hWnd, const RECT &RectDest, const RECT &RectSrc)
+{
+	WaitForSingleObject(Present_Free, INFINITE);
+
+	Present_Frame *frame = &Present_Frames[Present_Next];
+	if (Bits32)
+		memcpy(frame->Screen32, MD_Screen32, sizeof(frame->Screen32));
+	else
+		memcpy(frame->Screen, MD_Screen, sizeof(frame->Screen));
+	frame->hWnd = hWnd;
+	frame->RectDest = RectDest;
+	frame->RectSrc = RectSrc;
+
+	InterlockedIncrement(&Present_Queued);
+	Present_Pending = Present_Next;
+	Present_Next ^= 1;
+	SetEvent(Present_Ready);
+}
+
+// waits until the presentation thread is done with DirectDraw, does nothing on that thread
+void Present_Wait(void)
+{
+	if (!Present_Thread || GetCurrentThreadId() == Present_Thread_Id)
+		return;
+
+	while (Present_Shown != Present_Queued)
+		WaitForSingleObject(Present_Done, INFINITE);
+}
+
+int Flip(HWND hWnd)
+{
+	if(!lpDD)
+		return 0; // bail if directdraw hasn't been initialized yet or if we're still in the middle of initializing it
+
+	HRESULT rval = DD_OK;
+	RECT RectDest, RectSrc;
+
+	DrawInformationOnTheScreen(); // Modif N. -- moved all this stuff out to its own function
+
+	if (Fast_Blur) Half_Blur();
+	
+	CalculateDrawArea(hWnd, RectDest, RectSrc);
+
+	int Clr_Cmp_Val  = IS_FULL_X_RESOLUTION ? 4 : 8;
+		Clr_Cmp_Val |= IS_FULL_Y_RESOLUTION ? 16 : 32;
+
+	if (Present_Lost)
+	{
+		Present_Wait();
+		Present_Lost = 0;
+		RestoreGraphics(hWnd);
+	}
+
+	if (Flag_Clr_Scr & 0x100) // need clear second buffer
+	{
+		Present_Wait();
+		Clear_Primary_Screen(hWnd);
+		Flag_Clr_Scr ^= 0x300; // already cleared
+	}
+
+	if ((Flag_Clr_Scr & 0xFF) != (Clr_Cmp_Val & 0xFF))
+	{
+		Present_Wait();
+		if (!Full_Screen && W_VSync)
+			lpDD->WaitForVerticalBlank(DDWAITVB_BLOCKBEGIN, 0);
+		if (!(Flag_Clr_Scr & 0x200))
+			Clear_Primary_Screen(hWnd); // already cleared
+		if ((!Full_Screen && Render_W >= 2)
+		 || ( Full_Screen && Render_FS >= 2))
+			Clear_Back_Screen(hWnd);
+		
+		if (Full_Screen && FS_VSync)
+			Flag_Clr_Scr = Clr_Cmp_Val | 0x100; // need to clear second buffer
+		else
+			Flag_Clr_Scr = Clr_Cmp_Val;
+	}
+
+	Flag_Clr_Scr &= 0x1FF; // remove "already cleared"
+
+	// the single render modes blit from a surface that is MD_Screen itself, nothing to gain there
+	if (Present_Threaded && (Full_Screen ? Render_FS : Render_W) >= 2 && Present_Start())
+	{
+		Present_Queue(hWnd, RectDest, RectSrc);
+		return 1;
+	}
+
+	Present_Wait();
+	rval = Flip_Surface(hWnd, RectDest, RectSrc);
+
 	if (rval == DDERR_SURFACELOST)
 		rval = RestoreGraphics(hWnd);
 
@@ -1409,6 +1545,11 @@ void UpdateLagCount()
 		LagCountPersistent++;
 	}
 
+	// every emulated frame ends here, so this is also where rewind captures are taken
+	Rewind_Capture();
+	SyncLog_Frame();
+	Coverage_Frame();
+
 	// catch-all to fix problem with sound stuttered when paused during frame skipping
 	// looks out of place but maybe this function should be renamed
 	extern bool soundCleared;
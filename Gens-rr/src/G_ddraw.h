@@ -29,6 +29,7 @@ extern int Kaillera_Error;
 extern unsigned char CleanAvi;
 extern bool frameadvSkipLag;
 extern bool justlagged;
+extern int Present_Threaded;
 
 #define ALT_X_RATIO_RES (Correct_256_Aspect_Ratio ? 320 : 256)
 
@@ -61,6 +62,7 @@ extern "C" void Put_Info(char *Message, int Duration = 4000);
 extern "C" void Put_Info_NonImmediate(char *Message, int Duration = 4000);
 int Show_Genesis_Screen(HWND hWnd);
 int Flip(HWND hWnd);
+void Present_Wait(void);
 void Restore_Primary(void);
 int Take_Shot();
 int Take_Shot_Clipboard();
@@ -9,6 +9,7 @@
 #include "save.h" //Modif
 #include "hackdefs.h"
 #include "luascript.h"
+#include "rewind.h"
 
 #define KEYDOWN(key) (Keys[key] & 0x80) 
 #define MAX_JOYS 8
@@ -251,6 +252,18 @@ static InputButton s_inputButtons [] =
 	{MOD_NONE,			VK_OEM_3,	   ID_NONE, 0, &AutoClearKeyDown,    "Clear Auto-Fire and Auto-Hold", "AutoClearKey"},
 	
 	{MOD_SHIFT,			 VK_TAB,	   ID_TOGGLE_TURBO,				   0, NULL, "Toggle Fast Forward", "ToggleFastForwardKey"},
+	{MOD_NONE,			VK_NONE,	   ID_NONE, 0, &RewindKeyDown,       "Rewind", "RewindKey"},
+	{MOD_NONE,          VK_NONE,       ID_TOGGLE_REWIND,               0, NULL, "Toggle Rewind Capture", "ToggleRewindKey"},
+	{MOD_NONE,          VK_NONE,       ID_REWIND_BENCHMARK,            0, NULL, "Benchmark Rewind Capture", "RewindBenchmarkKey"},
+	{MOD_NONE,          VK_NONE,       ID_MOVIE_INPUT_BENCHMARK,       0, NULL, "Benchmark Movie Input", "MovieInputBenchmarkKey"},
+	{MOD_NONE,          VK_NONE,       ID_TOGGLE_MOVIE_STATE_DIFFS,    0, NULL, "Toggle Savestate Movie Diffs", "ToggleMovieStateDiffsKey"},
+	{MOD_NONE,          VK_NONE,       ID_RAM_SEARCH_BENCHMARK,        0, NULL, "Benchmark RAM Search", "RamSearchBenchmarkKey"},
+	{MOD_NONE,          VK_NONE,       ID_YM2612_BENCHMARK,            0, NULL, "Benchmark YM2612", "YM2612BenchmarkKey"},
+	{MOD_NONE,          VK_NONE,       ID_PSG_BENCHMARK,               0, NULL, "Benchmark PSG", "PSGBenchmarkKey"},
+	{MOD_NONE,          VK_NONE,       ID_PCM_BENCHMARK,               0, NULL, "Benchmark Sega CD PCM", "PCMBenchmarkKey"},
+	{MOD_NONE,          VK_NONE,       ID_CDDA_BENCHMARK,              0, NULL, "Benchmark CD Audio Resampler", "CDDABenchmarkKey"},
+	{MOD_NONE,          VK_NONE,       ID_VDP_BENCHMARK,               0, NULL, "Benchmark VDP Renderer", "VDPBenchmarkKey"},
+	{MOD_NONE,          VK_NONE,       ID_LUA_MEMHOOK_BENCHMARK,       0, NULL, "Benchmark Lua Memory Hooks", "LuaMemHookBenchmarkKey"},
 	{MOD_NONE,     VK_OEM_COMMA,       ID_TOGGLE_SHOWINPUT,            0, NULL, "Show Input", "ShowInputKey"},
 	{MOD_NONE,    VK_OEM_PERIOD,       ID_TOGGLE_SHOWFRAMEANDLAGCOUNT, 0, NULL, "Show Frame/Lag Counter", "ShowFrameAndLagCounterKey"},
 	{MOD_NONE,          VK_NONE,       ID_TOGGLE_TIMEUNIT,             0, NULL, "Toggle Counter Time Unit", "ToggleCounterTimeUnitKey"},
@@ -364,12 +377,15 @@ static InputButton s_inputButtons [] =
 
 	{MOD_NONE,              VK_NONE,   ID_GRAPHICS_SPRITEALWAYS, 0, NULL, "Sprites On Top On/Off", "SpritesOnTopKey"},
 	{MOD_NONE,              VK_NONE,   ID_CHANGE_PALLOCK,        0, NULL, "Lock/Unlock Palette", "LockPaletteKey"},
+	{MOD_NONE,              VK_NONE,   ID_GRAPHICS_TILECACHE,    0, NULL, "Tile Cache Renderer On/Off", "TileCacheKey"},
+	{MOD_NONE,              VK_NONE,   ID_GRAPHICS_THREADEDPRESENT, 0, NULL, "Threaded Presentation On/Off", "ThreadedPresentKey"},
 
 	{MOD_CONTROL|MOD_SHIFT,   'P',     ID_SOUND_PLAYGYM,         0, NULL, "Play GYM", "GYMKey"},
 	{MOD_NONE,              VK_NONE,   ID_SOUND_STARTWAVDUMP,    0, NULL, "Dump WAV", "WAVKey"},
 
 	{MOD_NONE,             VK_NONE,    ID_SOUND_DACIMPROV,       0, NULL, "Improved DAC On/Off", "ImpDACKey"},
 //	{MOD_NONE,             VK_NONE,    ID_SOUND_PSGIMPROV,       0, NULL, "Improved PSG On/Off", "ImpPSGKey"},
+	{MOD_NONE,             VK_NONE,    ID_SOUND_PSGBLEP,         0, NULL, "Band-Limited PSG On/Off", "BlepPSGKey"},
 	{MOD_NONE,             VK_NONE,    ID_SOUND_YMIMPROV,        0, NULL, "Improved YM On/Off", "ImpYMKey"},
 	{MOD_NONE,             VK_NONE,    ID_SOUND_SOFTEN,          0, NULL, "Sound Soften Filter On/Off", "SoundSoftenKey"},
 
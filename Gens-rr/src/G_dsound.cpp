@@ -13,6 +13,7 @@
 #include "misc.h"		// for Have_MMX flag
 #include "scrshot.h"
 #include <math.h> // Nitsuja includes this for his softsound filter
+#include <emmintrin.h>
 
 LPDIRECTSOUND lpDS;
 WAVEFORMATEX MainWfx;
@@ -42,6 +43,10 @@ unsigned short MastVol = 128;
 extern unsigned long FrameCount;
 unsigned long FrameCountAtLastAudioOutput = -1;
 
+LONGLONG Sound_Mix_Ticks = 0;	// time spent in the mix stage of Write_Sound_Buffer, in QueryPerformanceCounter ticks
+int Sound_Mix_Segments = 0;		// and the number of segments it was measured over (both shown and reset with the framerate)
+static int Sound_SSE2 = -1;
+
 unsigned int Sound_Interpol[882];
 unsigned int Sound_Extrapol[312][2];
 
@@ -375,15 +380,279 @@ void Dump_Sound_Mono(short *Dest, int length)
 }
 
 
+// SSE2 versions of the functions above, they give exactly the same output.
+// _mm_packs_epi32 saturates to [-0x8000, 0x7FFF] the same way the scalar clipping does,
+// and the mono clipping is the same as saturating out >> 1.
+
+// x / 9 for 4 ints, rounded towards zero like C does (SSE2 has no integer division)
+static inline __m128i Div9_SSE2(__m128i x)
+{
+	const __m128i magic = _mm_set1_epi32(0x38E38E39);
+	__m128i sign = _mm_srai_epi32(x, 31);
+	__m128i a = _mm_sub_epi32(_mm_xor_si128(x, sign), sign);
+	__m128i even = _mm_srli_epi64(_mm_mul_epu32(a, magic), 33);
+	__m128i odd = _mm_srli_epi64(_mm_mul_epu32(_mm_srli_epi64(a, 32), magic), 33);
+	__m128i q = _mm_or_si128(even, _mm_slli_epi64(odd, 32));
+
+	return _mm_sub_epi32(_mm_xor_si128(q, sign), sign);
+}
+
+// lowpass of buf[i] to buf[i + 3], buf[i - 2] to buf[i + 5] must be inside the segment
+static inline __m128i Lowpass_SSE2(const int *buf)
+{
+	__m128i c = _mm_loadu_si128((const __m128i *) buf);
+	__m128i n1 = _mm_add_epi32(_mm_loadu_si128((const __m128i *) (buf - 1)), _mm_loadu_si128((const __m128i *) (buf + 1)));
+	__m128i n2 = _mm_add_epi32(_mm_loadu_si128((const __m128i *) (buf - 2)), _mm_loadu_si128((const __m128i *) (buf + 2)));
+	__m128i sum = _mm_add_epi32(_mm_add_epi32(c, _mm_slli_epi32(c, 1)), _mm_add_epi32(_mm_slli_epi32(n1, 1), n2));
+
+	return Div9_SSE2(sum);
+}
+
+static inline short Clip_Stereo(int out)
+{
+	if (out < -0x8000) return -0x8000;
+	if (out > 0x7FFF) return 0x7FFF;
+	return (short) out;
+}
+
+static inline short Clip_Mono(int out)
+{
+	if (out < -0x10000) return -0x8000;
+	if (out > 0xFFFF) return 0x7FFF;
+	return (short) (out >> 1);
+}
+
+// mixes Seg_L and Seg_R into Dest with clipping, the soften filter if asked,
+// and clears the segment when clear is set, all in one pass over the buffers
+static void Mix_Sound_Stereo_SSE2(short *Dest, int soften, int clear)
+{
+	const __m128i zero = _mm_setzero_si128();
+	short *dest = Dest;
+	int i = 0, cleared = 0;
+
+	if (soften)
+	{
+		// the filter reads 2 samples on each side, so a block can only
+		// clear what the next block doesn't read anymore
+		for(; i < 2 && i < Seg_Length; i++)
+		{
+			*dest++ = Clip_Stereo(lowpass(Seg_L, i, Seg_Length));
+			*dest++ = Clip_Stereo(lowpass(Seg_R, i, Seg_Length));
+		}
+		for(; i + 6 <= Seg_Length; i += 4)
+		{
+			__m128i l = Lowpass_SSE2(Seg_L + i), r = Lowpass_SSE2(Seg_R + i);
+
+			_mm_storeu_si128((__m128i *) dest, _mm_unpacklo_epi16(_mm_packs_epi32(l, l), _mm_packs_epi32(r, r)));
+			dest += 8;
+
+			if (clear)
+			{
+				_mm_storeu_si128((__m128i *) (Seg_L + i - 2), zero);
+				_mm_storeu_si128((__m128i *) (Seg_R + i - 2), zero);
+				cleared = i + 2;
+			}
+		}
+		for(; i < Seg_Length; i++)
+		{
+			*dest++ = Clip_Stereo(lowpass(Seg_L, i, Seg_Length));
+			*dest++ = Clip_Stereo(lowpass(Seg_R, i, Seg_Length));
+		}
+	}
+	else
+	{
+		for(; i + 8 <= Seg_Length; i += 8)
+		{
+			__m128i l = _mm_packs_epi32(_mm_loadu_si128((const __m128i *) (Seg_L + i)), _mm_loadu_si128((const __m128i *) (Seg_L + i + 4)));
+			__m128i r = _mm_packs_epi32(_mm_loadu_si128((const __m128i *) (Seg_R + i)), _mm_loadu_si128((const __m128i *) (Seg_R + i + 4)));
+
+			_mm_storeu_si128((__m128i *) dest, _mm_unpacklo_epi16(l, r));
+			_mm_storeu_si128((__m128i *) (dest + 8), _mm_unpackhi_epi16(l, r));
+			dest += 16;
+
+			if (clear)
+			{
+				_mm_storeu_si128((__m128i *) (Seg_L + i), zero);
+				_mm_storeu_si128((__m128i *) (Seg_L + i + 4), zero);
+				_mm_storeu_si128((__m128i *) (Seg_R + i), zero);
+				_mm_storeu_si128((__m128i *) (Seg_R + i + 4), zero);
+				cleared = i + 8;
+			}
+		}
+		for(; i < Seg_Length; i++)
+		{
+			*dest++ = Clip_Stereo(Seg_L[i]);
+			*dest++ = Clip_Stereo(Seg_R[i]);
+		}
+	}
+
+	if (clear)
+	{
+		for(i = cleared; i < Seg_Length; i++)
+			Seg_L[i] = Seg_R[i] = 0;
+	}
+}
+
+static void Mix_Sound_Mono_SSE2(short *Dest, int soften, int clear)
+{
+	const __m128i zero = _mm_setzero_si128();
+	short *dest = Dest;
+	int i = 0, cleared = 0;
+
+	if (soften)
+	{
+		for(; i < 2 && i < Seg_Length; i++)
+			*dest++ = Clip_Mono(lowpass(Seg_L, i, Seg_Length) + lowpass(Seg_R, i, Seg_Length));
+		for(; i + 6 <= Seg_Length; i += 4)
+		{
+			__m128i out = _mm_srai_epi32(_mm_add_epi32(Lowpass_SSE2(Seg_L + i), Lowpass_SSE2(Seg_R + i)), 1);
+
+			_mm_storel_epi64((__m128i *) dest, _mm_packs_epi32(out, out));
+			dest += 4;
+
+			if (clear)
+			{
+				_mm_storeu_si128((__m128i *) (Seg_L + i - 2), zero);
+				_mm_storeu_si128((__m128i *) (Seg_R + i - 2), zero);
+				cleared = i + 2;
+			}
+		}
+		for(; i < Seg_Length; i++)
+			*dest++ = Clip_Mono(lowpass(Seg_L, i, Seg_Length) + lowpass(Seg_R, i, Seg_Length));
+	}
+	else
+	{
+		for(; i + 8 <= Seg_Length; i += 8)
+		{
+			__m128i lo = _mm_add_epi32(_mm_loadu_si128((const __m128i *) (Seg_L + i)), _mm_loadu_si128((const __m128i *) (Seg_R + i)));
+			__m128i hi = _mm_add_epi32(_mm_loadu_si128((const __m128i *) (Seg_L + i + 4)), _mm_loadu_si128((const __m128i *) (Seg_R + i + 4)));
+
+			_mm_storeu_si128((__m128i *) dest, _mm_packs_epi32(_mm_srai_epi32(lo, 1), _mm_srai_epi32(hi, 1)));
+			dest += 8;
+
+			if (clear)
+			{
+				_mm_storeu_si128((__m128i *) (Seg_L + i), zero);
+				_mm_storeu_si128((__m128i *) (Seg_L + i + 4), zero);
+				_mm_storeu_si128((__m128i *) (Seg_R + i), zero);
+				_mm_storeu_si128((__m128i *) (Seg_R + i + 4), zero);
+				cleared = i + 8;
+			}
+		}
+		for(; i < Seg_Length; i++)
+			*dest++ = Clip_Mono(Seg_L[i] + Seg_R[i]);
+	}
+
+	if (clear)
+	{
+		for(i = cleared; i < Seg_Length; i++)
+			Seg_L[i] = Seg_R[i] = 0;
+	}
+}
+
+// fills the segment with mostly sound-sized samples and some that clip, both loud and at the 32-bit limits
+static void Mix_Check_Fill(unsigned int *seed)
+{
+	int i;
+
+	for(i = 0; i < 882; i++)
+	{
+		*seed = *seed * 1103515245 + 12345;
+		switch((*seed >> 28) & 15)
+		{
+			case 0: Seg_L[i] = 0x7FFFFFFF - (int) ((*seed >> 8) & 15); break;
+			case 1: Seg_L[i] = (int) 0x80000000 + (int) ((*seed >> 8) & 15); break;
+			case 2: case 3: Seg_L[i] = (int) ((*seed >> 4) & 0x7FFFF) - 0x40000; break;
+			default: Seg_L[i] = (int) ((*seed >> 8) & 0xFFFF) - 0x8000; break;
+		}
+		Seg_R[i] = (Seg_L[i] ^ (int) (*seed & 0x3FFF)) - 0x2000;
+	}
+}
+
+// runs the SSE2 and the scalar mixes on the same segments (stereo and mono, with and without soften, and as dumps)
+// and compares the samples and what's left in the segment buffers, returns the number of segments that differ
+static int Sound_Mix_Check(void)
+{
+	static int savedL[882], savedR[882], inL[882], inR[882], outL[2][882], outR[2][882];
+	static short dest[2][882 * 2 + 8];
+	static const int lengths[] = {1, 3, 7, 8, 9, 13, 184, 220, 368, 441, 735, 882};
+	int savedLength = Seg_Length, savedSoften = Sound_Soften;
+	unsigned int seed = 1;
+	int mode, len, n, simd, mismatches = 0;
+
+	memcpy(savedL, Seg_L, sizeof(savedL));
+	memcpy(savedR, Seg_R, sizeof(savedR));
+
+	for(mode = 0; mode < 6; mode++)
+	{
+		int stereo = !(mode & 1), soften = (mode >> 1) == 1, dump = (mode >> 1) == 2;
+
+		Sound_Soften = soften;
+
+		for(len = 0; len < sizeof(lengths) / sizeof(*lengths); len++)
+		for(n = 0; n < 4; n++)
+		{
+			Seg_Length = lengths[len];
+			Mix_Check_Fill(&seed);
+			memcpy(inL, Seg_L, sizeof(inL));
+			memcpy(inR, Seg_R, sizeof(inR));
+
+			for(simd = 0; simd < 2; simd++)
+			{
+				memcpy(Seg_L, inL, sizeof(inL));
+				memcpy(Seg_R, inR, sizeof(inR));
+				memset(dest[simd], 0x55, sizeof(dest[simd]));
+
+				if (simd && stereo) Mix_Sound_Stereo_SSE2(dest[1], soften, !dump);
+				else if (simd) Mix_Sound_Mono_SSE2(dest[1], soften, !dump);
+				else if (dump && stereo) Dump_Sound_Stereo(dest[0], Seg_Length);
+				else if (dump) Dump_Sound_Mono(dest[0], Seg_Length);
+				else if (stereo) Write_Sound_Stereo(dest[0], Seg_Length);
+				else Write_Sound_Mono(dest[0], Seg_Length);
+
+				memcpy(outL[simd], Seg_L, sizeof(inL));
+				memcpy(outR[simd], Seg_R, sizeof(inR));
+			}
+
+			if (memcmp(dest[0], dest[1], sizeof(dest[0])) || memcmp(outL[0], outL[1], sizeof(outL[0])) || memcmp(outR[0], outR[1], sizeof(outR[0])))
+				mismatches++;
+		}
+	}
+
+	memcpy(Seg_L, savedL, sizeof(savedL));
+	memcpy(Seg_R, savedR, sizeof(savedR));
+	Seg_Length = savedLength;
+	Sound_Soften = savedSoften;
+
+	return mismatches;
+}
+
+
 int Write_Sound_Buffer(void *Dump_Buf)
 {
 	LPVOID lpvPtr1;
 	DWORD dwBytes1; 
 	HRESULT rval;
+	LARGE_INTEGER mixStart, mixEnd;
+
+	if (Sound_SSE2 < 0)
+	{
+		Sound_SSE2 = CPU_Has_SSE2();
+		if (Sound_SSE2 && Sound_Mix_Check())
+		{
+			Sound_SSE2 = 0;		// nothing should ever sound different from the scalar mix
+			Put_Info("SSE2 sound mixing doesn't match the scalar mixing, using the scalar one");
+		}
+	}
 
 	if (Dump_Buf)
 	{
-		if (Sound_Stereo) Dump_Sound_Stereo((short *) Dump_Buf, Seg_Length);
+		if (Sound_SSE2)
+		{
+			if (Sound_Stereo) Mix_Sound_Stereo_SSE2((short *) Dump_Buf, 0, 0);
+			else Mix_Sound_Mono_SSE2((short *) Dump_Buf, 0, 0);
+		}
+		else if (Sound_Stereo) Dump_Sound_Stereo((short *) Dump_Buf, Seg_Length);
 		else Dump_Sound_Mono((short *) Dump_Buf, Seg_Length);
 	}
 	else
@@ -423,17 +692,25 @@ int Write_Sound_Buffer(void *Dump_Buf)
 			FrameCountAtLastAudioOutput = FrameCount;
 		}
 
+		QueryPerformanceCounter(&mixStart);
+
 		if (Sound_Stereo)
 		{
-			if (Have_MMX && !Sound_Soften) Write_Sound_Stereo_MMX(Seg_L, Seg_R, (short *) lpvPtr1, Seg_Length); //Nitsuja changed this
+			if (Sound_SSE2) Mix_Sound_Stereo_SSE2((short *) lpvPtr1, Sound_Soften, 1);
+			else if (Have_MMX && !Sound_Soften) Write_Sound_Stereo_MMX(Seg_L, Seg_R, (short *) lpvPtr1, Seg_Length); //Nitsuja changed this
 			else Write_Sound_Stereo((short *) lpvPtr1, Seg_Length);
 		}
 		else
 		{
-			if (Have_MMX && !Sound_Soften) Write_Sound_Mono_MMX(Seg_L, Seg_R, (short *) lpvPtr1, Seg_Length); //Nitsuja changed this
+			if (Sound_SSE2) Mix_Sound_Mono_SSE2((short *) lpvPtr1, Sound_Soften, 1);
+			else if (Have_MMX && !Sound_Soften) Write_Sound_Mono_MMX(Seg_L, Seg_R, (short *) lpvPtr1, Seg_Length); //Nitsuja changed this
 			else Write_Sound_Mono((short *) lpvPtr1, Seg_Length);
 		}
 
+		QueryPerformanceCounter(&mixEnd);
+		Sound_Mix_Ticks += mixEnd.QuadPart - mixStart.QuadPart;
+		Sound_Mix_Segments++;
+
 		lpDSBuffer->Unlock(lpvPtr1, dwBytes1, NULL, NULL);
 	}
 
@@ -821,7 +1098,8 @@ int GYM_Next(void)
 		switch(c)
 		{
 			case 0:
-				PSG_Update(buf, Seg_Length);
+				if (PSG_Blep) PSG_Update_BLEP(buf, Seg_Length);
+				else PSG_Update(buf, Seg_Length);
 				if (YM2612_Enable) YM2612_Update(buf, Seg_Length);
 				break;
 
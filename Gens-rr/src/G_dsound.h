@@ -32,6 +32,8 @@ extern char Dump_Dir[1024];
 extern char Dump_GYM_Dir[1024];
 
 extern unsigned short MastVol;
+extern LONGLONG Sound_Mix_Ticks;
+extern int Sound_Mix_Segments;
 
 int Init_Sound(HWND hWnd);
 void End_Sound(void);
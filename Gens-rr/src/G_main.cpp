@@ -62,9 +62,14 @@ extern "C" void Read_To_68K_Space(int adr);
 #define uint32 unsigned int
 
 #include "tracer.h"
+#include "coverage.h"
+#include "rewind.h"
+#include "headless.h"
+#include "benchmark.h"
 bool trace_map=0;
 bool hook_trace=0;
 bool trace_indent=false;
+bool trace_binary=false;
 unsigned char trace_limit=0;
 
 #define WM_KNUX WM_USER + 3
@@ -447,6 +452,44 @@ int Set_Sprite_Over(HWND hWnd, int Num)
 }
 
 
+int Change_VDP_Tile_Cache(HWND hWnd)
+{
+	if (VDP_Tile_Cache)
+	{
+		VDP_Tile_Cache = 0;
+		MESSAGE_L("Assembly VDP renderer", "Assembly VDP renderer")
+	}
+	else
+	{
+		VDP_Tile_Cache = 1;
+		VDP_Tile_Cache_Invalidate();
+		MESSAGE_L("Tile cache VDP renderer", "Tile cache VDP renderer")
+	}
+
+	Build_Main_Menu();
+	return 1;
+}
+
+
+int Change_Present_Threaded(HWND hWnd)
+{
+	if (Present_Threaded)
+	{
+		Present_Wait();
+		Present_Threaded = 0;
+		MESSAGE_L("Threaded presentation disabled", "Threaded presentation disabled")
+	}
+	else
+	{
+		Present_Threaded = 1;
+		MESSAGE_L("Threaded presentation enabled", "Threaded presentation enabled")
+	}
+
+	Build_Main_Menu();
+	return 1;
+}
+
+
 int Change_Debug(HWND hWnd, int Debug_Mode)
 {
 	if (!Game) return 0;
@@ -558,6 +601,44 @@ int Change_Trace_Indent()
 	return 1;
 }
 
+int Change_Trace_Binary()
+{
+	// a running trace is restarted in the new format
+	bool restart = trace_map;
+	if (restart)
+		Change_Trace();
+	trace_binary = !trace_binary;
+	if (restart)
+		Change_Trace();
+
+	Build_Main_Menu();
+
+	char message [256];
+	sprintf(message, "Binary Trace %sabled", trace_binary?"en":"dis");
+	MESSAGE_L(message, message)
+
+	return 1;
+}
+
+int Change_Coverage()
+{
+	if (!Coverage_Enabled)
+	{
+		const char * err = Coverage_Start(SegaCD_Started != 0);
+		if (err)
+			MessageBox(HWnd, err, "Error", MB_OK);
+	}
+	else
+		Coverage_Stop();
+	Build_Main_Menu();
+
+	char message [256];
+	sprintf(message, "Code coverage logging %sed", Coverage_Enabled?"start":"end");
+	MESSAGE_L(message, message)
+
+	return 1;
+}
+
 int Change_Fast_Blur(HWND hWnd)
 {
 	Flag_Clr_Scr = 1;
@@ -1092,6 +1173,24 @@ int Change_PSG_Improv(HWND hWnd)
 }
 
 
+int Change_PSG_Blep(HWND hWnd)
+{
+	if (PSG_Blep)
+	{
+		PSG_Blep = 0;
+		MESSAGE_L("Normal PSG sound", "Normal PSG sound")
+	}
+	else
+	{
+		PSG_Blep = 1;
+		MESSAGE_L("Band-limited PSG sound", "Band-limited PSG sound")
+	}
+
+	Build_Main_Menu();
+	return 1;
+}
+
+
 int Change_PCM(HWND hWnd)
 {
 	if (PCM_Enable)
@@ -2234,6 +2333,24 @@ int PASCAL WinMain(HINSTANCE hInst,	HINSTANCE hPrevInst, LPSTR lpCmdLine, int nC
 					skipLagNow = true;
 					Paused = 0; // so the pause button can re-pause while skipping lag frames
 				}
+				else if(RewindKeyDown && Rewind_Enable && ((GetActiveWindow() == HWnd) || BackgroundInput))
+				{
+					// step back one capture per displayed frame while the rewind key is held
+					static DWORD lastRewindTime = 0;
+					DWORD rewindTime = timeGetTime();
+					if(rewindTime - lastRewindTime >= (DWORD)(CPU_Mode ? 20 : 16))
+					{
+						lastRewindTime = rewindTime;
+						if(!soundCleared)
+						{
+							Clear_Sound_Buffer();
+							soundCleared = true;
+						}
+						Rewind_Step();
+					}
+					else
+						Sleep(1);
+				}
 				else if(((GetActiveWindow() == HWnd) || BackgroundInput) && Check_Skip_Key())
 				{
 					// handle frame advance key
@@ -2389,9 +2506,12 @@ int PASCAL WinMain(HINSTANCE hInst,	HINSTANCE hPrevInst, LPSTR lpCmdLine, int nC
 
 	End_Sound(); //Modif N - making sure sound doesn't stutter upon exit
 
-	strcpy(Str_Tmp, Gens_Path);
-	strcat(Str_Tmp, "Gens.cfg");
-	Save_Config(Str_Tmp);
+	if (Headless_Exit_Code < 0) // a verification run shouldn't touch the user's settings
+	{
+		strcpy(Str_Tmp, Gens_Path);
+		strcat(Str_Tmp, "Gens.cfg");
+		Save_Config(Str_Tmp);
+	}
 
 	End_All(); //Modif N
 
@@ -2406,6 +2526,8 @@ int PASCAL WinMain(HINSTANCE hInst,	HINSTANCE hPrevInst, LPSTR lpCmdLine, int nC
 
 	//TerminateProcess(GetCurrentProcess(), 0);
 
+	if (Headless_Exit_Code >= 0)
+		return Headless_Exit_Code;
 	return 0;
 }
 
@@ -2886,6 +3008,9 @@ long PASCAL WinProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 					}
 				}
 
+				if(Benchmark_Command(command))
+					return 0;
+
 			switch(command)
 			{
 				case ID_GRAPHICS_NEVER_SKIP_FRAME:
@@ -2972,6 +3097,21 @@ long PASCAL WinProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 				case ID_TOGGLE_TURBO:
 					TurboToggle = !TurboToggle;
 					return 0;
+				case ID_TOGGLE_REWIND:
+					Rewind_Enable = !Rewind_Enable;
+					Rewind_Reset();
+					if(Rewind_Enable)
+						MESSAGE_L("Rewind capture enabled", "Rewind capture enabled")
+					else
+						MESSAGE_L("Rewind capture disabled", "Rewind capture disabled")
+					return 0;
+				case ID_TOGGLE_MOVIE_STATE_DIFFS:
+					MovieStateDiffs = !MovieStateDiffs;
+					if(MovieStateDiffs)
+						MESSAGE_L("Savestates store movie input as a diff", "Savestates store movie input as a diff")
+					else
+						MESSAGE_L("Savestates store the full movie input", "Savestates store the full movie input")
+					return 0;
 				case ID_SLOW_SPEED_PLUS: //Modif N - for new "speed up" key:
 					if(SlowDownSpeed==1 || SlowDownMode==0)
 						SlowDownMode=0;
@@ -3768,6 +3908,14 @@ dialogAgain: //Nitsuja added this
 					Set_Sprite_Over(hWnd, Sprite_Over ^ 1);
 					return 0;
 
+				case ID_GRAPHICS_TILECACHE:
+					Change_VDP_Tile_Cache(hWnd);
+					return 0;
+
+				case ID_GRAPHICS_THREADEDPRESENT:
+					Change_Present_Threaded(hWnd);
+					return 0;
+
 				case ID_GRAPHICS_SHOT:
 					Clear_Sound_Buffer();
 					Take_Shot();
@@ -4132,6 +4280,10 @@ dialogAgain: //Nitsuja added this
 //					Change_PSG_Improv(hWnd);
 					return 0;
 
+				case ID_SOUND_PSGBLEP:
+					Change_PSG_Blep(hWnd);
+					return 0;
+
 				case ID_SOUND_YMIMPROV:
 					Change_YM2612_Improv(hWnd);
 					return 0;
@@ -4481,6 +4633,14 @@ dialogAgain: //Nitsuja added this
 					Change_Trace_Indent();
 					return 0;
 
+				case ID_CHANGE_TRACE_BINARY:
+					Change_Trace_Binary();
+					return 0;
+
+				case ID_CHANGE_COVERAGE:
+					Change_Coverage();
+					return 0;
+
 				case ID_EMULATION_PAUSED:
 					if (Debug)
 					{
@@ -5071,6 +5231,10 @@ HMENU Build_Main_Menu(void)
 		ID_CHANGE_PALLOCK, "Lock Palette", "", "Lock &Palette");
 	MENU_L(Graphics, i++, Flags | (Sprite_Over ? MF_CHECKED : MF_UNCHECKED),
 		ID_GRAPHICS_SPRITEOVER, "Sprite Limit", "", "&Sprite Limit");
+	MENU_L(Graphics, i++, Flags | (VDP_Tile_Cache ? MF_CHECKED : MF_UNCHECKED),
+		ID_GRAPHICS_TILECACHE, "Tile Cache Renderer", "", "&Tile Cache Renderer");
+	MENU_L(Graphics, i++, Flags | (Present_Threaded ? MF_CHECKED : MF_UNCHECKED),
+		ID_GRAPHICS_THREADEDPRESENT, "Threaded Presentation", "", "T&hreaded Presentation");
 	MENU_L(Graphics, i++, Flags | (PinkBG ? MF_CHECKED : MF_UNCHECKED),
 		ID_GRAPHICS_PINKBG, "Pink Background", "", "&Pink Background");
 
@@ -5467,6 +5631,8 @@ HMENU Build_Main_Menu(void)
 		ID_SOUND_YMIMPROV, "YM2612 High Quality", "", "YM2612 High &Quality");
 /*	MENU_L(Sound, i++, Flags | (PSG_Improv ? MF_CHECKED : MF_UNCHECKED),
 		ID_SOUND_PSGIMPROV, "PSG High Quality", "", "PSG High &Quality"); */
+	MENU_L(Sound, i++, Flags | (PSG_Blep ? MF_CHECKED : MF_UNCHECKED),
+		ID_SOUND_PSGBLEP, "PSG Band-Limited", "", "PSG &Band-Limited");
 	MENU_L(Sound, i++, Flags | (DAC_Improv ? MF_CHECKED : MF_UNCHECKED),
 		ID_SOUND_DACIMPROV, "DAC High Quality", "", "DAC High &Quality");
 
@@ -5628,6 +5794,10 @@ HMENU Build_Main_Menu(void)
 		ID_CHANGE_TRACE_LIMIT, "Trace Limit", "", "Trace Spam Filter");
 	MENU_L(Tools_Trace, i++, Flags | (trace_indent ? MF_CHECKED : MF_UNCHECKED),
 		ID_CHANGE_TRACE_INDENT, "Trace Indentation", "", "Trace Indentation");
+	MENU_L(Tools_Trace, i++, Flags | (trace_binary ? MF_CHECKED : MF_UNCHECKED),
+		ID_CHANGE_TRACE_BINARY, "Binary Trace", "", "&Binary Trace");
+	MENU_L(Tools_Trace, i++, Flags | (Coverage_Enabled ? MF_CHECKED : MF_UNCHECKED),
+		ID_CHANGE_COVERAGE, "Code Coverage", "", "Code &Coverage");
 
 
 	// LUA SCRIPT //
@@ -7166,12 +7336,14 @@ void DoMovieSplice() //Splices saved input back into the movie file
 	fseek(TempSplice,0,SEEK_END);
 	unsigned long size = ftell(TempSplice);
 	//MainMovie.LastFrame++; // removed ++ because it was causing the input to be spliced 1 frame late at the end
+	FlushMovieInput(&MainMovie);
 	fseek(MainMovie.File,(MainMovie.LastFrame * 3) + 64,SEEK_SET);
 	char *TempBuffer = (char *) malloc(size);
 	fseek(TempSplice,0,SEEK_SET);
 	fread(TempBuffer,1,size,TempSplice);
 	fwrite(TempBuffer,1,size,MainMovie.File);
 	free(TempBuffer);
+	InvalidateMovieInput();
 	if (MainMovie.Status == MOVIE_RECORDING) Put_Info("Movie successfully spliced. Resuming playback from now.");
 	else Put_Info("Movie successfully spliced.");
 	MainMovie.Status = MOVIE_PLAYING;
@@ -7241,6 +7413,7 @@ LRESULT CALLBACK PromptSpliceFrameProc(HWND hDlg, UINT uMsg, WPARAM wParam, LPAR
 						break;
 					}
 					SpliceFrame = GetDlgItemInt(hDlg,IDC_PROMPT_EDIT,NULL,false);
+					FlushMovieInput(&MainMovie);
 					fseek(MainMovie.File,0,SEEK_END);
                     unsigned long size = ftell(MainMovie.File);
 					fseek(MainMovie.File,(((SpliceFrame - 1) * 3) + 64),SEEK_SET);
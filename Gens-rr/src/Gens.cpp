@@ -38,6 +38,7 @@
 // uncomment this to run a simple test every frame for potential desyncs
 // you do not need to start any movie for the test to work, just play
 // expect it to be pretty slow, though
+// (to check a whole movie at close to normal speed, use -synclog instead, see synclog.h)
 //#define TEST_GENESIS_FOR_DESYNCS
 
 // uncomment this to test the sega-cd specific parts of the savestates for desyncs
@@ -1027,6 +1028,9 @@ extern "C"
 inline static int* LeftAudioBuffer() {	return disableSound2 ? Seg_Junk : Seg_L;	}
 inline static int* RightAudioBuffer() {	return disableSound2 ? Seg_Junk : Seg_R;	}
 
+// nothing will play or dump the samples of the frame about to be emulated
+inline static int Sound_Unheard() {	return disableSound2 || (!Sound_Enable && !WAV_Dumping && !(AVISound && AVIRecording));	}
+
 // to make two different compiled functions
 template<int bits>
 void Render_MD_Screen_()
@@ -1205,6 +1209,15 @@ void Render_MD_Screen32X()
 		Render_MD_Screen32X_2<16>();
 }
 
+// Genesis/Sega CD line, the 32X renderer has its own asm path
+static inline void Render_VDP_Line()
+{
+	if (VDP_Tile_Cache)
+		Render_Line_Cached();
+	else
+		Render_Line();
+}
+
 #ifdef SONICCAMHACK
 
 #else 
@@ -1225,6 +1238,7 @@ int Do_Genesis_Frame(bool fast)
 		YM_Buf[1] = PSG_Buf[1] = RightAudioBuffer();
 	}
 	YM_Len = PSG_Len = 0;
+	YM2612_Unheard = YM2612_Lazy && Sound_Unheard();
 
 	Cycles_M68K = Cycles_Z80 = 0;
 	Last_BUS_REQ_Cnt = -1000;
@@ -1273,7 +1287,9 @@ int Do_Genesis_Frame(bool fast)
 		}
 
 		if (!fast)
-			Render_Line();
+			Render_VDP_Line();
+		else
+			Render_Line_Status();
 
 		main68k_exec(Cycles_M68K);
 		if (Z80_State == 3) z80_Exec(&M_Z80, Cycles_Z80);
@@ -1402,7 +1418,7 @@ int Do_VDP_Refresh()
 		{
 			if(FakeVDPScreen)
 				for(VDP_Current_Line = 0; VDP_Current_Line < VDP_Num_Vis_Lines; VDP_Current_Line++)
-					Render_Line();
+					Render_VDP_Line();
 			Render_MD_Screen();
 		}
 		else // emulation hasn't started so just set all pixels to black
@@ -1742,6 +1758,7 @@ int Do_32X_Frame(bool fast)
 		YM_Buf[1] = PSG_Buf[1] = RightAudioBuffer();
 	}
 	YM_Len = PSG_Len = 0;
+	YM2612_Unheard = YM2612_Lazy && Sound_Unheard();
 
 	CPL_PWM = CPL_M68K * 3;
 
@@ -2325,6 +2342,7 @@ int Do_SegaCD_Frame(bool fast)
 		YM_Buf[1] = PSG_Buf[1] = RightAudioBuffer();
 	}
 	YM_Len = PSG_Len = 0;
+	YM2612_Unheard = YM2612_Lazy && Sound_Unheard();
 
 	Cycles_S68K = Cycles_M68K = Cycles_Z80 = 0;
 	Last_BUS_REQ_Cnt = -1000;
@@ -2376,7 +2394,9 @@ int Do_SegaCD_Frame(bool fast)
 		}
 
 		if (!fast)
-			Render_Line();
+			Render_VDP_Line();
+		else
+			Render_Line_Status();
 
 		main68k_exec(Cycles_M68K);
 		sub68k_exec(Cycles_S68K);
@@ -2513,6 +2533,7 @@ int Do_SegaCD_Frame_Cycle_Accurate(bool fast)
 		YM_Buf[1] = PSG_Buf[1] = RightAudioBuffer();
 	}
 	YM_Len = PSG_Len = 0;
+	YM2612_Unheard = YM2612_Lazy && Sound_Unheard();
 
 	Cycles_S68K = Cycles_M68K = Cycles_Z80 = 0;
 	Last_BUS_REQ_Cnt = -1000;
@@ -2586,7 +2607,9 @@ int Do_SegaCD_Frame_Cycle_Accurate(bool fast)
 		}
 
 		if (!fast)
-			Render_Line();
+			Render_VDP_Line();
+		else
+			Render_Line_Status();
 
 		/* instruction by instruction execution */
 		
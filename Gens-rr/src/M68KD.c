@@ -4,13 +4,14 @@
 #include "mem_S68K.h"
 
 
-static char Dbg_Str[64];
-static char Dbg_EA_Str[16];
-static char Dbg_Size_Str[3];
-static char Dbg_Cond_Str[3];
+// per thread, so -decodetrace can disassemble on several at once
+static __declspec(thread) char Dbg_Str[64];
+static __declspec(thread) char Dbg_EA_Str[16];
+static __declspec(thread) char Dbg_Size_Str[3];
+static __declspec(thread) char Dbg_Cond_Str[3];
 
-static unsigned short (*Next_Word)();
-static unsigned int (*Next_Long)();
+static __declspec(thread) unsigned short (*Next_Word)();
+static __declspec(thread) unsigned int (*Next_Long)();
 
 
 char *Make_Dbg_EA_Str(int Size, int EA_Num, int Reg_Num)
@@ -232,7 +233,7 @@ char *Make_Dbg_Cond_Str(int Cond)
 
 // max length is 35 plus terminating zero:
 // d0-d1/d3-d4/d6-d7/a0-a1/a3-a4/a6-a7
-static char Dbg_Reg_List[64];
+static __declspec(thread) char Dbg_Reg_List[64];
 
 static char* Make_Reg_Range(char *s, char type, int reg1, int reg2)
 {
@@ -864,6 +864,17 @@ section .text align=64
 		popad
 		ret
 
+	ALIGN4
+
+	; int CPU_Has_SSE2(void)
+	DECL CPU_Has_SSE2
+
+		call Identify_CPU		; fills CPU_Model with the feature flags
+		mov eax, [CPU_Model]
+		shr eax, 26				; SSE2 flag
+		and eax, 1
+		ret
+
 	ALIGN32
 
 	; int Half_Blur(void)
@@ -17,6 +17,7 @@ extern int Have_MMX;
 extern int MMX_Enable;
 
 void Identify_CPU(void);
+int CPU_Has_SSE2(void);
 int Half_Blur(void);
 void Byte_Swap(void *Ptr, int NumByte);
 void Word_Swap(void *Ptr, int NumByte);
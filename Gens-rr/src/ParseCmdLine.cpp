@@ -10,10 +10,15 @@
 #include "movie.h"
 #include "save.h"
 #include "G_ddraw.h"
+#include "headless.h"
+#include "synclog.h"
+#include "soundrender.h"
+#include "trace_bin.h"
 
 using namespace std;
 
 extern int Paused;
+extern int Gens_Running;
 
 //To add additional commandline options
 //1) add the identifier (-rom, -play, etc) into the argCmds array
@@ -28,7 +33,7 @@ void ParseCmdLine(LPSTR lpCmdLine, HWND HWnd)
 	int argLength = argumentList.size();	//Size of command line argument
 
 	//List of valid commandline args
-	string argCmds[] = {"-cfg", "-rom", "-play", "-readwrite", "-loadstate", "-pause", "-lua", ""};	//Hint:  to add new commandlines, start by inserting them here.
+	string argCmds[] = {"-cfg", "-rom", "-play", "-readwrite", "-loadstate", "-pause", "-lua", "-verify", "-movielist", "-jobs", "-synclog", "-render", "-musiclist", "-output", "-results", "-decodetrace", ""};	//Hint:  to add new commandlines, start by inserting them here.
 
 	//Strings that will get parsed:
 	string CfgToLoad = "";		//Cfg filename
@@ -39,6 +44,16 @@ void ParseCmdLine(LPSTR lpCmdLine, HWND HWnd)
 	string FileToLoad = "";		//Any file
 	string PauseGame = "";		//adelikat: If user puts anything after -pause it will flag true, documentation will probably say put "1".  There is no case for "-paused 0" since, to my knowledge, it would serve no purpose
 	string ReadWrite = "";		//adelikat: Read Only is the default so this will be the same situation as above, any value will set to read+write status
+	string VerifyResults = "";	//Results file for -verify, which plays the -play movie headless and exits
+	bool Verify = false;
+	string MovieList = "";		//List of movies to -verify, each one in a separate process
+	string Jobs = "";			//How many of those processes can run at once
+	string SyncLogName = "";	//Per-frame state hash log to record, or to check against if it already exists
+	string RenderMusic = "";	//GYM/VGM file to render to -output without a sound device, then exit
+	string MusicList = "";		//List of GYM/VGM files to -render, each one in a separate process
+	string OutputName = "";		//WAV file for -render, directory for -musiclist
+	string ResultsName = "";	//Where -render, -musiclist and -decodetrace append their result lines
+	string DecodeTrace = "";	//Binary instruction trace to turn into a text log at -output, then exit
 
 	//Temps for finding string list
 	int commandBegin = 0;	//Beginning of Command
@@ -91,7 +106,35 @@ void ParseCmdLine(LPSTR lpCmdLine, HWND HWnd)
 		case 6:	//-lua
 			ScriptsToLoad.push_back(newCommand);
 			break;
-		case 7: //  (a filename on its own, this must come BEFORE any other options on the commandline)
+		case 7:	//-verify
+			Verify = argumentList.find(argCmds[x]) != string::npos;
+			VerifyResults = newCommand;
+			break;
+		case 8:	//-movielist
+			MovieList = newCommand;
+			break;
+		case 9:	//-jobs
+			Jobs = newCommand;
+			break;
+		case 10:	//-synclog
+			SyncLogName = newCommand;
+			break;
+		case 11:	//-render
+			RenderMusic = newCommand;
+			break;
+		case 12:	//-musiclist
+			MusicList = newCommand;
+			break;
+		case 13:	//-output
+			OutputName = newCommand;
+			break;
+		case 14:	//-results
+			ResultsName = newCommand;
+			break;
+		case 15:	//-decodetrace
+			DecodeTrace = newCommand;
+			break;
+		case 16: //  (a filename on its own, this must come BEFORE any other options on the commandline)
 			if(newCommand[0] != '-')
 				FileToLoad = newCommand;
 			break;
@@ -115,12 +158,54 @@ void ParseCmdLine(LPSTR lpCmdLine, HWND HWnd)
 		Put_Info(Str_Tmp);
 	}
 
+	//Binary trace decoding (no ROM needed, never returns to normal emulation)
+	if (DecodeTrace[0])
+	{
+		Headless_Exit_Code = Trace_Bin_Decode(DecodeTrace.c_str(), OutputName.c_str(), ResultsName.c_str(), atoi(Jobs.c_str()));
+		Gens_Running = 0;
+		return;
+	}
+
+	//Offline music rendering (no ROM needed, never returns to normal emulation)
+	if (MusicList[0])
+	{
+		Headless_Exit_Code = Sound_Render_List(CfgToLoad.c_str(), MusicList.c_str(), OutputName.c_str(), ResultsName.c_str(), atoi(Jobs.c_str()));
+		Gens_Running = 0;
+		return;
+	}
+	if (RenderMusic[0])
+	{
+		Headless_Exit_Code = Sound_Render_File(RenderMusic.c_str(), OutputName.c_str(), ResultsName.c_str());
+		Gens_Running = 0;
+		return;
+	}
+
+	//Movie list verification (the ROM is only loaded by the processes this starts)
+	if (Verify && MovieList[0])
+	{
+		Headless_Exit_Code = Headless_Verify_List(CfgToLoad.c_str(), RomToLoad.c_str(), MovieList.c_str(), VerifyResults.c_str(), atoi(Jobs.c_str()), SyncLogName[0] != 0);
+		Gens_Running = 0;
+		return;
+	}
+
 	//ROM
 	if (RomToLoad[0]) 
 	{
 		GensLoadRom(RomToLoad.c_str());
 	}
 	
+	//Sync log
+	if (SyncLogName[0] && !SyncLog_Begin(SyncLogName.c_str()))
+		fprintf(stderr, "failed to open sync log \"%s\"\n", SyncLogName.c_str());
+
+	//Headless verification (never returns to normal emulation)
+	if (Verify)
+	{
+		Headless_Exit_Code = Headless_Verify(MovieToLoad.c_str(), VerifyResults.c_str());
+		Gens_Running = 0;
+		return;
+	}
+
 	//Movie
 	if (MovieToLoad[0]) GensPlayMovie(MovieToLoad.c_str(), 1);
 
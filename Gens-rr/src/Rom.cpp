@@ -21,6 +21,8 @@
 #include "wave.h"
 #include "cd_file.h"
 #include "luascript.h"
+#include "headless.h"
+#include "rewind.h"
 #include "OpenArchive.h"
 #include <assert.h>
 
@@ -746,12 +748,16 @@ void Free_Rom(Rom *Rom_MD)
 	CC_Close();
 #endif
 
-	if (SegaCD_Started) Save_BRAM();
-	Save_SRAM();
-	Save_Patch_File();
+	if (Headless_Exit_Code < 0) // a verification run shouldn't touch the user's saves either
+	{
+		if (SegaCD_Started) Save_BRAM();
+		Save_SRAM();
+		Save_Patch_File();
+	}
 	if (WAV_Dumping) Stop_WAV_Dump();
 	if (GYM_Dumping) Stop_GYM_Dump();
 	if (SegaCD_Started) Stop_CD();
+	Rewind_Reset(); // the captures belong to this game
 	Net_Play = 0;
 	Genesis_Started = 0;
 	_32X_Started = 0;
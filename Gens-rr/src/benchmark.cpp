@@ -0,0 +1,76 @@
+#include <windows.h>
+#include <stdio.h>
+#include "benchmark.h"
+#include "G_ddraw.h"
+#include "G_dsound.h"
+#include "resource.h"
+#include "rewind.h"
+#include "movie.h"
+#include "ram_search.h"
+#include "gens.h"
+#include "ym2612.h"
+#include "psg.h"
+#include "pcm.h"
+#include "cd_sys.h"
+#include "vdp_rend.h"
+#include "luascript.h"
+
+double Benchmark_Time(void)
+{
+	static LARGE_INTEGER freq = {0};
+	LARGE_INTEGER count;
+	if(!freq.QuadPart)
+		QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+	return count.QuadPart * 1000.0 / freq.QuadPart;
+}
+
+FILE *Benchmark_Log(const char *name)
+{
+	char path[MAX_PATH];
+	sprintf(path, "./Logs/%s_bench.log", name);
+	return fopen(path, "a");
+}
+
+// the sound chips are timed at the clock and rate the game is running with
+static int YM2612_Bench(char *summary)
+{
+	return YM2612_Benchmark((CPU_Mode ? CLOCK_PAL : CLOCK_NTSC) / 7, Sound_Rate, YM2612_Improv, summary);
+}
+
+static int PSG_Bench(char *summary)
+{
+	return PSG_Benchmark((CPU_Mode ? CLOCK_PAL : CLOCK_NTSC) / 15, Sound_Rate, summary);
+}
+
+static const struct
+{
+	int command;
+	int (*run)(char *summary);
+} Benchmarks [] = {
+	{ID_REWIND_BENCHMARK, Rewind_Benchmark},
+	{ID_MOVIE_INPUT_BENCHMARK, MovieInput_Benchmark},
+	{ID_RAM_SEARCH_BENCHMARK, RamSearch_Benchmark},
+	{ID_YM2612_BENCHMARK, YM2612_Bench},
+	{ID_PSG_BENCHMARK, PSG_Bench},
+	{ID_PCM_BENCHMARK, PCM_Benchmark},
+	{ID_CDDA_BENCHMARK, CD_Audio_Benchmark},
+	{ID_VDP_BENCHMARK, VDP_Render_Benchmark},
+	{ID_LUA_MEMHOOK_BENCHMARK, Lua_MemHook_Benchmark},
+};
+
+bool Benchmark_Command(int command)
+{
+	for(int i = 0; i < sizeof(Benchmarks)/sizeof(*Benchmarks); i++)
+	{
+		if(Benchmarks[i].command != command)
+			continue;
+		char summary[256] = "";
+		Clear_Sound_Buffer(); // the benchmarks take a while, the sound buffer would loop meanwhile
+		Benchmarks[i].run(summary);
+		if(summary[0])
+			Put_Info(summary);
+		return true;
+	}
+	return false;
+}
@@ -0,0 +1,22 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <stdio.h>
+
+// the measurements behind the Benchmark hotkeys. each benchmark takes a string for a one-line summary,
+// appends the details to Logs\<name>_bench.log, and leaves the emulation the way it found it
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+double Benchmark_Time(void); // milliseconds from the performance counter, only meaningful as a difference
+FILE *Benchmark_Log(const char *name); // Logs\<name>_bench.log opened for appending, NULL if it can't be
+
+#ifdef __cplusplus
+}
+
+bool Benchmark_Command(int command); // runs the benchmark bound to this command and shows its summary, returns false if there is none
+#endif
+
+#endif
@@ -29,7 +29,7 @@
 
 section .data align=64
 
-	extern MD_Screen
+	extern _MD_Screen_Blit
 	extern TAB336
 	extern Have_MMX
 	extern Mode_555
@@ -118,7 +118,8 @@ section .text align=64
 		mov ecx, [esp + 32]				; ecx = Number of pixels per row
 		mov ebx, [esp + 28]				; ebx = pitch of the Dest surface
 		add ecx, ecx					; ecx = Number of bytes per row
-		lea esi, [MD_Screen + 8 * 2]	; esi = Source
+		mov esi, [_MD_Screen_Blit]
+		add esi, 8 * 2					; esi = Source
 		sub ebx, ecx					; ebx = Adjust offset for the following row
 		shr ecx, 3						; we transfer 8 bytes in each loop
 		mov edi, [esp + 24]				; edi = Destination
@@ -167,7 +168,8 @@ section .text align=64
 		mov ecx, [esp + 32]				; ecx = Number of pixels per row
 		mov ebx, [esp + 28]				; ebx = pitch of the Dest surface
 		add ecx, ecx					; ecx = Number of bytes per row
-		lea esi, [MD_Screen + 8 * 2]	; esi = Source
+		mov esi, [_MD_Screen_Blit]
+		add esi, 8 * 2					; esi = Source
 		sub ebx, ecx					; ebx = Adjust offset for the following row
 		shr ecx, 6						; we transfer 64 bytes in each loop
 		mov edi, [esp + 24]				; edi = Destination
@@ -229,7 +231,8 @@ section .text align=64
 		mov ecx, [esp + 32]				; ecx = Number of pixels per row
 		mov ebx, [esp + 28]				; ebx = pitch of the Dest surface
 		lea ecx, [ecx * 4]				; ecx = Number of bytes per row Dest
-		lea esi, [MD_Screen + 8 * 2]	; esi = Source
+		mov esi, [_MD_Screen_Blit]
+		add esi, 8 * 2					; esi = Source
 		sub ebx, ecx					; ebx = Adjust offset for the following row
 		shr ecx, 4						; we transfer 16 bytes in each loop
 		mov edi, [esp + 24]				; edi = Destination
@@ -313,7 +316,8 @@ section .text align=64
 		mov ecx, [esp + 32]				; ecx = Number of pixels per row
 		mov ebx, [esp + 28]				; ebx = pitch of the Dest surface
 		lea ecx, [ecx * 4]				; ecx = Number of bytes per row Dest
-		lea esi, [MD_Screen + 8 * 2]	; esi = Source
+		mov esi, [_MD_Screen_Blit]
+		add esi, 8 * 2					; esi = Source
 		sub ebx, ecx					; ebx = Adjust offset for the following row
 		shr ecx, 6						; we transfer 64 bytes in each loop
 		mov edi, [esp + 24]				; edi = Destination
@@ -425,7 +429,8 @@ section .text align=64
 		mov eax, Line1Int				; eax = offset Line 1 Int buffer
 		lea ecx, [ecx * 4]				; ecx = Number of bytes per row Dest
 		mov [Line1IntP], eax			; store first buffer addr
-		lea esi, [MD_Screen + 8 * 2]	; esi = Source
+		mov esi, [_MD_Screen_Blit]
+		add esi, 8 * 2					; esi = Source
 		mov eax, Line2Int				; eax = offset Line 2 Int buffer
 		sub ebx, ecx					; ebx = Adjust offset for the following row
 		shr ecx, 2						; we transfer 4 bytes in each loop
@@ -605,7 +610,8 @@ section .text align=64
 		mov eax, Line1Int				; eax = offset Line 1 Int buffer
 		lea ecx, [ecx * 4]				; ecx = Number of bytes per row Dest
 		mov [Line1IntP], eax			; store first buffer addr
-		lea esi, [MD_Screen + 8 * 2]	; esi = Source
+		mov esi, [_MD_Screen_Blit]
+		add esi, 8 * 2					; esi = Source
 		mov eax, Line2Int				; eax = offset Line 2 Int buffer
 		sub ebx, ecx					; ebx = Adjust offset for the following row
 		shr ecx, 4						; we transfer 16 bytes in each loop
@@ -799,7 +805,8 @@ section .text align=64
 		mov ebx, [esp + 28]				; ebx = pitch of the Dest surface
 		lea ecx, [ecx * 4]				; ecx = Number of bytes per row Dest
 		add ebx, ebx					; ebx = pitch * 2
-		lea esi, [MD_Screen + 8 * 2]	; esi = Source
+		mov esi, [_MD_Screen_Blit]
+		add esi, 8 * 2					; esi = Source
 		sub ebx, ecx					; ebx = Adjust offset for the following row
 		shr ecx, 4						; we transfer 16 bytes in each loop
 		mov edi, [esp + 24]				; edi = Destination
@@ -859,7 +866,8 @@ section .text align=64
 		mov ebx, [esp + 28]				; ebx = pitch of the Dest surface
 		lea ecx, [ecx * 4]				; ecx = Number of bytes per row Dest
 		add ebx, ebx					; ebx = pitch * 2
-		lea esi, [MD_Screen + 8 * 2]	; esi = Source
+		mov esi, [_MD_Screen_Blit]
+		add esi, 8 * 2					; esi = Source
 		sub ebx, ecx					; ebx = Adjust offset for the following row
 		shr ecx, 5						; we transfer 32 Dest bytes to in each loop
 		mov edi, [esp + 24]				; edi = Destination
@@ -917,7 +925,8 @@ section .text align=64
 		mov ecx, [esp + 32]				; ecx = Number of pixels per row
 		mov ebx, [esp + 28]				; ebx = pitch of the Dest surface
 		lea ecx, [ecx * 4]				; ecx = Number of bytes per row Dest
-		lea esi, [MD_Screen + 8 * 2]	; esi = Source
+		mov esi, [_MD_Screen_Blit]
+		add esi, 8 * 2					; esi = Source
 		sub ebx, ecx					; ebx = Adjust offset for the following row
 		shr ecx, 5						; we transfer 32 Dest bytes to in each loop
 		mov edi, [esp + 24]				; edi = Destination
@@ -1012,7 +1021,8 @@ section .text align=64
 		mov ecx, [esp + 32]				; ecx = Number of pixels per row
 		mov ebx, [esp + 28]				; ebx = pitch of the Dest surface
 		lea ecx, [ecx * 4]				; ecx = Number of bytes per row Dest
-		lea esi, [MD_Screen + 8 * 2]	; esi = Source
+		mov esi, [_MD_Screen_Blit]
+		add esi, 8 * 2					; esi = Source
 		sub ebx, ecx					; ebx = Adjust offset for the following row
 		shr ecx, 5						; we transfer 32 Dest bytes to in each loop
 		mov edi, [esp + 24]				; edi = Destination
@@ -1117,7 +1127,8 @@ section .text align=64
 		mov ebx, [esp + 28]				; ebx = pitch of the Dest surface
 		lea ecx, [ecx * 4]				; ecx = Number of bytes per row Dest
 		add ebx, ebx					; ebx = pitch * 2
-		lea esi, [MD_Screen + 8 * 2]	; esi = Source
+		mov esi, [_MD_Screen_Blit]
+		add esi, 8 * 2					; esi = Source
 		sub ebx, ecx					; ebx = Adjust offset for the following row
 		shr ecx, 2						; we transfer 4 bytes in each loop
 		mov edi, [esp + 24]				; edi = Destination
@@ -1191,7 +1202,8 @@ section .text align=64
 		mov ebx, [esp + 28]				; ebx = pitch of the Dest surface
 		lea ecx, [ecx * 4]				; ecx = Number of bytes per row Dest
 		add ebx, ebx					; ebx = pitch * 2
-		lea esi, [MD_Screen + 8 * 2]	; esi = Source
+		mov esi, [_MD_Screen_Blit]
+		add esi, 8 * 2					; esi = Source
 		sub ebx, ecx					; ebx = Adjust offset for the following row
 		shr ecx, 4						; we transfer 16 bytes in each loop
 		mov edi, [esp + 24]				; edi = Destination
@@ -1256,7 +1268,8 @@ section .text align=64
 		mov ecx, [esp + 32]				; ecx = Number of pixels per row
 		mov ebx, [esp + 28]				; ebx = pitch of the Dest surface
 		lea ecx, [ecx * 4]				; ecx = Number of bytes per row Dest
-		lea esi, [MD_Screen + 8 * 2]	; esi = Source
+		mov esi, [_MD_Screen_Blit]
+		add esi, 8 * 2					; esi = Source
 		sub ebx, ecx					; ebx = Adjust offset for the following row
 		shr ecx, 4						; we transfer 32 Dest bytes to in each loop
 		mov edi, [esp + 24]				; edi = Destination
@@ -1353,7 +1366,8 @@ section .text align=64
 		mov ecx, [esp + 32]				; ecx = Number of pixels per row
 		mov ebx, [esp + 28]				; ebx = pitch of the Dest surface
 		lea ecx, [ecx * 4]				; ecx = Number of bytes per row Dest
-		lea esi, [MD_Screen + 8 * 2]	; esi = Source
+		mov esi, [_MD_Screen_Blit]
+		add esi, 8 * 2					; esi = Source
 		sub ebx, ecx					; ebx = Adjust offset for the following row
 		shr ecx, 4						; we transfer 32 Dest bytes to in each loop
 		mov edi, [esp + 24]				; edi = Destination
@@ -1459,7 +1473,8 @@ section .text align=64
 		mov ecx, [esp + 36]				; ecx = Number of rows
 		mov edx, [esp + 32]				; width
 		mov ebx, [esp + 28]				; ebx = pitch of the Dest surface
-		lea esi, [MD_Screen + 8 * 2]	; esi = Source
+		mov esi, [_MD_Screen_Blit]
+		add esi, 8 * 2					; esi = Source
 		mov edi, [esp + 24]				; edi = Destination
 		test byte [Have_MMX], 0xFF		; check for MMX support
 		jz near .End
@@ -5,6 +5,10 @@
 extern "C" {
 #endif
 
+// screen read by the blitters, MD_Screen/MD_Screen32 except while a copy is being presented
+extern unsigned short *MD_Screen_Blit;
+extern unsigned int *MD_Screen32_Blit;
+
 // blitters/filters implemented in ASM that only work in 16-bit color depth
 void Blit_X1(unsigned char *Dest, int pitch, int x, int y, int offset);
 void Blit_X2(unsigned char *Dest, int pitch, int x, int y, int offset);
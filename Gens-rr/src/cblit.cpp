@@ -252,9 +252,9 @@ static void TBlit_Scanline_25_Int(pixel* Src, pixel* Dest, int srcWidth, int dst
 	void CBlit_##name(unsigned char *Dest, int pitch, int x, int y, int offset) \
 	{ \
 		if(Bits32) \
-			TBlit_##name(MD_Screen32 + 8, (unsigned int*)Dest, 336, pitch>>2, x, y); \
+			TBlit_##name(MD_Screen32_Blit + 8, (unsigned int*)Dest, 336, pitch>>2, x, y); \
 		else \
-			TBlit_##name(MD_Screen + 8, (unsigned short*)Dest, 336, pitch>>1, x, y); \
+			TBlit_##name(MD_Screen_Blit + 8, (unsigned short*)Dest, 336, pitch>>1, x, y); \
 	}
 
 MAKE_CBLIT_FUNC(EPX)
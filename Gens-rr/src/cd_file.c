@@ -37,6 +37,46 @@ void FILE_End(void)
 	Unload_ISO();
 }
 
+// maps a whole image file read-only so sectors can be read without going through the file system,
+// leaves Map NULL if it can't (not enough address space for a big BIN, for example)
+static void Map_Track(int i, const char *name)
+{
+	HANDLE file, mapping;
+	DWORD size;
+
+	Tracks[i].Map = NULL;
+	Tracks[i].Map_Size = 0;
+	Tracks[i].Map_Owned = 0;
+
+	file = CreateFile(name, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+	if (file == INVALID_HANDLE_VALUE) return;
+
+	size = GetFileSize(file, NULL);
+	mapping = (size && size != INVALID_FILE_SIZE) ? CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+
+	if (mapping)
+	{
+		Tracks[i].Map = (const unsigned char *) MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(mapping);		// the view keeps it open
+	}
+	CloseHandle(file);
+
+	if (Tracks[i].Map)
+	{
+		Tracks[i].Map_Size = size;
+		Tracks[i].Map_Owned = 1;
+	}
+}
+
+static void Unmap_Track(int i)
+{
+	if (Tracks[i].Map && Tracks[i].Map_Owned) UnmapViewOfFile(Tracks[i].Map);
+
+	Tracks[i].Map = NULL;
+	Tracks[i].Map_Size = 0;
+	Tracks[i].Map_Owned = 0;
+}
+
 // Modif N. -- added helper function for manipulating MSF times
 void AddToMSF(_msf* MSF, int lba, int m, int s, int f)
 {
@@ -121,7 +161,7 @@ int Load_ISO(char *buf, char *iso_name)
 	CloseHandle(File_Size);
 
 	Tracks[0].F = fopen(iso_name, "rb");
-	Tracks[0].F_decoded = NULL;
+	if (Tracks[0].F && !Tracks[0].Map) Map_Track(0, iso_name);		// a reset that keeps the audio cache keeps the mapping too
 
 	if (Tracks[0].F == NULL)
 	{
@@ -207,10 +247,17 @@ int Load_ISO(char *buf, char *iso_name)
 							{
 								tmp_file = fopen(g_cuefile_TOC_filenames[i], "rb");
 								if(tmp_file)
+								{
 									Tracks[i].F = tmp_file;
+									Map_Track(i, g_cuefile_TOC_filenames[i]);
+								}
 								else
+								{
 									Tracks[i].F = Tracks[0].F;
-								Tracks[i].F_decoded = NULL;
+									Tracks[i].Map = Tracks[0].Map;
+									Tracks[i].Map_Size = Tracks[0].Map_Size;
+									Tracks[i].Map_Owned = 0;
+								}
 
 								strncpy(Tracks[i].filename, g_cuefile_TOC_filenames[i], 512);
 								Tracks[i].filename[511] = 0;
@@ -276,7 +323,6 @@ int Load_ISO(char *buf, char *iso_name)
 								Tracks[i].Type = TYPE_ISO;
 								Tracks[i].Length = 0;
 								Tracks[i].F = NULL;
-								Tracks[i].F_decoded = NULL;
 								if(g_cuefile_TOC_filetype[i] == TYPE_WAV)
 								{
 									if(tmp_file)
@@ -338,7 +384,6 @@ int Load_ISO(char *buf, char *iso_name)
 						CloseHandle(File_Size);
 
 						Tracks[num_track - SCD.TOC.First_Track].F = tmp_file; 
-						Tracks[num_track - SCD.TOC.First_Track].F_decoded = NULL;
 
 						strncpy(Tracks[num_track - SCD.TOC.First_Track].filename, tmp_name, 512);
 						Tracks[num_track - SCD.TOC.First_Track].filename[511] = 0;
@@ -496,10 +541,8 @@ void Unload_ISO(void)
 		for(i = 0; i < 100; i++)
 		{
 			if (Tracks[i].F) fclose(Tracks[i].F);
-			if (Tracks[i].F_decoded)
-				fclose(Tracks[i].F_decoded);
+			Unmap_Track(i);
 			Tracks[i].F = NULL;
-			Tracks[i].F_decoded = NULL;
 			Tracks[i].Length = 0;
 			Tracks[i].Type = 0;
 			Tracks[i].filename[0] = 0;
@@ -772,6 +815,7 @@ int Load_CUE(char *buf, char *cue_name)
 int FILE_Read_One_LBA_CDC(void)
 {
 	int where_read;
+	const char *sector = cp_buf;		// points into the mapped image when the sector can be read from there
 	
 	//struct cdcstruct cdc = CDC; // enable this for stupid debuggers that don't realize CDC is a variable
 
@@ -790,8 +834,15 @@ int FILE_Read_One_LBA_CDC(void)
 		//       but I don't know what the condition is supposed to be (maybe !(CDC.CTRL.B.B1 & 0x20))
 		//memset(cp_buf, 0, 2048);
 
-		fseek(Tracks[0].F, where_read, SEEK_SET);
-		fread(cp_buf, 1, 2048, Tracks[0].F);
+		if (Tracks[0].Map && (unsigned int) where_read + 2048 <= Tracks[0].Map_Size)
+		{
+			sector = (const char *) Tracks[0].Map + where_read;
+		}
+		else
+		{
+			fseek(Tracks[0].F, where_read, SEEK_SET);
+			fread(cp_buf, 1, 2048, Tracks[0].F);
+		}
 
 #ifdef DEBUG_CD
 		fprintf(debug_SCD_file, "\n\nRead file CDC 1 data sector :\n");
@@ -811,25 +862,14 @@ int FILE_Read_One_LBA_CDC(void)
 			int forceNoDecode = 0;
 #endif
 
-			int fileNeedsClose = 0;
-			FILE* decodedFile = GetMP3TrackFile(index, &fileNeedsClose, &where_read);
+			int decoded = MP3_Read_Decoded(index, cp_buf);
 
-			if(decodedFile || forceNoDecode)
+			if(decoded || forceNoDecode)
 			{
-				// copy audio data to buffer
-				int outRead = 0;
-				if(decodedFile)
-				{
-					fseek(decodedFile, where_read, SEEK_SET);
-					outRead = fread(cp_buf, 1, 588*4, decodedFile);
-				}
-				if(outRead < 588*4)
+				if(!decoded)
 					memset(cp_buf, 0, 588*4); // failed to read, use silence
 
 				Write_CD_Audio((short *) cp_buf, 44100, 2, 588);
-
-				if(fileNeedsClose)
-					fclose(decodedFile);
 			}
 			else // stream it
 			{
@@ -866,10 +906,17 @@ int FILE_Read_One_LBA_CDC(void)
 				where_read = (lba - 150) * 588*4 + 16;
 				if(where_read < 0) where_read = 0;
 
-				// copy audio data to buffer
-				fseek(Tracks[index].F, where_read, SEEK_SET);
-				fread(cp_buf, 1, 588*4, Tracks[index].F);
-				Write_CD_Audio((short *) cp_buf, 44100, 2, 588);
+				// copy audio data to buffer, or use it straight from the mapped image
+				if(Tracks[index].Map && (unsigned int) where_read + 588*4 <= Tracks[index].Map_Size)
+				{
+					sector = (const char *) Tracks[index].Map + where_read;
+				}
+				else
+				{
+					fseek(Tracks[index].F, where_read, SEEK_SET);
+					fread(cp_buf, 1, 588*4, Tracks[index].F);
+				}
+				Write_CD_Audio((short *) sector, 44100, 2, 588);
 			}
 		}
 
@@ -895,7 +942,7 @@ int FILE_Read_One_LBA_CDC(void)
 				CDC.WA.N = (CDC.WA.N + 2352) & 0x7FFF;		// add one sector to WA
 				CDC.PT.N = (CDC.PT.N + 2352) & 0x7FFF;
 
-				memcpy(&CDC.Buffer[CDC.PT.N + 4], cp_buf, 2048);
+				memcpy(&CDC.Buffer[CDC.PT.N + 4], sector, 2048);
 				memcpy(&CDC.Buffer[CDC.PT.N], &CDC.HEAD, 4);
 
 #ifdef DEBUG_CD
@@ -950,7 +997,7 @@ int FILE_Read_One_LBA_CDC(void)
 			{
 				// CAUTION : lookahead bit not implemented
 
-				memcpy(&CDC.Buffer[CDC.PT.N], cp_buf, 2352);
+				memcpy(&CDC.Buffer[CDC.PT.N], sector, 2352);
 			}
 
 			CDC.STAT.B.B0 = 0x80;
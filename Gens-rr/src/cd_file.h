@@ -13,7 +13,9 @@ extern "C" {
 
 struct _file_track {
 	FILE *F;
-	FILE *F_decoded;
+	const unsigned char *Map;	// whole file mapped read-only, NULL when it has to be read through F
+	unsigned int Map_Size;
+	int Map_Owned;				// 0 when Map belongs to another track
 	int Length;
 	int Type;
 	char filename [512];
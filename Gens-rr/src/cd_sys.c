@@ -11,6 +11,9 @@
 #include "Mem_S68K.h"
 #include "save.h"
 #include "misc.h"
+#include <math.h>
+#include <emmintrin.h>
+#include "benchmark.h"
 
 int File_Add_Delay = 0;
 
@@ -977,10 +980,150 @@ int CDD_Def(void)
 
 extern int disableSound; // Gens.cpp
 
+// CD audio resampler : polyphase windowed sinc, with CD_RESAMPLE_ZEROS zero crossings on each side
+// at the lower of the two rates, CD_RESAMPLE_PHASES positions between two input samples
+
+#ifndef PI
+#define PI 3.14159265358979323846
+#endif
+
+#define CD_RESAMPLE_PHASE_BITS 6
+#define CD_RESAMPLE_PHASES (1 << CD_RESAMPLE_PHASE_BITS)
+#define CD_RESAMPLE_ZEROS 8
+#define CD_RESAMPLE_MAX_TAPS 128
+#define CD_RESAMPLE_MAX_IN (48000 / 75)
+
+static short CD_Resample_Kernel[CD_RESAMPLE_PHASES][CD_RESAMPLE_MAX_TAPS];
+static short CD_Resample_L[CD_RESAMPLE_MAX_TAPS + CD_RESAMPLE_MAX_IN];	// the last block's end first, then the new one
+static short CD_Resample_R[CD_RESAMPLE_MAX_TAPS + CD_RESAMPLE_MAX_IN];
+static int CD_Resample_Taps;
+static int CD_Resample_Rate_In, CD_Resample_Rate_Out;
+static int CD_Resample_SSE2 = -1;
+
+static void CD_Resample_Init(int rate_in, int rate_out)
+{
+	double ratio = (double) rate_in / (double) rate_out;
+	double cutoff, half, t, h, sum;
+	int p, k, taps, center;
+
+	if (ratio < 1.0) ratio = 1.0;
+
+	// multiple of 8 taps for the SSE2 dot product
+	taps = ((int) ceil(2 * CD_RESAMPLE_ZEROS * ratio) + 7) & ~7;
+	if (taps > CD_RESAMPLE_MAX_TAPS) taps = CD_RESAMPLE_MAX_TAPS;
+
+	cutoff = 0.45 / ratio;			// in cycles per input sample
+	half = taps / 2;
+
+	for(p = 0; p < CD_RESAMPLE_PHASES; p++)
+	{
+		double coef[CD_RESAMPLE_MAX_TAPS];
+		int total = 0;
+
+		sum = 0.0;
+
+		// tap k reads input sample (i - taps + 1 + k) for an output at i + p / PHASES, taps / 2 samples late
+		for(k = 0; k < taps; k++)
+		{
+			t = k + 1 - half - (double) p / CD_RESAMPLE_PHASES;
+			h = (t == 0.0) ? 1.0 : sin(2.0 * PI * cutoff * t) / (2.0 * PI * cutoff * t);
+			h *= (fabs(t) >= half) ? 0.0 : 0.42 + 0.5 * cos(PI * t / half) + 0.08 * cos(2.0 * PI * t / half);
+			coef[k] = h;
+			sum += h;
+		}
+
+		// each phase adds up to exactly 1.0, so DC and silence go through unchanged
+		center = 0;
+		for(k = 0; k < taps; k++)
+		{
+			CD_Resample_Kernel[p][k] = (short) floor(coef[k] / sum * 32768.0 + 0.5);
+			total += CD_Resample_Kernel[p][k];
+			if (coef[k] > coef[center]) center = k;
+		}
+		CD_Resample_Kernel[p][center] += (short) (32768 - total);
+
+		for(; k < CD_RESAMPLE_MAX_TAPS; k++) CD_Resample_Kernel[p][k] = 0;
+	}
+
+	CD_Resample_Taps = taps;
+	CD_Resample_Rate_In = rate_in;
+	CD_Resample_Rate_Out = rate_out;
+}
+
+static int CD_Resample_Dot(const short *in, const short *kernel, int taps)
+{
+	int k, acc = 0;
+
+	if (CD_Resample_SSE2)
+	{
+		__m128i sum = _mm_setzero_si128();
+
+		for(k = 0; k < taps; k += 8)
+			sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_loadu_si128((const __m128i *) (in + k)), _mm_loadu_si128((const __m128i *) (kernel + k))));
+
+		sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+		sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+		acc = _mm_cvtsi128_si32(sum);
+	}
+	else
+	{
+		for(k = 0; k < taps; k++) acc += in[k] * kernel[k];
+	}
+
+	return (acc + (1 << 14)) >> 15;
+}
+
+// resamples a 75th of a second of audio at rate into the CD audio buffers
+static void CD_Resample_Block(const short *Buf, int rate, int channel, int length_src, int length_dst)
+{
+	short *in_L = CD_Resample_L + CD_RESAMPLE_MAX_TAPS, *in_R = CD_Resample_R + CD_RESAMPLE_MAX_TAPS;
+	unsigned int pos, step;
+	int i, wp = CD_Audio_Buffer_Write_Pos;
+
+	if (CD_Resample_SSE2 < 0) CD_Resample_SSE2 = CPU_Has_SSE2();
+	if (rate != CD_Resample_Rate_In || Sound_Rate != CD_Resample_Rate_Out) CD_Resample_Init(rate, Sound_Rate);
+
+	for(i = 0; i < length_src; i++)
+	{
+		in_L[i] = Buf[i * channel];
+		in_R[i] = Buf[i * channel + channel - 1];
+	}
+
+	if (length_src == length_dst)
+	{
+		// same rate, nothing to filter
+		for(i = 0; i < length_dst; i++)
+		{
+			CD_Audio_Buffer_L[wp] = in_L[i];
+			CD_Audio_Buffer_R[wp] = in_R[i];
+			wp = (wp + 1) & 0xFFF;
+		}
+	}
+	else
+	{
+		step = (length_src << 16) / length_dst;
+
+		for(i = 0, pos = 0; i < length_dst; i++, pos += step)
+		{
+			const short *kernel = CD_Resample_Kernel[(pos >> (16 - CD_RESAMPLE_PHASE_BITS)) & (CD_RESAMPLE_PHASES - 1)];
+			int first = (pos >> 16) - CD_Resample_Taps + 1;
+
+			CD_Audio_Buffer_L[wp] = CD_Resample_Dot(in_L + first, kernel, CD_Resample_Taps);
+			CD_Audio_Buffer_R[wp] = CD_Resample_Dot(in_R + first, kernel, CD_Resample_Taps);
+			wp = (wp + 1) & 0xFFF;
+		}
+	}
+
+	memmove(CD_Resample_L, CD_Resample_L + length_src, CD_RESAMPLE_MAX_TAPS * sizeof(short));
+	memmove(CD_Resample_R, CD_Resample_R + length_src, CD_RESAMPLE_MAX_TAPS * sizeof(short));
+
+	CD_Audio_Buffer_Write_Pos = wp;
+}
+
+
 void Write_CD_Audio(short *Buf, int rate, int channel, int _length)
 {
 	unsigned int _length_src, _length_dst;
-	unsigned int pos_src, pas_src;
 
 	if(disableSound)
 		return;
@@ -993,82 +1136,21 @@ void Write_CD_Audio(short *Buf, int rate, int channel, int _length)
 		CD_Audio_Starting = 0;
 		memset(CD_Audio_Buffer_L, 0, 4096 * 4);
 		memset(CD_Audio_Buffer_R, 0, 4096 * 4);
+		memset(CD_Resample_L, 0, sizeof(CD_Resample_L));
+		memset(CD_Resample_R, 0, sizeof(CD_Resample_R));
 		CD_Audio_Buffer_Write_Pos = (CD_Audio_Buffer_Read_Pos + 2000) & 0xFFF;
 	}
 
 	_length_src = rate / 75;				// 75th of a second
 	_length_dst = Sound_Rate / 75;		// 75th of a second
 
-	pas_src = (_length_src << 16) / _length_dst;
-	pos_src = 0;
+	if (_length_src > CD_RESAMPLE_MAX_IN) return;
 
 #ifdef DEBUG_CD
 	fprintf(debug_SCD_file, "\n*********  Write Pos = %d    ", CD_Audio_Buffer_Write_Pos);
 #endif
 
-	if (channel == 2)
-	{
-		__asm
-		{
-			mov edi, CD_Audio_Buffer_Write_Pos
-			mov ebx, Buf
-			xor esi, esi
-			mov ecx, _length_dst
-			xor eax, eax
-			mov edx, pas_src
-			dec ecx
-			jmp short loop_stereo
-
-align 16
-
-loop_stereo:
-			movsx eax, word ptr [ebx + esi * 4]
-			mov CD_Audio_Buffer_L[edi * 4], eax
-			movsx eax, word ptr [ebx + esi * 4 + 2]
-			mov CD_Audio_Buffer_R[edi * 4], eax
-			mov esi, dword ptr pos_src
-			inc edi
-			add esi, edx
-			and edi, 0xFFF
-			mov dword ptr pos_src, esi
-			shr esi, 16
-			dec ecx
-			jns short loop_stereo
-
-			mov CD_Audio_Buffer_Write_Pos, edi
-		}
-	}
-	else
-	{
-		__asm
-		{
-			mov edi, CD_Audio_Buffer_Write_Pos
-			mov ebx, Buf
-			xor esi, esi
-			mov ecx, _length_dst
-			xor eax, eax
-			mov edx, pas_src
-			dec ecx
-			jmp short loop_mono
-
-align 16
-
-loop_mono:
-			movsx eax, word ptr [ebx + esi * 2]
-			mov CD_Audio_Buffer_L[edi * 4], eax
-			mov CD_Audio_Buffer_R[edi * 4], eax
-			mov esi, dword ptr pos_src
-			inc edi
-			add esi, edx
-			and edi, 0xFFF
-			mov dword ptr pos_src, esi
-			shr esi, 16
-			dec ecx
-			jns short loop_mono
-
-			mov CD_Audio_Buffer_Write_Pos, edi
-		}
-	}
+	CD_Resample_Block(Buf, rate, channel, _length_src, _length_dst);
 
 #ifdef DEBUG_CD
 	fprintf(debug_SCD_file, "Write Pos 2 = %d\n\n", CD_Audio_Buffer_Write_Pos);
@@ -1116,45 +1198,16 @@ void Update_CD_Audio(int **buf, int _length)
 
 	if (CDDA_Enable)
 	{
-		int i = 0;
-		for (; i <= _length; i++)
-		{
-			int readPos = (CD_Audio_Buffer_Read_Pos + i) & 0xFFF;
-			CD_Audio_Buffer_L[readPos] = (CD_Audio_Buffer_L[readPos] * CDDAVol) >> 8;
-			CD_Audio_Buffer_R[readPos] = (CD_Audio_Buffer_R[readPos] * CDDAVol) >> 8;
-		}
-		__asm
+		int i, rp = CD_Audio_Buffer_Read_Pos;
+
+		for (i = 0; i < _length; i++)
 		{
-			mov ecx, _length
-			mov esi, CD_Audio_Buffer_Read_Pos
-			mov edi, Buf_L
-			dec ecx
-
-loop_L:
-			mov eax, CD_Audio_Buffer_L[esi * 4]
-			add [edi], eax
-			inc esi
-			add edi, 4
-			and esi, 0xFFF
-			dec ecx
-			jns short loop_L
-
-			mov ecx, _length
-			mov esi, CD_Audio_Buffer_Read_Pos
-			mov edi, Buf_R
-			dec ecx
-
-loop_R:
-			mov eax, CD_Audio_Buffer_R[esi * 4]
-			add [edi], eax
-			inc esi
-			add edi, 4
-			and esi, 0xFFF
-			dec ecx
-			jns short loop_R
-
-			mov CD_Audio_Buffer_Read_Pos, esi
+			Buf_L[i] += (CD_Audio_Buffer_L[rp] * CDDAVol) >> 8;
+			Buf_R[i] += (CD_Audio_Buffer_R[rp] * CDDAVol) >> 8;
+			rp = (rp + 1) & 0xFFF;
 		}
+
+		CD_Audio_Buffer_Read_Pos = rp;
 	}
 	else
 	{
@@ -1168,3 +1221,170 @@ loop_R:
 }
 
 
+/* Benchmark */
+
+#define CD_BENCH_BLOCKS (75 * 60)			// one minute of audio
+#define CD_BENCH_CASES 6
+#define CD_BENCH_MODES 3					// nearest neighbour, resampler without and with SSE2
+
+static const int CD_Bench_Rates[CD_BENCH_CASES][2] = {{44100, 44100}, {44100, 22050}, {44100, 11025}, {32000, 44100}, {48000, 44100}, {48000, 22050}};
+
+// what Write_CD_Audio used to do : take the nearest input sample
+static void CD_Nearest_Block(const short *Buf, int channel, int length_src, int length_dst)
+{
+	unsigned int pos = 0, step = (length_src << 16) / length_dst;
+	int i, wp = CD_Audio_Buffer_Write_Pos;
+
+	for(i = 0; i < length_dst; i++, pos += step)
+	{
+		CD_Audio_Buffer_L[wp] = Buf[(pos >> 16) * channel];
+		CD_Audio_Buffer_R[wp] = Buf[(pos >> 16) * channel + channel - 1];
+		wp = (wp + 1) & 0xFFF;
+	}
+
+	CD_Audio_Buffer_Write_Pos = wp;
+}
+
+// a tone at freq Hz, or music-like noise when freq is 0
+static void CD_Bench_Input(short *buf, int rate, int block, double freq)
+{
+	int i, length = rate / 75;
+	unsigned int seed = block * 2654435761u + 1;
+
+	for(i = 0; i < length; i++)
+	{
+		double t = (double) (block * length + i) / rate;
+		double v = freq ? sin(2.0 * PI * freq * t) * 16000.0 : sin(2.0 * PI * 440.0 * t) * 8000.0 + sin(2.0 * PI * 6000.0 * t) * 4000.0;
+
+		seed = seed * 1103515245 + 12345;
+		if (!freq) v += (double) ((seed >> 16) & 0xFFF) - 2048.0;
+
+		buf[i * 2] = (short) v;
+		buf[i * 2 + 1] = (short) -v;
+	}
+}
+
+// plays CD_BENCH_BLOCKS blocks through one mode and returns the microseconds per block,
+// out gets the CD audio buffer after the last block when it isn't NULL
+static double CD_Bench_Pass(int rate_in, int rate_out, int mode, int *out)
+{
+	static short in[CD_RESAMPLE_MAX_IN * 2];
+	double start, us;
+	int block;
+
+	Sound_Rate = rate_out;
+	CD_Resample_SSE2 = (mode == 2);
+	CD_Resample_Rate_In = 0;
+	CD_Audio_Buffer_Write_Pos = 0;
+	memset(CD_Resample_L, 0, sizeof(CD_Resample_L));
+	memset(CD_Resample_R, 0, sizeof(CD_Resample_R));
+	start = Benchmark_Time();
+
+	for(block = 0; block < CD_BENCH_BLOCKS; block++)
+	{
+		if (block < 8) CD_Bench_Input(in, rate_in, block, 0.0);		// the same few blocks over and over, the time is in the resampling
+
+		if (mode == 0) CD_Nearest_Block(in, 2, rate_in / 75, rate_out / 75);
+		else CD_Resample_Block(in, rate_in, 2, rate_in / 75, rate_out / 75);
+	}
+
+	us = (Benchmark_Time() - start) * 1000.0 / CD_BENCH_BLOCKS;
+	if (out) memcpy(out, CD_Audio_Buffer_L, 4096 * sizeof(int));
+
+	return us;
+}
+
+// how loud a tone above the output Nyquist frequency comes out, relative to the input, in dB
+static double CD_Bench_Alias(int rate_in, int rate_out, int mode)
+{
+	static short in[CD_RESAMPLE_MAX_IN * 2];
+	double power = 0.0;
+	int block, i, length = rate_out / 75;
+
+	Sound_Rate = rate_out;
+	CD_Resample_SSE2 = 0;
+	CD_Resample_Rate_In = 0;
+	CD_Audio_Buffer_Write_Pos = 0;
+	memset(CD_Resample_L, 0, sizeof(CD_Resample_L));
+	memset(CD_Resample_R, 0, sizeof(CD_Resample_R));
+
+	for(block = 0; block < 6; block++)
+	{
+		CD_Bench_Input(in, rate_in, block, (rate_in + rate_out) / 4.0);	// between the two Nyquist frequencies
+		if (mode == 0) CD_Nearest_Block(in, 2, rate_in / 75, length);
+		else CD_Resample_Block(in, rate_in, 2, rate_in / 75, length);
+	}
+
+	// skip the first block, the filter is still filling up
+	for(i = length; i < length * 6; i++) power += (double) CD_Audio_Buffer_L[i] * CD_Audio_Buffer_L[i];
+
+	return 10.0 * log10((power / (length * 5) + 1e-9) / (16000.0 * 16000.0 / 2.0));
+}
+
+// times nearest neighbour conversion against the resampler (with and without SSE2) and measures the aliasing
+int CD_Audio_Benchmark(char *summary)
+{
+	static int savedL[4096], savedR[4096], out[2][4096];
+	static short savedHistL[CD_RESAMPLE_MAX_TAPS + CD_RESAMPLE_MAX_IN], savedHistR[CD_RESAMPLE_MAX_TAPS + CD_RESAMPLE_MAX_IN];
+	int savedRate = Sound_Rate, savedWrite = CD_Audio_Buffer_Write_Pos, savedSSE2 = CD_Resample_SSE2;
+	int hasSSE2 = CPU_Has_SSE2();
+	double us[CD_BENCH_CASES][CD_BENCH_MODES], alias[CD_BENCH_CASES][2];
+	int mismatches = 0;
+	int c, mode;
+	FILE *log;
+
+	memcpy(savedL, CD_Audio_Buffer_L, sizeof(savedL));
+	memcpy(savedR, CD_Audio_Buffer_R, sizeof(savedR));
+	memcpy(savedHistL, CD_Resample_L, sizeof(savedHistL));
+	memcpy(savedHistR, CD_Resample_R, sizeof(savedHistR));
+
+	for(c = 0; c < CD_BENCH_CASES; c++)
+	{
+		for(mode = 0; mode < CD_BENCH_MODES; mode++)
+		{
+			us[c][mode] = 0.0;
+			if (mode == 2 && !hasSSE2) continue;
+			us[c][mode] = CD_Bench_Pass(CD_Bench_Rates[c][0], CD_Bench_Rates[c][1], mode, (mode > 0) ? out[mode - 1] : NULL);
+		}
+
+		if (hasSSE2 && memcmp(out[0], out[1], sizeof(out[0]))) mismatches++;
+
+		alias[c][0] = alias[c][1] = 0.0;
+		if (CD_Bench_Rates[c][0] > CD_Bench_Rates[c][1])
+		{
+			alias[c][0] = CD_Bench_Alias(CD_Bench_Rates[c][0], CD_Bench_Rates[c][1], 0);
+			alias[c][1] = CD_Bench_Alias(CD_Bench_Rates[c][0], CD_Bench_Rates[c][1], 1);
+		}
+	}
+
+	memcpy(CD_Audio_Buffer_L, savedL, sizeof(savedL));
+	memcpy(CD_Audio_Buffer_R, savedR, sizeof(savedR));
+	memcpy(CD_Resample_L, savedHistL, sizeof(savedHistL));
+	memcpy(CD_Resample_R, savedHistR, sizeof(savedHistR));
+	Sound_Rate = savedRate;
+	CD_Audio_Buffer_Write_Pos = savedWrite;
+	CD_Resample_SSE2 = savedSSE2;
+	CD_Resample_Rate_In = 0;
+
+	log = Benchmark_Log("cdda");
+	if (log)
+	{
+		fprintf(log, "CD audio, microseconds per 75th of a second block (%s)\n", hasSSE2 ? "SSE2" : "no SSE2");
+		for(c = 0; c < CD_BENCH_CASES; c++)
+		{
+			fprintf(log, "%5d -> %5d: nearest %6.2f us, resampler %6.2f us, SSE2 %6.2f us",
+				CD_Bench_Rates[c][0], CD_Bench_Rates[c][1], us[c][0], us[c][1], us[c][2]);
+			if (CD_Bench_Rates[c][0] > CD_Bench_Rates[c][1])
+				fprintf(log, ", tone above Nyquist at %.0f dB nearest, %.0f dB resampled", alias[c][0], alias[c][1]);
+			fprintf(log, "\n");
+		}
+		if (mismatches) fprintf(log, "SSE2 output differs from the scalar output for %d rates\n", mismatches);
+		fprintf(log, "\n");
+		fclose(log);
+	}
+
+	sprintf(summary, "CD audio 44.1 kHz -> 22 kHz: nearest %.1f us, resampler %.1f us, SSE2 %.1f us per block%s",
+		us[1][0], us[1][1], us[1][2], mismatches ? " (MISMATCH)" : "");
+
+	return mismatches;
+}
@@ -1,5 +1,4 @@
 #include <windows.h>
-#include <direct.h>
 
 extern "C" {
 
@@ -34,10 +33,26 @@ char preloaded_tracks [100] = {0};
 extern BOOL IsAsyncAllowed(void);
 extern void Put_Info(char *Message, int Duration);
 extern void Put_Info_NonImmediate(char *Message, int Duration);
-extern char Gens_Path[1024];
 extern char played_tracks_linear [105];
-#define PRELOADED_MP3_DIRECTORY "temp"
-#define PRELOADED_MP3_FILENAME "\\track%02d.pcm"
+
+// decoded MP3 tracks are kept in memory as 44.1 kHz stereo samples, in one second chunks
+// so the preloading thread can keep appending to a track while it's being played
+#define MP3_CACHE_CHUNK (75 * 588*4)
+#define MP3_CACHE_MAX_CHUNKS (35 * 60)				// longest track that gets decoded, in seconds
+#define MP3_CACHE_BUDGET (256 * 1024 * 1024)		// past this, the least recently played tracks get dropped
+
+struct MP3CacheTrack
+{
+	char* chunks [MP3_CACHE_MAX_CHUNKS];
+	volatile LONG size;			// bytes decoded so far, only the preloading thread makes it grow
+	volatile LONG complete;
+	unsigned int lastUsed;
+};
+static MP3CacheTrack mp3Cache [100];
+static volatile LONG mp3CacheBytes = 0;
+static unsigned int mp3CacheClock = 0;
+
+static bool MP3_Preload_Pending(int track);
 
 int MP3_Init(void)
 {
@@ -259,43 +274,125 @@ int MP3_Update_OUT(void)
 	return 0;
 }
 
-void Delete_Preloaded_MP3(int track)
+// appends decoded samples to a track, returns false if there's no memory or the track is too long
+static bool MP3_Cache_Append(int track, const char* data, int bytes)
+{
+	MP3CacheTrack& cache = mp3Cache[track];
+
+	while(bytes > 0)
+	{
+		int pos = cache.size;
+		int chunk = pos / MP3_CACHE_CHUNK, offset = pos % MP3_CACHE_CHUNK;
+		int count = (bytes < MP3_CACHE_CHUNK - offset) ? bytes : MP3_CACHE_CHUNK - offset;
+
+		if(chunk >= MP3_CACHE_MAX_CHUNKS)
+			return false;
+		if(!cache.chunks[chunk])
+		{
+			if(!(cache.chunks[chunk] = (char*) malloc(MP3_CACHE_CHUNK)))
+				return false;
+			InterlockedExchangeAdd(&mp3CacheBytes, MP3_CACHE_CHUNK);
+		}
+
+		memcpy(cache.chunks[chunk] + offset, data, count);
+		InterlockedExchange(&cache.size, pos + count); // the samples have to be there before the reader can see them
+
+		data += count;
+		bytes -= count;
+	}
+
+	return true;
+}
+
+// copies decoded samples out of a track, returns false if they haven't been decoded (yet)
+static bool MP3_Cache_Read(int track, int pos, char* buf, int bytes)
+{
+	MP3CacheTrack& cache = mp3Cache[track];
+
+	if(pos < 0 || pos + bytes > cache.size)
+		return false;
+
+	while(bytes > 0)
+	{
+		int chunk = pos / MP3_CACHE_CHUNK, offset = pos % MP3_CACHE_CHUNK;
+		int count = (bytes < MP3_CACHE_CHUNK - offset) ? bytes : MP3_CACHE_CHUNK - offset;
+
+		memcpy(buf, cache.chunks[chunk] + offset, count);
+
+		pos += count;
+		buf += count;
+		bytes -= count;
+	}
+
+	cache.lastUsed = ++mp3CacheClock;
+	return true;
+}
+
+// only call this when the track isn't being preloaded
+static void MP3_Cache_Free(int track)
+{
+	MP3CacheTrack& cache = mp3Cache[track];
+
+	cache.complete = 0;
+	cache.size = 0;
+
+	for(int i = 0; i < MP3_CACHE_MAX_CHUNKS; i++)
+	{
+		if(cache.chunks[i])
+		{
+			free(cache.chunks[i]);
+			cache.chunks[i] = NULL;
+			InterlockedExchangeAdd(&mp3CacheBytes, -MP3_CACHE_CHUNK);
+		}
+	}
+}
+
+// drops the least recently played decoded tracks until the given track fits in the budget,
+// or goes over the budget if everything else is still in use
+static void MP3_Cache_Make_Room(int track)
 {
-	char str [128];
-	SetCurrentDirectory(Gens_Path);
-	_mkdir(PRELOADED_MP3_DIRECTORY);
-	sprintf(str, PRELOADED_MP3_DIRECTORY PRELOADED_MP3_FILENAME, track+1);
-	_unlink(str);
+	LONG needed = Tracks[track].Length * 588*4 - mp3Cache[track].size;
+
+	while(mp3CacheBytes + needed > MP3_CACHE_BUDGET)
+	{
+		int i, oldest = -1;
+
+		for(i = 0; i < 100; i++)
+			if(i != track && i != Track_Played && mp3Cache[i].complete && !MP3_Preload_Pending(i))
+				if(oldest < 0 || mp3Cache[i].lastUsed < mp3Cache[oldest].lastUsed)
+					oldest = i;
+
+		if(oldest < 0)
+			break;
+
+		MP3_Cache_Free(oldest);
+		preloaded_tracks[oldest] = 0;
+	}
 }
 
 void Delete_Preloaded_MP3s(void)
 {
 	int i;
 	for(i = 0; i < 100; i++)
-		Delete_Preloaded_MP3(i);
-
-	_rmdir(PRELOADED_MP3_DIRECTORY); // this will only delete the directory if it's empty, which is good. but it won't delete the directory if Windows Explorer has acquired and leaked the directory handle as it loves to do, which is bad. oh well.
+		MP3_Cache_Free(i);
 }
 
 int noTracksQueued = 1;
 
-bool Preload_MP3_Synchronous_Cancel;
-int Preload_MP3_Synchronous_Cancel_Exception = -1;
 bool Waiting_For_Preload_MP3_Synchronous = false;
-void Preload_MP3_Synchronous(FILE** filePtr, int track)
+#ifdef _WIN32
+static bool s_preloadThrottle = true;
+#endif
+
+// decodes a whole track into the cache, stops early when *cancel gets set
+void Preload_MP3_Synchronous(int track, volatile bool* cancel)
 {
-	if(filePtr && track >= 0 && track < 100)
+	if(track >= 0 && track < 100)
 	{
-		if(!*filePtr && Tracks[track].Type == TYPE_MP3)
+		if(!mp3Cache[track].complete && Tracks[track].Type == TYPE_MP3)
 		{
-			char str [1024], msg [256];
-			int prevTrack = Track_Played;
-			FILE* file = NULL;
-
-			SetCurrentDirectory(Gens_Path);
-			_mkdir(PRELOADED_MP3_DIRECTORY);
-
-			sprintf(str, PRELOADED_MP3_DIRECTORY PRELOADED_MP3_FILENAME, track+1);
+			char msg [256];
+			FILE* file;
 
 #ifdef _WIN32
 			sprintf(msg, "Loading track %02d MP3", track+1);
@@ -305,47 +402,38 @@ void Preload_MP3_Synchronous(FILE** filePtr, int track)
 			Put_Info(msg, 100);
 #endif
 
-			if(Preload_MP3_Synchronous_Cancel)
+			if(cancel && *cancel)
 				return;
 
-			//Tracks[track].F_decoded = fopen(str, "wb+");
-			if(preloaded_tracks[track] == 3)
-				file = fopen(str, "r+b");
-			else
-				file = fopen(str, "w+b");
-
-			if(Preload_MP3_Synchronous_Cancel && track != Preload_MP3_Synchronous_Cancel_Exception)
-			{
-				if(file)
-					fclose(file);
+			// a file of our own, Tracks[track].F may be in use by the streaming decoder or another preload
+			file = fopen(Tracks[track].filename, "rb");
+			if(!file)
 				return;
-			}
 
 			preloaded_tracks[track] = 3;
 
-			if(file)
 			{
-				// decode mp3 to the temporary file
+				// decode mp3 to memory, carrying on from where a cancelled preload stopped
 
 				static const int inSize = 588*4, outSize = 8192;
 				char temp_in_buf[inSize], temp_out_buf[outSize];
 				int inRead = 0, outRead = 0;
 				int ok = MP3_OK;
+				bool full = false;
 				mpstr temp_mp;
 				InitMP3(&temp_mp);
-				int inStartPos = MP3_Find_Frame(Tracks[track].F, 0);
-				fseek(file, 0, SEEK_END);
-				int outStartPos = ftell(file);
+				int inStartPos = MP3_Find_Frame(file, 0);
+				int outStartPos = mp3Cache[track].size;
 				int outPos = 0;
-				fseek(Tracks[track].F, inStartPos, SEEK_SET);
+				fseek(file, inStartPos, SEEK_SET);
 				int iter = 0;
 
-				while(ok == MP3_OK && !(Preload_MP3_Synchronous_Cancel && track != Preload_MP3_Synchronous_Cancel_Exception))
+				while(ok == MP3_OK && !full && !(cancel && *cancel))
 				{
-					inRead = fread(temp_in_buf, 1, inSize, Tracks[track].F);
+					inRead = fread(temp_in_buf, 1, inSize, file);
 					ok = decodeMP3(&temp_mp, temp_in_buf, inRead, temp_out_buf, outSize, (int*)&outRead);
 					if(outPos >= outStartPos)
-						fwrite(temp_out_buf, outRead, 1, file);
+						full = !MP3_Cache_Append(track, temp_out_buf, outRead); // out of memory or too long, keep what fit
 					outPos += outRead;
 
 					++iter;
@@ -353,9 +441,9 @@ void Preload_MP3_Synchronous(FILE** filePtr, int track)
 #ifdef _WIN32
 					// even with "lowest priority" set on this thread, on win32,
 					// it still prevents other threads from doing processing for long enough
-					// to cause stuttering problems, even with multiple CPU cores present,
+					// to cause stuttering problems when there's no core to spare,
 					// so voluntarily give up control of the thread by sleeping every few decoding iterations
-					if(!Waiting_For_Preload_MP3_Synchronous)
+					if(s_preloadThrottle && !Waiting_For_Preload_MP3_Synchronous)
 						if(iter % 16 == 0)
 							Sleep(10);
 						else
@@ -363,24 +451,16 @@ void Preload_MP3_Synchronous(FILE** filePtr, int track)
 #endif
 				}
 
-				if((Preload_MP3_Synchronous_Cancel && track != Preload_MP3_Synchronous_Cancel_Exception)
-				|| ferror(file)) // if we got some error (out of disk space?) give up on pre-loading the MP3
-				{
-					fclose(file);
-					file = NULL;
-				}
-			}
-			else
-			{
-				// couldn't open, maybe another instance of Gens has it open? if so use that
-				file = fopen(str, "rb");
-			}
+				ExitMP3(&temp_mp);
+				fclose(file);
 
-			*filePtr = file;
+				if(!(cancel && *cancel))
+					InterlockedExchange(&mp3Cache[track].complete, 1);
+			}
 		}
+		if(!(cancel && *cancel))
+			preloaded_tracks[track] = mp3Cache[track].complete ? 1 : 0;
 	}
-	if(!(Preload_MP3_Synchronous_Cancel && track != Preload_MP3_Synchronous_Cancel_Exception))
-		preloaded_tracks[track] = (filePtr && *filePtr) ? 1 : 0;
 }
 
 
@@ -426,9 +506,13 @@ CriticalSection preloadingCriticalSection;
 #define ENTER_CRIT_SECT do{ AutoCriticalSection acs (preloadingCriticalSection);
 #define EXIT_CRIT_SECT } while(0);
 
+// MP3s are preloaded by a pool of worker threads, one per spare CPU core, each decoding a whole track at a time.
+// the back of the queue is what gets decoded next
+
+#define PRELOAD_MAX_WORKERS 8
+
 struct PreloadMP3ThreadArg
 {
-	FILE** filePtr;
 	int track;
 	int sortPriority;
 
@@ -437,106 +521,262 @@ struct PreloadMP3ThreadArg
 	}
 };
 std::vector<PreloadMP3ThreadArg> preloadMP3ThreadArgs;
-PreloadMP3ThreadArg curThreadArgs;
 
-static HANDLE s_preloadingMP3Thread = NULL;
+struct PreloadMP3Worker
+{
+	HANDLE thread;			// NULL when this slot has no thread running
+	int track;				// being decoded, -1 between tracks
+	volatile bool cancel;	// stop decoding it, it gets queued again unless all preloading is being cancelled
+};
+static PreloadMP3Worker s_preloadWorkers [PRELOAD_MAX_WORKERS];
+static int s_preloadWorkerCount = 0;
+static bool s_preloadCancelAll = false;
+static int s_preloadDone, s_preloadTotal;	// since the pool last went idle, for the progress messages
+static DWORD s_preloadStartTime;
+
+static void Preload_MP3_Init_Pool(void)
+{
+	if(!s_preloadWorkerCount)
+	{
+		SYSTEM_INFO systemInfo;
+		GetSystemInfo(&systemInfo);
+
+		// leave a core for the emulator
+		s_preloadWorkerCount = systemInfo.dwNumberOfProcessors - 1;
+		if(s_preloadWorkerCount < 1) s_preloadWorkerCount = 1;
+		if(s_preloadWorkerCount > PRELOAD_MAX_WORKERS) s_preloadWorkerCount = PRELOAD_MAX_WORKERS;
+		s_preloadThrottle = (systemInfo.dwNumberOfProcessors < 2);
+
+		for(int i = 0; i < PRELOAD_MAX_WORKERS; i++)
+			s_preloadWorkers[i].track = -1;
+	}
+}
+
 DWORD Preload_MP3_Thread(LPVOID lpThreadParameter)
 {
+	PreloadMP3Worker& worker = s_preloadWorkers[(INT_PTR) lpThreadParameter];
+
 	for(;;)
 	{
 		ENTER_CRIT_SECT
 		if(preloadMP3ThreadArgs.empty())
 		{
-			s_preloadingMP3Thread = NULL;
-			noTracksQueued = 1;
+			int i;
+
+			::CloseHandle(worker.thread);
+			worker.thread = NULL;
+			worker.track = -1;
+
+			for(i = 0; i < s_preloadWorkerCount && !s_preloadWorkers[i].thread; i++);
+			if(i == s_preloadWorkerCount)
+				noTracksQueued = 1; // the last one out
 			return 0;
 		}
-		curThreadArgs = preloadMP3ThreadArgs.back();
+		worker.track = preloadMP3ThreadArgs.back().track;
+		worker.cancel = false;
 		preloadMP3ThreadArgs.pop_back();
 		EXIT_CRIT_SECT
 
-		Preload_MP3_Synchronous(curThreadArgs.filePtr, curThreadArgs.track);
+		Preload_MP3_Synchronous(worker.track, &worker.cancel);
 
 		ENTER_CRIT_SECT
-		if(Preload_MP3_Synchronous_Cancel)
+		if(worker.cancel)
+		{
+			// pushed aside for a track that's needed right now, carry on with this one after it
+			if(!s_preloadCancelAll)
+			{
+				PreloadMP3ThreadArg args = {worker.track};
+				preloadMP3ThreadArgs.insert(preloadMP3ThreadArgs.end() - (preloadMP3ThreadArgs.empty() ? 0 : 1), args);
+			}
+		}
+		else if(mp3Cache[worker.track].complete)
 		{
-			if(!preloadMP3ThreadArgs.empty()
-			&& preloadMP3ThreadArgs.back().track != curThreadArgs.track
-			&& Preload_MP3_Synchronous_Cancel_Exception >= 0)
-				preloadMP3ThreadArgs.insert(preloadMP3ThreadArgs.end()-1, curThreadArgs);
-			Preload_MP3_Synchronous_Cancel = false;
+			char msg [256];
+			if(++s_preloadDone < s_preloadTotal)
+				sprintf(msg, "Loaded track %02d MP3 (%d of %d)", worker.track+1, s_preloadDone, s_preloadTotal);
+			else
+				sprintf(msg, "Loaded %d MP3 tracks in %.1f seconds", s_preloadDone, (timeGetTime() - s_preloadStartTime) / 1000.0f);
+			Put_Info_NonImmediate(msg, 100);
 		}
-		curThreadArgs.filePtr = NULL;
-		curThreadArgs.track = -1;
+		worker.track = -1;
 		EXIT_CRIT_SECT
 	}
 }
 
-void Preload_MP3(FILE** filePtr, int track)
+// call with the lock held
+static bool Preload_MP3_Queued(int track)
 {
-	if(!filePtr || *filePtr || Tracks[track].Type != TYPE_MP3)
-		return;
+	for(int i = 0; i < s_preloadWorkerCount; i++)
+		if(s_preloadWorkers[i].track == track)
+			return true;
+	for(unsigned int i = 0; i < preloadMP3ThreadArgs.size(); i++)
+		if(preloadMP3ThreadArgs[i].track == track)
+			return true;
+	return false;
+}
 
-	ENTER_CRIT_SECT
-	if(!noTracksQueued)
+// call with the lock held, after queueing something, starts the progress count over if the pool was idle
+static void Preload_MP3_Start_Workers(void)
+{
+	if(noTracksQueued)
 	{
-		if(track == curThreadArgs.track)
-			return;
-		Preload_MP3_Synchronous_Cancel_Exception = track;
-		Preload_MP3_Synchronous_Cancel = true; // start loading this one immediately
+		s_preloadDone = 0;
+		s_preloadTotal = 0;
+		s_preloadStartTime = timeGetTime();
 	}
-	if(preloadMP3ThreadArgs.empty() || track != preloadMP3ThreadArgs.back().track)
+	noTracksQueued = 0;
+
+	unsigned int idle = preloadMP3ThreadArgs.size();
+	for(int i = 0; i < s_preloadWorkerCount && idle; i++)
 	{
-		PreloadMP3ThreadArg args = {filePtr, track};
-		preloadMP3ThreadArgs.push_back(args);
+		if(!s_preloadWorkers[i].thread)
+		{
+			s_preloadWorkers[i].track = -1;
+			s_preloadWorkers[i].thread = ::CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) Preload_MP3_Thread, (LPVOID) (INT_PTR) i, CREATE_SUSPENDED, NULL);
+			if(s_preloadWorkers[i].thread)
+			{
+				::SetThreadPriority(s_preloadWorkers[i].thread, THREAD_PRIORITY_LOWEST);
+				::ResumeThread(s_preloadWorkers[i].thread);
+			}
+			idle--;
+		}
+		else if(s_preloadWorkers[i].track < 0)
+		{
+			idle--;
+		}
 	}
-	noTracksQueued = 0;
+}
+
+static bool MP3_Preload_Pending(int track)
+{
+	bool pending;
+
+	ENTER_CRIT_SECT
+	pending = Preload_MP3_Queued(track);
 	EXIT_CRIT_SECT
 
-	if(!s_preloadingMP3Thread)
+	return pending;
+}
+
+// decodes this track before anything else
+void Preload_MP3(int track)
+{
+	if(mp3Cache[track].complete || Tracks[track].Type != TYPE_MP3)
+		return;
+
+	MP3_Cache_Make_Room(track);
+
+	ENTER_CRIT_SECT
+	Preload_MP3_Init_Pool();
+
+	int i, busy = 0;
+	for(i = 0; i < s_preloadWorkerCount; i++)
+	{
+		if(s_preloadWorkers[i].track == track)
+			return; // already on it
+		if(s_preloadWorkers[i].thread && s_preloadWorkers[i].track >= 0)
+			busy++;
+	}
+
+	// to the back of the queue, so it's what gets decoded next
+	for(i = preloadMP3ThreadArgs.size() - 1; i >= 0; i--)
+		if(preloadMP3ThreadArgs[i].track == track)
+			break;
+	bool isNew = (i < 0);
+	if(!isNew)
+		preloadMP3ThreadArgs.erase(preloadMP3ThreadArgs.begin() + i);
+
+	PreloadMP3ThreadArg args = {track};
+	preloadMP3ThreadArgs.push_back(args);
+
+	if(busy == s_preloadWorkerCount)
 	{
-		s_preloadingMP3Thread = ::CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) Preload_MP3_Thread, (LPVOID) NULL, CREATE_SUSPENDED, NULL);
-		::SetThreadPriority(s_preloadingMP3Thread, THREAD_PRIORITY_LOWEST);
-		::ResumeThread(s_preloadingMP3Thread);
+		// no free worker, interrupt one, it carries on with its track afterwards
+		for(i = 0; i < s_preloadWorkerCount && s_preloadWorkers[i].cancel; i++);
+		if(i < s_preloadWorkerCount)
+			s_preloadWorkers[i].cancel = true;
 	}
+
+	Preload_MP3_Start_Workers();
+	if(isNew)
+		s_preloadTotal++;
+	EXIT_CRIT_SECT
 }
 
+// queues every MP3 track the CD uses, as far as they fit in the cache,
+// the tracks a movie needs first, then the smallest files
 void Preload_Used_MP3s(void)
 {
+	std::vector<PreloadMP3ThreadArg> tracks;
+	LONG planned = mp3CacheBytes;
 	int track;
-	for(track = 0; track < 100; track++)
-		if(preloaded_tracks[track] > 1)
-			Preload_MP3(&Tracks[track].F_decoded, track);
-
-	ENTER_CRIT_SECT
 
-	// sort so that the smallest MP3 files load first
-
-	for(unsigned int i = 0; i < preloadMP3ThreadArgs.size(); i++)
+	for(track = 0; track < 100; track++)
 	{
-		const char* filename = Tracks[preloadMP3ThreadArgs[i].track].filename;
+		if(Tracks[track].Type != TYPE_MP3 || mp3Cache[track].complete)
+			continue;
+
+		PreloadMP3ThreadArg args = {track, 0};
+		const char* filename = Tracks[track].filename;
 		FILE* file;
-		if(filename && filename[0] && (file = fopen(filename, "rb")))
+		if(preloaded_tracks[track] > 1)
 		{
-			fseek(file, 0, SEEK_END);
-			preloadMP3ThreadArgs[i].sortPriority = ftell(file);
-			fclose(file);
+			args.sortPriority = -1;
 		}
-		else
+		else if(filename[0] && (file = fopen(filename, "rb")))
 		{
-			preloadMP3ThreadArgs[i].sortPriority = 0;
+			fseek(file, 0, SEEK_END);
+			args.sortPriority = ftell(file);
+			fclose(file);
 		}
+		tracks.push_back(args);
+	}
+
+	// the smallest priority value ends up at the back, which is decoded first
+	std::sort(tracks.begin(), tracks.end());
+
+	ENTER_CRIT_SECT
+	Preload_MP3_Init_Pool();
+
+	std::vector<PreloadMP3ThreadArg> queue;
+	for(int i = tracks.size() - 1; i >= 0; i--)
+	{
+		LONG needed = Tracks[tracks[i].track].Length * 588*4 - mp3Cache[tracks[i].track].size;
+
+		// the rest get decoded when they're played
+		if(planned + needed > MP3_CACHE_BUDGET && tracks[i].sortPriority >= 0)
+			continue;
+		if(Preload_MP3_Queued(tracks[i].track))
+			continue;
+
+		planned += needed;
+		queue.insert(queue.begin(), tracks[i]);
 	}
-	std::sort(preloadMP3ThreadArgs.begin(), preloadMP3ThreadArgs.end());
 
+	if(!queue.empty())
+	{
+		// after anything already queued, which was asked for more urgently
+		preloadMP3ThreadArgs.insert(preloadMP3ThreadArgs.begin(), queue.begin(), queue.end());
+		Preload_MP3_Start_Workers();
+		s_preloadTotal += queue.size();
+	}
 	EXIT_CRIT_SECT
 }
 
 #else // no support for threaded MP3 loading on this platform
 
-void Preload_MP3(FILE** filePtr, int track)
+static bool MP3_Preload_Pending(int track)
 {
-	Preload_MP3_Synchronous(filePtr, track);
+	return false;
+}
+
+void Preload_MP3(int track)
+{
+	if(mp3Cache[track].complete || Tracks[track].Type != TYPE_MP3)
+		return;
+
+	MP3_Cache_Make_Room(track);
+	Preload_MP3_Synchronous(track, NULL);
 }
 
 void Preload_Used_MP3s(void)
@@ -544,75 +784,62 @@ void Preload_Used_MP3s(void)
 	int track;
 	for(track = 0; track < 100; track++)
 		if(preloaded_tracks[track])
-			Preload_MP3(&Tracks[track].F_decoded, track);
+			Preload_MP3(track);
 }
 
 #endif
 
 void MP3_CancelAllPreloading(void)
 {
+#ifdef _WIN32
 	while(!noTracksQueued)
 	{
-		Preload_MP3_Synchronous_Cancel_Exception = -1;
-		Preload_MP3_Synchronous_Cancel = true;
-#ifdef _WIN32
 		ENTER_CRIT_SECT
+		s_preloadCancelAll = true;
 		preloadMP3ThreadArgs.clear();
+		for(int i = 0; i < s_preloadWorkerCount; i++)
+			s_preloadWorkers[i].cancel = true;
 		EXIT_CRIT_SECT
 		Sleep(10);
-#endif
 	}
+	s_preloadCancelAll = false;
+#endif
 }
 
-FILE* GetMP3TrackFile(int trackIndex, int* pDontLeaveFileOpen, int* pWhere_read)
+int MP3_Read_Decoded(int trackIndex, char* buf)
 {
-	FILE* decodedFile = Tracks[trackIndex].F_decoded;
-	int usePartiallyDecodedFile = 0;
-	char str [1024];
-
 	int curTrack = LBA_to_Track(SCD.Cur_LBA);
 	int lbaOffset = SCD.Cur_LBA - Track_to_LBA(curTrack);
-	int lba = lbaOffset;
-	int outRead = 0;
-	int forceNoDecode = 0;
-
-	int& where_read = *pWhere_read;
-	where_read = (lba) * 588*4 + 16;
+	int where_read = lbaOffset * 588*4 + 16;
+	int ok = 0;
 	if(where_read < 0) where_read = 0;
 
+	if(MP3_Cache_Read(trackIndex, where_read, buf, 588*4))
+		return 1;
+
 #ifdef _WIN32
-	if(!decodedFile)
+	if(!mp3Cache[trackIndex].complete)
 	{
 		Waiting_For_Preload_MP3_Synchronous = true;
-		Preload_MP3(&Tracks[trackIndex].F_decoded, trackIndex);
+		Preload_MP3(trackIndex);
 
 		DWORD tgtime = timeGetTime(); //Modif N - give frame advance sound:
 		bool soundCleared = false;
 
-		sprintf(str, "%s/" PRELOADED_MP3_DIRECTORY PRELOADED_MP3_FILENAME, Gens_Path, trackIndex+1);
-		while(!usePartiallyDecodedFile)
+		for(;;)
 		{
-			if(!decodedFile)
-				decodedFile = fopen(str, "rb");
-			if(decodedFile)
-			{
-				int decodedSize;
-				fseek(decodedFile, 0, SEEK_END);
-				decodedSize = ftell(decodedFile);
-				if(decodedSize >= where_read + 588*4)
-					usePartiallyDecodedFile = 1;
-			}
-			if(!usePartiallyDecodedFile && noTracksQueued)
+			// checked before reading, so samples decoded right before the preload ends aren't missed
+			bool done = noTracksQueued || mp3Cache[trackIndex].complete;
+
+			if(MP3_Cache_Read(trackIndex, where_read, buf, 588*4))
 			{
-				if(decodedFile)
-					fclose(decodedFile);
-				decodedFile = NULL;
+				ok = 1;
 				break;
 			}
-#ifdef _WIN32
-			if(!usePartiallyDecodedFile)
-				Sleep(5);
-#endif // win32
+			if(done)
+				break;
+
+			Sleep(5);
 
 			if(!soundCleared && timeGetTime() - tgtime >= 125) //eliminate stutter
 			{
@@ -621,14 +848,11 @@ FILE* GetMP3TrackFile(int trackIndex, int* pDontLeaveFileOpen, int* pWhere_read)
 				soundCleared = true;
 			}
 		}
-		if(!decodedFile)
-			decodedFile = Tracks[trackIndex].F_decoded;
 		Waiting_For_Preload_MP3_Synchronous = false;
 	}
 #endif // threaded
 
-	*pDontLeaveFileOpen = usePartiallyDecodedFile;
-	return decodedFile;
+	return ok;
 }
 
 int MP3_Play(int track, int lba_pos, int async)
@@ -647,12 +871,17 @@ int MP3_Play(int track, int lba_pos, int async)
 	if(!IsAsyncAllowed())
 		async = 0;
 
+#ifdef _WIN32
+	// the worker pool decodes it first, even when it's going to be streamed until then
+	Preload_MP3(Track_Played);
+#else
 	if(!async)
 	{
-		Preload_MP3(&Tracks[Track_Played].F_decoded, Track_Played);
+		Preload_MP3(Track_Played);
 	}
+#endif
 
-	if(async && !Tracks[Track_Played].F_decoded)
+	if(async && !mp3Cache[Track_Played].complete)
 	{
 		// start playing MP3 "asynchronously", decoding on the fly... but it won't reliably produce the same sound samples under the same circumstances
 		Current_IN_Pos = MP3_Find_Frame(Tracks[Track_Played].F, lba_pos);
@@ -14,7 +14,7 @@ int MP3_Find_Frame(FILE *f, int pos_wanted);
 int MP3_Play(int track, int lba_pos, int async);
 int MP3_Update(char *buf, int *rate, int *channel, unsigned int length_dest); // returns number of bytes written to buf
 void MP3_Test(FILE* f);
-FILE* GetMP3TrackFile(int trackIndex, int* pDontLeaveFileOpen, int* pWhere_read);
+int MP3_Read_Decoded(int trackIndex, char* buf); // copies the current sector of a preloaded MP3 track, returns 0 if it isn't decoded
 void MP3_CancelAllPreloading(void);
 
 
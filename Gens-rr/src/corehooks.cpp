@@ -2,6 +2,7 @@
 #include "ggenie.h"
 #include "corehooks.h"
 #include "tracer.h"
+#include "coverage.h"
 
 extern "C" {
 	 uint32 hook_address;
@@ -50,10 +51,14 @@ defvramhooks(word)
 void hook_exec()
 {
 	hook_pc &= 0xFFFFFF;
+	if (Coverage_Enabled)
+		Coverage_Hit(Coverage_M68K, hook_pc);
 	GensTrace();
 }
 void hook_exec_cd()
 {
 	hook_pc_cd &= 0xFFFFFF;
+	if (Coverage_Enabled)
+		Coverage_Hit(Coverage_S68K, hook_pc_cd);
 	GensTrace_cd();
 }
\ No newline at end of file
@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "coverage.h"
+#include "movie.h"
+
+bool Coverage_Enabled = false;
+Coverage_Map Coverage_M68K, Coverage_S68K;
+
+static FILE* Coverage_Log = NULL;
+static FILE* Coverage_Log_CD = NULL;
+
+void Coverage_Init(Coverage_Map &map, int addressBits, bool trackNew)
+{
+	map.pageCount = 1 << (addressBits - COVERAGE_PAGE_BITS);
+	map.addressMask = (addressBits < 32) ? ((1u << addressBits) - 1) : 0xFFFFFFFF;
+	map.pages = new unsigned char* [map.pageCount];
+	memset(map.pages, 0, map.pageCount * sizeof(unsigned char*));
+	map.trackNew = trackNew;
+	map.newCode.clear();
+}
+
+void Coverage_Free(Coverage_Map &map)
+{
+	if (!map.pages)
+		return;
+
+	for (unsigned int i = 0; i < map.pageCount; i++)
+		delete [] map.pages[i];
+	delete [] map.pages;
+	map.pages = NULL;
+	map.newCode.clear();
+}
+
+unsigned char* Coverage_Alloc_Page(Coverage_Map &map, unsigned int address)
+{
+	unsigned char* &page = map.pages[(address & map.addressMask) >> COVERAGE_PAGE_BITS];
+	if (!page)
+	{
+		page = new unsigned char[COVERAGE_PAGE_SIZE];
+		memset(page, 0, COVERAGE_PAGE_SIZE);
+	}
+	return page;
+}
+
+unsigned int Coverage_Count(const Coverage_Map &map, unsigned int address)
+{
+	address &= map.addressMask;
+	const unsigned char* page = map.pages[address >> COVERAGE_PAGE_BITS];
+	return page ? page[address & (COVERAGE_PAGE_SIZE - 1)] : 0;
+}
+
+unsigned int Coverage_Covered(const Coverage_Map &map)
+{
+	unsigned int covered = 0;
+	for (unsigned int i = 0; i < map.pageCount; i++)
+	{
+		if (!map.pages[i])
+			continue;
+		for (int j = 0; j < COVERAGE_PAGE_SIZE; j++)
+			covered += (map.pages[i][j] != 0);
+	}
+	return covered;
+}
+
+const char* Coverage_Start(bool segaCD)
+{
+	if (Coverage_Enabled)
+		return NULL;
+
+	Coverage_Log = fopen("./Logs/coverage.log", "a");
+	if (!Coverage_Log)
+		return "Can't open file ./Logs/coverage.log";
+	if (segaCD)
+	{
+		Coverage_Log_CD = fopen("./Logs/coverage_cd.log", "a");
+		if (!Coverage_Log_CD)
+		{
+			fclose(Coverage_Log);
+			Coverage_Log = NULL;
+			return "Can't open file ./Logs/coverage_cd.log";
+		}
+		fprintf(Coverage_Log_CD, "COVERAGE STARTED\n\n");
+	}
+	fprintf(Coverage_Log, "COVERAGE STARTED\n\n");
+
+	Coverage_Init(Coverage_M68K, 24, true);
+	Coverage_Init(Coverage_S68K, 24, true);
+	Coverage_Enabled = true;
+	return NULL;
+}
+
+// the addresses that ran for the first time this frame, in order, 8 to a line
+static void Coverage_Log_New(FILE* log, Coverage_Map &map)
+{
+	if (!map.newCode.empty())
+	{
+		if (log)
+		{
+			std::sort(map.newCode.begin(), map.newCode.end());
+			fprintf(log, "FRAME %u: %u new\n", (unsigned int) FrameCount, (unsigned int) map.newCode.size());
+			for (unsigned int i = 0; i < map.newCode.size(); i++)
+				fprintf(log, "%06X%c", map.newCode[i], (i % 8 == 7 || i + 1 == map.newCode.size()) ? '\n' : ' ');
+		}
+		map.newCode.clear();
+	}
+}
+
+void Coverage_Frame()
+{
+	if (!Coverage_Enabled)
+		return;
+
+	Coverage_Log_New(Coverage_Log, Coverage_M68K);
+	Coverage_Log_New(Coverage_Log_CD, Coverage_S68K);
+}
+
+void Coverage_Stop()
+{
+	if (!Coverage_Enabled)
+		return;
+
+	Coverage_Frame();
+	Coverage_Enabled = false;
+
+	fprintf(Coverage_Log, "\nCOVERAGE STOPPED: %u addresses\n\n", Coverage_Covered(Coverage_M68K));
+	fclose(Coverage_Log);
+	Coverage_Log = NULL;
+	if (Coverage_Log_CD)
+	{
+		fprintf(Coverage_Log_CD, "\nCOVERAGE STOPPED: %u addresses\n\n", Coverage_Covered(Coverage_S68K));
+		fclose(Coverage_Log_CD);
+		Coverage_Log_CD = NULL;
+	}
+
+	Coverage_Free(Coverage_M68K);
+	Coverage_Free(Coverage_S68K);
+}
@@ -0,0 +1,59 @@
+#ifndef COVERAGE_H
+#define COVERAGE_H
+
+#include <vector>
+
+// code coverage: how many times (saturating at 255) an instruction started at each address,
+// kept in 4 KB pages that are only allocated once code runs in them, so a whole 24 or 32 bit address space costs
+// a page table plus the pages actually used. the tracer's spam filter (Trace Limit) counts with one as well.
+//
+// Tools > Trace > Code Coverage feeds one map per 68000 from every instruction it runs, and after each frame
+// appends the addresses that ran for the first time to ./Logs/coverage.log (./Logs/coverage_cd.log for the Sega CD),
+// which makes a running list of the code a movie or a play session has reached.
+
+#define COVERAGE_PAGE_BITS 12
+#define COVERAGE_PAGE_SIZE (1 << COVERAGE_PAGE_BITS)
+
+struct Coverage_Map
+{
+	unsigned char** pages;
+	unsigned int pageCount;
+	unsigned int addressMask;
+	bool trackNew;
+	std::vector<unsigned int> newCode; // addresses run for the first time, if trackNew
+};
+
+void Coverage_Init(Coverage_Map &map, int addressBits, bool trackNew);
+void Coverage_Free(Coverage_Map &map);
+unsigned char* Coverage_Alloc_Page(Coverage_Map &map, unsigned int address);
+unsigned int Coverage_Count(const Coverage_Map &map, unsigned int address);
+unsigned int Coverage_Covered(const Coverage_Map &map); // how many addresses ran at least once
+
+// counts one more run at address, returns the count from before
+static inline unsigned int Coverage_Hit(Coverage_Map &map, unsigned int address)
+{
+	address &= map.addressMask;
+	unsigned char* page = map.pages[address >> COVERAGE_PAGE_BITS];
+	if (!page)
+		page = Coverage_Alloc_Page(map, address);
+
+	unsigned char* count = page + (address & (COVERAGE_PAGE_SIZE - 1));
+	unsigned int prev = *count;
+	if (prev < 255)
+	{
+		*count = prev + 1;
+		if (!prev && map.trackNew)
+			map.newCode.push_back(address);
+	}
+	return prev;
+}
+
+// Tools > Trace > Code Coverage
+extern bool Coverage_Enabled;
+extern Coverage_Map Coverage_M68K, Coverage_S68K;
+
+const char* Coverage_Start(bool segaCD); // returns an error message, or NULL
+void Coverage_Stop();
+void Coverage_Frame(); // call once after every emulated frame
+
+#endif
@@ -0,0 +1,307 @@
+#include <windows.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "headless.h"
+#include "gens.h"
+#include "G_main.h"
+#include "G_ddraw.h"
+#include "G_dsound.h"
+#include "save.h"
+#include "movie.h"
+#include "rewind.h"
+#include "synclog.h"
+#include "Rom.h"
+#include "io.h"
+#include "mem_M68K.h"
+#include "mem_Z80.h"
+
+int Headless_Exit_Code = -1;
+
+extern "C" int disableSound2;
+extern void UpdateLagCount();
+
+#if ((!defined SONICMAPHACK) && (!defined SONICROUTEHACK))
+#define Update_RAM_Cheats();
+#else
+#include "SonicHackSuite.h"
+#endif
+
+#define HEADLESS_HASH_SEED 14695981039346656037ULL // FNV-1a
+#define HEADLESS_HASH_PRIME 1099511628211ULL
+
+ALIGN16 static unsigned char s_headlessStateBuffer[MAX_STATE_FILE_LENGTH];
+
+unsigned __int64 Headless_Hash(const unsigned char* data, int length, unsigned __int64 hash)
+{
+	for(int i = 0; i < length; i++)
+		hash = (hash ^ data[i]) * HEADLESS_HASH_PRIME;
+	return hash;
+}
+
+// the same per-frame sequence as the frame skipping branch of Update_Emulation,
+// minus everything that only exists for the user (sound buffers, AVI, RAM search, Lua, sleeping)
+static void Headless_Frame()
+{
+	MoviePlayingStuff();
+	FrameCount++;
+	Lag_Frame = 1;
+	Update_Frame_Fast();
+	Update_RAM_Cheats();
+	UpdateLagCount();
+}
+
+int Headless_Verify(const char* movieName, const char* resultsName)
+{
+	Headless_Exit_Code = 1; // from now on this is a verification run, whatever happens to the ROM
+	ShowWindow(HWnd, SW_HIDE);
+	Clear_Sound_Buffer();
+
+	const char* error = NULL;
+	if(!Game)
+		error = "no ROM loaded";
+	else
+		error = GensPlayMovie(movieName, true);
+	if(!error && MainMovie.Status != MOVIE_PLAYING)
+		error = "could not start playback";
+
+	// reaching the end of the movie must not ask anything, and nothing else should cost time per frame
+	bool autoCloseMovie = AutoCloseMovie;
+	int rewindEnable = Rewind_Enable;
+	AutoCloseMovie = true;
+	Rewind_Enable = 0;
+	disableSound2 = true;
+
+	unsigned long movieFrames = error ? 0 : MainMovie.LastFrame;
+	bool syncLogActive = SyncLog_Active();
+	DWORD startTime = timeGetTime();
+	while(!error && MainMovie.Status == MOVIE_PLAYING)
+		Headless_Frame();
+	DWORD elapsed = timeGetTime() - startTime;
+
+	disableSound2 = false;
+	AutoCloseMovie = autoCloseMovie;
+	Rewind_Enable = rewindEnable;
+
+	char line[1024];
+	if(error)
+	{
+		sprintf(line, "%s\terror: %s", movieName, error);
+	}
+	else
+	{
+		int length = Save_State_To_Buffer(s_headlessStateBuffer);
+		unsigned __int64 stateHash = Headless_Hash(s_headlessStateBuffer, length, HEADLESS_HASH_SEED);
+		unsigned __int64 ramHash = Headless_Hash(Ram_68k, sizeof(Ram_68k), HEADLESS_HASH_SEED);
+		ramHash = Headless_Hash(Ram_Z80, sizeof(Ram_Z80), ramHash);
+		sprintf(line, "%s\tframes %lu/%lu\tlag %lu\tstate %016I64X\tram %016I64X\t%.1f fps",
+			movieName, FrameCount, movieFrames, LagCount, stateHash, ramHash,
+			FrameCount * 1000.0 / (elapsed ? elapsed : 1));
+		if(syncLogActive)
+		{
+			strcat(line, "\t");
+			strcat(line, SyncLog_Result());
+		}
+	}
+	bool desynced = SyncLog_Desynced();
+	SyncLog_End();
+
+	FILE* results = resultsName[0] ? fopen(resultsName, "a") : NULL;
+	if(results)
+	{
+		fprintf(results, "%s\n", line);
+		fclose(results);
+	}
+	else
+	{
+		fprintf(stderr, "%s\n", line);
+	}
+
+	return (error || desynced) ? 1 : 0;
+}
+
+int Headless_Run_Processes(const std::vector<std::string>& commandLines, int jobs, std::vector<DWORD>& exitCodes)
+{
+	if(jobs <= 0)
+	{
+		SYSTEM_INFO systemInfo;
+		GetSystemInfo(&systemInfo);
+		jobs = systemInfo.dwNumberOfProcessors;
+	}
+	jobs = max(1, min(jobs, MAXIMUM_WAIT_OBJECTS));
+
+	exitCodes.assign(commandLines.size(), HEADLESS_NOT_STARTED);
+	std::vector<HANDLE> running;
+	std::vector<int> runningIndex;
+	unsigned int next = 0;
+	while(next < commandLines.size() || !running.empty())
+	{
+		while(next < commandLines.size() && (int)running.size() < jobs)
+		{
+			std::vector<char> commandBuffer (commandLines[next].begin(), commandLines[next].end());
+			commandBuffer.push_back(0);
+
+			STARTUPINFO startup = {sizeof(startup)};
+			startup.dwFlags = STARTF_USESHOWWINDOW;
+			startup.wShowWindow = SW_HIDE;
+			PROCESS_INFORMATION info;
+			if(CreateProcess(NULL, &commandBuffer[0], NULL, NULL, FALSE, BELOW_NORMAL_PRIORITY_CLASS, NULL, NULL, &startup, &info))
+			{
+				CloseHandle(info.hThread);
+				running.push_back(info.hProcess);
+				runningIndex.push_back(next);
+			}
+			next++;
+		}
+		if(running.empty())
+			break;
+
+		DWORD which = WaitForMultipleObjects(running.size(), &running[0], FALSE, INFINITE) - WAIT_OBJECT_0;
+		if(which >= running.size())
+			break;
+		DWORD exitCode = 1;
+		GetExitCodeProcess(running[which], &exitCode);
+		CloseHandle(running[which]);
+		exitCodes[runningIndex[which]] = exitCode;
+		running.erase(running.begin() + which);
+		runningIndex.erase(runningIndex.begin() + which);
+	}
+	return jobs;
+}
+
+struct VerifyJob
+{
+	std::string movieName;
+	std::string expectedHash; // empty if the list didn't give one
+	std::string tempName; // where the child process writes its result line
+	std::string result;
+};
+
+static std::string VerifyCommandLine(const VerifyJob& job, const char* exeName, const char* cfgName, const char* romName, bool syncLog)
+{
+	std::string commandLine = std::string("\"") + exeName + "\"";
+	if(cfgName[0])
+		commandLine += std::string(" -cfg \"") + cfgName + "\"";
+	commandLine += std::string(" -rom \"") + romName + "\" -play \"" + job.movieName + "\" -verify \"" + job.tempName + "\"";
+	if(syncLog)
+		commandLine += " -synclog \"" + job.movieName + ".synclog\"";
+	return commandLine;
+}
+
+std::string Headless_Read_Result(const char* tempName)
+{
+	char line[1024] = "";
+	FILE* temp = fopen(tempName, "r");
+	if(temp)
+	{
+		if(!fgets(line, sizeof(line), temp))
+			line[0] = 0;
+		fclose(temp);
+		DeleteFile(tempName);
+	}
+	int length = strlen(line);
+	while(length && (line[length-1] == '\n' || line[length-1] == '\r'))
+		line[--length] = 0;
+	return line;
+}
+
+// collects the result line the child process wrote, and checks it against the expected hash
+static bool FinishVerifyJob(VerifyJob& job, DWORD exitCode)
+{
+	char line[1024];
+	if(exitCode == HEADLESS_NOT_STARTED)
+	{
+		job.result = job.movieName + "\terror: could not start a verification process";
+		return false;
+	}
+	strcpy(line, Headless_Read_Result(job.tempName.c_str()).c_str());
+	if(!line[0])
+	{
+		sprintf(line, "%s\terror: exited with code 0x%X", job.movieName.c_str(), exitCode);
+		job.result = line;
+		return false;
+	}
+	job.result = line;
+	if(exitCode != 0)
+		return false;
+	if(job.expectedHash.empty())
+		return true;
+	if(job.result.find("state " + job.expectedHash) != std::string::npos)
+	{
+		job.result += "\tok";
+		return true;
+	}
+	job.result += "\tDESYNC (expected state " + job.expectedHash + ")";
+	return false;
+}
+
+int Headless_Verify_List(const char* cfgName, const char* romName, const char* listName, const char* resultsName, int jobs, bool syncLogs)
+{
+	Headless_Exit_Code = 1;
+	ShowWindow(HWnd, SW_HIDE);
+
+	std::vector<VerifyJob> queue;
+	FILE* list = fopen(listName, "r");
+	if(list)
+	{
+		char line[1024];
+		while(fgets(line, sizeof(line), list))
+		{
+			char* end = line + strlen(line);
+			while(end > line && (end[-1] == '\n' || end[-1] == '\r' || end[-1] == ' '))
+				*--end = 0;
+			if(!line[0] || line[0] == '#')
+				continue;
+			VerifyJob job;
+			char* tab = strchr(line, '\t');
+			if(tab)
+			{
+				*tab = 0;
+				job.expectedHash = tab + 1;
+				for(unsigned int i = 0; i < job.expectedHash.size(); i++)
+					job.expectedHash[i] = toupper(job.expectedHash[i]);
+			}
+			job.movieName = line;
+			sprintf(line, "%s.%d.tmp", resultsName[0] ? resultsName : "verify", (int)queue.size());
+			job.tempName = line;
+			queue.push_back(job);
+		}
+		fclose(list);
+	}
+
+	char exeName[MAX_PATH];
+	GetModuleFileName(NULL, exeName, MAX_PATH);
+
+	// every movie runs in its own process, since the emulation core only exists once per process.
+	// they all load the same ROM, config and save files, but being -verify runs none of them writes any back
+	std::vector<std::string> commandLines;
+	for(unsigned int i = 0; i < queue.size(); i++)
+	{
+		DeleteFile(queue[i].tempName.c_str());
+		commandLines.push_back(VerifyCommandLine(queue[i], exeName, cfgName, romName, syncLogs));
+	}
+
+	std::vector<DWORD> exitCodes;
+	DWORD startTime = timeGetTime();
+	jobs = Headless_Run_Processes(commandLines, jobs, exitCodes);
+	DWORD elapsed = timeGetTime() - startTime;
+
+	int failed = 0;
+	for(unsigned int i = 0; i < queue.size(); i++)
+		if(!FinishVerifyJob(queue[i], exitCodes[i]))
+			failed++;
+
+	FILE* results = resultsName[0] ? fopen(resultsName, "a") : stderr;
+	if(results)
+	{
+		for(unsigned int i = 0; i < queue.size(); i++)
+			fprintf(results, "%s\n", queue[i].result.c_str());
+		fprintf(results, "%d movies, %d failed, %d jobs, %.1f seconds\n\n", (int)queue.size(), failed, jobs, elapsed / 1000.0);
+		if(results != stderr)
+			fclose(results);
+	}
+
+	return (failed || queue.empty()) ? 1 : 0;
+}
@@ -0,0 +1,30 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <windows.h>
+#include <string>
+#include <vector>
+
+// batch movie verification: -verify <results file> together with -rom and -play
+// plays the movie back with the window hidden, no sound output, no rendering and no frame timing,
+// appends one line with the final frame/lag counts and state hashes to the results file, then exits.
+// nothing the user keeps is written on the way out: not Gens.cfg, and not the game's SRAM, BRAM or patch file.
+//
+// -movielist <list file> together with -rom and -verify runs one -verify process per movie in the list,
+// up to -jobs at a time (default: one per processor), and writes their result lines to the results file in list order.
+// each list line is a movie filename, optionally followed by a tab and the state hash it is expected to end with.
+// with -synclog, each movie is also checked frame by frame against <movie>.synclog (recorded on the first run).
+
+extern int Headless_Exit_Code; // -1 unless Gens was started with -verify, otherwise the process exit code
+
+int Headless_Verify(const char* movieName, const char* resultsName); // returns 0 if the movie played to the end (in sync with the -synclog, if any), 1 otherwise
+int Headless_Verify_List(const char* cfgName, const char* romName, const char* listName, const char* resultsName, int jobs, bool syncLogs); // returns 0 if every movie played to the end and matched its expected hash
+unsigned __int64 Headless_Hash(const unsigned char* data, int length, unsigned __int64 hash);
+
+// runs every command line as a hidden child process, at most jobs at a time (one per processor if jobs <= 0),
+// and waits for all of them. exitCodes gets each one's exit code, or HEADLESS_NOT_STARTED. returns the number of jobs used.
+#define HEADLESS_NOT_STARTED 0xFFFFFFFF
+int Headless_Run_Processes(const std::vector<std::string>& commandLines, int jobs, std::vector<DWORD>& exitCodes);
+std::string Headless_Read_Result(const char* tempName); // the first line a child process wrote to its results file, which is then deleted
+
+#endif
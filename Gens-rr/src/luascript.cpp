@@ -13,7 +13,13 @@
 #include "io.h"
 #include "ym2612.h"
 #include "resource.h"
+#include "Mem_M68k.h"
+#include "Mem_S68k.h"
+#include "Mem_SH2.h"
+#include "Mem_Z80.h"
+#include "benchmark.h"
 #include <assert.h>
+#include <ctype.h>
 #include <vector>
 #include <map>
 #include <string>
@@ -103,6 +109,8 @@ struct LuaContextInfo {
 	std::vector<std::string> persistVars; // names of the global variables to persist, kept here so their associated values can be output when the script exits
 	LuaSaveData newDefaultData; // data about the default state of persisted global variables, which we save on script exit so we can detect when the default value has changed to make it easier to reset persisted variables
 	unsigned int numMemHooks; // number of registered memory functions (1 per hooked byte)
+	std::map<unsigned int, int> memHooks [LUAMEMHOOK_COUNT]; // hooked address -> registry reference of its function
+	std::map<int, unsigned int> memHookRefCounts; // registry reference -> number of hooked bytes using it
 	// callbacks into the lua window... these don't need to exist per context the way I'm using them, but whatever
 	void(*print)(int uid, const char* str);
 	void(*onstart)(int uid);
@@ -178,18 +186,6 @@ static const char* luaCallIDStrings [] =
 };
 static const int _makeSureWeHaveTheRightNumberOfStrings [sizeof(luaCallIDStrings)/sizeof(*luaCallIDStrings) == LUACALL_COUNT ? 1 : 0];
 
-static const char* luaMemHookTypeStrings [] =
-{
-	"MEMHOOK_WRITE",
-	"MEMHOOK_READ",
-	"MEMHOOK_EXEC",
-
-	"MEMHOOK_WRITE_SUB",
-	"MEMHOOK_READ_SUB",
-	"MEMHOOK_EXEC_SUB",
-};
-static const int _makeSureWeHaveTheRightNumberOfStrings2 [sizeof(luaMemHookTypeStrings)/sizeof(*luaMemHookTypeStrings) == LUAMEMHOOK_COUNT ? 1 : 0];
-
 void StopScriptIfFinished(int uid, bool justReturned = false);
 void SetSaveKey(LuaContextInfo& info, const char* key);
 void SetLoadKey(LuaContextInfo& info, const char* key);
@@ -199,7 +195,7 @@ void RefreshScriptSpeedStatus();
 static char* rawToCString(lua_State* L, int idx=0);
 static const char* toCString(lua_State* L, int idx=0);
 
-static void CalculateMemHookRegions(LuaMemHookType hookType);
+static void RebuildMemHookIndex(LuaMemHookType hookType);
 
 static int memory_registerHook(lua_State* L, LuaMemHookType hookType, int defaultSize)
 {
@@ -228,33 +224,49 @@ static int memory_registerHook(lua_State* L, LuaMemHookType hookType, int defaul
 		luaL_checktype(L, funcIdx, LUA_TFUNCTION);
 	lua_settop(L,funcIdx);
 
-	// get the address-to-callback table for this hook type of the current script
-	lua_getfield(L, LUA_REGISTRYINDEX, luaMemHookTypeStrings[hookType]);
+	// get the address-to-callback map for this hook type of the current script
+	LuaContextInfo& info = GetCurrentInfo();
+	std::map<unsigned int, int>& hooks = info.memHooks[hookType];
 
-	// count how many callback functions we'll be displacing
-	int numFuncsAfter = clearing ? 0 : size;
-	int numFuncsBefore = 0;
-	for(unsigned int i = addr; i != addr+size; i++)
+	// keep one reference to the callback function for all of its address slots
+	int ref = LUA_NOREF;
+	if(!clearing && size)
 	{
-		lua_rawgeti(L, -1, i);
-		if(lua_isfunction(L, -1))
-			numFuncsBefore++;
-		lua_pop(L,1);
+		ref = luaL_ref(L, LUA_REGISTRYINDEX);
+		info.memHookRefCounts[ref] = size;
 	}
 
-	// put the callback function in the address slots
+	// put the callback function in the address slots, counting how many we displace
+	int numFuncsAfter = clearing ? 0 : size;
+	int numFuncsBefore = 0;
 	for(unsigned int i = addr; i != addr+size; i++)
 	{
-		lua_pushvalue(L, -2);
-		lua_rawseti(L, -2, i);
+		std::map<unsigned int, int>::iterator found = hooks.find(i);
+		if(found != hooks.end())
+		{
+			numFuncsBefore++;
+			std::map<int, unsigned int>::iterator refCount = info.memHookRefCounts.find(found->second);
+			if(refCount != info.memHookRefCounts.end() && --refCount->second == 0)
+			{
+				luaL_unref(L, LUA_REGISTRYINDEX, found->second);
+				info.memHookRefCounts.erase(refCount);
+			}
+			if(clearing)
+				hooks.erase(found);
+			else
+				found->second = ref;
+		}
+		else if(!clearing)
+		{
+			hooks[i] = ref;
+		}
 	}
 
 	// adjust the count of active hooks
-	LuaContextInfo& info = GetCurrentInfo();
 	info.numMemHooks += numFuncsAfter - numFuncsBefore;
 
-	// re-cache regions of hooked memory across all scripts
-	CalculateMemHookRegions(hookType);
+	// re-index hooked memory across all scripts
+	RebuildMemHookIndex(hookType);
 
 	StopScriptIfFinished(luaStateToUIDMap[L]);
 	return 0;
@@ -2110,6 +2122,220 @@ DEFINE_LUA_FUNCTION(memory_isvalid, "address")
 	return 1;
 }
 
+// memory views read emulated RAM in place, without going through ReadValueAtHardwareAddress,
+// so HUD scripts can fetch many values per frame for the price of one Lua call each (or one in total with gather)
+struct LuaMemoryView
+{
+	const char* name;
+	unsigned int start; // hardware address of the first byte
+	unsigned int size;
+	bool byteSwapped; // stored as little-endian words
+	unsigned char* (*data)(); // NULL while the memory doesn't exist
+};
+static unsigned char* MemoryViewData68k() { return Ram_68k; }
+static unsigned char* MemoryViewDataZ80() { return Ram_Z80; }
+static unsigned char* MemoryViewDataPrg() { return SegaCD_Started ? Ram_Prg : NULL; }
+static unsigned char* MemoryViewData32X() { return _32X_Started ? _32X_Ram : NULL; }
+static const LuaMemoryView memoryViews [] =
+{
+	{"68k", 0xFF0000, sizeof(Ram_68k), true, MemoryViewData68k},
+	{"z80", 0xA00000, sizeof(Ram_Z80), true, MemoryViewDataZ80},
+	{"prg", 0x020000, sizeof(Ram_Prg), true, MemoryViewDataPrg},
+	{"32x", 0x06000000, sizeof(_32X_Ram), false, MemoryViewData32X},
+};
+
+// negative sizes mean signed values
+static __forceinline void PushMemoryValue(lua_State* L, unsigned int value, int size)
+{
+	switch(size)
+	{
+		case 1: lua_pushinteger(L, (unsigned char)value); break;
+		case -1: lua_pushinteger(L, (signed char)value); break;
+		case 2: lua_pushinteger(L, (unsigned short)value); break;
+		case -2: lua_pushinteger(L, (signed short)value); break;
+		case 4: lua_pushnumber(L, value); break; // can't use pushinteger in this case (out of range)
+		default: lua_pushinteger(L, (signed long)value); break;
+	}
+}
+static __forceinline unsigned int ReadMemoryView(const unsigned char* data, unsigned int offset, unsigned int size, bool byteSwapped)
+{
+	unsigned int swap = byteSwapped ? 1 : 0;
+	unsigned int value = 0;
+	for(unsigned int i = offset; i != offset+size; i++)
+		value = (value << 8) | data[i ^ swap];
+	return value;
+}
+
+static const LuaMemoryView& CheckMemoryView(lua_State* L, int idx)
+{
+	return **(const LuaMemoryView**)luaL_checkudata(L, idx, "MemoryView");
+}
+// returns the view's memory and sets offset to where address is in it, or raises an error
+static const unsigned char* CheckMemoryViewRange(lua_State* L, const LuaMemoryView& view, unsigned int address, unsigned int size, unsigned int& offset)
+{
+	if((address & ~0xFFFFFF) == ~0xFFFFFF)
+		address &= 0xFFFFFF;
+	offset = address - view.start;
+	if(offset >= view.size || view.size - offset < size)
+		luaL_error(L, "address 0x%X is outside of the %s memory view", address, view.name);
+	const unsigned char* data = view.data();
+	if(!data)
+		luaL_error(L, "%s memory is not available right now", view.name);
+	return data;
+}
+
+static int MemoryViewRead(lua_State* L, int size)
+{
+	const LuaMemoryView& view = CheckMemoryView(L, 1);
+	unsigned int address = luaL_checkinteger(L,2);
+	unsigned int offset;
+	const unsigned char* data = CheckMemoryViewRange(L, view, address, abs(size), offset);
+	PushMemoryValue(L, ReadMemoryView(data, offset, abs(size), view.byteSwapped), size);
+	return 1;
+}
+DEFINE_LUA_FUNCTION(memoryview_readbyte, "address") { return MemoryViewRead(L, 1); }
+DEFINE_LUA_FUNCTION(memoryview_readbytesigned, "address") { return MemoryViewRead(L, -1); }
+DEFINE_LUA_FUNCTION(memoryview_readword, "address") { return MemoryViewRead(L, 2); }
+DEFINE_LUA_FUNCTION(memoryview_readwordsigned, "address") { return MemoryViewRead(L, -2); }
+DEFINE_LUA_FUNCTION(memoryview_readdword, "address") { return MemoryViewRead(L, 4); }
+DEFINE_LUA_FUNCTION(memoryview_readdwordsigned, "address") { return MemoryViewRead(L, -4); }
+
+// struct-style format characters: B/b byte, H/h word, I/i (or L/l) dword, x skipped byte,
+// upper case is unsigned, lower case is signed, and a number in front repeats the next character
+static int MemoryFormatSize(char c)
+{
+	switch(c)
+	{
+		case 'B': case 'x': return 1;
+		case 'b': return -1;
+		case 'H': return 2;
+		case 'h': return -2;
+		case 'I': case 'L': return 4;
+		case 'i': case 'l': return -4;
+	}
+	return 0;
+}
+DEFINE_LUA_FUNCTION(memoryview_unpack, "address,format")
+{
+	const LuaMemoryView& view = CheckMemoryView(L, 1);
+	unsigned int address = luaL_checkinteger(L,2);
+	const char* format = luaL_checkstring(L,3);
+
+	// measure first so the whole range gets checked once
+	unsigned int total = 0;
+	int count = 0;
+	for(const char* f = format; *f; f++)
+	{
+		unsigned long repeat = 1;
+		if(isdigit((unsigned char)*f))
+			repeat = strtoul(f, (char**)&f, 10);
+		if(!*f)
+			luaL_error(L, "format \"%s\" ends with a repeat count", format);
+		int size = MemoryFormatSize(*f);
+		if(!size)
+			luaL_error(L, "invalid format character '%c'", *f);
+		if(repeat > view.size || (total += repeat * abs(size)) > view.size)
+			luaL_error(L, "format \"%s\" is larger than the %s memory view", format, view.name);
+		if(*f != 'x')
+			count += repeat;
+	}
+
+	unsigned int offset;
+	const unsigned char* data = CheckMemoryViewRange(L, view, address, total, offset);
+	luaL_checkstack(L, count, "too many values to unpack");
+	for(const char* f = format; *f; f++)
+	{
+		unsigned long repeat = 1;
+		if(isdigit((unsigned char)*f))
+			repeat = strtoul(f, (char**)&f, 10);
+		int size = MemoryFormatSize(*f);
+		for(; repeat; repeat--, offset += abs(size))
+			if(*f != 'x')
+				PushMemoryValue(L, ReadMemoryView(data, offset, abs(size), view.byteSwapped), size);
+	}
+	return count;
+}
+
+// reads a flat list of address,size pairs into the (optionally given) result array,
+// through the view if there is one or anywhere memory.readbyte etc. can read otherwise
+static int MemoryGather(lua_State* L, const LuaMemoryView* view, int listIdx)
+{
+	luaL_checktype(L, listIdx, LUA_TTABLE);
+	int n = lua_objlen(L, listIdx);
+	if(n & 1)
+		luaL_error(L, "gather list must hold address,size pairs");
+	if(lua_istable(L, listIdx+1))
+		lua_settop(L, listIdx+1);
+	else
+	{
+		lua_settop(L, listIdx);
+		lua_createtable(L, n/2, 0);
+	}
+	for(int i = 1, j = 1; i <= n; i += 2, j++)
+	{
+		lua_rawgeti(L, listIdx, i);
+		lua_rawgeti(L, listIdx, i+1);
+		unsigned int address = lua_tointeger(L, -2);
+		int size = lua_tointeger(L, -1);
+		lua_pop(L, 2);
+		if(size != 1 && size != 2 && size != 4 && size != -1 && size != -2 && size != -4)
+			luaL_error(L, "invalid size %d for address 0x%X (must be 1, 2 or 4, negative for signed)", size, address);
+
+		unsigned int value;
+		if(view)
+		{
+			unsigned int offset;
+			const unsigned char* data = CheckMemoryViewRange(L, *view, address, abs(size), offset);
+			value = ReadMemoryView(data, offset, abs(size), view->byteSwapped);
+		}
+		else
+		{
+			value = ReadValueAtHardwareAddress(address, abs(size));
+		}
+		PushMemoryValue(L, value, size);
+		lua_rawseti(L, -2, j);
+	}
+	return 1;
+}
+DEFINE_LUA_FUNCTION(memoryview_gather, "list[,result]")
+{
+	const LuaMemoryView& view = CheckMemoryView(L, 1);
+	return MemoryGather(L, &view, 2);
+}
+DEFINE_LUA_FUNCTION(memory_gather, "list[,result]")
+{
+	return MemoryGather(L, NULL, 1);
+}
+
+DEFINE_LUA_FUNCTION(memoryview_len, "")
+{
+	lua_pushinteger(L, CheckMemoryView(L, 1).size);
+	return 1;
+}
+DEFINE_LUA_FUNCTION(memoryview_tostring, "")
+{
+	const LuaMemoryView& view = CheckMemoryView(L, 1);
+	lua_pushfstring(L, "memory view %s (%d bytes)", view.name, (int)view.size);
+	return 1;
+}
+
+DEFINE_LUA_FUNCTION(memory_view, "[region]")
+{
+	const char* name = luaL_optstring(L, 1, "68k");
+	for(int i = 0; i < sizeof(memoryViews)/sizeof(*memoryViews); i++)
+	{
+		if(!stricmp(name, memoryViews[i].name))
+		{
+			*(const LuaMemoryView**)lua_newuserdata(L, sizeof(LuaMemoryView*)) = &memoryViews[i];
+			luaL_getmetatable(L, "MemoryView");
+			lua_setmetatable(L, -2);
+			return 1;
+		}
+	}
+	luaL_error(L, "unknown memory view \"%s\" (valid views are 68k, z80, prg and 32x)", name);
+	return 0;
+}
+
 struct registerPointerMap
 {
 	const char* registerName;
@@ -2947,22 +3173,85 @@ DEFINE_LUA_FUNCTION(gui_text, "x,y,str[,color=\"white\"[,outline=\"black\"]]")
 	return 0;
 }
 
-static inline void ApplyShaderToPixel(int off, std::map<int,int>& cachedShaderResults, lua_State* L, int idx)
+// shading runs the Lua shader once per distinct color in the shaded pixels and then applies the
+// results as a lookup table: a direct 65536-entry table in 16-bit mode, a small open-addressed hash in 32-bit mode.
+// the tables are static and entries are only valid if their stamp matches, so they never need clearing.
+// the shader itself is only called while no table is in use, so a shader that shades boxes of its own is harmless.
+struct ShaderSpan
 {
-	int color;
-	if (Bits32)
-		color = MD_Screen32[off];
-	else
-		color = DrawUtil::Pix16To32(MD_Screen[off]);
+	int off;
+	int count;
+	int step;
+};
+
+#define SHADER_HASH_BITS 18 // more than twice the pixels on screen, so probe sequences stay short
+#define SHADER_HASH_SIZE (1 << SHADER_HASH_BITS)
+
+static unsigned short shaderLUT16 [0x10000];
+static unsigned int shaderStamp16 [0x10000];
+static unsigned int shaderHashKey [SHADER_HASH_SIZE];
+static unsigned int shaderHashValue [SHADER_HASH_SIZE];
+static unsigned int shaderHashStamp [SHADER_HASH_SIZE];
+static unsigned int shaderStamp = 0;
 
-	int result;
-	std::map<int,int>::const_iterator found = cachedShaderResults.find(color);
-	if(found != cachedShaderResults.end())
+static unsigned int NextShaderStamp()
+{
+	if(++shaderStamp == 0)
 	{
-		result = found->second;
+		memset(shaderStamp16, 0, sizeof(shaderStamp16));
+		memset(shaderHashStamp, 0, sizeof(shaderHashStamp));
+		shaderStamp = 1;
 	}
-	else
+	return shaderStamp;
+}
+
+// returns the slot holding color, or the empty slot where it belongs
+static __forceinline unsigned int FindShaderHashSlot(unsigned int color, unsigned int stamp)
+{
+	unsigned int h = (color * 0x9E3779B1) >> (32 - SHADER_HASH_BITS);
+	while(shaderHashStamp[h] == stamp && shaderHashKey[h] != color)
+		h = (h + 1) & (SHADER_HASH_SIZE - 1);
+	return h;
+}
+
+static void ApplyShaderToSpans(const ShaderSpan* spans, int numSpans, lua_State* L, int idx)
+{
+	// collect the distinct colors, in the order they're first seen
+	std::vector<unsigned int> colors;
+	unsigned int stamp = NextShaderStamp();
+	for(int s = 0; s < numSpans; s++)
 	{
+		int off = spans[s].off;
+		for(int i = 0; i < spans[s].count; i++, off += spans[s].step)
+		{
+			if (Bits32)
+			{
+				unsigned int color = MD_Screen32[off];
+				unsigned int h = FindShaderHashSlot(color, stamp);
+				if(shaderHashStamp[h] != stamp)
+				{
+					shaderHashStamp[h] = stamp;
+					shaderHashKey[h] = color;
+					colors.push_back(color);
+				}
+			}
+			else
+			{
+				unsigned short pixel = MD_Screen[off];
+				if(shaderStamp16[pixel] != stamp)
+				{
+					shaderStamp16[pixel] = stamp;
+					colors.push_back(pixel);
+				}
+			}
+		}
+	}
+
+	// run the shader on each of them
+	std::vector<int> results(colors.size());
+	for(unsigned int c = 0; c < colors.size(); c++)
+	{
+		int color = Bits32 ? colors[c] : DrawUtil::Pix16To32(colors[c]);
 		int b = (color & 0x000000FF);
 		int g = (color & 0x0000FF00) >> 8;
 		int r = (color & 0x00FF0000) >> 16;
@@ -2982,19 +3271,58 @@ static inline void ApplyShaderToPixel(int off, std::map<int,int>& cachedShaderRe
 		if(gout < 0) gout = 0; if(gout > 255) gout = 255;
 		if(bout < 0) bout = 0; if(bout > 255) bout = 255;
 
-		result = DrawUtil::Make32(rout,gout,bout);
-		cachedShaderResults[color] = result;
+		results[c] = DrawUtil::Make32(rout,gout,bout);
+	}
+
+	// build the lookup table (the shader may have used the static tables meanwhile)
+	stamp = NextShaderStamp();
+	for(unsigned int c = 0; c < colors.size(); c++)
+	{
+		if (Bits32)
+		{
+			unsigned int h = FindShaderHashSlot(colors[c], stamp);
+			shaderHashStamp[h] = stamp;
+			shaderHashKey[h] = colors[c];
+			shaderHashValue[h] = results[c];
+		}
+		else
+		{
+			shaderStamp16[colors[c]] = stamp;
+			shaderLUT16[colors[c]] = DrawUtil::Pix32To16(results[c]);
+		}
+	}
+
+	// and apply it, leaving alone any pixels the shader drew over with colors it wasn't asked about
+	for(int s = 0; s < numSpans; s++)
+	{
+		int off = spans[s].off;
+		int count = spans[s].count;
+		int step = spans[s].step;
+		if (Bits32)
+		{
+			unsigned int* pix = &MD_Screen32[off];
+			for(int i = 0; i < count; i++, pix += step)
+			{
+				unsigned int h = FindShaderHashSlot(*pix, stamp);
+				if(shaderHashStamp[h] == stamp)
+					*pix = shaderHashValue[h];
+			}
+		}
+		else
+		{
+			unsigned short* pix = &MD_Screen[off];
+			for(int i = 0; i < count; i++, pix += step)
+			{
+				unsigned short pixel = *pix;
+				if(shaderStamp16[pixel] == stamp)
+					*pix = shaderLUT16[pixel];
+			}
+		}
 	}
-	if (Bits32) 
-		MD_Screen32[off] = result;
-	else
-		MD_Screen[off] = DrawUtil::Pix32To16(result);
 }
 
 #define SWAP_INTEGERS(x,y) x^=y, y^=x, x^=y
 
-// performance note: for me, this function is extremely slow in debug builds,
-// but when compiled with full optimizations turned on it becomes very fast.
 void ApplyShaderToBox(int x1, int y1, int x2, int y2, lua_State* L, int idx)
 {
 	if((x1 < 0 && x2 < 0) || (x1 > 319 && x2 > 319) || (y1 < 0 && y2 < 0) || (y1 > 223 && y2 > 223))
@@ -3014,16 +3342,14 @@ void ApplyShaderToBox(int x1, int y1, int x2, int y2, lua_State* L, int idx)
 	if (y2 < 0)  y2 = 0;
 	if (y2 > 223) y2 = 223;
 
-	std::map<int,int> cachedShaderResults;
-
-	for(short y = y1; y <= y2; y++)
+	ShaderSpan spans [224];
+	int numSpans = 0;
+	for(int y = y1; y <= y2; y++)
 	{
-		int off = (y * 336) + x1 + 8;
-		for(short x = x1; x <= x2; x++, off++)
-		{
-			ApplyShaderToPixel(off, cachedShaderResults, L, idx);
-		}
+		ShaderSpan span = {(y * 336) + x1 + 8, x2 - x1 + 1, 1};
+		spans[numSpans++] = span;
 	}
+	ApplyShaderToSpans(spans, numSpans, L, idx);
 }
 
 void ApplyShaderToBoxOutline(int x1, int y1, int x2, int y2, lua_State* L, int idx)
@@ -3042,20 +3368,33 @@ void ApplyShaderToBoxOutline(int x1, int y1, int x2, int y2, lua_State* L, int i
 	if (y2 < -1)  y2 = -1;
 	if (y2 > 224) y2 = 224;
 
-	std::map<int,int> cachedShaderResults;
+	// the sides only cover the rows that are on screen
+	int top = (y1 < 0) ? 0 : y1;
+	int bottom = (y2 > 223) ? 223 : y2;
 
-	if(y1 >= 0 && y1 < 224)
-		for (short x = x1+1; x < x2; x++)
-			ApplyShaderToPixel((y1 * 336) + x + 8, cachedShaderResults, L, idx);
-	if(x1 >= 0 && x1 < 320)
-		for (short y = y1; y <= y2; y++)
-			ApplyShaderToPixel((y * 336) + x1 + 8, cachedShaderResults, L, idx);
-	if(y1 != y2 && y2 >= 0 && y2 < 224)
-		for (short x = x1+1; x < x2; x++)
-			ApplyShaderToPixel((y2 * 336) + x + 8, cachedShaderResults, L, idx);
-	if(x1 != x2 && x2 >= 0 && x2 < 320)
-		for (short y = y1; y <= y2; y++)
-			ApplyShaderToPixel((y * 336) + x2 + 8, cachedShaderResults, L, idx);
+	ShaderSpan spans [4];
+	int numSpans = 0;
+	if(y1 >= 0 && y1 < 224 && x2 - x1 > 1)
+	{
+		ShaderSpan span = {(y1 * 336) + x1 + 1 + 8, x2 - x1 - 1, 1};
+		spans[numSpans++] = span;
+	}
+	if(x1 >= 0 && x1 < 320 && top <= bottom)
+	{
+		ShaderSpan span = {(top * 336) + x1 + 8, bottom - top + 1, 336};
+		spans[numSpans++] = span;
+	}
+	if(y1 != y2 && y2 >= 0 && y2 < 224 && x2 - x1 > 1)
+	{
+		ShaderSpan span = {(y2 * 336) + x1 + 1 + 8, x2 - x1 - 1, 1};
+		spans[numSpans++] = span;
+	}
+	if(x1 != x2 && x2 >= 0 && x2 < 320 && top <= bottom)
+	{
+		ShaderSpan span = {(top * 336) + x2 + 8, bottom - top + 1, 336};
+		spans[numSpans++] = span;
+	}
+	ApplyShaderToSpans(spans, numSpans, L, idx);
 }
 
 int amplifyShader(lua_State* L)
@@ -4028,6 +4367,8 @@ static const struct luaL_reg memorylib [] =
 	{"readdword", memory_readdword},
 	{"readdwordsigned", memory_readdwordsigned},
 	{"readbyterange", memory_readbyterange},
+	{"gather", memory_gather},
+	{"view", memory_view},
 	{"writebyte", memory_writebyte},
 	{"writeword", memory_writeword},
 	{"writedword", memory_writedword},
@@ -4059,6 +4400,31 @@ static const struct luaL_reg memorylib [] =
 
 	{NULL, NULL}
 };
+static const struct luaL_reg memoryviewlib [] =
+{
+	{"readbyte", memoryview_readbyte},
+	{"readbytesigned", memoryview_readbytesigned},
+	{"readword", memoryview_readword},
+	{"readwordsigned", memoryview_readwordsigned},
+	{"readdword", memoryview_readdword},
+	{"readdwordsigned", memoryview_readdwordsigned},
+	{"unpack", memoryview_unpack},
+	{"gather", memoryview_gather},
+	// alternate naming scheme, same as the memory library
+	{"readbyteunsigned", memoryview_readbyte},
+	{"readwordunsigned", memoryview_readword},
+	{"readdwordunsigned", memoryview_readdword},
+	{"readshort", memoryview_readword},
+	{"readshortunsigned", memoryview_readword},
+	{"readshortsigned", memoryview_readwordsigned},
+	{"readlong", memoryview_readdword},
+	{"readlongunsigned", memoryview_readdword},
+	{"readlongsigned", memoryview_readdwordsigned},
+
+	{"__len", memoryview_len},
+	{"__tostring", memoryview_tostring},
+	{NULL, NULL}
+};
 static const struct luaL_reg joylib [] =
 {
 	{"get", joy_get},
@@ -4313,6 +4679,10 @@ void registerLibs(lua_State* L)
 	luaL_register(L, "tile", tilelib);
 	luaL_register(L, "palette", pallib);
 	luaL_register(L, "pal", pallib);
+	luaL_newmetatable(L, "MemoryView"); // for memory.view objects, which are their own method table
+	lua_pushvalue(L, -1);
+	lua_setfield(L, -2, "__index");
+	luaL_register(L, NULL, memoryviewlib);
 	lua_settop(L, 0); // clean the stack, because each call to luaL_register leaves a table on top
 	
 	// register a few utility functions outside of libraries (in the global namespace)
@@ -4381,13 +4751,6 @@ void registerLibs(lua_State* L)
 		}
 		lua_pop(L,1);
 	}
-
-	// push arrays for storing hook functions in
-	for(int i = 0; i < LUAMEMHOOK_COUNT; i++)
-	{
-		lua_newtable(L);
-		lua_setfield(L, LUA_REGISTRYINDEX, luaMemHookTypeStrings[i]);
-	}
 }
 
 void ResetInfo(LuaContextInfo& info)
@@ -4413,6 +4776,9 @@ void ResetInfo(LuaContextInfo& info)
 	info.dataSaveLoadKeySet = false;
 	info.rerecordCountingDisabled = false;
 	info.numMemHooks = 0;
+	for(int i = 0; i < LUAMEMHOOK_COUNT; i++)
+		info.memHooks[i].clear();
+	info.memHookRefCounts.clear();
 	info.persistVars.clear();
 	info.newDefaultData.ClearRecords();
 }
@@ -4767,7 +5133,11 @@ void StopLuaScript(int uid)
 			
 			info.numMemHooks = 0;
 			for(int i = 0; i < LUAMEMHOOK_COUNT; i++)
-				CalculateMemHookRegions((LuaMemHookType)i);
+			{
+				info.memHooks[i].clear(); // the references went away with L
+				RebuildMemHookIndex((LuaMemHookType)i);
+			}
+			info.memHookRefCounts.clear();
 		}
 		RefreshScriptStartedStatus();
 	}
@@ -4782,122 +5152,152 @@ void CloseLuaContext(int uid)
 
 
 // the purpose of this structure is to provide a way of
-// QUICKLY determining whether a memory address range has a hook associated with it,
+// QUICKLY finding the hook functions associated with a memory address,
 // with a bias toward fast rejection because the majority of addresses will not be hooked.
 // (it must not use any part of Lua or perform any per-script operations,
 //  otherwise it would definitely be too slow.)
-// calculating the regions when a hook is added/removed may be slow,
+// every 24-bit address maps through a flat page table to the start of a run of
+// (script, function reference) entries, so checking an address is one array lookup.
+// rebuilding the index when a hook is added/removed may be slow,
 // but this is an intentional tradeoff to obtain a high speed of checking during later execution
-struct TieredRegion
+struct MemHookIndex
 {
-	template<unsigned int maxGap>
-	struct Region
+	struct Entry
 	{
-		struct Island
-		{
-			unsigned int start;
-			unsigned int end;
-			__forceinline bool Contains(unsigned int address, int size) const { return address < end && address+size > start; }
-		};
-		std::vector<Island> islands;
+		int uid; // -1 terminates a run of entries
+		int ref; // reference to the hook function in the registry of L
+		lua_State* L;
+	};
+	struct Hook
+	{
+		unsigned int address;
+		Entry entry;
+		bool operator<(const Hook& other) const { return address < other.address; }
+	};
 
-		void Calculate(const std::vector<unsigned int>& bytes)
-		{
-			islands.clear();
+	enum { PAGE_BITS = 12, PAGE_SIZE = 1 << PAGE_BITS, NUM_PAGES = 0x1000000 >> PAGE_BITS };
 
-			unsigned int lastEnd = ~0;
+	int* pages [NUM_PAGES]; // offsets into entries, pages with no hooks all share emptyPage
+	std::map<unsigned int, int> overflow; // offsets for the rare hooks above the 24-bit address space
+	std::vector<Entry> entries; // entries[0] is a lone terminator, so offset 0 means "not hooked"
+	unsigned int count;
 
-			std::vector<unsigned int>::const_iterator iter = bytes.begin();
-			std::vector<unsigned int>::const_iterator end = bytes.end();
-			for(; iter != end; ++iter)
-			{
-				unsigned int addr = *iter;
-				if(addr < lastEnd || addr > lastEnd + (long long)maxGap)
-				{
-					islands.push_back(Island());
-					islands.back().start = addr;
-				}
-				islands.back().end = addr+1;
-				lastEnd = addr+1;
-			}
-		}
+	static int emptyPage [PAGE_SIZE];
 
-		bool Contains(unsigned int address, int size) const
+	MemHookIndex()
+	{
+		for(int i = 0; i < NUM_PAGES; i++)
+			pages[i] = emptyPage;
+		Clear();
+	}
+	~MemHookIndex()
+	{
+		Clear();
+	}
+
+	void Clear()
+	{
+		for(int i = 0; i < NUM_PAGES; i++)
 		{
-			std::vector<Island>::const_iterator iter = islands.begin();
-			std::vector<Island>::const_iterator end = islands.end();
-			for(; iter != end; ++iter)
-				if(iter->Contains(address, size))
-					return true;
-			return false;
+			if(pages[i] != emptyPage)
+				delete[] pages[i];
+			pages[i] = emptyPage;
 		}
-	};
-
-	Region<0xFFFFFFFF> broad;
-	Region<0x1000> mid;
-	Region<0> narrow;
+		overflow.clear();
+		entries.clear();
+		Entry terminator = {-1, LUA_NOREF, NULL};
+		entries.push_back(terminator);
+		count = 0;
+	}
 
-	void Calculate(std::vector<unsigned int>& bytes)
+	void Build(std::vector<Hook>& hooks)
 	{
-		std::sort(bytes.begin(), bytes.end());
+		Clear();
+
+		// the hooks come in script order, keep it within each address so scripts get called in order
+		std::stable_sort(hooks.begin(), hooks.end());
+
+		std::vector<Hook>::const_iterator iter = hooks.begin();
+		std::vector<Hook>::const_iterator end = hooks.end();
+		while(iter != end)
+		{
+			unsigned int address = iter->address;
+			int offset = entries.size();
+			for(; iter != end && iter->address == address; ++iter)
+				entries.push_back(iter->entry);
+			entries.push_back(entries[0]);
+
+			if(address < 0x1000000)
+			{
+				int*& page = pages[address >> PAGE_BITS];
+				if(page == emptyPage)
+					page = new int [PAGE_SIZE]();
+				page[address & (PAGE_SIZE-1)] = offset;
+			}
+			else
+			{
+				overflow[address] = offset;
+			}
+		}
+		count = hooks.size();
+	}
 
-		broad.Calculate(bytes);
-		mid.Calculate(bytes);
-		narrow.Calculate(bytes);
+	void Swap(MemHookIndex& other)
+	{
+		for(int i = 0; i < NUM_PAGES; i++)
+			std::swap(pages[i], other.pages[i]);
+		overflow.swap(other.overflow);
+		entries.swap(other.entries);
+		std::swap(count, other.count);
 	}
 
-	TieredRegion()
+	__forceinline int NotEmpty() const
 	{
-		Calculate(std::vector<unsigned int>());
+		return count;
 	}
 
-	__forceinline int NotEmpty()
+	__forceinline int Find(unsigned int address) const
 	{
-		return broad.islands.size();
+		if(address < 0x1000000)
+			return pages[address >> PAGE_BITS][address & (PAGE_SIZE-1)];
+		std::map<unsigned int, int>::const_iterator found = overflow.find(address);
+		return (found != overflow.end()) ? found->second : 0;
 	}
 
 	// note: it is illegal to call this if NotEmpty() returns 0
-	__forceinline bool Contains(unsigned int address, int size)
+	__forceinline bool Contains(unsigned int address, int size) const
 	{
-		return broad.islands[0].Contains(address,size) &&
-		       mid.Contains(address,size) &&
-			   narrow.Contains(address,size);
+		for(unsigned int i = address; i != address+size; i++)
+			if(Find(i))
+				return true;
+		return false;
 	}
 };
-TieredRegion hookedRegions [LUAMEMHOOK_COUNT];
+int MemHookIndex::emptyPage [MemHookIndex::PAGE_SIZE];
+MemHookIndex memHookIndex [LUAMEMHOOK_COUNT];
 
 
-static void CalculateMemHookRegions(LuaMemHookType hookType)
+static void RebuildMemHookIndex(LuaMemHookType hookType)
 {
-	std::vector<unsigned int> hookedBytes;
+	std::vector<MemHookIndex::Hook> hooks;
 	std::map<int, LuaContextInfo*>::iterator iter = luaContextInfo.begin();
 	std::map<int, LuaContextInfo*>::iterator end = luaContextInfo.end();
 	while(iter != end)
 	{
-		LuaContextInfo& info = *iter->second;
-		if(info.numMemHooks)
+		LuaContextInfo* info = iter->second;
+		if(info && info->numMemHooks && info->L)
 		{
-			lua_State* L = info.L;
-			if(L)
+			std::map<unsigned int, int>::const_iterator hookIter = info->memHooks[hookType].begin();
+			std::map<unsigned int, int>::const_iterator hookEnd = info->memHooks[hookType].end();
+			for(; hookIter != hookEnd; ++hookIter)
 			{
-				lua_settop(L, 0);
-				lua_getfield(L, LUA_REGISTRYINDEX, luaMemHookTypeStrings[hookType]);
-				lua_pushnil(L);
-				while(lua_next(L, -2))
-				{
-					if(lua_isfunction(L, -1))
-					{
-						unsigned int addr = lua_tointeger(L, -2);
-						hookedBytes.push_back(addr);
-					}
-					lua_pop(L, 1);
-				}
-				lua_settop(L, 0);
+				MemHookIndex::Hook hook = {hookIter->first, {iter->first, hookIter->second, info->L}};
+				hooks.push_back(hook);
 			}
 		}
 		++iter;
 	}
-	hookedRegions[hookType].Calculate(hookedBytes);
+	memHookIndex[hookType].Build(hooks);
 }
 
 
@@ -4906,51 +5306,62 @@ static void CalculateMemHookRegions(LuaMemHookType hookType)
 
 static void CallRegisteredLuaMemHook_LuaMatch(unsigned int address, int size, unsigned int value, LuaMemHookType hookType)
 {
-	std::map<int, LuaContextInfo*>::iterator iter = luaContextInfo.begin();
-	std::map<int, LuaContextInfo*>::iterator end = luaContextInfo.end();
-	while(iter != end)
+	// gather the first hook of each script in the range before calling anything,
+	// because a hook function can add or remove hooks and rebuild the index under us
+	MemHookIndex::Entry hits [64];
+	int numHits = 0;
+	const MemHookIndex& index = memHookIndex[hookType];
+	for(unsigned int i = address; i != address+size; i++)
 	{
-		LuaContextInfo& info = *iter->second;
-		if(info.numMemHooks)
+		for(const MemHookIndex::Entry* entry = &index.entries[index.Find(i)]; entry->uid >= 0; entry++)
+		{
+			int h = 0;
+			while(h < numHits && hits[h].uid != entry->uid)
+				h++;
+			if(h == numHits && numHits < (int)(sizeof(hits)/sizeof(*hits)))
+				hits[numHits++] = *entry;
+		}
+	}
+
+	// call them in script order, same as the other callbacks
+	for(int h = 1; h < numHits; h++)
+		for(int j = h; j > 0 && hits[j].uid < hits[j-1].uid; j--)
+			std::swap(hits[j], hits[j-1]);
+
+	for(int h = 0; h < numHits; h++)
+	{
+		int uid = hits[h].uid;
+		std::map<int, LuaContextInfo*>::iterator found = luaContextInfo.find(uid);
+		if(found == luaContextInfo.end() || !found->second)
+			continue;
+		LuaContextInfo& info = *found->second;
+		lua_State* L = info.L;
+		if(L && L == hits[h].L && !info.panic)
 		{
-			lua_State* L = info.L;
-			if(L && !info.panic)
-			{
 #ifdef USE_INFO_STACK
-				infoStack.insert(infoStack.begin(), &info);
-				struct Scope { ~Scope(){ infoStack.erase(infoStack.begin()); } } scope;
+			infoStack.insert(infoStack.begin(), &info);
+			struct Scope { ~Scope(){ infoStack.erase(infoStack.begin()); } } scope;
 #endif
-				lua_settop(L, 0);
-				lua_getfield(L, LUA_REGISTRYINDEX, luaMemHookTypeStrings[hookType]);
-				for(int i = address; i != address+size; i++)
+			lua_settop(L, 0);
+			lua_rawgeti(L, LUA_REGISTRYINDEX, hits[h].ref);
+			if (lua_isfunction(L, -1))
+			{
+				bool wasRunning = info.running;
+				info.running = true;
+				RefreshScriptSpeedStatus();
+				lua_pushinteger(L, address);
+				lua_pushinteger(L, size);
+				int errorcode = lua_pcall(L, 2, 0, 0);
+				info.running = wasRunning;
+				RefreshScriptSpeedStatus();
+				if (errorcode)
 				{
-					lua_rawgeti(L, -1, i);
-					if (lua_isfunction(L, -1))
-					{
-						bool wasRunning = info.running;
-						info.running = true;
-						RefreshScriptSpeedStatus();
-						lua_pushinteger(L, address);
-						lua_pushinteger(L, size);
-						int errorcode = lua_pcall(L, 2, 0, 0);
-						info.running = wasRunning;
-						RefreshScriptSpeedStatus();
-						if (errorcode)
-						{
-							int uid = iter->first;
-							HandleCallbackError(L,info,uid,true);
-						}
-						break;
-					}
-					else
-					{
-						lua_pop(L,1);
-					}
+					HandleCallbackError(L,info,uid,true);
+					continue; // L might be closed now
 				}
-				lua_settop(L, 0);
 			}
+			lua_settop(L, 0);
 		}
-		++iter;
 	}
 }
 void CallRegisteredLuaMemHook(unsigned int address, int size, unsigned int value, LuaMemHookType hookType)
@@ -4960,15 +5371,71 @@ void CallRegisteredLuaMemHook(unsigned int address, int size, unsigned int value
 	// before and after, because even the most innocent change can make it become 30% to 400% slower.
 	// a good amount to test is: 100000000 calls with no hook set, and another 100000000 with a hook set.
 	// (on my system that consistently took 200 ms total in the former case and 350 ms total in the latter case)
-	if(hookedRegions[hookType].NotEmpty())
+	// Lua_MemHook_Benchmark does exactly that and logs the results.
+	const MemHookIndex& index = memHookIndex[hookType];
+	if(index.NotEmpty())
 	{
 		if((hookType <= LUAMEMHOOK_EXEC) && (address >= 0xE00000))
 			address |= 0xFF0000; // account for mirroring of RAM
-		if(hookedRegions[hookType].Contains(address, size))
+		if(index.Contains(address, size))
 			CallRegisteredLuaMemHook_LuaMatch(address, size, value, hookType); // something has hooked this specific address
 	}
 }
 
+// times CallRegisteredLuaMemHook with no hooks, and with hooks (of no script, so everything up to the Lua call is timed)
+#define LUA_MEMHOOK_BENCH_CALLS 100000000
+#define LUA_MEMHOOK_BENCH_HOOKS 1000
+
+static double Lua_MemHook_Bench_Pass(unsigned int base, unsigned int mask)
+{
+	double start = Benchmark_Time();
+	for(unsigned int i = 0; i < LUA_MEMHOOK_BENCH_CALLS; i++)
+		CallRegisteredLuaMemHook(base + ((i * 2) & mask), 2, 0, LUAMEMHOOK_READ);
+	return Benchmark_Time() - start;
+}
+
+int Lua_MemHook_Benchmark(char* summary)
+{
+	static MemHookIndex saved;
+	saved.Swap(memHookIndex[LUAMEMHOOK_READ]);
+
+	double idleMs = Lua_MemHook_Bench_Pass(0xFF0000, 0x7FFF);
+
+	// hook the upper half of RAM for a script uid that never exists
+	std::vector<MemHookIndex::Hook> hooks;
+	for(unsigned int i = 0; i < LUA_MEMHOOK_BENCH_HOOKS; i++)
+	{
+		MemHookIndex::Hook hook = {0xFF8000 + i * 8, {-2, LUA_NOREF, NULL}};
+		hooks.push_back(hook);
+	}
+	memHookIndex[LUAMEMHOOK_READ].Build(hooks);
+	int missing = 0;
+	for(unsigned int i = 0; i < LUA_MEMHOOK_BENCH_HOOKS; i++)
+		if(!memHookIndex[LUAMEMHOOK_READ].Find(0xFF8000 + i * 8))
+			missing++;
+
+	double missMs = Lua_MemHook_Bench_Pass(0xFF0000, 0x7FFF);
+	double hitMs = Lua_MemHook_Bench_Pass(0xFF8000, 0xFF8);
+
+	memHookIndex[LUAMEMHOOK_READ].Clear();
+	saved.Swap(memHookIndex[LUAMEMHOOK_READ]);
+
+	FILE* file = Benchmark_Log("luahook");
+	if(file)
+	{
+		fprintf(file, "Lua memory hooks, %d calls per pass, %d hooked bytes\n", LUA_MEMHOOK_BENCH_CALLS, LUA_MEMHOOK_BENCH_HOOKS);
+		fprintf(file, "no hooks set: %.0f ms\n", idleMs);
+		fprintf(file, "hooks set, unhooked address: %.0f ms\n", missMs);
+		fprintf(file, "hooks set, hooked address: %.0f ms\n\n", hitMs);
+		fclose(file);
+	}
+
+	sprintf(summary, "Lua memory hooks: %.0f ms idle, %.0f ms miss, %.0f ms hit per %d calls%s",
+		idleMs, missMs, hitMs, LUA_MEMHOOK_BENCH_CALLS, missing ? " (MISMATCH)" : "");
+
+	return missing;
+}
+
 
 
 void CallRegisteredLuaFunctions(LuaCallID calltype)
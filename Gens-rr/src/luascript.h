@@ -51,6 +51,7 @@ enum LuaMemHookType
 	LUAMEMHOOK_COUNT
 };
 void CallRegisteredLuaMemHook(unsigned int address, int size, unsigned int value, LuaMemHookType hookType);
+int Lua_MemHook_Benchmark(char* summary); // times CallRegisteredLuaMemHook and writes the results to Logs\luahook_bench.log
 
 struct LuaSaveData
 {
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <io.h>
 #include "gens.h"
 #include "G_main.h"
 #include "io.h"
@@ -8,6 +9,10 @@
 #include "mem_M68K.h"
 #include "luascript.h"
 #include "OpenArchive.h"
+#include "save.h"
+#include "benchmark.h"
+#include "headless.h"
+#include <vector>
 
 long unsigned int FrameCount=0;
 long unsigned int LagCount=0;
@@ -21,11 +26,335 @@ char Movie_Dir[1024]="";
 bool tempflag = false; //Upth-Add - This is for the new feature which pauses at the end of movie play if readonly isn't set
 bool AutoCloseMovie = false; //Upth-Add - For the new AutoClose Movie toggle
 bool Def_Read_Only = true; //Upth-Add - For the new Default Read Only toggle
+bool MovieStateDiffs = false; // savestates store the movie input as a diff (see SaveMovieInputDiff) instead of a full copy
 char track = 1 | 2 | 4;
 extern int AVIRecording;
 typeMovie MainMovie;
 extern "C" char preloaded_tracks [100], played_tracks_linear [105]; // Modif N. -- added
 extern "C" int Clear_Sound_Buffer(void);
+extern "C" int disableSound2;
+
+// the input log of the open movie is kept in memory, so per-frame reads and writes don't seek the file.
+// modified frames are written back in batches, and whenever something else is about to use the file directly.
+static std::vector<unsigned char> s_movieInput; // 3 bytes per frame, starting right after the 64 byte header
+static FILE* s_movieInputFile = NULL; // file s_movieInput was loaded from, NULL if nothing is loaded
+static unsigned int s_movieInputDirtyBegin = 0, s_movieInputDirtyEnd = 0; // frames not written back yet
+static int s_movieInputFileCalls = 0; // CRT file calls made for the input log (for MovieInput_Benchmark)
+#define MOVIE_INPUT_WRITEBACK_FRAMES 3600 // so at most a minute of recording is only in memory
+
+// the input log as it was when the movie was opened, savestate input diffs are made against this.
+// it is also written next to the savestates (once per session, named by its hash),
+// so diffs saved in earlier sessions can still be restored after the movie has changed
+static std::vector<unsigned char> s_movieInputBase;
+static unsigned __int64 s_movieInputBaseHash = 0;
+static bool s_movieInputBaseValid = false;
+static bool s_movieInputBaseSaved = false;
+static std::vector<unsigned __int64> s_movieInputHash; // s_movieInputHash[i] is the hash of frames [0,i), computed lazily
+static const unsigned char s_releasedFrame[3] = {0xFF, 0xFF, 0xFF};
+#define MOVIE_INPUT_HASH_SEED 14695981039346656037ULL // FNV-1a
+#define MOVIE_INPUT_HASH_PRIME 1099511628211ULL
+
+static inline unsigned __int64 HashMovieInput(unsigned __int64 hash, const unsigned char *data, unsigned int size)
+{
+	for(unsigned int i = 0; i < size; i++)
+		hash = (hash ^ data[i]) * MOVIE_INPUT_HASH_PRIME;
+	return hash;
+}
+
+static unsigned __int64 MovieInputBaseHash(const std::vector<unsigned char>& base)
+{
+	unsigned int baseSize = base.size();
+	unsigned __int64 hash = HashMovieInput(MOVIE_INPUT_HASH_SEED, (const unsigned char*)&baseSize, sizeof(baseSize));
+	if(baseSize)
+		hash = HashMovieInput(hash, &base[0], baseSize);
+	return hash;
+}
+
+// frames past the end of the log read as released, like ReadMovieInput
+static inline const unsigned char* MovieFrame(const std::vector<unsigned char>& log, unsigned int frame)
+{
+	return frame*3 + 3 <= log.size() ? &log[frame*3] : s_releasedFrame;
+}
+
+// call whenever frame and anything after it might have changed
+static void InvalidateMovieInputHash(unsigned int frame)
+{
+	if(s_movieInputHash.size() > frame + 1)
+		s_movieInputHash.resize(frame + 1);
+}
+
+static unsigned __int64 MovieInputHash(unsigned int frames)
+{
+	if(s_movieInputHash.empty())
+		s_movieInputHash.push_back(MOVIE_INPUT_HASH_SEED);
+	while(s_movieInputHash.size() <= frames)
+	{
+		unsigned int i = s_movieInputHash.size() - 1;
+		s_movieInputHash.push_back(HashMovieInput(s_movieInputHash[i], MovieFrame(s_movieInput, i), 3));
+	}
+	return s_movieInputHash[frames];
+}
+
+static void LoadMovieInput(typeMovie *aMovie)
+{
+	if(s_movieInputFile == aMovie->File)
+		return;
+
+	s_movieInput.clear();
+	s_movieInputDirtyBegin = s_movieInputDirtyEnd = 0;
+	s_movieInputFile = aMovie->File;
+
+	fseek(aMovie->File,0,SEEK_END);
+	long size = ftell(aMovie->File) - 64;
+	if(size > 0)
+	{
+		s_movieInput.resize(size);
+		fseek(aMovie->File,64,SEEK_SET);
+		size = fread(&s_movieInput[0],1,size,aMovie->File);
+		s_movieInput.resize(max(size,0));
+	}
+	s_movieInputHash.clear();
+	s_movieInputFileCalls += 4;
+
+	if(!s_movieInputBaseValid)
+	{
+		s_movieInputBase = s_movieInput;
+		s_movieInputBaseHash = MovieInputBaseHash(s_movieInputBase);
+		s_movieInputBaseValid = true;
+		s_movieInputBaseSaved = false;
+	}
+}
+
+static void MovieInputBaseFileName(const typeMovie *aMovie, unsigned __int64 hash, char *name)
+{
+	const char* title = aMovie->FileName;
+	for(const char* c = aMovie->FileName; *c; c++)
+		if(*c == '\\' || *c == '/' || *c == '|')
+			title = c + 1;
+	sprintf(name, "%s%s.%016I64X.gmb", State_Dir, title, hash);
+}
+
+static void SaveMovieInputBase(const typeMovie *aMovie)
+{
+	if(s_movieInputBaseSaved)
+		return;
+	char name[2048];
+	MovieInputBaseFileName(aMovie, s_movieInputBaseHash, name);
+	FILE* f = fopen(name, "rb");
+	if(f)
+		fclose(f); // an earlier session started from the same log
+	else if((f = fopen(name, "wb")) != NULL)
+	{
+		if(!s_movieInputBase.empty())
+			fwrite(&s_movieInputBase[0], 1, s_movieInputBase.size(), f);
+		fclose(f);
+	}
+	else
+		return; // try again with the next savestate
+	s_movieInputBaseSaved = true;
+}
+
+// loads the log an earlier session's savestate diffs were made against, if it was kept
+static bool LoadMovieInputBase(const typeMovie *aMovie, unsigned __int64 hash, std::vector<unsigned char>& base)
+{
+	char name[2048];
+	MovieInputBaseFileName(aMovie, hash, name);
+	FILE* f = fopen(name, "rb");
+	if(!f)
+		return false;
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	base.resize(max(size, 0));
+	if(size > 0 && fread(&base[0], 1, size, f) != (size_t)size)
+		base.clear();
+	fclose(f);
+	return MovieInputBaseHash(base) == hash;
+}
+
+void ReadMovieInput(typeMovie *aMovie, unsigned int frame, char *PadData)
+{
+	LoadMovieInput(aMovie);
+	unsigned int offset = frame*3;
+	if(offset + 3 <= s_movieInput.size())
+		memcpy(PadData, &s_movieInput[offset], 3);
+	else
+		PadData[0] = PadData[1] = PadData[2] = (char)0xFF; // past the end of the movie, nothing pressed
+}
+
+void WriteMovieInput(typeMovie *aMovie, unsigned int frame, const char *PadData)
+{
+	LoadMovieInput(aMovie);
+	unsigned int offset = frame*3;
+	if(offset + 3 > s_movieInput.size())
+	{
+		InvalidateMovieInputHash(s_movieInput.size()/3); // frames in the gap read as released until now
+		s_movieInput.resize(offset + 3, 0);
+	}
+	memcpy(&s_movieInput[offset], PadData, 3);
+	InvalidateMovieInputHash(frame);
+
+	if(s_movieInputDirtyBegin == s_movieInputDirtyEnd)
+	{
+		s_movieInputDirtyBegin = frame;
+		s_movieInputDirtyEnd = frame + 1;
+	}
+	else
+	{
+		s_movieInputDirtyBegin = min(s_movieInputDirtyBegin, frame);
+		s_movieInputDirtyEnd = max(s_movieInputDirtyEnd, frame + 1);
+	}
+	if(s_movieInputDirtyEnd - s_movieInputDirtyBegin >= MOVIE_INPUT_WRITEBACK_FRAMES)
+		FlushMovieInput(aMovie);
+}
+
+void FlushMovieInput(typeMovie *aMovie)
+{
+	if(!aMovie->File || s_movieInputFile != aMovie->File || s_movieInputDirtyBegin == s_movieInputDirtyEnd)
+		return;
+
+	fseek(aMovie->File,64+s_movieInputDirtyBegin*3,SEEK_SET);
+	fwrite(&s_movieInput[s_movieInputDirtyBegin*3],3,s_movieInputDirtyEnd-s_movieInputDirtyBegin,aMovie->File);
+	s_movieInputDirtyBegin = s_movieInputDirtyEnd = 0;
+	s_movieInputFileCalls += 2;
+}
+
+void InvalidateMovieInput()
+{
+	s_movieInput.clear();
+	s_movieInputHash.clear();
+	s_movieInputFile = NULL;
+	s_movieInputDirtyBegin = s_movieInputDirtyEnd = 0;
+}
+
+void TruncateMovieInput(typeMovie *aMovie, unsigned int frames)
+{
+	FlushMovieInput(aMovie);
+	fflush(aMovie->File);
+	_chsize(_fileno(aMovie->File), 64 + frames*3);
+
+	if(s_movieInputFile == aMovie->File)
+	{
+		InvalidateMovieInputHash(min(frames, s_movieInput.size()/3));
+		s_movieInput.resize(frames*3, 0);
+	}
+}
+
+// writes the input of frames [0,frames) as the frames that differ from the log the movie was opened with,
+// preceded by the hash of that log and the hash of the input itself.
+// only the changed frames are written, so this costs little even for long movies.
+void SaveMovieInputDiff(typeMovie *aMovie, unsigned int frames, FILE *f)
+{
+	LoadMovieInput(aMovie);
+	SaveMovieInputBase(aMovie);
+	unsigned __int64 hash = MovieInputHash(frames);
+	fwrite(&s_movieInputBaseHash,8,1,f);
+	fwrite(&frames,4,1,f);
+	fwrite(&hash,8,1,f);
+
+	std::vector<unsigned char> run;
+	unsigned int common = min(s_movieInput.size(), s_movieInputBase.size()) / 3;
+	unsigned int i = 0;
+	while(i < frames)
+	{
+		// skip identical stretches a block at a time
+		while(i + 1024 <= min(common, frames) && !memcmp(&s_movieInput[i*3], &s_movieInputBase[i*3], 1024*3))
+			i += 1024;
+		if(i >= frames)
+			break;
+		if(!memcmp(MovieFrame(s_movieInput, i), MovieFrame(s_movieInputBase, i), 3))
+		{
+			i++;
+			continue;
+		}
+
+		unsigned int start = i;
+		run.clear();
+		while(i < frames && memcmp(MovieFrame(s_movieInput, i), MovieFrame(s_movieInputBase, i), 3))
+		{
+			run.insert(run.end(), MovieFrame(s_movieInput, i), MovieFrame(s_movieInput, i) + 3);
+			i++;
+		}
+		unsigned int count = i - start;
+		fwrite(&start,4,1,f);
+		fwrite(&count,4,1,f);
+		fwrite(&run[0],3,count,f);
+	}
+	unsigned int end = 0xFFFFFFFF;
+	fwrite(&end,4,1,f);
+}
+
+// reads what SaveMovieInputDiff wrote and compares it with the movie input.
+// returns the first frame where they differ, *frames if they match,
+// or -1 if the diff was made against a movie log that wasn't kept (or is unreadable) so it can't be compared.
+// if apply is set, differing frames are overwritten with the savestate's input.
+int LoadMovieInputDiff(typeMovie *aMovie, FILE *f, unsigned int *frames, bool apply)
+{
+	LoadMovieInput(aMovie);
+	unsigned __int64 baseHash, hash;
+	if(fread(&baseHash,8,1,f) != 1 || fread(frames,4,1,f) != 1 || fread(&hash,8,1,f) != 1)
+		return -1;
+
+	// runs must be in order, not overlap and stay within the frames, or the state is damaged
+	struct Run { unsigned int start, count; std::vector<unsigned char> data; };
+	std::vector<Run> runs;
+	unsigned int previousEnd = 0;
+	for(;;)
+	{
+		Run run;
+		if(fread(&run.start,4,1,f) != 1)
+			return -1;
+		if(run.start == 0xFFFFFFFF)
+			break;
+		if(fread(&run.count,4,1,f) != 1 || run.count == 0 || run.start < previousEnd
+		|| run.start > *frames || run.count > *frames - run.start)
+			return -1;
+		previousEnd = run.start + run.count;
+		run.data.resize(run.count*3);
+		if(fread(&run.data[0],3,run.count,f) != run.count)
+			return -1;
+		runs.push_back(run);
+	}
+
+	if(hash == MovieInputHash(*frames))
+		return *frames; // same input, nothing else to check
+
+	// a diff from an earlier session needs the log that session started with
+	std::vector<unsigned char> otherBase;
+	const std::vector<unsigned char>* base = &s_movieInputBase;
+	if(baseHash != s_movieInputBaseHash)
+	{
+		if(!LoadMovieInputBase(aMovie, baseHash, otherBase))
+			return -1;
+		base = &otherBase;
+	}
+
+	int firstMismatch = -1;
+	unsigned int i = 0, r = 0;
+	while(i < *frames)
+	{
+		const unsigned char* expected;
+		if(r < runs.size() && i >= runs[r].start)
+		{
+			expected = &runs[r].data[(i - runs[r].start)*3];
+			if(i + 1 == runs[r].start + runs[r].count)
+				r++;
+		}
+		else
+			expected = MovieFrame(*base, i);
+
+		if(memcmp(expected, MovieFrame(s_movieInput, i), 3))
+		{
+			if(firstMismatch < 0)
+				firstMismatch = i;
+			if(!apply)
+				break;
+			WriteMovieInput(aMovie, i, (const char*)expected);
+		}
+		i++;
+	}
+	return firstMismatch < 0 ? *frames : firstMismatch;
+}
 
 void Update_Recent_Movie(const char *Path)
 {
@@ -87,9 +416,9 @@ void MoviePlayingStuff()
 
 	char PadData[3]; //Modif
 
-	Check_Misc_Key();
-	fseek(MainMovie.File,64+FrameCount*3,SEEK_SET);
-	fread(PadData,3,1,MainMovie.File);
+	if(Headless_Exit_Code < 0) // a -verify run ignores whatever keys are held on the desktop
+		Check_Misc_Key();
+	ReadMovieInput(&MainMovie,FrameCount,PadData);
 	Controller_1_Up=(PadData[0]&1);
 	Controller_1_Down=(PadData[0]&2)>>1;
 	Controller_1_Left=(PadData[0]&4)>>2;
@@ -192,10 +521,8 @@ void MoviePlayingStuff()
 void MoviePlayPlayer1()
 {
 	char PadData[3]; //Modif
-//	if(!fseek(MainMovie.File,64+FrameCount*3,SEEK_SET))
-	fseek(MainMovie.File,64+FrameCount*3,SEEK_SET);
+	ReadMovieInput(&MainMovie,FrameCount,PadData);
 	{
-		fread(PadData,3,1,MainMovie.File);
 		{
 			Controller_1_Up=(PadData[0]&1);
 			Controller_1_Down=(PadData[0]&2)>>1;
@@ -220,10 +547,8 @@ void MoviePlayPlayer1()
 void MoviePlayPlayer2()
 {
 	char PadData[3]; //Modif
-//	if(!fseek(MainMovie.File,64+FrameCount*3,SEEK_SET))
-	fseek(MainMovie.File,64+FrameCount*3,SEEK_SET);
+	ReadMovieInput(&MainMovie,FrameCount,PadData);
 	{
-		fread(PadData,3,1,MainMovie.File);
 		{
 			if(MainMovie.TriplePlayerHack)
 			{
@@ -261,9 +586,8 @@ void MoviePlayPlayer3()
 	if (!MainMovie.TriplePlayerHack)
 		return;
 	char PadData[3]; //Modif
-	fseek(MainMovie.File,64+FrameCount*3,SEEK_SET);
+	ReadMovieInput(&MainMovie,FrameCount,PadData);
 	{
-		fread(PadData,3,1,MainMovie.File);
 		{
 			Controller_1C_Up=(PadData[2]&1);
 			Controller_1C_Down=(PadData[2]&2)>>1;
@@ -472,8 +796,7 @@ void MovieRecordingStuff()
 	PadData[2]=Controller_1_X|(Controller_1_Y<<1)|(Controller_1_Z<<2)|(Controller_1_Mode<<3)
 		|(Controller_2_X<<4)|(Controller_2_Y<<5)|(Controller_2_Z<<6)|(Controller_2_Mode<<7);
 	}
-	fseek(MainMovie.File,64+FrameCount*3,SEEK_SET);
-	fwrite(PadData,3,1,MainMovie.File);
+	WriteMovieInput(&MainMovie,FrameCount,PadData);
 	if ((track == ALL_TRACKS) || ((track == (TRACK1 | TRACK2)) && !MainMovie.TriplePlayerHack))
 		MainMovie.LastFrame = FrameCount;
 	else 
@@ -684,6 +1007,9 @@ int OpenMovieFile(typeMovie *aMovie)
 	if(!aMovie->Ok)
 		return 0;
 
+	InvalidateMovieInput();
+	s_movieInputBaseValid = false;
+
 	// use ObtainFile to support loading movies from archives (read-only)
 	char LogicalName[1024], PhysicalName[1024];
 	if(ObtainFile(aMovie->FileName, LogicalName, PhysicalName, "mov", s_nonMovieExtensions, sizeof(s_nonMovieExtensions)/sizeof(*s_nonMovieExtensions)))
@@ -741,39 +1067,25 @@ void WriteMovieHeader(typeMovie *aMovie)
 int FlushMovieFile(typeMovie *aMovie)
 {
 	unsigned int MovieFileLastFrame=0;
-	char * movieData = NULL;
 
 	if(aMovie->File==NULL)
 		return 0;
+	FlushMovieInput(aMovie);
 	if(aMovie->ReadOnly==0 || aMovie->Status==MOVIE_RECORDING)
 	{
 		WriteMovieHeader(aMovie);
 		fseek(aMovie->File,0,SEEK_END);
 		MovieFileLastFrame=(ftell(aMovie->File)-64)/3;
+
+		// if necessary, truncate the frame data to match the length of the movie
 		if(MovieFileLastFrame>aMovie->LastFrame)
-		{
-			fseek(aMovie->File,0,SEEK_SET);
-			movieData=new char[aMovie->LastFrame*3+64];
-			fread(movieData,aMovie->LastFrame*3+64,1,aMovie->File);
-		}
+			TruncateMovieInput(aMovie,aMovie->LastFrame);
 	}
 
 	fclose(aMovie->File);
 	aMovie->File=NULL;
+	InvalidateMovieInput();
 
-	// if necessary, truncate the frame data to match the length of the movie
-	if((MovieFileLastFrame>aMovie->LastFrame) && (aMovie->ReadOnly == 0 || aMovie->Status==MOVIE_RECORDING))
-	{
-		aMovie->File=fopen(aMovie->PhysicalFileName,"wb");
-		if(aMovie->File)
-		{
-			fseek(aMovie->File,0,SEEK_SET);
-			fwrite(movieData,aMovie->LastFrame*3+64,1,aMovie->File);
-			fclose(aMovie->File);
-		}
-	}
-
-	delete[] movieData;
 	return 1;
 }
 
@@ -804,6 +1116,7 @@ int BackupMovieFile(typeMovie *aMovie)
 	if(aMovie->File==NULL)
 		return 0;
 
+	FlushMovieInput(aMovie);
 	Put_Info(aMovie->FileName);
 
 	strncpy(aMovie->PhysicalFileName,aMovie->FileName,1024);
@@ -823,4 +1136,94 @@ int BackupMovieFile(typeMovie *aMovie)
 	delete[] movieData;
 
 	return 1;
-}
\ No newline at end of file
+}
+
+// the per-frame file access the cache replaced, only kept for comparison in MovieInput_Benchmark
+static void ReadMovieInputFromFile(FILE *file, unsigned int frame, char *PadData)
+{
+	fseek(file,64+frame*3,SEEK_SET);
+	fread(PadData,3,1,file);
+}
+
+int MovieInput_Benchmark(char* summary)
+{
+	if(!Game || !MainMovie.File || MainMovie.LastFrame == 0)
+	{
+		strcpy(summary, "Movie input benchmark needs an open movie");
+		return 0;
+	}
+
+	FlushMovieInput(&MainMovie);
+	const unsigned int frames = MainMovie.LastFrame;
+	const int emulatedFrames = 600;
+	char PadData[3];
+	unsigned int checksum[2] = {0, 0};
+	double readMs[2], frameMs[2];
+	int fileCalls[2];
+
+	// reading the whole input log one frame at a time, the way playback does
+	double start = Benchmark_Time();
+	for(unsigned int i = 0; i < frames; i++)
+	{
+		ReadMovieInputFromFile(MainMovie.File, i, PadData);
+		checksum[0] = checksum[0]*31 + (unsigned char)PadData[0] + ((unsigned char)PadData[1]<<8) + ((unsigned char)PadData[2]<<16);
+	}
+	readMs[0] = Benchmark_Time() - start;
+	fileCalls[0] = frames*2;
+
+	InvalidateMovieInput(); // so the cached run includes loading the log
+	s_movieInputFileCalls = 0;
+	start = Benchmark_Time();
+	for(unsigned int i = 0; i < frames; i++)
+	{
+		ReadMovieInput(&MainMovie, i, PadData);
+		checksum[1] = checksum[1]*31 + (unsigned char)PadData[0] + ((unsigned char)PadData[1]<<8) + ((unsigned char)PadData[2]<<16);
+	}
+	readMs[1] = Benchmark_Time() - start;
+	fileCalls[1] = s_movieInputFileCalls;
+
+	// fast-forwarding with the input fetched every frame.
+	// the input isn't applied, so both runs emulate exactly the same frames
+	ALIGN16 static unsigned char backup[MAX_STATE_FILE_LENGTH];
+	Save_State_To_Buffer(backup);
+	disableSound2 = true;
+	for(int path = 0; path < 2; path++)
+	{
+		Load_State_From_Buffer(backup);
+		start = Benchmark_Time();
+		for(int i = 0; i < emulatedFrames; i++)
+		{
+			if(path == 0)
+				ReadMovieInputFromFile(MainMovie.File, (FrameCount + i) % frames, PadData);
+			else
+				ReadMovieInput(&MainMovie, (FrameCount + i) % frames, PadData);
+			Update_Frame_Fast();
+		}
+		frameMs[path] = Benchmark_Time() - start;
+	}
+	disableSound2 = false;
+	Load_State_From_Buffer(backup);
+
+	char str[1024];
+	sprintf(str,
+		"%s: %s, %d frames of input\n"
+		"file: %d file calls, %.1f us for the whole log, %.1f us/frame while fast-forwarding\n"
+		"memory: %d file calls, %.1f us for the whole log, %.1f us/frame while fast-forwarding\n"
+		"%s\n",
+		Game->Rom_Name, MainMovie.FileName, frames,
+		fileCalls[0], readMs[0] * 1000.0, frameMs[0] * 1000.0 / emulatedFrames,
+		fileCalls[1], readMs[1] * 1000.0, frameMs[1] * 1000.0 / emulatedFrames,
+		checksum[0] == checksum[1] ? "input matches" : "INPUT MISMATCH");
+
+	FILE* log = Benchmark_Log("movie_input");
+	if(log)
+	{
+		fprintf(log, "%s\n", str);
+		fclose(log);
+	}
+
+	sprintf(summary, "Movie input: %d -> %d file calls, %.1f -> %.1f us/frame%s", fileCalls[0], fileCalls[1],
+		frameMs[0] * 1000.0 / emulatedFrames, frameMs[1] * 1000.0 / emulatedFrames,
+		checksum[0] == checksum[1] ? "" : " (MISMATCH)");
+	return 1;
+}
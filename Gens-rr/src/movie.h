@@ -58,6 +58,7 @@ struct typeMovie
 extern bool AutoCloseMovie; //Upth-Add - So these flags
 extern bool Def_Read_Only;  //Upth-Add - are externally accessible
 extern bool UseMovieStates; //Upth-Add - save.h doesn't like bools
+extern bool MovieStateDiffs;
 void InitMovie(typeMovie * aMovie);
 void CopyMovie(typeMovie *MovieSrc,typeMovie *MovieDest);
 int GetMovieInfo(char *FileName,typeMovie *aMovie);
@@ -68,6 +69,17 @@ int FlushMovieFile(typeMovie *aMovie); // same as CloseMovieFile but doesn't cle
 int OpenMovieFile(typeMovie *aMovie);
 int BackupMovieFile(typeMovie *aMovie);
 
+// the input log is cached in memory, so anything that accesses aMovie->File directly
+// must call FlushMovieInput first, and InvalidateMovieInput after writing to it or reopening it
+void ReadMovieInput(typeMovie *aMovie, unsigned int frame, char *PadData); // all released past the end
+void WriteMovieInput(typeMovie *aMovie, unsigned int frame, const char *PadData);
+void FlushMovieInput(typeMovie *aMovie);
+void InvalidateMovieInput();
+void TruncateMovieInput(typeMovie *aMovie, unsigned int frames); // shrinks (or zero-extends) the file in place
+void SaveMovieInputDiff(typeMovie *aMovie, unsigned int frames, FILE *f);
+int LoadMovieInputDiff(typeMovie *aMovie, FILE *f, unsigned int *frames, bool apply);
+int MovieInput_Benchmark(char* summary); // compares per-frame file access with the cache, writes to Logs\movie_input_bench.log
+
 extern typeMovie MainMovie;
 
 #endif
\ No newline at end of file
@@ -10,10 +10,13 @@
 
 #include <stdio.h>
 #include "pcm.h"
+#include "benchmark.h"
 #include "cd_sys.h"
 #include "star_68k.h"
 #include "Mem_M68k.h"
+#include "misc.h"
 #include <memory.h>
+#include <emmintrin.h>
 
 #define PCM_STEP_SHIFT 11
 
@@ -21,8 +24,10 @@ struct pcm_chip_ PCM_Chip;
 unsigned char Ram_PCM[64 * 1024];
 int PCM_Volume_Tab[256 * 256];
 int PCM_Enable;
+int PCM_SSE2;
 unsigned short PCMVol = 256;
 
+
 /* initialise the pcm chip */
 int Init_PCM(int Rate)
 {
@@ -49,6 +54,7 @@ int Init_PCM(int Rate)
 
 	Reset_PCM();
 	Set_Rate_PCM(Rate);
+	PCM_SSE2 = CPU_Has_SSE2();
 
 	return 0;
 }
@@ -248,13 +254,73 @@ void Write_PCM_Reg(unsigned int Reg, unsigned int Data)
 }
 
 
-int Update_PCM(int **buf, int Length)
+// plays samples j to Length - 1 of a channel
+static void PCM_Update_Channel(struct pcm_chan_ *CH, int *bufL, int *bufR, int j, int Length)
 {
-	int i, j;
-	int *bufL, *bufR;
-	//int *volL, *volR;
 	unsigned int Addr, k;
-	struct pcm_chan_ *CH;
+
+	Addr = CH->Addr >> PCM_STEP_SHIFT;
+
+//	volL = &(PCM_Volume_Tab[CH->MUL_L << 8]);
+//	volR = &(PCM_Volume_Tab[CH->MUL_R << 8]);
+
+	for (; j < Length; j++)
+	{
+		// test for loop signal
+		if (Ram_PCM[Addr] == 0xFF)
+		{
+			CH->Addr = (Addr = CH->Loop_Addr) << PCM_STEP_SHIFT;
+			if (Ram_PCM[Addr] == 0xFF) break;
+			else j--;
+		}
+		else
+		{
+/*
+			CH->Data = Ram_PCM[Addr];
+			
+			bufL[j] += volL[CH->Data];
+			bufR[j] += volR[CH->Data];
+*/
+			if (Ram_PCM[Addr] & 0x80)
+			{
+				CH->Data = Ram_PCM[Addr] & 0x7F;
+				bufL[j] -= (int)(((CH->Data * CH->MUL_L) * PCMVol) >> 8);
+				bufR[j] -= (int)(((CH->Data * CH->MUL_R) * PCMVol) >> 8);
+			}
+			else
+			{
+				CH->Data = Ram_PCM[Addr];
+				bufL[j] += (int)(((CH->Data * CH->MUL_L) * PCMVol) >> 8);
+				bufR[j] += (int)(((CH->Data * CH->MUL_R) * PCMVol) >> 8);
+			}
+
+			// update address register
+			k = Addr + 1;
+			CH->Addr = (CH->Addr + CH->Step) & 0x7FFFFFF;
+			Addr = CH->Addr >> PCM_STEP_SHIFT;
+
+			for(; k < Addr; k++)
+			{
+				if (Ram_PCM[k] == 0xFF)
+				{
+					CH->Addr = (Addr = CH->Loop_Addr) << PCM_STEP_SHIFT;
+					break;
+				}
+			}
+		}
+	}
+
+	if (Ram_PCM[Addr] == 0xFF)
+	{
+		CH->Addr = CH->Loop_Addr << PCM_STEP_SHIFT;
+	}
+}
+
+
+static int Update_PCM_Scalar(int **buf, int Length)
+{
+	int i;
+	int *bufL, *bufR;
 
 	// if PCM disable, no sound
 	if (!PCM_Chip.Enable) return 1;
@@ -336,68 +402,115 @@ int Update_PCM(int **buf, int Length)
 	}
 */
 
-	// for long update
+	for (i = 0; i < 8; i++)
+	{
+		// only loop when sounding and on
+		if (PCM_Chip.Channel[i].Enable) PCM_Update_Channel(&PCM_Chip.Channel[i], bufL, bufR, 0, Length);
+	}
+
+	return 0;
+}
+
+// Same output as Update_PCM_Scalar, with the channels stepped side by side in SSE2 registers.
+// A channel goes in the SSE2 lanes when its address can't reach a loop marker (or wrap) before the end
+// of the update, the ones that can are left to the scalar code.
+static int Update_PCM_SSE2(int **buf, int Length)
+{
+	unsigned int A0[8], Step[8], Vol_L[8], Vol_R[8], Idx[8];
+	int i, j, active = 0;
+	int *bufL, *bufR;
+	struct pcm_chan_ *CH;
+
+	// if PCM disable, no sound
+	if (!PCM_Chip.Enable) return 1;
+
+	bufL = buf[0];
+	bufR = buf[1];
+
 	for (i = 0; i < 8; i++)
 	{
 		CH = &(PCM_Chip.Channel[i]);
+		A0[i] = Step[i] = Vol_L[i] = Vol_R[i] = 0;
 
-		// only loop when sounding and on
 		if (CH->Enable)
 		{
-			Addr = CH->Addr >> PCM_STEP_SHIFT;
+			// where the address is after the whole update
+			unsigned __int64 End = CH->Addr + (unsigned __int64) Length * CH->Step;
+			unsigned int Addr = CH->Addr >> PCM_STEP_SHIFT;
+			const unsigned char *Mark = NULL;
 
-//			volL = &(PCM_Volume_Tab[CH->MUL_L << 8]);
-//			volR = &(PCM_Volume_Tab[CH->MUL_R << 8]);
+			if (End <= 0x7FFFFFF) Mark = (const unsigned char *) memchr(Ram_PCM + Addr, 0xFF, (unsigned int) (End >> PCM_STEP_SHIFT) - Addr + 1);
 
-			for (j = 0; j < Length; j++)
+			// 16 bit products only
+			if (End > 0x7FFFFFF || Mark || CH->MUL_L * PCMVol > 0xFFFF || CH->MUL_R * PCMVol > 0xFFFF)
 			{
-				// test for loop signal
-				if (Ram_PCM[Addr] == 0xFF)
-				{
-					CH->Addr = (Addr = CH->Loop_Addr) << PCM_STEP_SHIFT;
-					if (Ram_PCM[Addr] == 0xFF) break;
-					else j--;
-				}
-				else
-				{
-/*
-					CH->Data = Ram_PCM[Addr];
-					
-					bufL[j] += volL[CH->Data];
-					bufR[j] += volR[CH->Data];
-*/
-					if (Ram_PCM[Addr] & 0x80)
-					{
-						CH->Data = Ram_PCM[Addr] & 0x7F;
-						bufL[j] -= (int)(((CH->Data * CH->MUL_L) * PCMVol) >> 8);
-						bufR[j] -= (int)(((CH->Data * CH->MUL_R) * PCMVol) >> 8);
-					}
-					else
-					{
-						CH->Data = Ram_PCM[Addr];
-						bufL[j] += (int)(((CH->Data * CH->MUL_L) * PCMVol) >> 8);
-						bufR[j] += (int)(((CH->Data * CH->MUL_R) * PCMVol) >> 8);
-					}
+				PCM_Update_Channel(CH, bufL, bufR, 0, Length);
+				continue;
+			}
 
-					// update address register
-					k = Addr + 1;
-					CH->Addr = (CH->Addr + CH->Step) & 0x7FFFFFF;
-					Addr = CH->Addr >> PCM_STEP_SHIFT;
+			A0[i] = CH->Addr;
+			Step[i] = CH->Step;
+			Vol_L[i] = CH->MUL_L * PCMVol;
+			Vol_R[i] = CH->MUL_R * PCMVol;
+			active |= 1 << i;
+		}
+	}
 
-					for(; k < Addr; k++)
-					{
-						if (Ram_PCM[k] == 0xFF)
-						{
-							CH->Addr = (Addr = CH->Loop_Addr) << PCM_STEP_SHIFT;
-							break;
-						}
-					}
-				}
-			}
+	if (active && Length > 0)
+	{
+		const __m128i mask = _mm_set1_epi16(0x7F);
+		__m128i addr0 = _mm_loadu_si128((const __m128i *) A0), addr1 = _mm_loadu_si128((const __m128i *) (A0 + 4));
+		__m128i step0, step1, volL, volR;
+
+		step0 = _mm_loadu_si128((const __m128i *) Step);
+		step1 = _mm_loadu_si128((const __m128i *) (Step + 4));
+		volL = _mm_setr_epi16(Vol_L[0], Vol_L[1], Vol_L[2], Vol_L[3], Vol_L[4], Vol_L[5], Vol_L[6], Vol_L[7]);
+		volR = _mm_setr_epi16(Vol_R[0], Vol_R[1], Vol_R[2], Vol_R[3], Vol_R[4], Vol_R[5], Vol_R[6], Vol_R[7]);
 
-			if (Ram_PCM[Addr] == 0xFF)
+		for (j = 0; j < Length; j++)
+		{
+			__m128i data, sign, sign0, sign1, lo, hi, outL, outR;
+
+			_mm_storeu_si128((__m128i *) Idx, _mm_srli_epi32(addr0, PCM_STEP_SHIFT));
+			_mm_storeu_si128((__m128i *) (Idx + 4), _mm_srli_epi32(addr1, PCM_STEP_SHIFT));
+			data = _mm_setr_epi16(Ram_PCM[Idx[0]], Ram_PCM[Idx[1]], Ram_PCM[Idx[2]], Ram_PCM[Idx[3]],
+				Ram_PCM[Idx[4]], Ram_PCM[Idx[5]], Ram_PCM[Idx[6]], Ram_PCM[Idx[7]]);
+
+			// sign and magnitude samples : bit 7 set means negative
+			sign = _mm_cmpgt_epi16(data, mask);
+			sign0 = _mm_unpacklo_epi16(sign, sign);
+			sign1 = _mm_unpackhi_epi16(sign, sign);
+			data = _mm_and_si128(data, mask);
+
+			lo = _mm_mullo_epi16(data, volL);
+			hi = _mm_mulhi_epu16(data, volL);
+			outL = _mm_add_epi32(
+				_mm_sub_epi32(_mm_xor_si128(_mm_srli_epi32(_mm_unpacklo_epi16(lo, hi), 8), sign0), sign0),
+				_mm_sub_epi32(_mm_xor_si128(_mm_srli_epi32(_mm_unpackhi_epi16(lo, hi), 8), sign1), sign1));
+
+			lo = _mm_mullo_epi16(data, volR);
+			hi = _mm_mulhi_epu16(data, volR);
+			outR = _mm_add_epi32(
+				_mm_sub_epi32(_mm_xor_si128(_mm_srli_epi32(_mm_unpacklo_epi16(lo, hi), 8), sign0), sign0),
+				_mm_sub_epi32(_mm_xor_si128(_mm_srli_epi32(_mm_unpackhi_epi16(lo, hi), 8), sign1), sign1));
+
+			// left and right sums of the 4 lanes side by side
+			outL = _mm_add_epi32(_mm_unpacklo_epi32(outL, outR), _mm_unpackhi_epi32(outL, outR));
+			outL = _mm_add_epi32(outL, _mm_shuffle_epi32(outL, 0x4E));
+			bufL[j] += _mm_cvtsi128_si32(outL);
+			bufR[j] += _mm_cvtsi128_si32(_mm_shuffle_epi32(outL, 0x55));
+
+			addr0 = _mm_add_epi32(addr0, step0);
+			addr1 = _mm_add_epi32(addr1, step1);
+		}
+
+		for (i = 0; i < 8; i++)
+		{
+			if (active & (1 << i))
 			{
-				CH->Addr = CH->Loop_Addr << PCM_STEP_SHIFT;
+				CH = &(PCM_Chip.Channel[i]);
+				CH->Data = Ram_PCM[Idx[i]] & 0x7F;
+				CH->Addr += Length * CH->Step;
 			}
 		}
 	}
@@ -406,3 +519,162 @@ int Update_PCM(int **buf, int Length)
 }
 
 
+int Update_PCM(int **buf, int Length)
+{
+	if (PCM_SSE2) return Update_PCM_SSE2(buf, Length);
+	return Update_PCM_Scalar(buf, Length);
+}
+
+
+/* Benchmark */
+
+#define PCM_BENCH_RATE		44100
+#define PCM_BENCH_FRAMES	(60 * 60)			// one minute of sound
+#define PCM_BENCH_FRAME		735					// samples per NTSC frame at 44.1 kHz
+#define PCM_BENCH_LINES		262
+
+static unsigned int PCM_Bench_Seed;
+
+static int PCM_Bench_Random(int range)
+{
+	PCM_Bench_Seed = PCM_Bench_Seed * 1103515245 + 12345;
+	return (PCM_Bench_Seed >> 16) % range;
+}
+
+// 8 looping waves of different sizes, one with a loop marker at its loop point, a one sample long one
+// and one without a marker that runs off the end of the wave RAM
+static void PCM_Bench_Wave_RAM(void)
+{
+	int i, ch, start, len;
+
+	for (ch = 0; ch < 8; ch++)
+	{
+		start = ch << 13;
+		if (ch == 4) len = 1;
+		else if (ch == 7) len = 0x2000;
+		else len = 0x400 + PCM_Bench_Random(0x1800);
+
+		for (i = 0; i < len; i++)
+		{
+			int v = PCM_Bench_Random(0x7F);
+			Ram_PCM[start + i] = (unsigned char) ((i & 0x20) ? v : (v | 0x80));
+		}
+		for (; i < 0x2000; i++) Ram_PCM[start + i] = 0xFF;
+	}
+}
+
+static void PCM_Bench_Registers(int frame)
+{
+	int ch;
+
+	for (ch = 0; ch < 8; ch++)
+	{
+		if (frame && PCM_Bench_Random(16)) continue;
+
+		Write_PCM_Reg(0x07, 0xC0 | ch);
+		Write_PCM_Reg(0x00, PCM_Bench_Random(0x100));
+		Write_PCM_Reg(0x01, PCM_Bench_Random(0x100));
+		// up to 4 bytes per sample, so that the marker scan between samples has something to do
+		Write_PCM_Reg(0x02, PCM_Bench_Random(0x100));
+		Write_PCM_Reg(0x03, (ch == 6) ? 0x20 + PCM_Bench_Random(0x10) : PCM_Bench_Random(0x10));
+		Write_PCM_Reg(0x04, (ch & 1) ? 0x00 : 0x10);
+		Write_PCM_Reg(0x05, (ch << 5) + ((ch == 5) ? 0x1F : 0));
+		Write_PCM_Reg(0x06, ch << 5);
+	}
+
+	Write_PCM_Reg(0x08, (frame & 0x100) ? 0x21 : 0x00);
+	Write_PCM_Reg(0x07, 0x80);
+}
+
+static unsigned int PCM_Bench_Hash(unsigned int hash, const int *data, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++) hash = (hash ^ data[i]) * 16777619u;
+	return hash;
+}
+
+// plays the register stream a few samples at a time like the emulation does every line,
+// hashing the output and the chip state after every frame unless outHash is NULL, returns the time it took in ms
+static double PCM_Bench_Pass(int sse2, unsigned int *outHash, unsigned int *stateHash)
+{
+	static int bufL[PCM_BENCH_FRAME], bufR[PCM_BENCH_FRAME];
+	int *buf[2];
+	int frame, line, pos, next;
+	double start;
+
+	Init_PCM(PCM_BENCH_RATE);
+	PCM_SSE2 = sse2;
+	PCM_Bench_Seed = 1;
+	PCM_Bench_Wave_RAM();
+	start = Benchmark_Time();
+
+	for (frame = 0; frame < PCM_BENCH_FRAMES; frame++)
+	{
+		PCM_Bench_Registers(frame);
+		memset(bufL, 0, sizeof(bufL));
+		memset(bufR, 0, sizeof(bufR));
+
+		for (line = 0, pos = 0; line < PCM_BENCH_LINES; line++, pos = next)
+		{
+			next = (line + 1) * PCM_BENCH_FRAME / PCM_BENCH_LINES;
+			buf[0] = bufL + pos;
+			buf[1] = bufR + pos;
+			Update_PCM(buf, next - pos);
+		}
+
+		if (outHash)
+		{
+			outHash[frame] = PCM_Bench_Hash(PCM_Bench_Hash(2166136261u, bufL, PCM_BENCH_FRAME), bufR, PCM_BENCH_FRAME);
+			stateHash[frame] = PCM_Bench_Hash(2166136261u, (const int *) PCM_Chip.Channel, 8 * sizeof(struct pcm_chan_) / sizeof(int));
+		}
+	}
+
+	return Benchmark_Time() - start;
+}
+
+// times the SSE2 mixer against the scalar one on 8 looping channels, the wave RAM is restored afterwards too
+int PCM_Benchmark(char *summary)
+{
+	static unsigned int outHash[2][PCM_BENCH_FRAMES], stateHash[2][PCM_BENCH_FRAMES];
+	static unsigned char savedRam[64 * 1024];
+	struct pcm_chip_ saved = PCM_Chip;
+	int hasSSE2 = CPU_Has_SSE2(), savedSSE2 = PCM_SSE2;
+	double ms[2] = {0.0, 0.0};
+	int mismatches = 0;
+	int sse2, frame;
+	FILE *log;
+
+	memcpy(savedRam, Ram_PCM, sizeof(savedRam));
+
+	for (sse2 = 0; sse2 <= hasSSE2; sse2++)
+	{
+		ms[sse2] = PCM_Bench_Pass(sse2, NULL, NULL);
+		PCM_Bench_Pass(sse2, outHash[sse2], stateHash[sse2]);
+	}
+
+	for (frame = 0; hasSSE2 && frame < PCM_BENCH_FRAMES; frame++)
+	{
+		if (outHash[0][frame] != outHash[1][frame] || stateHash[0][frame] != stateHash[1][frame]) mismatches++;
+	}
+
+	Init_PCM(PCM_BENCH_RATE);
+	PCM_Chip = saved;
+	PCM_SSE2 = savedSSE2;
+	memcpy(Ram_PCM, savedRam, sizeof(savedRam));
+
+	log = Benchmark_Log("pcm");
+	if (log)
+	{
+		double samples = (double) PCM_BENCH_FRAME * PCM_BENCH_FRAMES;
+
+		fprintf(log, "PCM, 8 channels updated every line: scalar %.0f ms (%.0f samples/s), SSE2 %.0f ms (%.0f samples/s), %d of %d frames differ\n\n",
+			ms[0], samples * 1000.0 / (ms[0] ? ms[0] : 1), ms[1], samples * 1000.0 / (ms[1] ? ms[1] : 1), mismatches, PCM_BENCH_FRAMES);
+		fclose(log);
+	}
+
+	sprintf(summary, "PCM: scalar %.0f ms, SSE2 %.0f ms%s", ms[0], ms[1],
+		mismatches ? " (MISMATCH)" : hasSSE2 ? "" : " (no SSE2)");
+
+	return mismatches;
+}
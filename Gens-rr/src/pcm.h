@@ -31,12 +31,14 @@ struct pcm_chip_
 extern struct pcm_chip_ PCM_Chip;
 extern unsigned char Ram_PCM[64 * 1024];
 extern int PCM_Enable;
+extern int PCM_SSE2;
 extern unsigned short PCMVol;
 
 int Init_PCM(int Rate);
 void Set_Rate_PCM(int Rate);
 void Reset_PCM(void);
 int Update_PCM(int **buf, int Length);
+int PCM_Benchmark(char *summary);
 
 
 #ifdef __cplusplus
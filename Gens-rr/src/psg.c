@@ -13,6 +13,7 @@
 #include <stdio.h>
 #include <math.h>
 #include "psg.h"
+#include "benchmark.h"
 #include <memory.h>
 
 
@@ -33,6 +34,15 @@
 //#define NOISE_DEF 0x0001
 #define NOISE_DEF 0x4000
 
+// Band-limited steps : TAPS samples long (latency of TAPS / 2), PHASES sub-sample positions,
+// BITS of precision, and cut off at CUTOFF of the sample rate
+
+#define PSG_BLEP_TAPS 32
+#define PSG_BLEP_PHASES 64
+#define PSG_BLEP_BITS 12
+#define PSG_BLEP_CUTOFF 0.40
+#define PSG_BLEP_MAX 1024
+
 #define PSG_DEBUG_LEVEL 0
 
 #if PSG_DEBUG_LEVEL > 0
@@ -66,9 +76,18 @@ unsigned int PSG_Step_Table[1024];
 unsigned int PSG_Volume_Table[16];
 unsigned int PSG_Noise_Step_Table[4];
 unsigned int PSG_Save[8];
+int PSG_Blep_Kernel[PSG_BLEP_PHASES + 1][PSG_BLEP_TAPS];
 
 struct _psg PSG;
 
+// steps waiting to be integrated, starting at the next sample to output
+struct _psg_blep
+{
+	int Delta[PSG_BLEP_MAX + PSG_BLEP_TAPS];
+	int Sum;
+	int Level[4];
+} PSG_Blep_State;
+
 #if PSG_DEBUG_LEVEL > 0
 FILE *psg_debug_file = NULL;
 #endif
@@ -88,6 +107,7 @@ int Update_GYM_Dump(char v0, char v1, char v2);
 
 int PSG_Enable;
 int PSG_Improv=0;
+int PSG_Blep=0;
 int *PSG_Buf[2];
 int PSG_Len = 0;
 unsigned short PSGVol = 256;
@@ -315,6 +335,203 @@ void PSG_Update(int **buffer, int length)
 }
 
 
+// Band-limited renderer : instead of testing every channel at every sample, jumps straight
+// to the next time the counter flips the output, and puts a band-limited step there.
+// Counter and Noise end up exactly where PSG_Update leaves them.
+
+static void PSG_Blep_Step(int time, unsigned int phase, int delta)
+{
+	int *d = PSG_Blep_State.Delta + time;
+	const int *k = PSG_Blep_Kernel[phase];
+	int i;
+
+	for(i = 0; i < PSG_BLEP_TAPS; i++) d[i] += delta * k[i];
+}
+
+static void PSG_Blep_Level(int chan, int time, unsigned int phase, int level)
+{
+	if (level != PSG_Blep_State.Level[chan])
+	{
+		PSG_Blep_Step(time, phase, level - PSG_Blep_State.Level[chan]);
+		PSG_Blep_State.Level[chan] = level;
+	}
+}
+
+// position of the flip inside the sample where it happens, rem is how far the counter had to go in that sample
+#define PSG_BLEP_PHASE(rem, step) (((rem) * PSG_BLEP_PHASES + ((step) >> 1)) / (step))
+
+static void PSG_Update_BLEP_Block(int **buffer, int length)
+{
+	int i, j, n, pos, sum, amp;
+	unsigned int cur_cnt, cur_step, rem;
+
+	for(j = 2; j >= 0; j--)
+	{
+		cur_step = PSG.CntStep[j];
+
+		if (PSG.Volume[j])
+		{
+			amp = ((int) PSG.Volume[j] * PSGVol) >> 8;
+
+			if (cur_step < 0x10000)
+			{
+				cur_cnt = PSG.Counter[j];
+				PSG_Blep_Level(j, 0, 0, (cur_cnt & 0x10000) ? amp : 0);
+
+				for(pos = 0; cur_step; )
+				{
+					rem = 0x10000 - (cur_cnt & 0xFFFF);
+					n = (rem + cur_step - 1) / cur_step;
+					if (pos + n > length) break;
+
+					pos += n;
+					cur_cnt += n * cur_step;
+					PSG_Blep_Level(j, pos - 1, PSG_BLEP_PHASE(rem - (n - 1) * cur_step, cur_step), (cur_cnt & 0x10000) ? amp : 0);
+				}
+
+				PSG.Counter[j] += cur_step * length;
+			}
+			else PSG_Blep_Level(j, 0, 0, amp);
+		}
+		else
+		{
+			PSG_Blep_Level(j, 0, 0, 0);
+			PSG.Counter[j] += cur_step * length;
+		}
+	}
+
+	// Channel 3 - Noise
+
+	cur_cnt = PSG.Counter[3];
+	cur_step = PSG.CntStep[3];
+
+	if (PSG.Volume[3])
+	{
+		amp = ((int) PSG.Volume[3] * PSGVol) >> 8;
+		PSG_Blep_Level(3, 0, 0, (PSG.Noise & 1) ? amp : 0);
+
+		if (cur_step >= 0x10000)
+		{
+			for(i = 0; i < length; i++)
+			{
+				if ((cur_cnt += cur_step) & 0x10000)
+				{
+					cur_cnt &= 0xFFFF;
+					if (PSG.Noise & 1) PSG.Noise = (PSG.Noise ^ PSG.Noise_Type) >> 1;
+					else PSG.Noise >>= 1;
+					PSG_Blep_Level(3, i, PSG_BLEP_PHASES, (PSG.Noise & 1) ? amp : 0);
+				}
+			}
+		}
+		else
+		{
+			for(pos = 0; cur_step; )
+			{
+				// PSG_Update shifts when bit 16 is set after adding the step,
+				// the counter is masked then so only the first time can start with it set
+				unsigned int low = cur_cnt & 0x1FFFF, target;
+
+				if (low < 0x10000) target = 0x10000;
+				else if (low + cur_step < 0x20000) target = low + cur_step;
+				else target = 0x30000;
+
+				rem = target - low;
+				n = (rem + cur_step - 1) / cur_step;
+				if (pos + n > length) break;
+
+				pos += n;
+				cur_cnt = (cur_cnt + n * cur_step) & 0xFFFF;
+				if (PSG.Noise & 1) PSG.Noise = (PSG.Noise ^ PSG.Noise_Type) >> 1;
+				else PSG.Noise >>= 1;
+				PSG_Blep_Level(3, pos - 1, PSG_BLEP_PHASE(rem - (n - 1) * cur_step, cur_step), (PSG.Noise & 1) ? amp : 0);
+			}
+
+			cur_cnt += cur_step * (length - pos);
+		}
+
+		PSG.Counter[3] = cur_cnt;
+	}
+	else
+	{
+		PSG_Blep_Level(3, 0, 0, 0);
+		PSG.Counter[3] += cur_step * length;
+	}
+
+	sum = PSG_Blep_State.Sum;
+
+	for(i = 0; i < length; i++)
+	{
+		int out = ((sum += PSG_Blep_State.Delta[i]) + (1 << (PSG_BLEP_BITS - 1))) >> PSG_BLEP_BITS;
+
+		buffer[0][i] += out;
+		buffer[1][i] += out;
+	}
+
+	PSG_Blep_State.Sum = sum;
+	memmove(PSG_Blep_State.Delta, PSG_Blep_State.Delta + length, PSG_BLEP_TAPS * sizeof(int));
+	memset(PSG_Blep_State.Delta + PSG_BLEP_TAPS, 0, length * sizeof(int));
+}
+
+
+void PSG_Update_BLEP(int **buffer, int length)
+{
+	int *buf[2];
+	int i, len;
+
+	for(i = 0; i < length; i += len)
+	{
+		len = length - i;
+		if (len > PSG_BLEP_MAX) len = PSG_BLEP_MAX;
+
+		buf[0] = buffer[0] + i;
+		buf[1] = buffer[1] + i;
+		PSG_Update_BLEP_Block(buf, len);
+	}
+}
+
+
+// steps of a Blackman windowed sinc, summed over each sample so that every row adds up to exactly 1 << PSG_BLEP_BITS
+static void PSG_Blep_Init(void)
+{
+	static double step[PSG_BLEP_TAPS * PSG_BLEP_PHASES + 1];
+	const double half = PSG_BLEP_TAPS / 2 - 1;
+	double x, h, total = 0.0;
+	int i, j, q0, q1;
+
+	step[0] = 0.0;
+
+	for(i = 0; i < PSG_BLEP_TAPS * PSG_BLEP_PHASES; i++)
+	{
+		for(j = 0; j < 8; j++)
+		{
+			x = ((double) i + (j + 0.5) / 8.0) / PSG_BLEP_PHASES - PSG_BLEP_TAPS / 2;
+
+			if (fabs(x) >= half) continue;
+			h = (x == 0.0) ? 1.0 : sin(PI * 2.0 * PSG_BLEP_CUTOFF * x) / (PI * 2.0 * PSG_BLEP_CUTOFF * x);
+			total += h * (0.42 + 0.5 * cos(PI * x / half) + 0.08 * cos(2.0 * PI * x / half));
+		}
+
+		step[i + 1] = total;
+	}
+
+	for(i = 0; i <= PSG_BLEP_TAPS * PSG_BLEP_PHASES; i++)
+		step[i] = floor(step[i] / total * (1 << PSG_BLEP_BITS) + 0.5);
+
+	for(i = 0; i <= PSG_BLEP_PHASES; i++)
+	{
+		for(j = 0; j < PSG_BLEP_TAPS; j++)
+		{
+			q0 = j * PSG_BLEP_PHASES - i;
+			q1 = q0 + PSG_BLEP_PHASES;
+
+			PSG_Blep_Kernel[i][j] = (int) (step[q1] - ((q0 < 0) ? 0.0 : step[q0]));
+		}
+	}
+
+	memset(&PSG_Blep_State, 0, sizeof(PSG_Blep_State));
+}
+
+
 void PSG_Init(int clock, int rate)
 {
 	int i, j;
@@ -394,6 +611,8 @@ void PSG_Init(int clock, int rate)
 		}
 	}
 
+	PSG_Blep_Init();
+
 	PSG.Current_Register = 0;
 	PSG.Current_Channel = 0;
 	PSG.Noise = 0;
@@ -444,6 +663,7 @@ void PSG_Special_Update(void)
 	if (PSG_Len && PSG_Enable)
 	{
 		if (PSG_Improv) PSG_Update_SIN(PSG_Buf, PSG_Len);
+		else if (PSG_Blep) PSG_Update_BLEP(PSG_Buf, PSG_Len);
 		else PSG_Update(PSG_Buf, PSG_Len);
 
 		PSG_Buf[0] = LeftAudioBuffer() + Sound_Extrapol[VDP_Current_Line + 1][0];
@@ -452,4 +672,236 @@ void PSG_Special_Update(void)
 	}
 }
 
+
+/* Benchmark */
+
+#define PSG_BENCH_BLOCK		735						// one NTSC frame at 44.1 kHz
+#define PSG_BENCH_BLOCKS	(60 * 60)				// one minute of sound
+#define PSG_BENCH_FFT		8192
+#define PSG_BENCH_TONES		6
+
+static const int PSG_Bench_Periods[PSG_BENCH_TONES] = {0x3F8, 0x1FC, 0x0FE, 0x040, 0x010, 0x008};
+static unsigned int PSG_Bench_Seed;
+
+static int PSG_Bench_Random(int range)
+{
+	PSG_Bench_Seed = PSG_Bench_Seed * 1103515245 + 12345;
+	return (PSG_Bench_Seed >> 16) % range;
+}
+
+static void PSG_Bench_Tone(int chan, int period)
+{
+	PSG_Write(0x80 | (chan << 5) | (period & 0xF));
+	PSG_Write((period >> 4) & 0x3F);
+}
+
+// some music-like register writes every frame : new notes, volume changes and noise
+static void PSG_Bench_Registers(int block)
+{
+	int chan;
+
+	for(chan = 0; chan < 3; chan++)
+	{
+		if (PSG_Bench_Random(8) == 0) PSG_Bench_Tone(chan, 0x20 + PSG_Bench_Random(0x3E0));
+		if (PSG_Bench_Random(4) == 0) PSG_Write(0x90 | (chan << 5) | PSG_Bench_Random(16));
+	}
+
+	if (PSG_Bench_Random(16) == 0) PSG_Write(0xE0 | PSG_Bench_Random(8));
+	if (PSG_Bench_Random(4) == 0) PSG_Write(0xF0 | ((block & 256) ? 0x0F : PSG_Bench_Random(16)));
+}
+
+static unsigned int PSG_Bench_Hash(unsigned int hash, const int *data, int count)
+{
+	int i;
+
+	for(i = 0; i < count; i++) hash = (hash ^ data[i]) * 16777619u;
+	return hash;
+}
+
+// plays the register stream through PSG_Update or PSG_Update_BLEP, hashing the chip state after every
+// frame unless stateHash is NULL, returns the time it took in ms
+static double PSG_Bench_Pass(int psgClock, int rate, int blep, unsigned int *stateHash)
+{
+	static int bufL[PSG_BENCH_BLOCK], bufR[PSG_BENCH_BLOCK];
+	int *buf[2];
+	int block;
+	double start;
+
+	buf[0] = bufL;
+	buf[1] = bufR;
+
+	PSG_Init(psgClock, rate);
+	PSG_Bench_Seed = 1;
+	start = Benchmark_Time();
+
+	for(block = 0; block < PSG_BENCH_BLOCKS; block++)
+	{
+		PSG_Bench_Registers(block);
+
+		memset(bufL, 0, sizeof(bufL));
+		memset(bufR, 0, sizeof(bufR));
+		if (blep) PSG_Update_BLEP(buf, PSG_BENCH_BLOCK);
+		else PSG_Update(buf, PSG_BENCH_BLOCK);
+
+		if (stateHash) stateHash[block] = PSG_Bench_Hash(2166136261u, (const int *) &PSG, sizeof(PSG) / sizeof(int));
+	}
+
+	return Benchmark_Time() - start;
+}
+
+static void PSG_Bench_FFT(double *re, double *im, int n)
+{
+	int i, j, k, len;
+	double t;
+
+	for(i = 1, j = 0; i < n; i++)
+	{
+		for(k = n >> 1; j & k; k >>= 1) j ^= k;
+		j |= k;
+		if (i < j)
+		{
+			t = re[i]; re[i] = re[j]; re[j] = t;
+			t = im[i]; im[i] = im[j]; im[j] = t;
+		}
+	}
+
+	for(len = 2; len <= n; len <<= 1)
+	{
+		double wr = cos(-2.0 * PI / len), wi = sin(-2.0 * PI / len);
+
+		for(i = 0; i < n; i += len)
+		{
+			double cr = 1.0, ci = 0.0;
+
+			for(j = 0; j < len / 2; j++)
+			{
+				double *ar = re + i + j, *ai = im + i + j, *br = ar + len / 2, *bi = ai + len / 2;
+				double xr = *br * cr - *bi * ci, xi = *br * ci + *bi * cr;
+
+				*br = *ar - xr; *bi = *ai - xi;
+				*ar += xr; *ai += xi;
+				t = cr * wr - ci * wi;
+				ci = cr * wi + ci * wr;
+				cr = t;
+			}
+		}
+	}
+}
+
+// plays a steady square wave and returns how far above everything else its harmonics are, in dB
+static double PSG_Bench_SNR(int psgClock, int rate, int blep, int period)
+{
+	static int bufL[PSG_BENCH_FFT], bufR[PSG_BENCH_FFT];
+	static double re[PSG_BENCH_FFT], im[PSG_BENCH_FFT];
+	int *buf[2];
+	double bin, signal = 0.0, noise = 0.0, power;
+	int i, h;
+
+	buf[0] = bufL;
+	buf[1] = bufR;
+
+	PSG_Init(psgClock, rate);
+	PSG_Bench_Tone(0, period);
+	PSG_Write(0x90);
+
+	for(i = 0; i < 2; i++)
+	{
+		memset(bufL, 0, sizeof(bufL));
+		memset(bufR, 0, sizeof(bufR));
+		if (blep) PSG_Update_BLEP(buf, PSG_BENCH_FFT);
+		else PSG_Update(buf, PSG_BENCH_FFT);
+	}
+
+	// Blackman-Harris window, its side lobes are below the aliasing we want to see
+	for(i = 0; i < PSG_BENCH_FFT; i++)
+	{
+		double w = 2.0 * PI * i / PSG_BENCH_FFT;
+
+		re[i] = bufL[i] * (0.35875 - 0.48829 * cos(w) + 0.14128 * cos(2.0 * w) - 0.01168 * cos(3.0 * w));
+		im[i] = 0.0;
+	}
+
+	PSG_Bench_FFT(re, im, PSG_BENCH_FFT);
+
+	// the tone runs at the rate of the counter, not the exact frequency of the period
+	bin = (double) PSG.CntStep[0] / 131072.0 * PSG_BENCH_FFT;
+
+	for(i = 5; i < PSG_BENCH_FFT / 2; i++)
+	{
+		power = re[i] * re[i] + im[i] * im[i];
+		h = (int) floor(i / bin + 0.5);
+
+		if (h > 0 && fabs(i - h * bin) <= 4.0) signal += power;
+		else noise += power;
+	}
+
+	return 10.0 * log10(signal / (noise ? noise : 1e-9));
+}
+
+// times PSG_Update_BLEP against PSG_Update and measures the aliasing of both on some square waves
+int PSG_Benchmark(int psgClock, int rate, char *summary)
+{
+	static unsigned int stateHash[2][PSG_BENCH_BLOCKS];
+	static struct _psg_blep savedBlep;
+	struct _psg saved = PSG;
+	unsigned int savedSave[8];
+	int savedLen = PSG_Len, savedGYM = GYM_Dumping;
+	double ms[2], snr[2][PSG_BENCH_TONES], worst[2] = {1000.0, 1000.0};
+	int mismatches = 0;
+	int blep, i;
+	FILE *log;
+
+	memcpy(savedSave, PSG_Save, sizeof(savedSave));
+	savedBlep = PSG_Blep_State;
+	PSG_Len = 0;					// register writes must not render into the real sound buffers
+	GYM_Dumping = 0;
+
+	for(blep = 0; blep < 2; blep++)
+	{
+		ms[blep] = PSG_Bench_Pass(psgClock, rate, blep, NULL);
+		PSG_Bench_Pass(psgClock, rate, blep, stateHash[blep]);
+
+		// tones past the cutoff have no harmonics left to measure against
+		for(i = 0; i < PSG_BENCH_TONES; i++)
+		{
+			if ((double) psgClock / (32.0 * PSG_Bench_Periods[i]) >= rate * PSG_BLEP_CUTOFF) continue;
+			snr[blep][i] = PSG_Bench_SNR(psgClock, rate, blep, PSG_Bench_Periods[i]);
+			if (snr[blep][i] < worst[blep]) worst[blep] = snr[blep][i];
+		}
+	}
+
+	for(i = 0; i < PSG_BENCH_BLOCKS; i++)
+		if (stateHash[0][i] != stateHash[1][i]) mismatches++;
+
+	PSG_Init(psgClock, rate);
+	PSG = saved;
+	memcpy(PSG_Save, savedSave, sizeof(savedSave));
+	PSG_Blep_State = savedBlep;
+	PSG_Len = savedLen;
+	GYM_Dumping = savedGYM;
+
+	log = Benchmark_Log("psg");
+	if (log)
+	{
+		double samples = (double) PSG_BENCH_BLOCK * PSG_BENCH_BLOCKS;
+
+		fprintf(log, "PSG at %d Hz: normal %.0f ms (%.0f samples/s), band-limited %.0f ms (%.0f samples/s), %d of %d frames differ\n",
+			rate, ms[0], samples * 1000.0 / (ms[0] ? ms[0] : 1), ms[1], samples * 1000.0 / (ms[1] ? ms[1] : 1), mismatches, PSG_BENCH_BLOCKS);
+		for(i = 0; i < PSG_BENCH_TONES; i++)
+		{
+			double freq = (double) psgClock / (32.0 * PSG_Bench_Periods[i]);
+
+			if (freq >= rate * PSG_BLEP_CUTOFF) fprintf(log, "  %5.0f Hz tone: too high for this rate\n", freq);
+			else fprintf(log, "  %5.0f Hz tone: harmonics over the rest %5.1f dB normal, %5.1f dB band-limited\n", freq, snr[0][i], snr[1][i]);
+		}
+		fprintf(log, "\n");
+		fclose(log);
+	}
+
+	sprintf(summary, "PSG: normal %.0f ms, worst %.0f dB; band-limited %.0f ms, worst %.0f dB%s",
+		ms[0], worst[0], ms[1], worst[1], mismatches ? " (MISMATCH)" : "");
+
+	return mismatches;
+}
+
 /* end */
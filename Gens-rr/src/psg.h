@@ -26,6 +26,7 @@ extern struct _psg PSG;
 
 extern int PSG_Enable;
 extern int PSG_Improv;
+extern int PSG_Blep;
 extern int *PSG_Buf[2];
 extern int PSG_Len;
 extern unsigned short PSGVol;
@@ -34,6 +35,7 @@ extern unsigned short PSGVol;
 void PSG_Write(int data);
 void PSG_Update_SIN(int **buffer, int length);
 void PSG_Update(int **buffer, int length);
+void PSG_Update_BLEP(int **buffer, int length);
 void PSG_Init(int clock, int rate);
 // warning: these might not be complete, saving whole _psg struct might be better
 void PSG_Save_State(void);
@@ -42,6 +44,7 @@ void PSG_Restore_State(void);
 /* Gens */
 
 void PSG_Special_Update(void);
+int PSG_Benchmark(int psgClock, int rate, char *summary);
 
 #ifdef __cplusplus
 };
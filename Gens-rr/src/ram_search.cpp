@@ -36,13 +36,16 @@
 #include "ram_search.h"
 #include "hexeditor.h"
 #include "g_main.h"
+#include "G_ddraw.h"
 #include <assert.h>
 #include <commctrl.h>
 #include "G_dsound.h"
 #include "ramwatch.h"
 #include "luascript.h"
+#include "benchmark.h"
 #include <list>
 #include <vector>
+#include <emmintrin.h>
 #ifdef _WIN32
    #include "BaseTsd.h"
    typedef INT_PTR intptr_t;
@@ -69,6 +72,10 @@ static MemoryRegion* s_itemIndexToRegionPointer [MAX_RAM_SIZE+4] = {0}; // used
 static BOOL s_itemIndicesInvalid = true; // if true, the link from listbox items to memory regions (s_itemIndexToRegionPointer) and the link from memory regions to list box items (MemoryRegion::itemIndex) both need to be recalculated
 static BOOL s_prevValuesNeedUpdate = true; // if true, the "prev" values should be updated using the "cur" values on the next frame update signaled
 static unsigned int s_maxItemIndex = 0; // max currently valid item index, the listbox sometimes tries to update things past the end of the list so we need to know this to ignore those attempts
+static const bool s_searchUseSSE2 = CPU_Has_SSE2() != 0; // for the vectorized update and search functions
+#define UPDATE_SSE2_MIN_REGION_SIZE 64
+static bool s_updateUseSSE2 = s_searchUseSSE2; // RamSearch_Benchmark turns this off to compare with the scalar update
+static unsigned short s_changedBytes [MAX_RAM_SIZE/16+2]; // per block of 16 bytes of the region being updated, which bytes changed this frame
 
 static const MemoryRegion s_prgRegion    = {  0x020000, SEGACD_RAM_PRG_SIZE, (unsigned char*)Ram_Prg,     true};
 static const MemoryRegion s_word1MRegion = {  0x200000, SEGACD_1M_RAM_SIZE,  (unsigned char*)Ram_Word_1M, true};
@@ -199,6 +206,78 @@ void CalculateItemIndices(int itemSize)
 	s_itemIndicesInvalid = FALSE;
 }
 
+// same result as the scalar loops in UpdateRegionT:
+// every byte in [indexStart, readEnd) that differs from the source is copied if it's below copyEnd,
+// and every entry in [indexStart, indexEnd) that has a changed byte among its sizeof(compareType) bytes gets its change count increased once.
+// 16 bytes are compared at a time, and blocks where nothing changed are skipped.
+template<typename compareType, int swapXOR>
+void UpdateRegionSSE2T(const MemoryRegion& region, unsigned int indexStart, unsigned int indexEnd, unsigned int readEnd, unsigned int copyEnd)
+{
+	unsigned char* sourceAddr = region.softwareAddress - region.virtualIndex;
+	unsigned int blockStart = indexStart & ~(unsigned int)swapXOR; // swapped byte pairs start on even indices
+	unsigned int numBlocks = (readEnd - blockStart + 15) / 16;
+
+	// pass 1: find and copy the changed bytes
+	for(unsigned int b = 0, i = blockStart; b < numBlocks; b++, i += 16)
+	{
+		if(i >= indexStart && i + 16 <= readEnd && i + 16 <= copyEnd)
+		{
+			__m128i cur = _mm_loadu_si128((const __m128i*)(s_curValues + i));
+			__m128i src = _mm_loadu_si128((const __m128i*)(sourceAddr + i));
+			if(swapXOR)
+				src = _mm_or_si128(_mm_slli_epi16(src, 8), _mm_srli_epi16(src, 8));
+			unsigned int changed = ~_mm_movemask_epi8(_mm_cmpeq_epi8(cur, src)) & 0xFFFF;
+			if(changed)
+				_mm_storeu_si128((__m128i*)(s_curValues + i), src);
+			s_changedBytes[b] = changed;
+		}
+		else // first or last block
+		{
+			unsigned int changed = 0;
+			for(unsigned int t = 0; t < 16; t++)
+			{
+				unsigned int j = i + t;
+				if(j < indexStart || j >= readEnd || s_curValues[j] == sourceAddr[j^swapXOR])
+					continue;
+				changed |= 1 << t;
+				if(j < copyEnd)
+					s_curValues[j] = sourceAddr[j^swapXOR];
+			}
+			s_changedBytes[b] = changed;
+		}
+	}
+	s_changedBytes[numBlocks] = 0;
+
+	// pass 2: an entry changed if any of its bytes did, and those can continue into the next block
+	const __m128i bitsLo = _mm_set_epi16(0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+	const __m128i bitsHi = _mm_set_epi16(0x8000, 0x4000, 0x2000, 0x1000, 0x0800, 0x0400, 0x0200, 0x0100);
+	for(unsigned int b = 0, i = blockStart; b < numBlocks; b++, i += 16)
+	{
+		unsigned int bytes = s_changedBytes[b] | (s_changedBytes[b+1] << 16);
+		unsigned int entries = bytes;
+		for(unsigned int k = 1; k < sizeof(compareType); k++)
+			entries |= bytes >> k;
+		entries &= 0xFFFF;
+		if(!entries)
+			continue;
+
+		if(i >= indexStart && i + 16 <= indexEnd)
+		{
+			__m128i mask = _mm_set1_epi16((short)entries);
+			__m128i* counts = (__m128i*)(s_numChanges + i);
+			// subtracting -1 from the lanes of changed entries
+			_mm_storeu_si128(counts, _mm_sub_epi16(_mm_loadu_si128(counts), _mm_cmpeq_epi16(_mm_and_si128(mask, bitsLo), bitsLo)));
+			_mm_storeu_si128(counts + 1, _mm_sub_epi16(_mm_loadu_si128(counts + 1), _mm_cmpeq_epi16(_mm_and_si128(mask, bitsHi), bitsHi)));
+		}
+		else
+		{
+			for(unsigned int t = 0; t < 16; t++)
+				if((entries & (1 << t)) && i + t >= indexStart && i + t < indexEnd)
+					s_numChanges[i + t]++;
+		}
+	}
+}
+
 template<typename stepType, typename compareType, int swapXOR>
 void UpdateRegionT(const MemoryRegion& region, const MemoryRegion* nextRegionPtr)
 {
@@ -211,7 +290,15 @@ void UpdateRegionT(const MemoryRegion& region, const MemoryRegion* nextRegionPtr
 	unsigned int indexStart = region.virtualIndex + startSkipSize;
 	unsigned int indexEnd = region.virtualIndex + region.size;
 
-	if(sizeof(compareType) == 1)
+	// small regions (what's left after a few searches) are cheaper to walk one byte at a time
+	bool vectorize = s_updateUseSSE2 && region.size >= UPDATE_SSE2_MIN_REGION_SIZE;
+
+	if(sizeof(compareType) == 1 && vectorize)
+	{
+		if(indexStart < indexEnd)
+			UpdateRegionSSE2T<compareType, swapXOR>(region, indexStart, indexEnd, indexEnd, indexEnd);
+	}
+	else if(sizeof(compareType) == 1)
 	{
 		for(unsigned int i = indexStart; i < indexEnd; i++)
 		{
@@ -240,6 +327,13 @@ void UpdateRegionT(const MemoryRegion& region, const MemoryRegion* nextRegionPtr
 				lastIndexToCopy = nextIndexStart;
 		}
 
+		if(vectorize)
+		{
+			if(indexStart < lastIndexToRead)
+				UpdateRegionSSE2T<compareType, swapXOR>(region, indexStart, indexEnd, lastIndexToRead, lastIndexToCopy);
+			return;
+		}
+
 		unsigned int nextValidChange [sizeof(compareType)];
 		for(unsigned int i = 0; i < sizeof(compareType); i++)
 			nextValidChange[i] = indexStart + i;
@@ -495,9 +589,9 @@ template <typename T> inline bool UnequalCmp (T x, T y, T i)     { return x != y
 template <typename T> inline bool DiffByCmp (T x, T y, T p)      { return x - y == p || y - x == p; }
 template <typename T> inline bool ModIsCmp (T x, T y, T p)       { return p && x % p == y; }
 
-// compare-to type functions:
+// compare-to type functions (one item at a time, see FilterRegions for the faster version):
 template<typename stepType, typename T>
-void SearchRelative (bool(*cmpFun)(T,T,T), T ignored, T param)
+void SearchRelativeScalar (bool(*cmpFun)(T,T,T), T ignored, T param)
 {
 	for(MemoryList::iterator iter = s_activeMemoryRegions.begin(); iter != s_activeMemoryRegions.end(); )
 	{
@@ -515,7 +609,7 @@ outerContinue:
 	}
 }
 template<typename stepType, typename T>
-void SearchSpecific (bool(*cmpFun)(T,T,T), T value, T param)
+void SearchSpecificScalar (bool(*cmpFun)(T,T,T), T value, T param)
 {
 	for(MemoryList::iterator iter = s_activeMemoryRegions.begin(); iter != s_activeMemoryRegions.end(); )
 	{
@@ -551,7 +645,7 @@ outerContinue:
 	}
 }
 template<typename stepType, typename T>
-void SearchChanges (bool(*cmpFun)(T,T,T), T changes, T param)
+void SearchChangesScalar (bool(*cmpFun)(T,T,T), T changes, T param)
 {
 	for(MemoryList::iterator iter = s_activeMemoryRegions.begin(); iter != s_activeMemoryRegions.end(); )
 	{
@@ -569,6 +663,296 @@ outerContinue:
 	}
 }
 
+
+// vectorized search:
+// all items of a region are tested into s_searchPass first (with SSE2 compares when the operator has one),
+// then the surviving items are turned back into regions in a single pass.
+// this gives the same result as the scalar functions above, which call DeactivateRegion (and split a list node) on every miss.
+
+enum SearchSource { SEARCHSRC_RELATIVE, SEARCHSRC_SPECIFIC, SEARCHSRC_CHANGES };
+enum SearchOperator { SEARCHOP_SCALAR, SEARCHOP_LESS, SEARCHOP_MORE, SEARCHOP_LESSEQUAL, SEARCHOP_MOREEQUAL, SEARCHOP_EQUAL, SEARCHOP_UNEQUAL, SEARCHOP_DIFFBY };
+
+#define SEARCH_CHUNK_ITEMS 4096
+ALIGN16 static unsigned char s_searchX [SEARCH_CHUNK_ITEMS*sizeof(long)]; // values being tested
+ALIGN16 static unsigned char s_searchY [SEARCH_CHUNK_ITEMS*sizeof(long)]; // values they're compared to
+ALIGN16 static unsigned char s_searchPass [MAX_RAM_SIZE+16]; // 1 if the item survives, per item of the region being searched
+
+template<typename T>
+SearchOperator GetSearchOperator(bool(*cmpFun)(T,T,T))
+{
+	if(cmpFun == &LessCmp<T>) return SEARCHOP_LESS;
+	if(cmpFun == &MoreCmp<T>) return SEARCHOP_MORE;
+	if(cmpFun == &LessEqualCmp<T>) return SEARCHOP_LESSEQUAL;
+	if(cmpFun == &MoreEqualCmp<T>) return SEARCHOP_MOREEQUAL;
+	if(cmpFun == &EqualCmp<T>) return SEARCHOP_EQUAL;
+	if(cmpFun == &UnequalCmp<T>) return SEARCHOP_UNEQUAL;
+	if(cmpFun == &DiffByCmp<T>) return SEARCHOP_DIFFBY;
+	return SEARCHOP_SCALAR; // ModIsCmp
+}
+
+// reads count big-endian values that start sizeof(stepType) bytes apart
+template<typename stepType, typename T>
+void GatherValues(const unsigned char* src, T* out, unsigned int count)
+{
+	unsigned int k = 0;
+	if(sizeof(T) == 1)
+	{
+		memcpy(out, src, count);
+		return;
+	}
+	else if(sizeof(T) == 2 && s_searchUseSSE2)
+	{
+		if(sizeof(stepType) == 2)
+		{
+			for(; k + 8 <= count; k += 8)
+			{
+				__m128i v = _mm_loadu_si128((const __m128i*)(src + k*2));
+				_mm_store_si128((__m128i*)(out + k), _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
+			}
+		}
+		else
+		{
+			// value k is src[k] << 8 | src[k+1]
+			for(; k + 16 <= count; k += 16)
+			{
+				__m128i hi = _mm_loadu_si128((const __m128i*)(src + k));
+				__m128i lo = _mm_loadu_si128((const __m128i*)(src + k + 1));
+				_mm_store_si128((__m128i*)(out + k), _mm_unpacklo_epi8(lo, hi));
+				_mm_store_si128((__m128i*)(out + k + 8), _mm_unpackhi_epi8(lo, hi));
+			}
+		}
+	}
+	for(; k < count; k++)
+		out[k] = ReadBigEndian<T>(src + k*sizeof(stepType));
+}
+
+// compares 16 items per step with SSE2, returns how many items it did (the rest is left to the scalar comparator).
+// sizes without a specialization aren't vectorized.
+template<typename T, int size = sizeof(T)>
+struct SearchKernel
+{
+	static unsigned int Compare(SearchOperator op, const T* x, const T* y, T param, unsigned char* pass, unsigned int count) { return 0; }
+};
+
+template<int size> struct SearchLanes {};
+template<> struct SearchLanes<1>
+{
+	static __m128i Set(int v) { return _mm_set1_epi8((char)v); }
+	static __m128i Eq(__m128i a, __m128i b) { return _mm_cmpeq_epi8(a, b); }
+	static __m128i Gt(__m128i a, __m128i b) { return _mm_cmpgt_epi8(a, b); }
+	static __m128i DiffBy(__m128i a, __m128i b, __m128i d) { return _mm_cmpeq_epi8(_mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a)), d); } // |a-b| == d, unsigned
+	static __m128i Pack(const __m128i* m) { return m[0]; }
+};
+template<> struct SearchLanes<2>
+{
+	static __m128i Set(int v) { return _mm_set1_epi16((short)v); }
+	static __m128i Eq(__m128i a, __m128i b) { return _mm_cmpeq_epi16(a, b); }
+	static __m128i Gt(__m128i a, __m128i b) { return _mm_cmpgt_epi16(a, b); }
+	static __m128i DiffBy(__m128i a, __m128i b, __m128i d) { return _mm_cmpeq_epi16(_mm_or_si128(_mm_subs_epu16(a, b), _mm_subs_epu16(b, a)), d); }
+	static __m128i Pack(const __m128i* m) { return _mm_packs_epi16(m[0], m[1]); }
+};
+template<> struct SearchLanes<4>
+{
+	static __m128i Set(int v) { return _mm_set1_epi32(v); }
+	static __m128i Eq(__m128i a, __m128i b) { return _mm_cmpeq_epi32(a, b); }
+	static __m128i Gt(__m128i a, __m128i b) { return _mm_cmpgt_epi32(a, b); }
+	static __m128i DiffBy(__m128i a, __m128i b, __m128i d) { return _mm_or_si128(_mm_cmpeq_epi32(_mm_sub_epi32(a, b), d), _mm_cmpeq_epi32(_mm_sub_epi32(b, a), d)); } // wraps like 32-bit C arithmetic
+	static __m128i Pack(const __m128i* m) { return _mm_packs_epi16(_mm_packs_epi32(m[0], m[1]), _mm_packs_epi32(m[2], m[3])); }
+};
+
+template<typename T, int size>
+struct SearchKernelSSE2
+{
+	static unsigned int Compare(SearchOperator op, const T* x, const T* y, T param, unsigned char* pass, unsigned int count)
+	{
+		typedef SearchLanes<size> L;
+		const bool isSigned = (T)-1 < 0;
+		const __m128i signBit = L::Set(1 << (size*8-1));
+		const __m128i ones = _mm_set1_epi8((char)0xFF);
+		// SSE2 only has signed compares, so unsigned values get their sign bit flipped first.
+		// DiffBy works the other way around: in the unsigned domain, with the sizes that C promotes to int
+		const __m128i orderBias = isSigned ? _mm_setzero_si128() : signBit;
+		const __m128i diffBias = isSigned ? signBit : _mm_setzero_si128();
+		const __m128i diff = size < 4 ? L::Set(abs((int)param)) : L::Set((int)param);
+
+		unsigned int k = 0;
+		for(; k + 16 <= count; k += 16)
+		{
+			__m128i m[4];
+			for(int v = 0; v < size; v++)
+			{
+				__m128i a = _mm_loadu_si128((const __m128i*)(x + k) + v);
+				__m128i b = _mm_loadu_si128((const __m128i*)(y + k) + v);
+				switch(op)
+				{
+					case SEARCHOP_EQUAL: m[v] = L::Eq(a, b); break;
+					case SEARCHOP_UNEQUAL: m[v] = _mm_xor_si128(L::Eq(a, b), ones); break;
+					case SEARCHOP_LESS: m[v] = L::Gt(_mm_xor_si128(b, orderBias), _mm_xor_si128(a, orderBias)); break;
+					case SEARCHOP_MORE: m[v] = L::Gt(_mm_xor_si128(a, orderBias), _mm_xor_si128(b, orderBias)); break;
+					case SEARCHOP_LESSEQUAL: m[v] = _mm_xor_si128(L::Gt(_mm_xor_si128(a, orderBias), _mm_xor_si128(b, orderBias)), ones); break;
+					case SEARCHOP_MOREEQUAL: m[v] = _mm_xor_si128(L::Gt(_mm_xor_si128(b, orderBias), _mm_xor_si128(a, orderBias)), ones); break;
+					case SEARCHOP_DIFFBY: m[v] = L::DiffBy(_mm_xor_si128(a, diffBias), _mm_xor_si128(b, diffBias), diff); break;
+					default: return 0;
+				}
+			}
+			_mm_store_si128((__m128i*)(pass + k), _mm_and_si128(L::Pack(m), _mm_set1_epi8(1)));
+		}
+		return k;
+	}
+};
+template<typename T> struct SearchKernel<T,1> : SearchKernelSSE2<T,1> {};
+template<typename T> struct SearchKernel<T,2> : SearchKernelSSE2<T,2> {};
+template<typename T> struct SearchKernel<T,4> : SearchKernelSSE2<T,4> {};
+
+static void AppendSubRegion(MemoryList& out, const MemoryRegion& region, unsigned int offset, unsigned int size)
+{
+	MemoryRegion subRegion = {region.hardwareAddress + offset, size, region.softwareAddress + offset, region.byteSwapped, region.virtualIndex + offset};
+	out.push_back(subRegion);
+}
+
+// item k covers the bytes [k*sizeof(stepType), (k+1)*sizeof(stepType)) of the region,
+// the same range the scalar search functions pass to DeactivateRegion.
+// returns true if anything was eliminated
+template<typename stepType>
+bool AppendSurvivingRegions(MemoryList& out, const MemoryRegion& region, const unsigned char* pass, unsigned int numItems)
+{
+	unsigned int keepStart = 0;
+	bool eliminated = false;
+	unsigned int k = 0;
+	while(k < numItems)
+	{
+		// whole blocks of 16 items that all survive or all fail are handled at once
+		unsigned int blockItems = 1;
+		if(s_searchUseSSE2 && k + 16 <= numItems)
+		{
+			int failed = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(pass + k)), _mm_setzero_si128()));
+			if(failed == 0)
+			{
+				k += 16;
+				continue;
+			}
+			if(failed == 0xFFFF)
+				blockItems = 16;
+		}
+		if(blockItems == 1 && pass[k])
+		{
+			k++;
+			continue;
+		}
+		unsigned int removeStart = k*sizeof(stepType);
+		unsigned int removeEnd = min(removeStart + blockItems*(unsigned int)sizeof(stepType), region.size);
+		if(removeStart > keepStart)
+			AppendSubRegion(out, region, keepStart, removeStart - keepStart);
+		keepStart = removeEnd;
+		eliminated = true;
+		k += blockItems;
+	}
+	if(!eliminated)
+		out.push_back(region);
+	else if(keepStart < region.size)
+		AppendSubRegion(out, region, keepStart, region.size - keepStart);
+	return eliminated;
+}
+
+template<typename stepType, typename T>
+void FilterRegions(SearchSource source, bool(*cmpFun)(T,T,T), T value, T param)
+{
+	SearchOperator op = s_searchUseSSE2 ? GetSearchOperator(cmpFun) : SEARCHOP_SCALAR;
+	MemoryList result;
+	bool eliminated = false;
+
+	for(MemoryList::iterator iter = s_activeMemoryRegions.begin(); iter != s_activeMemoryRegions.end(); ++iter)
+	{
+		const MemoryRegion& region = *iter;
+		unsigned int startSkipSize = ((unsigned int)(sizeof(stepType) - region.hardwareAddress)) % sizeof(stepType);
+		unsigned int numItems = (region.size > startSkipSize) ? (region.size - startSkipSize + sizeof(stepType)-1) / sizeof(stepType) : 0;
+		unsigned int start = region.virtualIndex + startSkipSize;
+
+		for(unsigned int chunk = 0; chunk < numItems; chunk += SEARCH_CHUNK_ITEMS)
+		{
+			unsigned int count = min(numItems - chunk, (unsigned int)SEARCH_CHUNK_ITEMS);
+			unsigned int index = start + chunk*sizeof(stepType);
+			const T* x = (const T*)s_searchX;
+			const T* y = (const T*)s_searchY;
+			unsigned int k;
+
+			// byte values are already laid out the way the compare wants them
+			if(source == SEARCHSRC_CHANGES)
+				for(k = 0; k < count; k++)
+					((T*)s_searchX)[k] = (T)s_numChanges[index + k*sizeof(stepType)];
+			else if(sizeof(T) == 1)
+				x = (const T*)(s_curValues + index);
+			else
+				GatherValues<stepType,T>(s_curValues + index, (T*)s_searchX, count);
+
+			if(source == SEARCHSRC_RELATIVE && sizeof(T) == 1)
+				y = (const T*)(s_prevValues + index);
+			else if(source == SEARCHSRC_RELATIVE)
+				GatherValues<stepType,T>(s_prevValues + index, (T*)s_searchY, count);
+			else
+				for(k = 0; k < count; k++)
+					((T*)s_searchY)[k] = value;
+
+			unsigned char* pass = s_searchPass + chunk;
+			k = (op != SEARCHOP_SCALAR) ? SearchKernel<T>::Compare(op, x, y, param, pass, count) : 0;
+			for(; k < count; k++)
+				pass[k] = cmpFun(x[k], y[k], param) ? 1 : 0;
+		}
+
+		eliminated |= AppendSurvivingRegions<stepType>(result, region, s_searchPass, numItems);
+	}
+
+	if(eliminated)
+	{
+		s_activeMemoryRegions.swap(result);
+		s_itemIndicesInvalid = TRUE;
+	}
+}
+
+static bool SameRegions(const MemoryList& a, const MemoryList& b)
+{
+	if(a.size() != b.size())
+		return false;
+	for(MemoryList::const_iterator i = a.begin(), j = b.begin(); i != a.end(); ++i, ++j)
+		if(i->hardwareAddress != j->hardwareAddress || i->size != j->size || i->virtualIndex != j->virtualIndex || i->softwareAddress != j->softwareAddress)
+			return false;
+	return true;
+}
+
+// in debug builds every search is also done the old way, and the results have to match
+template<typename stepType, typename T>
+void FilterRegionsChecked(SearchSource source, void(*scalarFun)(bool(*)(T,T,T),T,T), bool(*cmpFun)(T,T,T), T value, T param)
+{
+#ifdef _DEBUG
+	MemoryList original = s_activeMemoryRegions;
+	scalarFun(cmpFun, value, param);
+	MemoryList expected;
+	expected.swap(s_activeMemoryRegions);
+	s_activeMemoryRegions.swap(original);
+	FilterRegions<stepType,T>(source, cmpFun, value, param);
+	assert(SameRegions(expected, s_activeMemoryRegions) && "vectorized RAM search disagrees with the scalar search");
+#else
+	FilterRegions<stepType,T>(source, cmpFun, value, param);
+#endif
+}
+
+template<typename stepType, typename T>
+void SearchRelative (bool(*cmpFun)(T,T,T), T ignored, T param)
+{
+	FilterRegionsChecked<stepType,T>(SEARCHSRC_RELATIVE, SearchRelativeScalar<stepType,T>, cmpFun, ignored, param);
+}
+template<typename stepType, typename T>
+void SearchSpecific (bool(*cmpFun)(T,T,T), T value, T param)
+{
+	FilterRegionsChecked<stepType,T>(SEARCHSRC_SPECIFIC, SearchSpecificScalar<stepType,T>, cmpFun, value, param);
+}
+template<typename stepType, typename T>
+void SearchChanges (bool(*cmpFun)(T,T,T), T changes, T param)
+{
+	FilterRegionsChecked<stepType,T>(SEARCHSRC_CHANGES, SearchChangesScalar<stepType,T>, cmpFun, changes, param);
+}
+
+
 char rs_c='s';
 char rs_o='=';
 char rs_t='s';
@@ -626,6 +1010,185 @@ void prune(char c,char o,char t,int v,int p)
 	}
 }
 
+static void BenchmarkSearch(bool vectorized, char c, char o, char size, bool isSigned, bool aligned, int v, int p)
+{
+	#define DO_BENCH_SEARCH(CmpFun) \
+	switch (c) \
+	{ \
+		case 'r': if(vectorized) CALL_WITH_T_SIZE_TYPES(FilterRegions, size, isSigned, aligned, SEARCHSRC_RELATIVE, CmpFun,v,p); \
+		          else CALL_WITH_T_SIZE_TYPES(SearchRelativeScalar, size, isSigned, aligned, CmpFun,v,p); break; \
+		case 's': if(vectorized) CALL_WITH_T_SIZE_TYPES(FilterRegions, size, isSigned, aligned, SEARCHSRC_SPECIFIC, CmpFun,v,p); \
+		          else CALL_WITH_T_SIZE_TYPES(SearchSpecificScalar, size, isSigned, aligned, CmpFun,v,p); break; \
+		case 'n': if(vectorized) CALL_WITH_T_STEP(FilterRegions, size, unsigned,short, aligned, SEARCHSRC_CHANGES, CmpFun,v,p); \
+		          else CALL_WITH_T_STEP(SearchChangesScalar, size, unsigned,short, aligned, CmpFun,v,p); break; \
+	}
+	switch (o)
+	{
+		case '<': DO_BENCH_SEARCH(LessCmp); break;
+		case '>': DO_BENCH_SEARCH(MoreCmp); break;
+		case '=': DO_BENCH_SEARCH(EqualCmp); break;
+		case 'd': DO_BENCH_SEARCH(DiffByCmp); break;
+		case '%': DO_BENCH_SEARCH(ModIsCmp); break;
+	}
+	#undef DO_BENCH_SEARCH
+}
+
+// times the scalar and vectorized searches and per-frame updates on a synthetic RAM image of MAX_RAM_SIZE bytes (laid out like Sega CD RAM),
+// and writes the results to Logs\ram_search_bench.log, returns the number of searches and updates that didn't match
+int RamSearch_Benchmark(char* summary)
+{
+	// borrow the search arrays and the region list, they're restored at the end
+	std::vector<unsigned char> savedPrevValues (s_prevValues, s_prevValues + sizeof(s_prevValues));
+	std::vector<unsigned char> savedCurValues (s_curValues, s_curValues + sizeof(s_curValues));
+	std::vector<unsigned short> savedNumChanges (s_numChanges, s_numChanges + sizeof(s_numChanges)/sizeof(*s_numChanges));
+	MemoryList savedRegions = s_activeMemoryRegions;
+
+	MemoryList allRegions;
+	const MemoryRegion* layout [] = {&s_68kRegion, &s_z80Region, &s_prgRegion, &s_word2MRegion};
+	unsigned int nextVirtualIndex = 0;
+	for(int i = 0; i < sizeof(layout)/sizeof(*layout); i++)
+	{
+		MemoryRegion region = *layout[i];
+		region.virtualIndex = nextVirtualIndex;
+		nextVirtualIndex += region.size;
+		allRegions.push_back(region);
+	}
+
+	// mostly small values with some bytes changed since the last search, roughly like game RAM
+	unsigned int seed = 0x12345678;
+	for(unsigned int i = 0; i < nextVirtualIndex + 4; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		unsigned int r = seed >> 4;
+		s_prevValues[i] = (r & 3) ? (unsigned char)((r >> 4) & 0x0F) : (unsigned char)(r >> 8);
+		s_curValues[i] = (r & 0x70) ? s_prevValues[i] : (unsigned char)(r >> 16);
+		s_numChanges[i] = (s_curValues[i] != s_prevValues[i]) ? (unsigned short)(((r >> 24) & 3) + 1) : 0;
+	}
+
+	struct { char c, o; int v, p; const char* name; } searches [] = {
+		{'r', '<', 0, 0, "cur < prev"},
+		{'r', 'd', 0, 1, "cur differs from prev by 1"},
+		{'s', '=', 0, 0, "cur == 0"},
+		{'s', '%', 1, 4, "cur % 4 == 1 (scalar compare)"},
+		{'n', '>', 0, 0, "changes > 0"},
+	};
+	struct { char size; bool aligned; } sizes [] = { {'b', true}, {'w', true}, {'w', false}, {'d', true}, {'d', false} };
+
+	double totalScalar = 0, totalVectorized = 0;
+	int mismatches = 0;
+
+	FILE* log = Benchmark_Log("ram_search");
+	if(log)
+		fprintf(log, "RAM search on %d synthetic bytes (%s)\n", nextVirtualIndex, s_searchUseSSE2 ? "SSE2" : "no SSE2, scalar compares");
+
+	for(int s = 0; s < sizeof(sizes)/sizeof(*sizes); s++)
+	for(int isSigned = 0; isSigned < 2; isSigned++)
+	for(int i = 0; i < sizeof(searches)/sizeof(*searches); i++)
+	{
+		double ms [2];
+		MemoryList results [2];
+		for(int vectorized = 0; vectorized < 2; vectorized++)
+		{
+			s_activeMemoryRegions = allRegions;
+			double start = Benchmark_Time();
+			BenchmarkSearch(vectorized != 0, searches[i].c, searches[i].o, sizes[s].size, isSigned != 0, sizes[s].aligned, searches[i].v, searches[i].p);
+			ms[vectorized] = Benchmark_Time() - start;
+			results[vectorized].swap(s_activeMemoryRegions);
+		}
+		bool match = SameRegions(results[0], results[1]);
+		if(!match)
+			mismatches++;
+		totalScalar += ms[0];
+		totalVectorized += ms[1];
+		if(log)
+			fprintf(log, "%c %s%s %-30s scalar %8.2f ms, vectorized %7.2f ms, %6d regions left%s\n",
+				sizes[s].size, isSigned ? "signed  " : "unsigned", sizes[s].aligned ? "" : " misaligned", searches[i].name,
+				ms[0], ms[1], (int)results[1].size(), match ? "" : " MISMATCH");
+	}
+
+	if(log)
+		fprintf(log, "search total: scalar %.1f ms, vectorized %.1f ms, %d mismatches\n", totalScalar, totalVectorized, mismatches);
+
+	// per-frame update: both ways start from the same values, and the same source bytes change every frame.
+	// this doubles as the regression test for the vectorized update, the change counts have to come out identical
+	const int updateFrames = 60;
+	std::vector<unsigned char> source (nextVirtualIndex + 32);
+	std::vector<unsigned char> startCurValues (s_curValues, s_curValues + sizeof(s_curValues));
+	std::vector<unsigned short> startNumChanges (s_numChanges, s_numChanges + sizeof(s_numChanges)/sizeof(*s_numChanges));
+	std::vector<unsigned char> scalarCurValues;
+	std::vector<unsigned short> scalarNumChanges;
+	MemoryList updateRegions [2];
+	for(MemoryList::iterator iter = allRegions.begin(); iter != allRegions.end(); ++iter)
+		iter->softwareAddress = &source[iter->virtualIndex];
+	updateRegions[0] = allRegions;
+	s_activeMemoryRegions = allRegions;
+	CALL_WITH_T_SIZE_TYPES(FilterRegions, 'b', false, true, SEARCHSRC_SPECIFIC, ModIsCmp, 1, 4); // leaves lots of small regions
+	updateRegions[1].swap(s_activeMemoryRegions);
+	double totalUpdate [2] = {0, 0};
+	int updateMismatches = 0;
+	bool prevValuesNeedUpdate = s_prevValuesNeedUpdate;
+
+	for(int s = 0; s < sizeof(sizes)/sizeof(*sizes); s++)
+	for(int r = 0; r < 2; r++)
+	{
+		double ms [2] = {0, 0};
+		for(int vectorized = 0; vectorized < 2; vectorized++)
+		{
+			memcpy(s_curValues, &startCurValues[0], sizeof(s_curValues));
+			memcpy(s_numChanges, &startNumChanges[0], sizeof(s_numChanges));
+			memcpy(&source[0], &startCurValues[0], nextVirtualIndex);
+			s_activeMemoryRegions = updateRegions[r];
+			s_prevValuesNeedUpdate = false;
+			s_updateUseSSE2 = vectorized && s_searchUseSSE2;
+			seed = 0x87654321;
+			for(int frame = 0; frame < updateFrames; frame++)
+			{
+				for(unsigned int i = 0; i < nextVirtualIndex; i += 1 + (seed >> 28))
+				{
+					seed = seed * 1103515245 + 12345;
+					if(!(seed & 0x0F000000))
+						source[i] = (unsigned char)(seed >> 12);
+				}
+				double start = Benchmark_Time();
+				CALL_WITH_T_SIZE_TYPES(UpdateRegionsT, sizes[s].size, false, sizes[s].aligned);
+				ms[vectorized] += Benchmark_Time() - start;
+			}
+			if(!vectorized)
+			{
+				scalarCurValues.assign(s_curValues, s_curValues + sizeof(s_curValues));
+				scalarNumChanges.assign(s_numChanges, s_numChanges + sizeof(s_numChanges)/sizeof(*s_numChanges));
+			}
+		}
+		bool match = !memcmp(&scalarCurValues[0], s_curValues, sizeof(s_curValues)) && !memcmp(&scalarNumChanges[0], s_numChanges, sizeof(s_numChanges));
+		if(!match)
+			updateMismatches++;
+		totalUpdate[0] += ms[0];
+		totalUpdate[1] += ms[1];
+		if(log)
+			fprintf(log, "update %c%s, %6d regions: scalar %6.3f ms/frame, vectorized %6.3f ms/frame%s\n",
+				sizes[s].size, sizes[s].aligned ? "" : " misaligned", (int)updateRegions[r].size(),
+				ms[0] / updateFrames, ms[1] / updateFrames, match ? "" : " MISMATCH");
+	}
+	s_updateUseSSE2 = s_searchUseSSE2;
+	s_prevValuesNeedUpdate = prevValuesNeedUpdate;
+
+	if(log)
+	{
+		fprintf(log, "update total: scalar %.1f ms, vectorized %.1f ms, %d mismatches\n\n", totalUpdate[0], totalUpdate[1], updateMismatches);
+		fclose(log);
+	}
+
+	memcpy(s_prevValues, &savedPrevValues[0], sizeof(s_prevValues));
+	memcpy(s_curValues, &savedCurValues[0], sizeof(s_curValues));
+	memcpy(s_numChanges, &savedNumChanges[0], sizeof(s_numChanges));
+	s_activeMemoryRegions.swap(savedRegions);
+	s_itemIndicesInvalid = TRUE; // the restored regions are copies, so s_itemIndexToRegionPointer is stale
+
+	sprintf(summary, "RAM search: scalar %.0f ms, vectorized %.0f ms, update: scalar %.0f ms, vectorized %.0f ms%s", totalScalar, totalVectorized,
+		totalUpdate[0], totalUpdate[1], (mismatches || updateMismatches) ? " (MISMATCH)" : "");
+	return mismatches + updateMismatches;
+}
+
 
 
 
@@ -983,6 +1546,8 @@ bool WriteCellToVDPAddress(unsigned short address, unsigned char *cell) {
 
 	Byte_Swap(cell,32);
 	memcpy(&(VRam[address]),cell,32);
+	VRam_Tile_Dirty[address >> 5] = 1;
+	VRam_Tile_Dirty[((address + 31) >> 5) & 0x7FF] = 1;
 	return true;
 }
 
@@ -555,6 +555,20 @@
 #define ID_TOGGLE_SHOWFPS               40725
 #define ID_TOGGLE_SHOWLED               40726
 #define ID_TOGGLE_TURBO                 40728
+#define ID_TOGGLE_REWIND                40729
+#define ID_REWIND_BENCHMARK             40730
+#define ID_MOVIE_INPUT_BENCHMARK        40731
+#define ID_TOGGLE_MOVIE_STATE_DIFFS     40732
+#define ID_RAM_SEARCH_BENCHMARK         40733
+#define ID_YM2612_BENCHMARK             40734
+#define ID_SOUND_PSGBLEP                40736
+#define ID_PSG_BENCHMARK                40737
+#define ID_PCM_BENCHMARK                40738
+#define ID_CDDA_BENCHMARK               40739
+#define ID_GRAPHICS_TILECACHE           40740
+#define ID_VDP_BENCHMARK                40741
+#define ID_GRAPHICS_THREADEDPRESENT     40742
+#define ID_LUA_MEMHOOK_BENCHMARK        40743
 #define IDC_EDIT_COMPAREVALUE           41090
 #define IDC_EDIT_COMPAREADDRESS         41091
 #define IDC_EDIT_COMPARECHANGES         41092
@@ -623,6 +637,8 @@
 #define ID_NEXT_TRACK                   43203
 #define ID_CHANGE_TRACE_LIMIT           43204
 #define ID_CHANGE_TRACE_INDENT          43205
+#define ID_CHANGE_TRACE_BINARY          43206
+#define ID_CHANGE_COVERAGE              43207
 #define IDC_MASTVOL                     43300
 #define IDC_2612VOL                     43301
 #define IDC_PSGVOL                      43302
@@ -0,0 +1,378 @@
+#include <windows.h>
+#include <stdio.h>
+#include <string.h>
+#include <deque>
+#include <vector>
+#include "rewind.h"
+#include "gens.h"
+#include "G_main.h"
+#include "G_ddraw.h"
+#include "save.h"
+#include "movie.h"
+#include "vdp_io.h"
+#include "Rom.h"
+#include "mem_M68K.h"
+#include "benchmark.h"
+
+int Rewind_Enable = 0;
+int Rewind_Interval = 1;
+int Rewind_Buffer_MB = 64;
+BOOL RewindKeyDown = 0;
+
+extern "C" int disableSound2;
+extern bool s_nextInputCondensedSet;
+extern int frameSearchFrames;
+
+// a new keyframe is started after this many deltas,
+// or sooner if a delta would be larger than half of a full state
+#define REWIND_MAX_DELTAS_PER_KEYFRAME 60
+
+struct RewindCapture
+{
+	std::vector<unsigned char> data; // raw state for a keyframe, XOR/RLE stream for a delta
+	unsigned long frameCount;
+	unsigned long lagCount;
+};
+
+// a keyframe followed by the deltas that were encoded against it.
+// deltas only depend on their keyframe, never on each other, so any capture decodes in one pass.
+struct RewindGroup
+{
+	std::vector<RewindCapture> captures; // captures[0] is the keyframe
+};
+
+class RewindRing
+{
+public:
+	RewindRing() : stateLength(0), totalBytes(0) {}
+	void Clear();
+	void Push(const unsigned char* state, int length, unsigned long frameCount, unsigned long lagCount, size_t budget);
+	bool Pop(unsigned char* state, unsigned long& frameCount, unsigned long& lagCount);
+	bool Newest(unsigned long& frameCount) const;
+	void DiscardFrom(unsigned long frameCount);
+	int Count() const;
+	int Keyframes() const { return groups.size(); }
+	size_t Bytes() const { return totalBytes; }
+private:
+	std::deque<RewindGroup> groups;
+	int stateLength;
+	size_t totalBytes;
+};
+
+ALIGN16 static unsigned char s_rewindStateBuffer[MAX_STATE_FILE_LENGTH];
+static unsigned char s_rewindDeltaBuffer[MAX_STATE_FILE_LENGTH/2 + 16];
+
+static inline unsigned char* PutRunLength(unsigned char* out, unsigned int n)
+{
+	while(n >= 0x80)
+	{
+		*out++ = (unsigned char)(n | 0x80);
+		n >>= 7;
+	}
+	*out++ = (unsigned char)n;
+	return out;
+}
+
+static inline const unsigned char* GetRunLength(const unsigned char* in, unsigned int& n)
+{
+	int shift = 0;
+	unsigned char c;
+	n = 0;
+	do
+	{
+		c = *in++;
+		n |= (c & 0x7F) << shift;
+		shift += 7;
+	} while(c & 0x80);
+	return in;
+}
+
+// writes (unchanged count, changed count, changed bytes XOR keyframe) triples until the whole state is covered.
+// a changed run only ends at 4 or more unchanged bytes, so isolated matches don't cost two run lengths.
+// returns -1 as soon as the output would exceed maxSize.
+static int EncodeDelta(const unsigned char* key, const unsigned char* cur, int length, unsigned char* out, int maxSize)
+{
+	unsigned char* o = out;
+	int i = 0;
+	while(i < length)
+	{
+		int start = i;
+		while(i + 4 <= length && *(const unsigned int*)(key + i) == *(const unsigned int*)(cur + i))
+			i += 4;
+		while(i < length && key[i] == cur[i])
+			i++;
+		int same = i - start;
+
+		start = i;
+		while(i < length)
+		{
+			if(key[i] != cur[i])
+			{
+				i++;
+				continue;
+			}
+			int j = i;
+			while(j < length && j - i < 4 && key[j] == cur[j])
+				j++;
+			if(j - i >= 4 || j == length)
+				break;
+			i = j;
+		}
+		int changed = i - start;
+
+		if((o - out) + 10 + changed > maxSize)
+			return -1;
+		o = PutRunLength(o, same);
+		o = PutRunLength(o, changed);
+		for(int k = start; k < i; k++)
+			*o++ = key[k] ^ cur[k];
+	}
+	return o - out;
+}
+
+// state must already hold a copy of the keyframe
+static void DecodeDelta(const unsigned char* in, int size, unsigned char* state)
+{
+	const unsigned char* end = in + size;
+	while(in < end)
+	{
+		unsigned int same, changed;
+		in = GetRunLength(in, same);
+		in = GetRunLength(in, changed);
+		state += same;
+		for(unsigned int k = 0; k < changed; k++)
+			state[k] ^= in[k];
+		state += changed;
+		in += changed;
+	}
+}
+
+void RewindRing::Clear()
+{
+	groups.clear();
+	totalBytes = 0;
+}
+
+void RewindRing::Push(const unsigned char* state, int length, unsigned long frameCount, unsigned long lagCount, size_t budget)
+{
+	if(length != stateLength)
+	{
+		// Sega CD / 32X started or stopped, old captures can't be diffed against this state
+		Clear();
+		stateLength = length;
+	}
+
+	int deltaSize = -1;
+	if(!groups.empty() && groups.back().captures.size() <= REWIND_MAX_DELTAS_PER_KEYFRAME)
+		deltaSize = EncodeDelta(&groups.back().captures[0].data[0], state, length, s_rewindDeltaBuffer, length/2);
+
+	if(deltaSize < 0)
+		groups.push_back(RewindGroup());
+
+	std::vector<RewindCapture>& captures = groups.back().captures;
+	captures.push_back(RewindCapture());
+	RewindCapture& capture = captures.back();
+	capture.frameCount = frameCount;
+	capture.lagCount = lagCount;
+	if(deltaSize < 0)
+		capture.data.assign(state, state + length);
+	else
+		capture.data.assign(s_rewindDeltaBuffer, s_rewindDeltaBuffer + deltaSize);
+	totalBytes += capture.data.size();
+
+	// the oldest keyframe can only go together with all of its deltas
+	while(totalBytes > budget && groups.size() > 1)
+	{
+		std::vector<RewindCapture>& oldest = groups.front().captures;
+		for(unsigned int i = 0; i < oldest.size(); i++)
+			totalBytes -= oldest[i].data.size();
+		groups.pop_front();
+	}
+}
+
+bool RewindRing::Pop(unsigned char* state, unsigned long& frameCount, unsigned long& lagCount)
+{
+	if(groups.empty())
+		return false;
+
+	std::vector<RewindCapture>& captures = groups.back().captures;
+	RewindCapture& capture = captures.back();
+	memcpy(state, &captures[0].data[0], stateLength);
+	if(captures.size() > 1)
+		DecodeDelta(&capture.data[0], capture.data.size(), state);
+	frameCount = capture.frameCount;
+	lagCount = capture.lagCount;
+
+	totalBytes -= capture.data.size();
+	captures.pop_back();
+	if(captures.empty())
+		groups.pop_back();
+	return true;
+}
+
+bool RewindRing::Newest(unsigned long& frameCount) const
+{
+	if(groups.empty())
+		return false;
+	frameCount = groups.back().captures.back().frameCount;
+	return true;
+}
+
+// drops every capture at or after frameCount (the future of a timeline we've left)
+void RewindRing::DiscardFrom(unsigned long frameCount)
+{
+	while(!groups.empty())
+	{
+		std::vector<RewindCapture>& captures = groups.back().captures;
+		if(captures.back().frameCount < frameCount)
+			break;
+		totalBytes -= captures.back().data.size();
+		captures.pop_back();
+		if(captures.empty())
+			groups.pop_back();
+	}
+}
+
+int RewindRing::Count() const
+{
+	int count = 0;
+	for(unsigned int i = 0; i < groups.size(); i++)
+		count += groups[i].captures.size();
+	return count;
+}
+
+
+static RewindRing s_rewindRing;
+static bool s_rewoundSinceCapture = false;
+
+void Rewind_Reset()
+{
+	s_rewindRing.Clear();
+	s_rewoundSinceCapture = false;
+}
+
+void Rewind_Capture()
+{
+	if(!Rewind_Enable || !Game)
+		return;
+
+	unsigned long newest;
+	if(s_rewindRing.Newest(newest))
+	{
+		if(FrameCount <= newest)
+			s_rewindRing.DiscardFrom(FrameCount); // something else (a Lua script, frame search) moved the emulation backwards
+		else if(FrameCount - newest < (unsigned long)max(Rewind_Interval, 1))
+			return;
+	}
+
+	int length = Save_State_To_Buffer(s_rewindStateBuffer);
+	s_rewindRing.Push(s_rewindStateBuffer, length, FrameCount, LagCount, (size_t)max(Rewind_Buffer_MB, 1) << 20);
+	s_rewoundSinceCapture = false;
+}
+
+bool Rewind_Step()
+{
+	if(!Game)
+		return false;
+
+	// the capture of the frame we're on wouldn't visibly change anything
+	s_rewindRing.DiscardFrom(FrameCount);
+
+	unsigned long frameCount, lagCount;
+	if(!s_rewindRing.Pop(s_rewindStateBuffer, frameCount, lagCount))
+		return false;
+
+	Load_State_From_Buffer(s_rewindStateBuffer);
+	FrameCount = frameCount;
+	LagCount = lagCount;
+	s_nextInputCondensedSet = false;
+	frameSearchFrames = -1;
+
+	// one rerecord per rewind, not per step
+	if(!s_rewoundSinceCapture && MainMovie.File && MainMovie.Status == MOVIE_RECORDING && !MainMovie.ReadOnly)
+		MainMovie.NbRerecords++;
+	s_rewoundSinceCapture = true;
+
+	Update_RAM_Search();
+
+	extern bool g_anyScriptsHighSpeed;
+	if(!g_anyScriptsHighSpeed)
+	{
+		FakeVDPScreen = true;
+		Show_Genesis_Screen(HWnd);
+	}
+	return true;
+}
+
+int Rewind_Captured_Count()
+{
+	return s_rewindRing.Count();
+}
+
+int Rewind_Benchmark(char* summary)
+{
+	if(!Game)
+		return 0;
+
+	const int frames = 600;
+	ALIGN16 static unsigned char backup[MAX_STATE_FILE_LENGTH];
+	Save_State_To_Buffer(backup);
+
+	RewindRing ring;
+	double saveMs = 0, encodeMs = 0, decodeMs;
+
+	int length = 0;
+	disableSound2 = true;
+	for(int i = 0; i < frames; i++)
+	{
+		Update_Frame_Fast();
+		double t0 = Benchmark_Time();
+		length = Save_State_To_Buffer(s_rewindStateBuffer);
+		double t1 = Benchmark_Time();
+		ring.Push(s_rewindStateBuffer, length, i, 0, ~(size_t)0);
+		double t2 = Benchmark_Time();
+		saveMs += t1 - t0;
+		encodeMs += t2 - t1;
+	}
+	disableSound2 = false;
+
+	int count = ring.Count();
+	int keyframes = ring.Keyframes();
+	size_t bytes = ring.Bytes();
+
+	unsigned long frameCount, lagCount;
+	double t0 = Benchmark_Time();
+	while(ring.Pop(s_rewindStateBuffer, frameCount, lagCount)) {}
+	decodeMs = Benchmark_Time() - t0;
+
+	Load_State_From_Buffer(backup);
+
+	const char* system = _32X_Started ? "32X" : SegaCD_Started ? "Sega CD" : "Genesis";
+	double bytesPerState = (double)bytes / count;
+	double secondsPerBudget = ((double)Rewind_Buffer_MB * 1048576.0 / bytesPerState) * max(Rewind_Interval, 1) / (CPU_Mode ? 50.0 : 60.0);
+
+	char str[1024];
+	sprintf(str,
+		"%s: %s, %d frames, full state %d bytes\n"
+		"capture (Save_State_To_Buffer): %.1f us/frame\n"
+		"delta encode: %.1f us/frame\n"
+		"restore decode: %.1f us/state\n"
+		"%d captures, %d keyframes, %.0f bytes/state (%.1f%% of a full state)\n"
+		"%d MB budget at interval %d holds about %.0f seconds\n",
+		Game->Rom_Name, system, frames, length,
+		saveMs * 1000.0 / frames,
+		encodeMs * 1000.0 / frames,
+		decodeMs * 1000.0 / count,
+		count, keyframes, bytesPerState, 100.0 * bytesPerState / length,
+		Rewind_Buffer_MB, max(Rewind_Interval, 1), secondsPerBudget);
+
+	FILE* log = Benchmark_Log("rewind");
+	if(log)
+	{
+		fprintf(log, "%s\n", str);
+		fclose(log);
+	}
+
+	sprintf(summary, "Rewind: %.0f bytes/state, %.1f us/frame", bytesPerState, (saveMs + encodeMs) * 1000.0 / frames);
+	return 1;
+}
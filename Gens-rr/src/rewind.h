@@ -0,0 +1,21 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include <windows.h>
+
+// in-memory rewind: every Rewind_Interval frames the emulator state is captured
+// with Save_State_To_Buffer and stored as an XOR/RLE delta against the most recent keyframe.
+// the oldest captures are discarded once the ring uses more than Rewind_Buffer_MB megabytes.
+
+extern int Rewind_Enable;
+extern int Rewind_Interval; // frames between captures
+extern int Rewind_Buffer_MB; // memory budget for the whole ring
+extern BOOL RewindKeyDown;
+
+void Rewind_Reset(); // forget all captures (call whenever the emulation timeline changes discontinuously)
+void Rewind_Capture(); // call once after every emulated frame
+bool Rewind_Step(); // restore the most recent capture before the current frame, returns false if there is none
+int Rewind_Captured_Count();
+int Rewind_Benchmark(char* summary); // measures capture cost of the running game and writes the results to Logs\rewind_bench.log
+
+#endif
@@ -36,6 +36,7 @@
 #include "ram_search.h"
 #include "ramwatch.h"
 #include "luascript.h"
+#include "rewind.h"
 #include <direct.h>
 #include "hackdefs.h"
 #ifdef SONICMAPHACK
@@ -241,6 +242,7 @@ int Load_State_From_Buffer(unsigned char *buf)
 
 	if ((MainMovie.Status == MOVIE_PLAYING) || (MainMovie.Status == MOVIE_FINISHED))
 	{
+		FlushMovieInput(&MainMovie);
 		fseek(MainMovie.File,0,SEEK_END);
 		MainMovie.LastFrame = ((ftell(MainMovie.File) - 64)/3);
 	}
@@ -271,17 +273,8 @@ void TruncateMovieToFrameCount()
 	MainMovie.LastFrame=FrameCount;
 	if(GetFileAttributes(MainMovie.PhysicalFileName) & FILE_ATTRIBUTE_READONLY)
 		return;
-	fseek(MainMovie.File,0,SEEK_SET);
-	char *tempbuf = new char[64 + (FrameCount * 3)];
-	fread(tempbuf,1,64 + (FrameCount * 3),MainMovie.File);
-	fclose(MainMovie.File);
-	MainMovie.File = fopen(MainMovie.PhysicalFileName,"wb");
-	fseek(MainMovie.File,0,SEEK_SET);
-	fwrite(tempbuf,1,64 + (FrameCount * 3),MainMovie.File);
+	TruncateMovieInput(&MainMovie,FrameCount);
 	WriteMovieHeader(&MainMovie);
-	fclose(MainMovie.File);
-	MainMovie.File = fopen(MainMovie.PhysicalFileName,"r+b");
-	delete[] tempbuf;
 }
 
 bool g_refreshScreenAfterLoad = true;
@@ -305,6 +298,7 @@ int Load_State(char *Name)
 	else return 0;
 
 	frameadvSkipLag_Rewind_State_Buffer_Valid = false;
+	Rewind_Reset();
 	s_nextInputCondensedSet = false;
 	if(skipLagNow)
 	{
@@ -439,6 +433,7 @@ int Load_State(char *Name)
 		int m = fgetc(f);
 		if(m == 'M' && !feof(f) && !ferror(f))
 		{
+			FlushMovieInput(&MainMovie);
 			int pos = ftell(MainMovie.File);
 			fseek(MainMovie.File,64,SEEK_SET);
 
@@ -448,6 +443,17 @@ int Load_State(char *Name)
 			delete[] bla;
 
 			fseek(MainMovie.File,pos,SEEK_SET);
+			InvalidateMovieInput();
+		}
+		else if(m == 'D' && !feof(f) && !ferror(f))
+		{
+			unsigned int frames;
+			if(LoadMovieInputDiff(&MainMovie, f, &frames, true) < 0)
+			{
+				char inconsistencyMessage[1024];
+				sprintf(inconsistencyMessage, "Warning: The input stored in this savestate was saved relative to a different version of the movie file, and the .gmb file kept for that version is missing, so it could not be restored.\nThe movie keeps its current input up to frame %d.", FrameCount);
+				WARNINGBOX(inconsistencyMessage, "Desync Warning");
+			}
 		}
 	}
 
@@ -460,14 +466,32 @@ int Load_State(char *Name)
 			Track3_FrameCount = temp;
 
 		int m = fgetc(f);
-		if (m != 'M')
+		if (m != 'M' && m != 'D')
 		{
 			char inconsistencyMessage[1024];
 			sprintf(inconsistencyMessage, "Warning: The state you are loading is inconsistent with the current movie.\nYou should load a different savestate\nReason: Savestate contains no input data.");
 			WARNINGBOX(inconsistencyMessage, "Desync Warning");
 		}
+		else if(m == 'D' && !feof(f) && !ferror(f))
+		{
+			unsigned int frames;
+			int firstMismatch = LoadMovieInputDiff(&MainMovie, f, &frames, false);
+			if(firstMismatch < 0)
+			{
+				char inconsistencyMessage[1024];
+				sprintf(inconsistencyMessage, "%s\n\nReason: Unable to compare %d frames.", standardInconsistencyMessage, FrameCount);
+				WARNINGBOX(inconsistencyMessage, "Desync Warning");
+			}
+			else if(firstMismatch < (int)frames)
+			{
+				char inconsistencyMessage[1024];
+				sprintf(inconsistencyMessage, "%s\n\nReason: Different input starting on frame %d.", standardInconsistencyMessage, firstMismatch);
+				WARNINGBOX(inconsistencyMessage, "Desync Warning");
+			}
+		}
 		else if(!feof(f) && !ferror(f))
 		{
+			FlushMovieInput(&MainMovie);
 			int pos = ftell(MainMovie.File);
 			fseek(MainMovie.File,64,SEEK_SET);
 
@@ -608,9 +632,15 @@ int Save_State (char *Name)
 #endif
 
 	//Modif N - bulletproof re-recording (saving)
-	if(MainMovie.File && (MainMovie.Status != MOVIE_FINISHED) )
+	if(MainMovie.File && (MainMovie.Status != MOVIE_FINISHED) && MovieStateDiffs)
+	{
+		fputc('D', f);
+		SaveMovieInputDiff(&MainMovie, FrameCount, f);
+	}
+	else if(MainMovie.File && (MainMovie.Status != MOVIE_FINISHED) )
 	{
 		fputc('M', f);
+		FlushMovieInput(&MainMovie);
 		int pos = ftell(MainMovie.File);
 		fseek(MainMovie.File,64,SEEK_SET);
 
@@ -901,6 +931,7 @@ int Import_Genesis(unsigned char * Data)
 		VRam[i + 0] = Data[i + 0x12478 + 1];
 		VRam[i + 1] = Data[i + 0x12478 + 0];
 	}
+	VDP_Tile_Cache_Invalidate();
 
 	YM2612_Restore(Data + 0x1E4);
 
@@ -2318,6 +2349,8 @@ int Save_Config(char *File_Name)
 	WritePrivateProfileString("General", "Movie Auto Close", Str_Tmp, Conf_File);
 	wsprintf(Str_Tmp, "%d", UseMovieStates); //Upth-Add - Save the auto close movie flag to config
 	WritePrivateProfileString("General", "Movie Based State Names", Str_Tmp, Conf_File);
+	wsprintf(Str_Tmp, "%d", MovieStateDiffs);
+	WritePrivateProfileString("General", "Movie State Diffs", Str_Tmp, Conf_File);
 	wsprintf(Str_Tmp, "%d", SlowDownSpeed); //Upth-Add - Save the current slowdown speed to config
 	WritePrivateProfileString("General", "Slow Down Speed", Str_Tmp, Conf_File);
 	wsprintf(Str_Tmp, "%d", DelayFactor); //Upth-Add - Make frame advance speed configurable
@@ -2330,6 +2363,12 @@ int Save_Config(char *File_Name)
 	WritePrivateProfileString("General", "AVI Fit Height", Str_Tmp, Conf_File);
 	wsprintf(Str_Tmp, "%d", Sleep_Time); //Modif N. - CPU hogging now a real setting
 	WritePrivateProfileString("General", "Allow Idle", Str_Tmp, Conf_File);
+	wsprintf(Str_Tmp, "%d", Rewind_Enable);
+	WritePrivateProfileString("General", "Rewind Enable", Str_Tmp, Conf_File);
+	wsprintf(Str_Tmp, "%d", Rewind_Interval);
+	WritePrivateProfileString("General", "Rewind Interval", Str_Tmp, Conf_File);
+	wsprintf(Str_Tmp, "%d", Rewind_Buffer_MB);
+	WritePrivateProfileString("General", "Rewind Buffer MB", Str_Tmp, Conf_File);
 
 	wsprintf(Str_Tmp, "%d", Full_Screen & 1);
 	WritePrivateProfileString("Graphics", "Full Screen", Str_Tmp, Conf_File);
@@ -2383,6 +2422,10 @@ int Save_Config(char *File_Name)
 	WritePrivateProfileString("Graphics", "Frame skip", Str_Tmp, Conf_File);
 	wsprintf(Str_Tmp, "%d", CleanAvi);
 	WritePrivateProfileString("Graphics", "Clean Avi", Str_Tmp, Conf_File);
+	wsprintf(Str_Tmp, "%d", VDP_Tile_Cache & 1);
+	WritePrivateProfileString("Graphics", "Tile Cache Renderer", Str_Tmp, Conf_File);
+	wsprintf(Str_Tmp, "%d", Present_Threaded & 1);
+	WritePrivateProfileString("Graphics", "Threaded Presentation", Str_Tmp, Conf_File);
 
 	wsprintf(Str_Tmp, "%d", Correct_256_Aspect_Ratio); //Modif N.
 	WritePrivateProfileString("Graphics", "Proper Aspect Ratio", Str_Tmp, Conf_File);
@@ -2413,10 +2456,14 @@ int Save_Config(char *File_Name)
 	WritePrivateProfileString("Sound", "CDDA State", Str_Tmp, Conf_File);
 	wsprintf(Str_Tmp, "%d", YM2612_Improv & 1);
 	WritePrivateProfileString("Sound", "YM2612 Improvement", Str_Tmp, Conf_File);
+	wsprintf(Str_Tmp, "%d", YM2612_Lazy & 1);
+	WritePrivateProfileString("Sound", "YM2612 Lazy", Str_Tmp, Conf_File);
 	wsprintf(Str_Tmp, "%d", DAC_Improv & 1);
 	WritePrivateProfileString("Sound", "DAC Improvement", Str_Tmp, Conf_File);
 //	wsprintf(Str_Tmp, "%d", PSG_Improv & 1);
 //	WritePrivateProfileString("Sound", "PSG Improvement", Str_Tmp, Conf_File);
+	wsprintf(Str_Tmp, "%d", PSG_Blep & 1);
+	WritePrivateProfileString("Sound", "PSG Band-Limited", Str_Tmp, Conf_File);
 
 	wsprintf(Str_Tmp,"%d",MastVol);
 	WritePrivateProfileString("Sound", "Master Volume", Str_Tmp, Conf_File);
@@ -2858,9 +2905,13 @@ int Load_Config(char *File_Name, void *Game_Active)
 	Effect_Color = Intro_Style ? GetPrivateProfileInt("General", "Free Mode Color", 7, Conf_File) : 0; //Modif N. - no intro style = no intro style color
 	Sleep_Time = GetPrivateProfileInt("General", "Allow Idle", 5, Conf_File); //Modif N. - CPU hogging now off by default
 	Gens_Priority = GetPrivateProfileInt("General", "Priority", 1, Conf_File);
+	Rewind_Enable = GetPrivateProfileInt("General", "Rewind Enable", 0, Conf_File);
+	Rewind_Interval = GetPrivateProfileInt("General", "Rewind Interval", 1, Conf_File);
+	Rewind_Buffer_MB = GetPrivateProfileInt("General", "Rewind Buffer MB", 64, Conf_File);
 	Def_Read_Only = (bool) (GetPrivateProfileInt("General", "Movie Default Read Only", 1, Conf_File) > 0); //Upth-Add - Load the flag from config
 	AutoCloseMovie = (bool) (GetPrivateProfileInt("General", "Movie Auto Close", 0, Conf_File) > 0); //Upth-Add - Load the flag from config
 	UseMovieStates = (bool) (GetPrivateProfileInt("General", "Movie Based State Names", 1, Conf_File) > 0); //Upth-Add - Load the flag from config
+	MovieStateDiffs = (bool) (GetPrivateProfileInt("General", "Movie State Diffs", 0, Conf_File) > 0);
 	SlowDownSpeed = GetPrivateProfileInt("General", "Slow Down Speed", 1, Conf_File); //Upth-Add - Load the slowdown speed from config
 	DelayFactor = GetPrivateProfileInt("General", "Frame Advance Delay Factor", 5, Conf_File); //Upth-Add - Frame advance speed configurable
 	AVISound = GetPrivateProfileInt("General", "AVI Sound", 1, Conf_File); //Upth-Add - Frame advance speed configurable
@@ -2908,6 +2959,8 @@ int Load_Config(char *File_Name, void *Game_Active)
 	Sprite_Over = GetPrivateProfileInt("Graphics", "Sprite limit", 1, Conf_File);
 	Frame_Skip = GetPrivateProfileInt("Graphics", "Frame skip", -1, Conf_File);
 	CleanAvi = GetPrivateProfileInt("Graphics", "Clean Avi", 1, Conf_File);
+	VDP_Tile_Cache = GetPrivateProfileInt("Graphics", "Tile Cache Renderer", 0, Conf_File);
+	Present_Threaded = GetPrivateProfileInt("Graphics", "Threaded Presentation", 0, Conf_File);
 
 	Correct_256_Aspect_Ratio = GetPrivateProfileInt("Graphics", "Proper Aspect Ratio", 1, Conf_File); //Modif N.
 	ShotPNGFormat = GetPrivateProfileInt("Graphics", "Screenshot Use PNG", 1, Conf_File); //Modif N.
@@ -2943,8 +2996,10 @@ int Load_Config(char *File_Name, void *Game_Active)
 	}
 
 	YM2612_Improv = GetPrivateProfileInt("Sound", "YM2612 Improvement", 0, Conf_File); // Modif N
+	YM2612_Lazy = GetPrivateProfileInt("Sound", "YM2612 Lazy", 1, Conf_File);
 	DAC_Improv = GetPrivateProfileInt("Sound", "DAC Improvement", 0, Conf_File); // Modif N
 //	PSG_Improv = GetPrivateProfileInt("Sound", "PSG Improvement", 0, Conf_File); // Modif N
+	PSG_Blep = GetPrivateProfileInt("Sound", "PSG Band-Limited", 0, Conf_File);
 	MastVol = (GetPrivateProfileInt("Sound", "Master Volume", 128, Conf_File) & 0x1FF);
 	YM2612Vol = (GetPrivateProfileInt("Sound", "YM2612 Volume", 256, Conf_File) & 0x1FF);
 	DACVol = (GetPrivateProfileInt("Sound", "DAC Volume", 256, Conf_File) & 0x1FF);
@@ -3171,6 +3226,7 @@ int Load_Config(char *File_Name, void *Game_Active)
 					BackupMovieFile(&MainMovie);
 					strcpy(MainMovie.FileName,"");
 					fclose(MainMovie.File);
+					InvalidateMovieInput();
 					remove(Str_Tmp);
 				}
 			}
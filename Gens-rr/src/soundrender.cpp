@@ -0,0 +1,397 @@
+#include <windows.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "soundrender.h"
+#include "headless.h"
+#include "gens.h"
+#include "G_main.h"
+#include "G_dsound.h"
+#include "ym2612.h"
+#include "psg.h"
+#include "zlib.h"
+
+#define RENDER_RATE 44100 // the VGM sample rate, so VGM waits need no conversion
+#define RENDER_BLOCK 1024 // samples per YM2612_Update/PSG_Update call (at most MAX_UPDATE_LENGTH)
+#define RENDER_GYM_FRAME (RENDER_RATE / 60)
+#define RENDER_GYMX_HEADER 428
+
+static int s_renderL[RENDER_BLOCK], s_renderR[RENDER_BLOCK];
+static short s_renderPCM[RENDER_BLOCK * 2];
+
+struct RenderOutput
+{
+	FILE* file; // NULL when only benchmarking
+	unsigned int samples;
+};
+
+static inline unsigned int Read32(const unsigned char* p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | (p[3] << 24);
+}
+
+// mixes count samples of the current chip state into the output, the same way Write_Sound_Stereo does
+static void Render_Samples(int count, RenderOutput& out)
+{
+	int* buf[2] = {s_renderL, s_renderR};
+	while(count > 0)
+	{
+		int length = min(count, RENDER_BLOCK);
+		memset(s_renderL, 0, length * sizeof(int));
+		memset(s_renderR, 0, length * sizeof(int));
+		if(PSG_Enable)
+		{
+			if(PSG_Blep)
+				PSG_Update_BLEP(buf, length);
+			else
+				PSG_Update(buf, length);
+		}
+		if(YM2612_Enable)
+		{
+			YM2612_Update(buf, length);
+			YM2612_DacAndTimers_Update(buf, length);
+		}
+
+		if(out.file)
+		{
+			short* dest = s_renderPCM;
+			for(int i = 0; i < length; i++)
+			{
+				*dest++ = (short)max(-0x8000, min(0x7FFF, s_renderL[i]));
+				*dest++ = (short)max(-0x8000, min(0x7FFF, s_renderR[i]));
+			}
+			fwrite(s_renderPCM, sizeof(short) * 2, length, out.file);
+		}
+		out.samples += length;
+		count -= length;
+	}
+}
+
+static void Render_Chips(int ymClock, int psgClock)
+{
+	YM2612_Init(ymClock, RENDER_RATE, YM2612_Improv);
+	PSG_Init(psgClock, RENDER_RATE);
+	YM_Len = PSG_Len = 0; // keeps YM2612_Write from rendering into the emulation's sound buffers
+	YM2612_Unheard = 0;
+}
+
+// same commands as GYM_Next, frames are 1/60 s
+static const char* Render_GYM(const unsigned char* data, int length, RenderOutput& out)
+{
+	Render_Chips(CLOCK_NTSC / 7, CLOCK_NTSC / 15);
+	for(int pos = 0; pos < length; )
+	{
+		switch(data[pos++])
+		{
+			case 0:
+				Render_Samples(RENDER_GYM_FRAME, out);
+				break;
+			case 1:
+				if(pos + 2 > length) return NULL;
+				YM2612_Write(0, data[pos]);
+				YM2612_Write(1, data[pos + 1]);
+				pos += 2;
+				break;
+			case 2:
+				if(pos + 2 > length) return NULL;
+				YM2612_Write(2, data[pos]);
+				YM2612_Write(3, data[pos + 1]);
+				pos += 2;
+				break;
+			case 3:
+				if(pos + 1 > length) return NULL;
+				PSG_Write(data[pos++]);
+				break;
+		}
+	}
+	return NULL;
+}
+
+// plays the YM2612 and SN76489 commands and their waits once (no looping), other chips are skipped
+static const char* Render_VGM(const unsigned char* data, int length, RenderOutput& out)
+{
+	if(length < 0x40)
+		return "truncated VGM header";
+	unsigned int version = Read32(data + 0x08);
+	unsigned int psgClock = Read32(data + 0x0C) & 0x3FFFFFFF;
+	unsigned int ymClock = Read32(version >= 0x110 ? data + 0x2C : data + 0x10) & 0x3FFFFFFF;
+	unsigned int start = (version >= 0x150 && Read32(data + 0x34)) ? 0x34 + Read32(data + 0x34) : 0x40;
+	if(!ymClock && !psgClock)
+		return "no YM2612 or SN76489 in this VGM";
+	Render_Chips(ymClock ? ymClock : CLOCK_NTSC / 7, psgClock ? psgClock : CLOCK_NTSC / 15);
+
+	std::vector<unsigned char> pcmBank; // YM2612 DAC samples from 0x67 data blocks, played by 0x8n
+	unsigned int pcmPos = 0;
+	unsigned int pos = start;
+	while(pos < (unsigned int)length)
+	{
+		unsigned char c = data[pos];
+		unsigned int operands;
+		if(c >= 0x30 && c <= 0x3F) operands = 1;
+		else if(c == 0x4F || c == 0x50) operands = 1;
+		else if(c >= 0x40 && c <= 0x5F) operands = 2;
+		else if(c == 0x61) operands = 2;
+		else if(c == 0x67) operands = 6;
+		else if(c == 0x68) operands = 11;
+		else if(c >= 0xA0 && c <= 0xBF) operands = 2;
+		else if(c >= 0xC0 && c <= 0xDF) operands = 3;
+		else if(c >= 0xE0) operands = 4;
+		else if(c == 0x90 || c == 0x91 || c == 0x95) operands = 4;
+		else if(c == 0x92) operands = 5;
+		else if(c == 0x93) operands = 10;
+		else if(c == 0x94) operands = 1;
+		else operands = 0;
+		if(pos + 1 + operands > (unsigned int)length)
+			return "truncated VGM command";
+		const unsigned char* op = data + pos + 1;
+		pos += 1 + operands;
+
+		switch(c)
+		{
+			case 0x50: PSG_Write(op[0]); break;
+			case 0x52: YM2612_Write(0, op[0]); YM2612_Write(1, op[1]); break;
+			case 0x53: YM2612_Write(2, op[0]); YM2612_Write(3, op[1]); break;
+			case 0x61: Render_Samples(op[0] | (op[1] << 8), out); break;
+			case 0x62: Render_Samples(735, out); break;
+			case 0x63: Render_Samples(882, out); break;
+			case 0x66: return NULL;
+			case 0x67:
+			{
+				unsigned int size = Read32(op + 2) & 0x7FFFFFFF;
+				if(pos + size > (unsigned int)length)
+					return "truncated VGM data block";
+				if(op[1] == 0x00)
+					pcmBank.insert(pcmBank.end(), data + pos, data + pos + size);
+				pos += size;
+				break;
+			}
+			case 0xE0: pcmPos = Read32(op); break;
+			default:
+				if(c >= 0x70 && c <= 0x7F)
+					Render_Samples((c & 0x0F) + 1, out);
+				else if(c >= 0x80 && c <= 0x8F)
+				{
+					YM2612_Write(0, 0x2A);
+					YM2612_Write(1, pcmPos < pcmBank.size() ? pcmBank[pcmPos] : 0x80);
+					pcmPos++;
+					Render_Samples(c & 0x0F, out);
+				}
+				else if(c < 0x30 || (c >= 0x96 && c <= 0x9F))
+					return "unknown VGM command";
+				break;
+		}
+	}
+	return NULL;
+}
+
+// .vgz files are gzipped VGMs
+static bool Render_Gunzip(const char* musicName, std::vector<unsigned char>& unpacked)
+{
+	gzFile gz = gzopen(musicName, "rb");
+	if(!gz)
+		return false;
+	unsigned char chunk[65536];
+	int got;
+	while((got = gzread(gz, chunk, sizeof(chunk))) > 0)
+		unpacked.insert(unpacked.end(), chunk, chunk + got);
+	gzclose(gz);
+	return got == 0;
+}
+
+int Sound_Render_File(const char* musicName, const char* outputName, const char* resultsName)
+{
+	ShowWindow(HWnd, SW_HIDE);
+
+	const char* error = NULL;
+	const char* format = "?";
+	RenderOutput out = {NULL, 0};
+	double seconds = 0.0;
+
+	// the file is read straight from a read-only mapping, unless it has to be decompressed first
+	HANDLE file = CreateFile(musicName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	HANDLE mapping = NULL;
+	const unsigned char* view = NULL;
+	int length = 0;
+	if(file == INVALID_HANDLE_VALUE)
+		error = "can't open the file";
+	else if((length = GetFileSize(file, NULL)) < 4)
+		error = "file too small";
+	else if(!(mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL)) || !(view = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)))
+		error = "can't map the file";
+
+	const unsigned char* data = view;
+	std::vector<unsigned char> unpacked;
+	if(!error && data[0] == 0x1F && data[1] == 0x8B)
+	{
+		if(!Render_Gunzip(musicName, unpacked) || unpacked.size() < 4)
+			error = "can't decompress the file";
+		else
+			data = &unpacked[0], length = unpacked.size();
+	}
+	if(!error && length >= RENDER_GYMX_HEADER && !memcmp(data, "GYMX", 4) && Read32(data + 424))
+	{
+		// compressed GYMX, the header gives the unpacked size
+		uLongf size = Read32(data + 424);
+		std::vector<unsigned char> packed (data + RENDER_GYMX_HEADER, data + length);
+		unpacked.resize(size);
+		if(uncompress(&unpacked[0], &size, &packed[0], packed.size()) != Z_OK)
+			error = "can't decompress the GYMX data";
+		else
+			data = &unpacked[0], length = size;
+	}
+	else if(!error && length >= RENDER_GYMX_HEADER && !memcmp(data, "GYMX", 4))
+	{
+		data += RENDER_GYMX_HEADER;
+		length -= RENDER_GYMX_HEADER;
+	}
+
+	if(!error && outputName[0])
+	{
+		out.file = fopen(outputName, "wb");
+		if(!out.file)
+			error = "can't create the output file";
+		else
+			setvbuf(out.file, NULL, _IOFBF, 1 << 20);
+	}
+	const char* extension = strrchr(outputName, '.');
+	bool wav = out.file && !(extension && !stricmp(extension, ".raw"));
+	if(wav)
+		fseek(out.file, 44, SEEK_SET); // header written at the end, once the size is known
+
+	if(!error)
+	{
+		LARGE_INTEGER freq, t0, t1;
+		QueryPerformanceFrequency(&freq);
+		QueryPerformanceCounter(&t0);
+		if(!memcmp(data, "Vgm ", 4))
+			format = "VGM", error = Render_VGM(data, length, out);
+		else
+			format = "GYM", error = Render_GYM(data, length, out);
+		QueryPerformanceCounter(&t1);
+		seconds = (double)(t1.QuadPart - t0.QuadPart) / (double)freq.QuadPart;
+	}
+
+	if(wav)
+	{
+		unsigned int dataSize = out.samples * 4;
+		unsigned char header[44] = {'R','I','F','F', 0,0,0,0, 'W','A','V','E', 'f','m','t',' ', 16,0,0,0, 1,0, 2,0,
+			RENDER_RATE & 0xFF, (RENDER_RATE >> 8) & 0xFF, 0,0, (RENDER_RATE * 4) & 0xFF, ((RENDER_RATE * 4) >> 8) & 0xFF, ((RENDER_RATE * 4) >> 16) & 0xFF, 0,
+			4,0, 16,0, 'd','a','t','a'};
+		for(int i = 0; i < 4; i++)
+		{
+			header[4 + i] = (unsigned char)((dataSize + 36) >> (i * 8));
+			header[40 + i] = (unsigned char)(dataSize >> (i * 8));
+		}
+		fseek(out.file, 0, SEEK_SET);
+		fwrite(header, 1, sizeof(header), out.file);
+	}
+	if(out.file)
+		fclose(out.file);
+	if(view)
+		UnmapViewOfFile(view);
+	if(mapping)
+		CloseHandle(mapping);
+	if(file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+
+	char line[1024];
+	if(error)
+		sprintf(line, "%s\terror: %s", musicName, error);
+	else
+		sprintf(line, "%s\t%s\t%u samples (%.1f s)\t%.2f s\t%.0f samples/s\t%.1fx real time",
+			musicName, format, out.samples, (double)out.samples / RENDER_RATE, seconds,
+			out.samples / (seconds > 0.0 ? seconds : 1.0), ((double)out.samples / RENDER_RATE) / (seconds > 0.0 ? seconds : 1.0));
+
+	FILE* results = resultsName[0] ? fopen(resultsName, "a") : NULL;
+	if(results)
+	{
+		fprintf(results, "%s\n", line);
+		fclose(results);
+	}
+	else
+	{
+		fprintf(stderr, "%s\n", line);
+	}
+
+	return error ? 1 : 0;
+}
+
+int Sound_Render_List(const char* cfgName, const char* listName, const char* outputDir, const char* resultsName, int jobs)
+{
+	ShowWindow(HWnd, SW_HIDE);
+
+	std::vector<std::string> musicNames;
+	FILE* list = fopen(listName, "r");
+	if(list)
+	{
+		char line[1024];
+		while(fgets(line, sizeof(line), list))
+		{
+			char* end = line + strlen(line);
+			while(end > line && (end[-1] == '\n' || end[-1] == '\r' || end[-1] == ' '))
+				*--end = 0;
+			if(line[0] && line[0] != '#')
+				musicNames.push_back(line);
+		}
+		fclose(list);
+	}
+
+	char exeName[MAX_PATH];
+	GetModuleFileName(NULL, exeName, MAX_PATH);
+
+	// the sound cores only exist once per process too
+	std::vector<std::string> commandLines, tempNames;
+	for(unsigned int i = 0; i < musicNames.size(); i++)
+	{
+		char tempName[1024];
+		sprintf(tempName, "%s.%d.tmp", resultsName[0] ? resultsName : "render", i);
+		tempNames.push_back(tempName);
+		DeleteFile(tempName);
+
+		std::string commandLine = std::string("\"") + exeName + "\"";
+		if(cfgName[0])
+			commandLine += std::string(" -cfg \"") + cfgName + "\"";
+		commandLine += " -render \"" + musicNames[i] + "\" -results \"" + tempName + "\"";
+		if(outputDir[0])
+		{
+			// <output directory>\<music file name>.wav
+			std::string baseName = musicNames[i].substr(musicNames[i].find_last_of("\\/") + 1);
+			baseName = baseName.substr(0, baseName.find_last_of('.'));
+			commandLine += std::string(" -output \"") + outputDir + "\\" + baseName + ".wav\"";
+		}
+		commandLines.push_back(commandLine);
+	}
+
+	std::vector<DWORD> exitCodes;
+	DWORD startTime = timeGetTime();
+	jobs = Headless_Run_Processes(commandLines, jobs, exitCodes);
+	DWORD elapsed = timeGetTime() - startTime;
+
+	int failed = 0;
+	double totalSamples = 0.0;
+	FILE* results = resultsName[0] ? fopen(resultsName, "a") : stderr;
+	for(unsigned int i = 0; i < musicNames.size(); i++)
+	{
+		std::string line = Headless_Read_Result(tempNames[i].c_str());
+		if(exitCodes[i] == HEADLESS_NOT_STARTED)
+			line = musicNames[i] + "\terror: could not start a render process";
+		else if(line.empty())
+			line = musicNames[i] + "\terror: the render process failed";
+		if(exitCodes[i] != 0)
+			failed++;
+		else
+			totalSamples += atof(line.substr(line.find('\t', line.find('\t') + 1) + 1).c_str());
+		if(results)
+			fprintf(results, "%s\n", line.c_str());
+	}
+	if(results)
+	{
+		fprintf(results, "%d files, %d failed, %d jobs, %.1f seconds, %.0f samples/s overall\n\n",
+			(int)musicNames.size(), failed, jobs, elapsed / 1000.0, totalSamples * 1000.0 / (elapsed ? elapsed : 1));
+		if(results != stderr)
+			fclose(results);
+	}
+
+	return (failed || musicNames.empty()) ? 1 : 0;
+}
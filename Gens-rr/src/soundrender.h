@@ -0,0 +1,15 @@
+#ifndef SOUNDRENDER_H
+#define SOUNDRENDER_H
+
+// offline music rendering: -render <GYM, VGM or VGZ file> plays it through the YM2612 and PSG cores as fast as they go,
+// with no sound device, and writes 16-bit stereo at 44100 Hz to -output (a .wav file, or headerless samples for .raw).
+// without -output nothing is written, which leaves a benchmark of the sound cores alone.
+// one line with the length rendered and the samples per second is appended to -results (or written to stderr).
+//
+// -musiclist <list file> renders every file in the list (one filename per line) into the -output directory,
+// one -render process per file and up to -jobs at a time, and writes their result lines to -results in list order.
+
+int Sound_Render_File(const char* musicName, const char* outputName, const char* resultsName); // returns 0 if the whole file was rendered
+int Sound_Render_List(const char* cfgName, const char* listName, const char* outputDir, const char* resultsName, int jobs); // returns 0 if every file was
+
+#endif
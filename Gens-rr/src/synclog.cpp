@@ -0,0 +1,207 @@
+#include <windows.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "synclog.h"
+#include "gens.h"
+#include "G_main.h"
+#include "G_ddraw.h"
+#include "save.h"
+#include "movie.h"
+#include "Rom.h"
+
+#define SYNCLOG_MAGIC "GSYN"
+#define SYNCLOG_VERSION 1
+#define SYNCLOG_HEADER_SIZE 16
+#define SYNCLOG_PIECE_SIZE 0x10000
+
+struct SyncLogSection
+{
+	int start, end;
+	char name [64];
+};
+
+static FILE* s_syncLogFile = NULL;
+static bool s_syncLogChecking = false;
+static int s_syncLogStateLength = 0;
+static std::vector<SyncLogSection> s_syncLogSections;
+static std::vector<unsigned __int64> s_syncLogHashes;
+static std::vector<unsigned __int64> s_syncLogExpected;
+static unsigned long s_syncLogFrames = 0; // recorded or checked
+static long s_syncLogDesyncFrame = -1;
+static char s_syncLogDesyncSection [64];
+static char s_syncLogResult [256];
+
+ALIGN16 static unsigned char s_syncLogStateBuffer[MAX_STATE_FILE_LENGTH];
+
+static void AddSection(int start, int end, const char* name)
+{
+	SyncLogSection section;
+	section.start = start;
+	section.end = end;
+	strcpy(section.name, name);
+	s_syncLogSections.push_back(section);
+}
+
+// splits the state the way Save_State_To_Buffer lays it out
+static void BuildSections(int length)
+{
+	s_syncLogSections.clear();
+	AddSection(0, 0x474, "68000/Z80/VDP registers, YM2612, PSG");
+	AddSection(0x474, 0x2478, "Z80 RAM");
+	AddSection(0x2478, 0x12478, "68000 RAM");
+	AddSection(0x12478, 0x22478, "VRAM");
+	AddSection(0x22478, 0x2247C, "FrameCount");
+	AddSection(0x2247C, GENESIS_STATE_LENGTH, "extended Genesis state");
+
+	const char* system = SegaCD_Started ? "Sega CD" : "32X";
+	for(int start = GENESIS_STATE_LENGTH; start < length; start += SYNCLOG_PIECE_SIZE)
+	{
+		char name [64];
+		sprintf(name, "%s state +0x%05X", system, start - GENESIS_STATE_LENGTH);
+		AddSection(start, min(start + SYNCLOG_PIECE_SIZE, length), name);
+	}
+}
+
+// FNV-1a style, but 8 bytes at a time (every section is a multiple of 4 bytes long and the state is 16-byte aligned)
+static unsigned __int64 HashSection(const unsigned char* data, int length)
+{
+	unsigned __int64 hash = 14695981039346656037ULL;
+	int i = 0;
+	for(; i + 8 <= length; i += 8)
+		hash = (hash ^ *(const unsigned __int64*)(data + i)) * 1099511628211ULL;
+	for(; i < length; i++)
+		hash = (hash ^ data[i]) * 1099511628211ULL;
+	return hash;
+}
+
+static long EntryOffset(unsigned long frame)
+{
+	return SYNCLOG_HEADER_SIZE + (long)(frame - 1) * (long)(s_syncLogSections.size() * sizeof(unsigned __int64));
+}
+
+bool SyncLog_Begin(const char* fileName)
+{
+	SyncLog_End();
+	if(!Game)
+		return false;
+
+	s_syncLogStateLength = Save_State_To_Buffer(s_syncLogStateBuffer);
+	BuildSections(s_syncLogStateLength);
+	s_syncLogHashes.resize(s_syncLogSections.size());
+	s_syncLogExpected.resize(s_syncLogSections.size());
+	s_syncLogFrames = 0;
+	s_syncLogDesyncFrame = -1;
+
+	unsigned char header [SYNCLOG_HEADER_SIZE] = {0};
+	int sections = s_syncLogSections.size();
+	s_syncLogFile = fopen(fileName, "r+b");
+	if(s_syncLogFile)
+	{
+		s_syncLogChecking = true;
+		unsigned char expected [SYNCLOG_HEADER_SIZE];
+		fread(header, 1, SYNCLOG_HEADER_SIZE, s_syncLogFile);
+		memcpy(expected, SYNCLOG_MAGIC, 4);
+		expected[4] = SYNCLOG_VERSION;
+		memset(expected + 5, 0, 3);
+		memcpy(expected + 8, &sections, 4);
+		memcpy(expected + 12, &s_syncLogStateLength, 4);
+		if(memcmp(header, expected, SYNCLOG_HEADER_SIZE))
+		{
+			// recorded with a different system or savestate version, nothing in it can match
+			fclose(s_syncLogFile);
+			s_syncLogFile = NULL;
+			return false;
+		}
+	}
+	else
+	{
+		s_syncLogChecking = false;
+		s_syncLogFile = fopen(fileName, "w+b");
+		if(!s_syncLogFile)
+			return false;
+		memcpy(header, SYNCLOG_MAGIC, 4);
+		header[4] = SYNCLOG_VERSION;
+		memcpy(header + 8, &sections, 4);
+		memcpy(header + 12, &s_syncLogStateLength, 4);
+		fwrite(header, 1, SYNCLOG_HEADER_SIZE, s_syncLogFile);
+	}
+	return true;
+}
+
+void SyncLog_End()
+{
+	if(s_syncLogFile)
+	{
+		SyncLog_Result(); // so it's still there after closing
+		fclose(s_syncLogFile);
+		s_syncLogFile = NULL;
+	}
+}
+
+bool SyncLog_Active()
+{
+	return s_syncLogFile != NULL;
+}
+
+bool SyncLog_Desynced()
+{
+	return s_syncLogDesyncFrame >= 0;
+}
+
+void SyncLog_Frame()
+{
+	if(!s_syncLogFile || !FrameCount)
+		return;
+	if(s_syncLogChecking && s_syncLogDesyncFrame >= 0)
+		return; // everything after the first desync is noise
+
+	int length = Save_State_To_Buffer(s_syncLogStateBuffer);
+	if(length != s_syncLogStateLength)
+	{
+		SyncLog_End(); // Sega CD / 32X started or stopped
+		return;
+	}
+	for(unsigned int i = 0; i < s_syncLogSections.size(); i++)
+	{
+		const SyncLogSection& section = s_syncLogSections[i];
+		s_syncLogHashes[i] = HashSection(s_syncLogStateBuffer + section.start, section.end - section.start);
+	}
+
+	int entrySize = s_syncLogHashes.size() * sizeof(unsigned __int64);
+	fseek(s_syncLogFile, EntryOffset(FrameCount), SEEK_SET);
+	if(!s_syncLogChecking)
+	{
+		fwrite(&s_syncLogHashes[0], 1, entrySize, s_syncLogFile);
+		s_syncLogFrames = max(s_syncLogFrames, FrameCount);
+		return;
+	}
+
+	if((int)fread(&s_syncLogExpected[0], 1, entrySize, s_syncLogFile) != entrySize)
+		return; // past the end of what was recorded
+	s_syncLogFrames = max(s_syncLogFrames, FrameCount);
+	for(unsigned int i = 0; i < s_syncLogSections.size(); i++)
+	{
+		if(s_syncLogHashes[i] != s_syncLogExpected[i])
+		{
+			s_syncLogDesyncFrame = FrameCount;
+			strcpy(s_syncLogDesyncSection, s_syncLogSections[i].name);
+			sprintf(Str_Tmp, "Desync at frame %lu in %s", FrameCount, s_syncLogDesyncSection);
+			Put_Info(Str_Tmp);
+			break;
+		}
+	}
+}
+
+const char* SyncLog_Result()
+{
+	if(!s_syncLogFile)
+		return s_syncLogResult;
+	if(!s_syncLogChecking)
+		sprintf(s_syncLogResult, "recorded %lu frames", s_syncLogFrames);
+	else if(s_syncLogDesyncFrame < 0)
+		sprintf(s_syncLogResult, "in sync for %lu frames", s_syncLogFrames);
+	else
+		sprintf(s_syncLogResult, "desync at frame %ld in %s", s_syncLogDesyncFrame, s_syncLogDesyncSection);
+	return s_syncLogResult;
+}
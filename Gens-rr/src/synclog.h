@@ -0,0 +1,18 @@
+#ifndef SYNCLOG_H
+#define SYNCLOG_H
+
+// lightweight desync detection: after every frame the savestate is hashed in sections
+// (named parts of the Genesis state, 64 KB pieces of the Sega CD and 32X states)
+// and the hashes are stored in a log file at a fixed position per frame.
+// SyncLog_Begin records a new log if the file doesn't exist yet, otherwise it checks against it,
+// so running the same movie twice (or in two instances) finds the first frame and state section that differ.
+// since entries are indexed by frame, loading a state while recording just overwrites the frames after it.
+
+bool SyncLog_Begin(const char* fileName); // returns false if the file couldn't be opened
+void SyncLog_End();
+void SyncLog_Frame(); // call once after every emulated frame
+bool SyncLog_Active();
+bool SyncLog_Desynced();
+const char* SyncLog_Result(); // "recorded N frames", "in sync for N frames", or where the first desync happened
+
+#endif
@@ -0,0 +1,484 @@
+#include <windows.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "trace_bin.h"
+#include "M68KD.h"
+
+#define TRACE_BIN_HEADER_SIZE 20
+#define TRACE_BIN_RECORD_MAX (1 + 8 + 3 + 10 + 2 + 64 + 5)
+#define TRACE_BIN_RECORD_MIN (1 + 3 + 10 + 2 + 1) // nothing changed: flags, pc, words, register mask, cycles
+#define TRACE_BIN_LINE_LENGTH 288 // a decoded record without the stack indentation, usually about 260 characters
+#define TRACE_BIN_SLOT_MEMORY (TRACE_BIN_BLOCK_SIZE + TRACE_BIN_BLOCK_SIZE / TRACE_BIN_RECORD_MIN * (TRACE_BIN_LINE_LENGTH + 64))
+#define TRACE_BIN_DECODE_MEMORY (384 * 1024 * 1024) // for the blocks being decoded or waiting to be written out
+
+static inline void Put16(unsigned char* p, unsigned int v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+static inline void Put32(unsigned char* p, unsigned int v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+static inline unsigned int Get16(const unsigned char* p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static inline unsigned int Get32(const unsigned char* p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | (p[3] << 24);
+}
+
+const char* Trace_Bin_Open(Trace_Bin &tb, const char* fileName, int cpu)
+{
+	static char error[256];
+
+	if (tb.fp)
+		return NULL;
+
+	tb.fp = fopen(fileName, "ab");
+	if (!tb.fp)
+	{
+		sprintf(error, "Can't open file %s", fileName);
+		return error;
+	}
+	tb.buf = new unsigned char[TRACE_BIN_BLOCK_SIZE];
+	tb.pos = 0;
+	tb.count = 0;
+	tb.cpu = cpu;
+	return NULL;
+}
+
+static void Trace_Bin_Flush(Trace_Bin &tb)
+{
+	if (!tb.count)
+		return;
+
+	unsigned char header[TRACE_BIN_HEADER_SIZE];
+	memcpy(header, "GTRB", 4);
+	Put32(header + 4, tb.pos);
+	Put32(header + 8, tb.count);
+	header[12] = tb.cpu;
+	header[13] = tb.flags;
+	Put16(header + 14, 0);
+	Put32(header + 16, tb.stackroot);
+	fwrite(header, 1, TRACE_BIN_HEADER_SIZE, tb.fp);
+	fwrite(tb.buf, 1, tb.pos, tb.fp);
+
+	tb.pos = 0;
+	tb.count = 0;
+}
+
+void Trace_Bin_Close(Trace_Bin &tb)
+{
+	if (!tb.fp)
+		return;
+
+	Trace_Bin_Flush(tb);
+	fclose(tb.fp);
+	delete [] tb.buf;
+	tb.fp = NULL;
+	tb.buf = NULL;
+}
+
+bool Trace_Bin_Active(const Trace_Bin &tb)
+{
+	return tb.fp != NULL;
+}
+
+void Trace_Bin_Write(Trace_Bin &tb, unsigned int pc, const unsigned short* words, const unsigned int* dreg, const unsigned int* areg,
+	unsigned short sr, unsigned int frame, int line, unsigned int cycle, bool indent, unsigned int stackroot)
+{
+	if (tb.pos + TRACE_BIN_RECORD_MAX > TRACE_BIN_BLOCK_SIZE)
+		Trace_Bin_Flush(tb);
+
+	unsigned char* p = tb.buf + tb.pos;
+	unsigned char* changed = p++;
+	bool first = (tb.count == 0);
+
+	if (first)
+	{
+		tb.flags = indent ? 1 : 0;
+		tb.stackroot = stackroot;
+		tb.cycle = 0;
+	}
+
+	*changed = 0;
+	if (first || sr != tb.sr)
+	{
+		*changed |= 1;
+		Put16(p, sr);
+		p += 2;
+		tb.sr = sr;
+	}
+	if (first || (unsigned short) line != tb.line)
+	{
+		*changed |= 2;
+		Put16(p, line);
+		p += 2;
+		tb.line = line;
+	}
+	if (first || frame != tb.frame)
+	{
+		*changed |= 4;
+		Put32(p, frame);
+		p += 4;
+		tb.frame = frame;
+	}
+
+	p[0] = pc >> 16;
+	Put16(p + 1, pc);
+	p += 3;
+	for (int i = 0; i < 5; i++, p += 2)
+		Put16(p, words[i]);
+
+	unsigned char* mask = p;
+	unsigned int regMask = 0;
+	p += 2;
+	for (int i = 0; i < 16; i++)
+	{
+		unsigned int reg = (i < 8) ? dreg[i] : areg[i - 8];
+		if (first || reg != tb.regs[i])
+		{
+			regMask |= 1 << i;
+			Put32(p, reg);
+			p += 4;
+			tb.regs[i] = reg;
+		}
+	}
+	Put16(mask, regMask);
+
+	unsigned int delta = cycle - tb.cycle;
+	tb.cycle = cycle;
+	while (delta >= 0x80)
+	{
+		*p++ = (delta & 0x7F) | 0x80;
+		delta >>= 7;
+	}
+	*p++ = delta;
+
+	tb.pos = p - tb.buf;
+	tb.count++;
+}
+
+
+// decoding
+
+struct Trace_Bin_Block
+{
+	unsigned int count;
+	int cpu;
+	unsigned char flags;
+	unsigned int stackroot;
+	unsigned int size;
+	std::vector<unsigned char> data; // size bytes, padded with a record of zeros
+	std::string text;
+	unsigned int firstFrame, lastFrame;
+	bool bad;
+};
+
+// the disassembler pulls the instruction words through these, one decoding thread each
+static __declspec(thread) const unsigned char* Decode_Words;
+static __declspec(thread) int Decode_Word_Index;
+
+static unsigned short Decode_Next_Word(void)
+{
+	unsigned short val = 0;
+
+	if (Decode_Word_Index < 5)
+		val = Get16(Decode_Words + Decode_Word_Index * 2);
+	Decode_Word_Index++;
+
+	return val;
+}
+
+static unsigned int Decode_Next_Long(void)
+{
+	unsigned int val = Decode_Next_Word() << 16;
+	return val | Decode_Next_Word();
+}
+
+static void Trace_Bin_Decode_Block(Trace_Bin_Block &block)
+{
+	const unsigned char* p = &block.data[0];
+	const unsigned char* end = p + block.size;
+	unsigned int regs[16] = {0};
+	unsigned int sr = 0, line = 0, frame = 0, cycle = 0;
+	char String [512];
+
+	block.text.reserve(block.count * (TRACE_BIN_LINE_LENGTH + ((block.flags & 1) ? 64 : 0)));
+
+	for (unsigned int n = 0; n < block.count; n++)
+	{
+		if (p >= end)
+		{
+			block.bad = true;
+			return;
+		}
+
+		unsigned char changed = *p++;
+		if (changed & 1)
+		{
+			sr = Get16(p);
+			p += 2;
+		}
+		if (changed & 2)
+		{
+			line = Get16(p);
+			p += 2;
+		}
+		if (changed & 4)
+		{
+			frame = Get32(p);
+			p += 4;
+			if (n == 0)
+				block.firstFrame = frame; // written out only if the previous block ended in another frame
+			else
+			{
+				sprintf(String, "FRAME %u\n", frame);
+				block.text += String;
+			}
+		}
+
+		unsigned int pc = (p[0] << 16) | Get16(p + 1);
+		p += 3;
+		const unsigned char* words = p;
+		p += 10;
+
+		unsigned int regMask = Get16(p);
+		p += 2;
+		for (int i = 0; i < 16; i++)
+		{
+			if (regMask & (1 << i))
+			{
+				regs[i] = Get32(p);
+				p += 4;
+			}
+		}
+
+		unsigned int delta = 0;
+		for (int shift = 0; shift < 35; shift += 7)
+		{
+			unsigned char b = *p++;
+			delta |= (b & 0x7F) << shift;
+			if (!(b & 0x80))
+				break;
+		}
+		cycle += delta;
+
+		const unsigned int* dreg = regs;
+		const unsigned int* areg = regs + 8;
+
+		if (block.flags & 1)
+		{
+			unsigned int stacksize = ((block.stackroot - areg[7]) / 4) & 63;
+			block.text.append(stacksize, ' ');
+		}
+
+		Decode_Words = words;
+		Decode_Word_Index = 0;
+		int OPC = Get16(words);
+		sprintf(String, "%02X:%04X  %02X %02X  %-33s",
+			pc >> 16, pc & 0xffff, OPC >> 8, OPC & 0xff,
+			M68KDisasm2(Decode_Next_Word, Decode_Next_Long, pc));
+		block.text += String;
+
+		sprintf(String, "A0=%.8X A1=%.8X A2=%.8X A3=%.8X A4=%.8X A5=%.8X A6=%.8X A7=%.8X D0=%.8X "
+			"D1=%.8X D2=%.8X D3=%.8X D4=%.8X D5=%.8X D6=%.8X D7=%.8X %c%c%c%c%c L=%.3d C=%u\n",
+			areg[0], areg[1], areg[2], areg[3], areg[4], areg[5], areg[6], areg[7], dreg[0],
+			dreg[1], dreg[2], dreg[3], dreg[4], dreg[5], dreg[6], dreg[7],
+			(sr & 0x10)?'X':'x', (sr & 0x08)?'N':'n', (sr & 0x04)?'Z':'z', (sr & 0x02)?'V':'v', (sr & 0x01)?'C':'c',
+			(short) line, cycle);
+		block.text += String;
+	}
+
+	block.lastFrame = frame;
+	if (p > end)
+		block.bad = true;
+}
+
+// the blocks go through a ring of slots: the main thread reads block n into slot n % slots once block n - slots
+// has been written out, a worker thread decodes it, and the main thread writes the blocks out in order
+struct Trace_Bin_Pipeline
+{
+	std::vector<Trace_Bin_Block> slots;
+	std::vector<HANDLE> decoded; // set when the block in that slot is decoded
+	HANDLE readable; // released once for every block read, and once for every worker when there are no more
+	volatile LONG next; // the block the next worker takes
+	volatile LONG stop; // the number of blocks read, once there are no more
+};
+
+static DWORD WINAPI Trace_Bin_Decode_Thread(LPVOID param)
+{
+	Trace_Bin_Pipeline* pipe = (Trace_Bin_Pipeline*) param;
+
+	for (;;)
+	{
+		WaitForSingleObject(pipe->readable, INFINITE);
+		LONG i = InterlockedIncrement(&pipe->next) - 1;
+		if (i >= pipe->stop)
+			return 0;
+		Trace_Bin_Decode_Block(pipe->slots[i % pipe->slots.size()]);
+		SetEvent(pipe->decoded[i % pipe->slots.size()]);
+	}
+}
+
+int Trace_Bin_Decode(const char* fileName, const char* outputName, const char* resultsName, int jobs)
+{
+	if (jobs <= 0)
+	{
+		SYSTEM_INFO systemInfo;
+		GetSystemInfo(&systemInfo);
+		jobs = systemInfo.dwNumberOfProcessors;
+	}
+	// a 32-bit process can't hold the text of many blocks at once
+	int slots = max(2, min(jobs + 1, TRACE_BIN_DECODE_MEMORY / TRACE_BIN_SLOT_MEMORY));
+	jobs = max(1, min(jobs, slots - 1));
+
+	char line[1024];
+	FILE* in = fopen(fileName, "rb");
+	FILE* out = (in && outputName[0]) ? fopen(outputName, "w") : NULL;
+	int error = 0;
+	unsigned int totalBlocks = 0;
+	double totalRecords = 0;
+	unsigned int lastFrame = 0;
+	DWORD startTime = GetTickCount();
+
+	if (!in || (outputName[0] && !out))
+	{
+		sprintf(line, "%s: can't open %s", fileName, in ? outputName : fileName);
+		error = 1;
+	}
+
+	Trace_Bin_Pipeline pipe;
+	pipe.slots.resize(slots);
+	for (int i = 0; i < slots; i++)
+		pipe.decoded.push_back(CreateEvent(NULL, FALSE, FALSE, NULL));
+	pipe.readable = CreateSemaphore(NULL, 0, 0x7FFFFFFF, NULL);
+	pipe.next = 0;
+	pipe.stop = 0x7FFFFFFF;
+	std::vector<HANDLE> threads;
+	for (int i = 0; i < jobs && !error; i++)
+	{
+		HANDLE thread = CreateThread(NULL, 0, Trace_Bin_Decode_Thread, &pipe, 0, NULL);
+		if (thread)
+			threads.push_back(thread);
+	}
+
+	unsigned int read = 0;
+	bool reading = !error;
+	for (;;)
+	{
+		while (reading && read - totalBlocks < (unsigned int) slots)
+		{
+			unsigned char header[TRACE_BIN_HEADER_SIZE];
+			size_t got = fread(header, 1, TRACE_BIN_HEADER_SIZE, in);
+			if (got == 0)
+			{
+				reading = false;
+				break;
+			}
+			if (got != TRACE_BIN_HEADER_SIZE || memcmp(header, "GTRB", 4) || Get32(header + 4) > TRACE_BIN_BLOCK_SIZE)
+			{
+				sprintf(line, "%s: not a binary trace, or damaged after block %u", fileName, read);
+				error = 1;
+				reading = false;
+				break;
+			}
+
+			Trace_Bin_Block &block = pipe.slots[read % slots];
+			block.count = Get32(header + 8);
+			block.cpu = header[12];
+			block.flags = header[13];
+			block.stackroot = Get32(header + 16);
+			block.size = Get32(header + 4);
+			if (block.count > block.size / TRACE_BIN_RECORD_MIN)
+			{
+				sprintf(line, "%s: damaged header in block %u", fileName, read);
+				error = 1;
+				reading = false;
+				break;
+			}
+			block.firstFrame = block.lastFrame = 0;
+			block.bad = false;
+			block.data.resize(block.size + TRACE_BIN_RECORD_MAX); // so a damaged record can't read past the end
+			if (fread(&block.data[0], 1, block.size, in) != block.size)
+			{
+				sprintf(line, "%s: truncated in block %u", fileName, read);
+				error = 1;
+				reading = false;
+				break;
+			}
+			memset(&block.data[block.size], 0, TRACE_BIN_RECORD_MAX);
+			read++;
+			ReleaseSemaphore(pipe.readable, 1, NULL);
+		}
+		if (totalBlocks == read)
+			break;
+
+		Trace_Bin_Block &block = pipe.slots[totalBlocks % slots];
+		if (threads.empty())
+			Trace_Bin_Decode_Block(block);
+		else
+			WaitForSingleObject(pipe.decoded[totalBlocks % slots], INFINITE);
+
+		if (block.bad && !error)
+		{
+			sprintf(line, "%s: damaged record in block %u", fileName, totalBlocks);
+			error = 1;
+			reading = false;
+		}
+		if (out)
+		{
+			if (totalBlocks == 0 || block.firstFrame != lastFrame)
+				fprintf(out, "FRAME %u\n", block.firstFrame);
+			fwrite(block.text.data(), 1, block.text.size(), out);
+		}
+		lastFrame = block.lastFrame;
+		totalRecords += block.count;
+		std::string().swap(block.text); // only the slots being decoded hold any text
+		totalBlocks++;
+	}
+
+	pipe.stop = read;
+	ReleaseSemaphore(pipe.readable, jobs, NULL);
+	if (!threads.empty())
+		WaitForMultipleObjects(threads.size(), &threads[0], TRUE, INFINITE);
+	for (unsigned int i = 0; i < threads.size(); i++)
+		CloseHandle(threads[i]);
+	for (int i = 0; i < slots; i++)
+		CloseHandle(pipe.decoded[i]);
+	CloseHandle(pipe.readable);
+
+	if (!error)
+	{
+		double seconds = (GetTickCount() - startTime) / 1000.0;
+		sprintf(line, "%s: %.0f instructions in %u blocks decoded in %.2f s with %d jobs", fileName, totalRecords, totalBlocks, seconds, jobs);
+	}
+
+	if (out)
+		fclose(out);
+	if (in)
+		fclose(in);
+
+	FILE* results = resultsName[0] ? fopen(resultsName, "a") : NULL;
+	if (results)
+	{
+		fprintf(results, "%s\n", line);
+		fclose(results);
+	}
+	else
+	{
+		fprintf(stderr, "%s\n", line);
+	}
+
+	return error;
+}
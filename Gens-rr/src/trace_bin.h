@@ -0,0 +1,44 @@
+#ifndef TRACE_BIN_H
+#define TRACE_BIN_H
+
+#include <stdio.h>
+
+// binary instruction trace: with Tools > Trace > Binary Trace, each traced instruction is appended
+// as a compact record to ./Logs/trace.bin (./Logs/trace_cd.bin for the Sega CD CPU), nothing is disassembled or formatted.
+// -decodetrace <file> -output <text file> turns it into the usual trace log afterwards, decoding up to -jobs blocks at a time
+// (default: one per processor), with each line followed by the VDP line and the cycle count of that CPU, and a line per new frame.
+// without -output nothing is written. one line with the instruction count and the time taken is appended to -results (or stderr).
+//
+// the file is a list of blocks that decode on their own:
+//   "GTRB", u32 record bytes, u32 record count, u8 CPU (0 = 68000, 1 = Sega CD 68000), u8 flags (1 = indent), u16 0, u32 stack root
+// followed by the records (little endian):
+//   u8 changed (1 = SR, 2 = line, 4 = frame), then u16 SR, u16 line, u32 frame for those that changed
+//   u24 PC, u16 x 5 words at the PC (the longest 68000 instruction)
+//   u16 changed registers (D0-D7 in bits 0-7, A0-A7 in bits 8-15), then u32 x each one
+//   cycles since the previous record, 7 bits per byte from the lowest, bit 7 set if more follow
+// the first record of a block has everything marked as changed and its cycle count from 0.
+
+#define TRACE_BIN_BLOCK_SIZE (1024 * 1024)
+
+struct Trace_Bin
+{
+	FILE *fp;
+	unsigned char *buf;
+	unsigned int pos, count; // in the block being filled
+	unsigned int regs[16];
+	unsigned int frame, cycle;
+	unsigned short sr, line;
+	unsigned char flags;
+	unsigned int stackroot;
+	int cpu;
+};
+
+const char* Trace_Bin_Open(Trace_Bin &tb, const char* fileName, int cpu); // returns an error message, or NULL
+void Trace_Bin_Close(Trace_Bin &tb);
+bool Trace_Bin_Active(const Trace_Bin &tb);
+void Trace_Bin_Write(Trace_Bin &tb, unsigned int pc, const unsigned short* words, const unsigned int* dreg, const unsigned int* areg,
+	unsigned short sr, unsigned int frame, int line, unsigned int cycle, bool indent, unsigned int stackroot);
+
+int Trace_Bin_Decode(const char* fileName, const char* outputName, const char* resultsName, int jobs); // returns 0 if the whole file was decoded
+
+#endif
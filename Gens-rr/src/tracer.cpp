@@ -7,7 +7,10 @@
 #include "Mem_S68k.h"
 #include "vdp_io.h"
 #include "luascript.h"
+#include "movie.h"
 #include "tracer.h"
+#include "trace_bin.h"
+#include "coverage.h"
 
 #define uint32 unsigned int
 
@@ -25,6 +28,7 @@ unsigned int *pc_start;
 extern bool trace_map;
 extern bool hook_trace;
 extern bool trace_indent;
+extern bool trace_binary;
 extern unsigned char trace_limit;
 
 int Change_Trace();
@@ -37,7 +41,9 @@ extern "C" {
 	unsigned int dma_src, dma_len;
 };
 
-char *mapped;
+static Coverage_Map trace_seen; // for the trace limit
+static unsigned char pc_pages[0x1000]; // 4 KB pages of the address space with a hook_pc range or start address in them
+static Trace_Bin trace_bin;
 uint32 Current_PC;
 int Debug = 1;
 
@@ -48,10 +54,11 @@ const char * InitTrace()
 		fp_trace = fopen( "./Logs/trace.log", "a" );
 		if ( !fp_trace )
 			return "Can't open file ./Logs/trace.log";
-		mapped = new char[ 0x100*0x10000 ];
-		memset( mapped,0,0x100*0x10000 );
+		Coverage_Init( trace_seen, 24, false );
 //		fseek(fp_trace,0,SEEK_END);
 		fprintf(fp_trace,"TRACE STARTED\n\n");
+		if (trace_binary)
+			return Trace_Bin_Open(trace_bin, "./Logs/trace.bin", 0);
 	}
 	return NULL;
 }
@@ -62,9 +69,9 @@ void DeInitTrace()
 	{
 		fprintf(fp_trace,"\nTRACE STOPPED\n\n");
 		fclose(fp_trace);
-		delete [] (mapped);
+		Trace_Bin_Close(trace_bin);
+		Coverage_Free( trace_seen );
 		fp_trace = NULL;
-		mapped = NULL;
 	}
 }
 
@@ -124,6 +131,19 @@ const char * InitDebug()
 
 	fclose( fp1 );
 
+	memset( pc_pages, 0, sizeof(pc_pages) );
+	for( int lcv = 0; lcv < STATES; lcv++ )
+	{
+		unsigned int low = pc_low[ lcv ];
+		unsigned int high = ( pc_mode[ lcv ] & 1 ) ? low : pc_high[ lcv ];
+
+		if( low > high || low > 0xffffff ) continue;
+		if( high > 0xffffff ) high = 0xffffff;
+
+		for( unsigned int page = low >> 12; page <= ( high >> 12 ); page++ )
+			pc_pages[ page ] = 1;
+	}
+
 	fprintf(fp_hook,"MEMORY ACCESS LOGGING STARTED\n\n");
 
 	return NULL;
@@ -251,18 +271,32 @@ void Print_Instruction( FILE *trace )
 	fprintf( trace, "\n", String );
 }
 
+// binary record for the decoder, or the text line right away
+static void Trace_Instruction()
+{
+	if (Trace_Bin_Active(trace_bin))
+	{
+		unsigned short words[5];
+		for (int i = 0; i < 5; i++)
+			words[i] = M68K_RW(hook_pc + i * 2);
+
+		uint32 stackroot = Rom_Data[2] | (Rom_Data[3] << 8) | (Rom_Data[0] << 16) | (Rom_Data[1] << 24);
+		Trace_Bin_Write(trace_bin, hook_pc, words, main68k_context.dreg, main68k_context.areg, main68k_context.sr,
+			FrameCount, VDP_Current_Line, main68k_readOdometer(), trace_indent, stackroot);
+	}
+	else
+		Print_Instruction( fp_trace );
+}
+
 static void GensTrace_trace()
 {
 	if (trace_limit)
 	{
-		if(mapped[ hook_pc ] < trace_limit)
-		{
-			Print_Instruction( fp_trace );
-			mapped[ hook_pc ] ++;
-		}
+		if(Coverage_Hit( trace_seen, hook_pc ) < trace_limit)
+			Trace_Instruction();
 	}
 	else
-		Print_Instruction( fp_trace );
+		Trace_Instruction();
 }
 
 void GensTrace_autotrace()
@@ -280,6 +314,10 @@ void GensTrace_autotrace()
 
 static void GensTrace_hook()
 {
+	// nothing to log outside the pages of the ranges, unless a start-stop range is running
+	if( !pc_pages[ hook_pc >> 12 ] && !pc_start[0] && !pc_start[1] && !pc_start[2] )
+		return;
+
 	for( int lcv = 0; lcv < STATES; lcv++ )
 	{
 		FILE *out;
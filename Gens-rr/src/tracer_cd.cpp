@@ -7,7 +7,10 @@
 #include "Mem_S68k.h"
 #include "vdp_io.h"
 #include "luascript.h"
+#include "movie.h"
 #include "tracer.h"
+#include "trace_bin.h"
+#include "coverage.h"
 
 #define uint32 unsigned int
 
@@ -25,6 +28,7 @@ unsigned int *pc_start_cd;
 extern bool trace_map;
 extern bool hook_trace;
 extern bool trace_indent;
+extern bool trace_binary;
 extern unsigned char trace_limit;
 
 int Change_Trace();
@@ -35,7 +39,9 @@ extern "C" {
 	extern uint32 hook_pc_cd;
 };
 
-char *mapped_cd;
+static Coverage_Map trace_seen_cd; // for the trace limit
+static unsigned char pc_pages_cd[0x1000]; // 4 KB pages of the address space with a hook_pc range or start address in them
+static Trace_Bin trace_bin_cd;
 uint32 Current_PC_cd;
 int Debug_CD = 2;
 
@@ -46,10 +52,11 @@ const char * InitTrace_cd()
 		fp_trace_cd = fopen( "./Logs/trace_cd.log", "a" );
 		if ( !fp_trace_cd )
 			return "Can't open file ./Logs/trace_cd.log";
-		mapped_cd = new char[ 0x100*0x10000 ];
-		memset( mapped_cd,0,0x100*0x10000 );
+		Coverage_Init( trace_seen_cd, 24, false );
 //		fseek(fp_trace_cd,0,SEEK_END);
 		fprintf(fp_trace_cd,"TRACE STARTED\n\n");
+		if (trace_binary)
+			return Trace_Bin_Open(trace_bin_cd, "./Logs/trace_cd.bin", 1);
 	}
 	return NULL;
 }
@@ -60,9 +67,9 @@ void DeInitTrace_cd()
 	{
 		fprintf(fp_trace_cd,"\nTRACE STOPPED\n\n");
 		fclose(fp_trace_cd);
-		delete [] (mapped_cd);
+		Trace_Bin_Close(trace_bin_cd);
+		Coverage_Free( trace_seen_cd );
 		fp_trace_cd = NULL;
-		mapped_cd = NULL;
 	}
 }
 
@@ -122,6 +129,19 @@ const char * InitDebug_cd()
 
 	fclose( fp1 );
 
+	memset( pc_pages_cd, 0, sizeof(pc_pages_cd) );
+	for( int lcv = 0; lcv < STATES; lcv++ )
+	{
+		unsigned int low = pc_low_cd[ lcv ];
+		unsigned int high = ( pc_mode_cd[ lcv ] & 1 ) ? low : pc_high_cd[ lcv ];
+
+		if( low > high || low > 0xffffff ) continue;
+		if( high > 0xffffff ) high = 0xffffff;
+
+		for( unsigned int page = low >> 12; page <= ( high >> 12 ); page++ )
+			pc_pages_cd[ page ] = 1;
+	}
+
 	fprintf(fp_hook_cd,"MEMORY ACCESS LOGGING STARTED\n\n");
 
 	return NULL;
@@ -250,18 +270,32 @@ void Print_Instruction_cd( FILE *trace )
 	fprintf( trace, "\n", String );
 }
 
+// binary record for the decoder, or the text line right away
+static void Trace_Instruction_cd()
+{
+	if (Trace_Bin_Active(trace_bin_cd))
+	{
+		unsigned short words[5];
+		for (int i = 0; i < 5; i++)
+			words[i] = S68K_RW(hook_pc_cd + i * 2);
+
+		uint32 stackroot = Ram_Prg[2] | (Ram_Prg[3] << 8) | (Ram_Prg[0] << 16) | (Ram_Prg[1] << 24);
+		Trace_Bin_Write(trace_bin_cd, hook_pc_cd, words, sub68k_context.dreg, sub68k_context.areg, sub68k_context.sr,
+			FrameCount, VDP_Current_Line, sub68k_readOdometer(), trace_indent, stackroot);
+	}
+	else
+		Print_Instruction_cd( fp_trace_cd );
+}
+
 static void GensTrace_cd_trace()
 {
 	if (trace_limit)
 	{
-		if(mapped_cd[ hook_pc_cd ] < 0x40)
-		{
-			Print_Instruction_cd( fp_trace_cd );
-			mapped_cd[ hook_pc_cd ] ++;
-		}
+		if(Coverage_Hit( trace_seen_cd, hook_pc_cd ) < 0x40)
+			Trace_Instruction_cd();
 	}
 	else
-		Print_Instruction_cd( fp_trace_cd );
+		Trace_Instruction_cd();
 }
 
 void GensTrace_cd_autotrace()
@@ -279,6 +313,10 @@ void GensTrace_cd_autotrace()
 
 static void GensTrace_cd_hook()
 {
+	// nothing to log outside the pages of the ranges, unless a start-stop range is running
+	if( !pc_pages_cd[ hook_pc_cd >> 12 ] && !pc_start_cd[0] && !pc_start_cd[1] && !pc_start_cd[2] )
+		return;
+
 	for( int lcv = 0; lcv < STATES; lcv++ )
 	{
 		FILE *out;
@@ -217,6 +217,8 @@ section .bss align=64
 	resd 1
 	DECL VRam_Flag
 	resd 1
+	DECL VRam_Tile_Dirty				; one byte per 32 byte tile, cleared by vdp_tile.cpp
+	resb 2048
 
 section .text align=64
 
@@ -316,14 +318,16 @@ section .text align=64
 	and di, byte 0x7E
 %endif
 	add bx, dx
-	dec ecx
 %if %2 < 1
 	mov [VRam + edi * 2], ax
+	shr edi, 4
+	mov byte [VRam_Tile_Dirty + edi], 1
 %elif %2 < 2
 	mov [CRam + edi], ax
 %else
 	mov [VSRam + edi], ax
 %endif
+	dec ecx
 	jnz short %%Loop
 
 %%End_Loop
@@ -369,6 +373,14 @@ section .text align=64
 		dec ecx
 		jnz .loop_VRam
 
+		mov ebx, VRam_Tile_Dirty
+		mov ecx, (2048 / 4)
+	.loop_VRam_Tile_Dirty
+		mov dword [ebx], 0x01010101
+		add ebx, 4
+		dec ecx
+		jnz .loop_VRam_Tile_Dirty
+
 		mov ebx, CRam
 		mov ecx, 40
 	.loop_CRam
@@ -816,6 +828,8 @@ section .text align=64
 		add ecx, [VDP_Reg.Auto_Inc]
 		mov [VRam + ebx * 2], ax
 		mov [Ctrl.Address], cx
+		shr ebx, 4
+		mov byte [VRam_Tile_Dirty + ebx], 1
 		pop ecx
 		pop ebx
 		ret
@@ -854,6 +868,7 @@ section .text align=64
 		push ebx
 		push ecx
 		push edx
+		push esi
 
 		mov ebx, [Ctrl.Address]					; bx = Address Dest
 		mov ecx, [VDP_Reg.DMA_Length]			; DMA Length
@@ -879,11 +894,15 @@ section .text align=64
 
 		.Loop
 			mov [VRam + ebx], ah					; VRam[Adr] = Fill Data
+			mov esi, ebx
 			add bx, dx								; Adr = Adr + Auto_Inc
+			shr esi, 5
+			mov byte [VRam_Tile_Dirty + esi], 1
 			dec ecx									; un transfert de moins
 			jns short .Loop							; s'il en reste alors on continue
 
 		mov [Ctrl.Address], bx					; on stocke la nouvelle valeur de Data_Address
+		pop esi
 		pop edx
 		pop ecx
 		pop ebx
@@ -1272,7 +1291,10 @@ section .text align=64
 			mov al, [VRam + esi]					; ax = Src
 			inc si									; on augment pointeur Src de 1
 			mov [VRam + edi], al					; VRam[Dest] = Src.W
+			movzx ebx, di
 			add di, dx								; Adr = Adr + Auto_Inc
+			shr ebx, 5
+			mov byte [VRam_Tile_Dirty + ebx], 1
 			dec ecx									; un transfert de moins
 			jnz short .VRam_Copy_Loop				; si DMA Length >= 0 alors on continue le transfert DMA
 
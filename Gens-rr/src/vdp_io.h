@@ -38,6 +38,22 @@ extern unsigned char VSRam[256];
 extern unsigned char H_Counter_Table[512 * 2];
 //extern unsigned int Spr_Link[256]; // not really
 extern int H_Pix_Begin;
+extern int H_Cell;
+extern int H_Win_Mul;
+extern int H_Pix;
+extern int H_Scroll_Mask;
+extern int H_Scroll_CMul;
+extern int H_Scroll_CMask;
+extern int V_Scroll_CMask;
+extern int V_Scroll_MMask;
+extern int Win_X_Pos;
+extern int Win_Y_Pos;
+// pointers into VRam, set by Set_VDP_Reg
+extern unsigned char *ScrA_Addr;
+extern unsigned char *ScrB_Addr;
+extern unsigned char *Win_Addr;
+extern unsigned char *Spr_Addr;
+extern unsigned char *H_Scroll_Addr;
 extern int Genesis_Started;
 extern int SegaCD_Started;
 extern int _32X_Started;
@@ -48,6 +64,7 @@ extern int VDP_Num_Lines;
 extern int VDP_Num_Vis_Lines;
 extern int CRam_Flag;
 extern int VRam_Flag;
+extern unsigned char VRam_Tile_Dirty[2048];	// one per 32 byte pattern, set on every VRAM write
 extern int VDP_Int;
 extern int VDP_Status;
 extern int DMAT_Length;
@@ -72,6 +72,13 @@ void Render_Line();
 void Post_Line();
 void Render_Line_32X();
 
+// tile cached C++ version of Render_Line (vdp_tile.cpp)
+extern int VDP_Tile_Cache;
+void Render_Line_Cached(void);
+void Render_Line_Status(void);
+void VDP_Tile_Cache_Invalidate(void);
+int VDP_Render_Benchmark(char *summary);
+
 #ifdef __cplusplus
 };
 #endif
@@ -0,0 +1,856 @@
+#include <stdio.h>
+#include <string.h>
+#include "vdp_io.h"
+#include "vdp_rend.h"
+#include "benchmark.h"
+
+// Tile cached line renderer : a C++ version of Render_Line (vdp_rend.asm) which writes exactly the same
+// Screen_16X words. Every 4 byte pattern line of VRAM is kept decoded to 8 palette indices, once in
+// display order and once H-flipped, with one bit per opaque pixel. VRAM writes and DMA (vdp_io.asm) set
+// VRam_Tile_Dirty for the 32 byte pattern they touch, and a dirty pattern is decoded again the next time
+// a line uses it, so a line of unchanged patterns is only name table reads and stores.
+
+#define TILE_CACHE_LINES	0x4000		// 64 KB of VRAM in 4 byte pattern lines
+#define TILE_CACHE_SCRATCH	TILE_CACHE_LINES
+
+int VDP_Tile_Cache = 0;
+
+// rendering scratch of vdp_rend.asm, only Spr_End carries over from one line to the next
+extern "C" struct
+{
+	int Pattern_Adr;
+	int Line_7;
+	int X;
+	int Cell;
+	int Start_A;
+	int Length_A;
+	int Start_W;
+	int Length_W;
+	int Mask;
+	int Spr_End;
+	int Next_Cell;
+	int Palette;
+	int Borne;
+} Data_Misc;
+
+static unsigned char Tile_Pixels[2][TILE_CACHE_LINES + 1][8];	// [H-flip][pattern line][pixel]
+static unsigned char Tile_Mask[2][TILE_CACHE_LINES + 1];		// bit n set if pixel n isn't transparent
+static int Tile_Visible[80];
+
+
+static inline void Decode_Pattern_Line(unsigned int data, unsigned int line)
+{
+	// pixel order of a VRAM dword, see PUTLINE_P0 and PUTLINE_FLIP_P0
+	static const unsigned char shift[8] = {12, 8, 4, 0, 28, 24, 20, 16};
+	unsigned char *norm = Tile_Pixels[0][line];
+	unsigned char *flip = Tile_Pixels[1][line];
+	unsigned int maskN = 0, maskF = 0;
+	int i;
+
+	for(i = 0; i < 8; i++)
+	{
+		unsigned char pix = (data >> shift[i]) & 0xF;
+
+		norm[i] = pix;
+		flip[7 - i] = pix;
+		if (pix)
+		{
+			maskN |= 1 << i;
+			maskF |= 0x80 >> i;
+		}
+	}
+
+	Tile_Mask[0][line] = maskN;
+	Tile_Mask[1][line] = maskF;
+}
+
+static void Decode_Tile(unsigned int tile)
+{
+	const unsigned int *src = (const unsigned int *) (VRam + tile * 32);
+	int i;
+
+	for(i = 0; i < 8; i++) Decode_Pattern_Line(src[i], tile * 8 + i);
+	VRam_Tile_Dirty[tile] = 0;
+}
+
+// marks the whole cache dirty, for code writing VRam directly (savestates, RAM search...)
+void VDP_Tile_Cache_Invalidate(void)
+{
+	memset(VRam_Tile_Dirty, 1, 2048);
+}
+
+// decoded pattern line at a VRAM offset (a multiple of 4), mask gets its opaque pixels
+static inline const unsigned char *Pattern_Line(unsigned int adr, int flip, unsigned int *mask)
+{
+	unsigned int line = adr >> 2;
+
+	if (adr < 0x10000)
+	{
+		if (VRam_Tile_Dirty[adr >> 5]) Decode_Tile(adr >> 5);
+	}
+	else
+	{
+		// interlaced and sprite patterns can point past the end of VRAM, the asm reads whatever follows it
+		line = TILE_CACHE_SCRATCH;
+		Decode_Pattern_Line(*(const unsigned int *) (VRam + adr), line);
+	}
+
+	*mask = Tile_Mask[flip][line];
+	return Tile_Pixels[flip][line];
+}
+
+
+// one pattern line of scroll B, see PUTLINE_P0 / PUTLINE_P1 with %1 = 0
+template<int prio, int hs>
+static inline void Put_Line_B(unsigned short *dst, const unsigned char *pix, unsigned int mask, unsigned int pal)
+{
+	unsigned short clear = (!prio && hs) ? 0x4040 : 0x0000;
+	unsigned short flags = prio ? 0x0300 : (hs ? 0x4140 : 0x0100);
+	int i;
+
+	for(i = 0; i < 8; i++) dst[i] = clear;
+
+	if (!(ScrollBOn & 1) || !((prio ? VScrollBh : VScrollBl) & 1) || !mask) return;
+
+	if (mask == 0xFF)
+	{
+		for(i = 0; i < 8; i++) dst[i] = flags | (pal + pix[i]);
+		return;
+	}
+
+	for(i = 0; i < 8; i++)
+		if (mask & (1 << i)) dst[i] = flags | (pal + pix[i]);
+}
+
+// one pattern line of scroll A or the window, see PUTLINE_P0 / PUTLINE_P1 with %1 = 1
+template<int prio, int hs>
+static inline void Put_Line_A(unsigned short *dst, const unsigned char *pix, unsigned int mask, unsigned int pal)
+{
+	int i;
+
+	if (!(ScrollAOn & 1) || !((prio ? VScrollAh : VScrollAl) & 1)) return;
+
+	if (prio)
+	{
+		if (hs) for(i = 0; i < 8; i++) dst[i] &= 0xBFBF;
+		if (!mask) return;
+
+		if (mask == 0xFF)
+		{
+			for(i = 0; i < 8; i++) dst[i] = 0x0300 + pal + pix[i];
+			return;
+		}
+
+		for(i = 0; i < 8; i++)
+			if (mask & (1 << i)) dst[i] = 0x0300 + pal + pix[i];
+	}
+	else
+	{
+		for(i = 0; i < 8; i++)
+		{
+			unsigned int w = dst[i];
+
+			if (!(mask & (1 << i)) || (w & 0x0200)) continue;		// transparent or behind scroll B priority
+			if (hs) dst[i] = ((w & 0xFF00) | 0x0100) + ((pal + pix[i] + ((w >> 8) & 0x40)) & 0xFF);
+			else dst[i] = ((w & 0xFF00) | 0x0100) + pal + pix[i];
+		}
+	}
+}
+
+// one pattern line of a sprite, see PUTLINE_SPRITE, dst points to the sprite X position in the line
+template<int prio, int hs>
+static inline void Put_Line_Sprite(unsigned short *dst, const unsigned char *pix, unsigned int mask, unsigned int pal)
+{
+	unsigned int collide = 0;
+	int i;
+
+	if (!(SpriteOn & 1) || !((prio ? VSpriteh : VSpritel) & 1) || !mask) return;
+
+	for(i = 0; i < 8; i++)
+	{
+		unsigned int w, hi, col;
+
+		if (!(mask & (1 << i))) continue;
+
+		w = dst[i];
+		hi = w >> 8;
+		if (hi & (prio ? 0x20 : 0x22))
+		{
+			// something already there, only a sprite pixel is a collision
+			collide |= hi;
+			if (!prio) dst[i] = w | 0x2000;
+			continue;
+		}
+
+		col = pal + pix[i];
+		if (hs)
+		{
+			if (col == 0x3E)
+			{
+				dst[i] = w | 0x8080;		// highlight
+				continue;
+			}
+			if (col == 0x3F)
+			{
+				dst[i] = w | 0x4040;		// shadow
+				continue;
+			}
+			col = (col + (hi & (prio ? 0x80 : 0xC0))) & 0xFF;
+		}
+
+		dst[i] = 0x2100 | col;
+	}
+
+	VDP_Status |= collide & 0x20;
+}
+
+// Put_Line_Sprite without the colors, outside of shadow/highlight mode the flags left in the
+// high byte are the same
+template<int prio>
+static inline void Mark_Line_Sprite(unsigned short *dst, unsigned int mask)
+{
+	unsigned int collide = 0;
+	int i;
+
+	if (!(SpriteOn & 1) || !((prio ? VSpriteh : VSpritel) & 1) || !mask) return;
+
+	for(i = 0; i < 8; i++)
+	{
+		unsigned int hi;
+
+		if (!(mask & (1 << i))) continue;
+
+		hi = dst[i] >> 8;
+		if (hi & (prio ? 0x20 : 0x22))
+		{
+			collide |= hi;
+			dst[i] |= 0x2000;
+		}
+		else dst[i] = 0x2100;
+	}
+
+	VDP_Status |= collide & 0x20;
+}
+
+
+// new V scroll for the cell in 2 cell mode, see UPDATE_Y_OFFSET
+template<int interlace, int scrollA>
+static inline void Update_Y_Offset(int cell, unsigned int *line7, unsigned int *ycell)
+{
+	unsigned int vscroll, y;
+
+	if ((unsigned int) cell & 0xFF81) return;			// odd cell or outside VSRam, keep the last one
+
+	if (scrollA) vscroll = *(const unsigned int *) (VSRam + cell * 2);
+	else vscroll = *(const unsigned short *) (VSRam + cell * 2 + 2);
+	y = VDP_Current_Line + (vscroll >> interlace);
+	*line7 = y & 7;
+	*ycell = (y >> 3) & V_Scroll_CMask;
+}
+
+template<int interlace>
+static inline unsigned int Pattern_Adr(unsigned int info, unsigned int line7)
+{
+	if (info & 0x1000) line7 ^= 7;					// V-Flip
+	return ((info & 0x7FF) << (5 + interlace)) + (line7 << (2 + interlace));
+}
+
+template<int interlace, int hs>
+static inline void Put_Cell_B(unsigned short *dst, unsigned int info, unsigned int line7)
+{
+	unsigned int mask;
+	const unsigned char *pix = Pattern_Line(Pattern_Adr<interlace>(info, line7), (info >> 11) & 1, &mask);
+
+	if (info & 0x8000) Put_Line_B<1, hs>(dst, pix, mask, (info >> 9) & 0x30);
+	else Put_Line_B<0, hs>(dst, pix, mask, (info >> 9) & 0x30);
+}
+
+template<int interlace, int hs>
+static inline void Put_Cell_A(unsigned short *dst, unsigned int info, unsigned int line7, unsigned int keep)
+{
+	unsigned int mask;
+	const unsigned char *pix = Pattern_Line(Pattern_Adr<interlace>(info, line7), (info >> 11) & 1, &mask);
+
+	if (info & 0x8000) Put_Line_A<1, hs>(dst, pix, mask & keep, (info >> 9) & 0x30);
+	else Put_Line_A<0, hs>(dst, pix, mask & keep, (info >> 9) & 0x30);
+}
+
+
+// see RENDER_LINE_SCROLL_B
+template<int interlace, int cellVScroll, int hs>
+static void Render_Scroll_B(unsigned short *line)
+{
+	const unsigned short *names = (const unsigned short *) ScrB_Addr;
+	unsigned int hscroll = ((const unsigned short *) H_Scroll_Addr)[(VDP_Current_Line & H_Scroll_Mask) * 2 + 1];
+	unsigned int xcell = (hscroll ^ 0x3FF) >> 3;
+	int cell = (xcell & 1) - 2;
+	unsigned int y = VDP_Current_Line + (*(const unsigned int *) (VSRam + 2) >> interlace);
+	unsigned int line7 = y & 7;
+	unsigned int ycell = (y >> 3) & V_Scroll_CMask;
+	unsigned short *dst = line + (hscroll & 7);
+	int n;
+
+	xcell &= H_Scroll_CMask;
+
+	for(n = H_Cell; n >= 0; n--)
+	{
+		unsigned int info;
+
+		if (cellVScroll && n != H_Cell)
+			Update_Y_Offset<interlace, 0>(cell, &line7, &ycell);
+
+		info = names[(ycell << H_Scroll_CMul) + xcell];
+		if (Swap_Scroll_PriorityB & 1) info ^= 0x8000;
+		Put_Cell_B<interlace, hs>(dst, info, line7);
+
+		cell++;
+		xcell = (xcell + 1) & H_Scroll_CMask;
+		dst += 8;
+	}
+}
+
+// see RENDER_LINE_SCROLL_A_WIN
+template<int interlace, int cellVScroll, int hs>
+static void Render_Scroll_A_Win(unsigned short *line)
+{
+	int startW, lengthW;
+	const unsigned short *names;
+	unsigned short *dst;
+	unsigned int line7;
+	int n;
+
+	if (((VDP_Reg.Win_V_Pos & 0xFF) >> 7) == ((unsigned int) (VDP_Current_Line >> 3) >= (unsigned int) Win_Y_Pos))
+	{
+		// the whole line is window
+		startW = 0;
+		lengthW = H_Cell;
+	}
+	else
+	{
+		int startA, lengthA;
+
+		if (VDP_Reg.Win_H_Pos & 0x80)
+		{
+			startW = Win_X_Pos;
+			lengthW = H_Cell - Win_X_Pos;
+			startA = 0;
+			lengthA = Win_X_Pos - 1;		// the last cell of scroll A is always drawn separately
+		}
+		else
+		{
+			startW = 0;
+			lengthW = Win_X_Pos;
+			startA = Win_X_Pos;
+			lengthA = H_Cell - Win_X_Pos - 1;
+		}
+
+		if (lengthA >= 0)
+		{
+			unsigned int hscroll = ((const unsigned short *) H_Scroll_Addr)[(VDP_Current_Line & H_Scroll_Mask) * 2];
+			unsigned int fine = hscroll & 7;
+			unsigned int xcell = (hscroll ^ 0x3FF) >> 3;
+			int cell = startA + (xcell & 1) - 2;
+			unsigned int vscroll, y, ycell;
+
+			names = (const unsigned short *) ScrA_Addr;
+			dst = line + fine + startA * 8;
+			xcell = (xcell + startA) & H_Scroll_CMask;
+
+			if (cell < 0) vscroll = *(const unsigned int *) (VSRam + 0);
+			else vscroll = *(const unsigned int *) (VSRam + (cell & V_Scroll_MMask) * 2);
+			y = VDP_Current_Line + (vscroll >> interlace);
+			line7 = y & 7;
+			ycell = (y >> 3) & V_Scroll_CMask;
+
+			for(n = lengthA; n >= 0; n--)
+			{
+				unsigned int info;
+
+				if (cellVScroll && n != lengthA)
+					Update_Y_Offset<interlace, 1>(cell, &line7, &ycell);
+
+				info = names[(ycell << H_Scroll_CMul) + xcell];
+				if (Swap_Scroll_PriorityA & 1) info ^= 0x8000;
+				Put_Cell_A<interlace, hs>(dst, info, line7, 0xFF);
+
+				cell++;
+				xcell = (xcell + 1) & H_Scroll_CMask;
+				dst += 8;
+			}
+
+			// last cell, cut by the fine scroll
+			if (cellVScroll) Update_Y_Offset<interlace, 1>(cell, &line7, &ycell);
+
+			{
+				unsigned int info = names[(ycell << H_Scroll_CMul) + xcell];
+
+				if (Swap_Scroll_PriorityA & 1) info ^= 0x8000;
+				Put_Cell_A<interlace, hs>(dst, info, line7, 0xFF >> fine);
+			}
+
+			if (!(lengthW & 0xFF)) return;
+		}
+	}
+
+	// window, no scrolling and no clipping
+	names = (const unsigned short *) Win_Addr + ((VDP_Current_Line >> 3) << H_Win_Mul);
+	dst = line + startW * 8 + 8;
+	line7 = VDP_Current_Line & 7;
+
+	for(n = 0; n < lengthW; n++, dst += 8)
+		Put_Cell_A<interlace, hs>(dst, names[startW + n], line7, 0xFF);
+}
+
+
+// see MAKE_SPRITE_STRUCT
+template<int interlace>
+static void Make_Sprite_Struct(void)
+{
+	const unsigned char *spr = (const unsigned char *) Spr_Addr;
+	int i = 0;
+
+	for(;;)
+	{
+		unsigned int size = spr[2 ^ 1];
+		unsigned int link = spr[3 ^ 1] & 0x7F;
+
+		Sprite_Struct[i].Pos_Y = ((*(const unsigned short *) (spr + 0) >> interlace) & 0x1FF) - 0x80;
+		Sprite_Struct[i].Pos_X = (*(const unsigned short *) (spr + 6) & 0x1FF) - 0x80;
+		Sprite_Struct[i].Size_X = ((size >> 2) & 3) + 1;
+		Sprite_Struct[i].Size_Y = size & 3;
+		Sprite_Struct[i].Pos_X_Max = Sprite_Struct[i].Pos_X + Sprite_Struct[i].Size_X * 8 - 1;
+		Sprite_Struct[i].Pos_Y_Max = Sprite_Struct[i].Pos_Y + Sprite_Struct[i].Size_Y * 8 + 7;
+		Sprite_Struct[i].Num_Tile = (Sprite_Struct[i].Num_Tile & 0xFFFF0000) | *(const unsigned short *) (spr + 4);
+		i++;
+
+		if (!link || i >= 80) break;
+		spr = (const unsigned char *) Spr_Addr + link * 8;
+	}
+
+	Data_Misc.Spr_End = (i - 1) * 32;
+}
+
+// see MAKE_SPRITE_STRUCT_PARTIAL, only X and the first tile change
+static void Make_Sprite_Struct_Partial(void)
+{
+	const unsigned char *spr = (const unsigned char *) Spr_Addr;
+	int i = 0;
+
+	for(;;)
+	{
+		unsigned int link = spr[3 ^ 1] & 0x7F;
+
+		Sprite_Struct[i].Num_Tile = (Sprite_Struct[i].Num_Tile & 0xFFFF0000) | *(const unsigned short *) (spr + 4);
+		Sprite_Struct[i].Pos_X = (*(const unsigned short *) (spr + 6) & 0x1FF) - 0x80;
+		Sprite_Struct[i].Pos_X_Max = Sprite_Struct[i].Pos_X + (spr[2 ^ 1] & 0x0C) * 2 + 7;
+
+		if (!link) break;
+		if (++i >= 80) break;
+		spr = (const unsigned char *) Spr_Addr + link * 8;
+	}
+}
+
+// list of the sprites to draw on the current line, see UPDATE_MASK_SPRITE
+template<int limit>
+static int Update_Mask_Sprite(void)
+{
+	int line = VDP_Current_Line;
+	int last = Data_Misc.Spr_End / 32;
+	int cells = H_Cell;
+	int count = 0;
+	int first = 1;
+	int i;
+
+	for(i = 0; i <= last; i++)
+	{
+		if (Sprite_Struct[i].Pos_Y > line || Sprite_Struct[i].Pos_Y_Max < line)
+		{
+			if (limit && !first && cells <= 0) goto Overflow;
+			continue;
+		}
+
+		// a sprite at X = -128 masks the following ones, unless it is the first one on the line
+		if (!first && Sprite_Struct[i].Pos_X == -128) break;
+
+		if (limit) cells -= Sprite_Struct[i].Size_X;
+		if (Sprite_Struct[i].Pos_X < H_Pix && Sprite_Struct[i].Pos_X_Max >= 0) Tile_Visible[count++] = i;
+
+		if (limit && !first && cells <= 0)
+		{
+			i++;
+			goto Overflow;
+		}
+		first = 0;
+	}
+
+	return count;
+
+Overflow:
+	// sprite overflow only if another sprite is on the line
+	for(; i <= last; i++)
+	{
+		if (Sprite_Struct[i].Pos_Y <= line && Sprite_Struct[i].Pos_Y_Max >= line)
+		{
+			VDP_Status |= 0x40;
+			break;
+		}
+	}
+
+	return count;
+}
+
+// see RENDER_LINE_SPR
+template<int interlace, int hs, int draw>
+static void Render_Sprites(unsigned short *line)
+{
+	int count = (Sprite_Over & 1) ? Update_Mask_Sprite<1>() : Update_Mask_Sprite<0>();
+	int n;
+
+	for(n = 0; n < count; n++)
+	{
+		int s = Tile_Visible[n];
+		unsigned int tile = Sprite_Struct[s].Num_Tile;
+		unsigned int info = tile;
+		unsigned int yoff = VDP_Current_Line - Sprite_Struct[s].Pos_Y;
+		unsigned int pal = ((tile & 0xFFFF) >> 9) & 0x30;
+		unsigned int sizeY = Sprite_Struct[s].Size_Y << (5 + interlace);
+		unsigned int rowOff = (yoff & 0xF8) << (2 + interlace);
+		unsigned int stride = sizeY + (32 << interlace);
+		unsigned int adr = (tile & 0x7FF) << (5 + interlace);
+		int high, x;
+
+		if (Swap_Sprite_Priority & 1) info ^= 0x8000;
+		high = (Sprite_Always_Top & 0xFF) || (info & 0x8000);
+
+		if (info & 0x1000) adr += sizeY - rowOff + (((yoff & 7) ^ 7) << (2 + interlace));		// V-Flip
+		else adr += rowOff + ((yoff & 7) << (2 + interlace));
+
+		if (info & 0x800)
+		{
+			// H-Flip : the last pattern column is drawn first, from the right
+			int hmin = (Sprite_Struct[s].Pos_X > -7) ? Sprite_Struct[s].Pos_X : -7;
+
+			for(x = Sprite_Struct[s].Pos_X_Max - 7; x >= H_Pix; x -= 8) adr += stride;
+
+			do
+			{
+				unsigned int mask;
+				const unsigned char *pix = Pattern_Line(adr, 1, &mask);
+
+				if (!draw)
+				{
+					if (high) Mark_Line_Sprite<1>(line + x + 8, mask);
+					else Mark_Line_Sprite<0>(line + x + 8, mask);
+				}
+				else if (high) Put_Line_Sprite<1, hs>(line + x + 8, pix, mask, pal);
+				else Put_Line_Sprite<0, hs>(line + x + 8, pix, mask, pal);
+				x -= 8;
+				adr += stride;
+			} while(x >= hmin);
+		}
+		else
+		{
+			int hmax = (Sprite_Struct[s].Pos_X_Max < H_Pix) ? Sprite_Struct[s].Pos_X_Max : H_Pix;
+
+			for(x = Sprite_Struct[s].Pos_X; x < -7; x += 8) adr += stride;
+
+			do
+			{
+				unsigned int mask;
+				const unsigned char *pix = Pattern_Line(adr, 0, &mask);
+
+				if (!draw)
+				{
+					if (high) Mark_Line_Sprite<1>(line + x + 8, mask);
+					else Mark_Line_Sprite<0>(line + x + 8, mask);
+				}
+				else if (high) Put_Line_Sprite<1, hs>(line + x + 8, pix, mask, pal);
+				else Put_Line_Sprite<0, hs>(line + x + 8, pix, mask, pal);
+				x += 8;
+				adr += stride;
+			} while(x < hmax);
+		}
+	}
+}
+
+// see RENDER_LINE
+template<int interlace, int hs>
+static void Render_Layers(unsigned short *line)
+{
+	if (VDP_Reg.Set3 & 4)
+	{
+		Render_Scroll_B<interlace, 1, hs>(line);
+		Render_Scroll_A_Win<interlace, 1, hs>(line);
+	}
+	else
+	{
+		Render_Scroll_B<interlace, 0, hs>(line);
+		Render_Scroll_A_Win<interlace, 0, hs>(line);
+	}
+
+	Render_Sprites<interlace, hs, 1>(line);
+}
+
+// rebuilds the sprite table the way VRam_Flag asks for
+static void Update_Sprite_Struct(void)
+{
+	int flag = VRam_Flag & 3;
+
+	VRam_Flag &= ~0xFF;
+	if (flag == 2) Make_Sprite_Struct_Partial();
+	else if (flag)
+	{
+		if (VDP_Reg.Set4 & 4) Make_Sprite_Struct<1>();
+		else Make_Sprite_Struct<0>();
+	}
+}
+
+void Render_Line_Cached(void)
+{
+	unsigned short *line = Screen_16X + TAB336[VDP_Current_Line];
+	const unsigned short *pal;
+	unsigned int backdrop;
+	int i, length;
+
+	if (!(VDP_Reg.Set2 & 0x40))
+	{
+		// display off
+		unsigned short fill = (VDP_Reg.Set4 & 0x08) ? 0x4040 : 0x0000;
+
+		for(i = 0; i < 320; i++) line[8 + i] = fill;
+	}
+	else
+	{
+		Update_Sprite_Struct();
+
+		switch(VDP_Reg.Set4 & 0xC)
+		{
+			case 0x0: Render_Layers<0, 0>(line); break;
+			case 0x4: Render_Layers<1, 0>(line); break;
+			case 0x8: Render_Layers<0, 1>(line); break;
+			case 0xC: Render_Layers<1, 1>(line); break;
+		}
+	}
+
+	// palette indexes to 0ahsbbbbggggrrrr
+	pal = (PalLock & 1) ? LockedPalette : CRam;
+	backdrop = VDP_Reg.BG_Color & 0x3F;
+	length = (160 - H_Pix_Begin) * 2;
+	line += 8;
+
+	for(i = 0; i < length; i++)
+	{
+		unsigned int w = line[i];
+		unsigned int index = w & 0x3F;
+
+		if (!index) index = backdrop;
+		line[i] = (pal[index] & 0xEEE) | ((w & 0x1C0) << 6);
+	}
+}
+
+
+// Same VDP_Status and Sprite_Struct as Render_Line_Cached, without drawing the planes or converting
+// the line. Used for the lines of skipped frames so sprite overflow and collision are seen by the game
+// exactly as when the frame is rendered.
+void Render_Line_Status(void)
+{
+	unsigned short *line = Screen_16X + TAB336[VDP_Current_Line];
+	const unsigned short *hscroll;
+
+	if (!(VDP_Reg.Set2 & 0x40) || (VDP_Reg.Set4 & 0x08))
+	{
+		// display off clears the line, shadow/highlight sprites also depend on the plane priorities
+		Render_Line_Cached();
+		return;
+	}
+
+	Update_Sprite_Struct();
+
+	// Scroll B overwrites (H_Cell + 1) cells from its fine scroll. The few off screen columns on either
+	// side keep the flags of the previous frame, and sprites reaching there collide with them, so those
+	// columns have to end up as if the line was rendered. Scroll A is only drawn when it reaches them.
+	hscroll = (const unsigned short *) H_Scroll_Addr + (VDP_Current_Line & H_Scroll_Mask) * 2;
+	memset(line + (hscroll[1] & 7), 0, (H_Cell + 1) * 8 * sizeof(unsigned short));
+
+	if ((hscroll[0] ^ hscroll[1]) & 7)
+	{
+		if (VDP_Reg.Set4 & 4)
+		{
+			if (VDP_Reg.Set3 & 4) Render_Scroll_A_Win<1, 1, 0>(line);
+			else Render_Scroll_A_Win<1, 0, 0>(line);
+		}
+		else
+		{
+			if (VDP_Reg.Set3 & 4) Render_Scroll_A_Win<0, 1, 0>(line);
+			else Render_Scroll_A_Win<0, 0, 0>(line);
+		}
+	}
+
+	if (VDP_Reg.Set4 & 4) Render_Sprites<1, 0, 0>(line);
+	else Render_Sprites<0, 0, 0>(line);
+}
+
+
+// benchmark : each run adds the current VRAM, CRAM, VSRAM and registers to Logs\vdp_dumps.bin, which keeps
+// the last VDP_BENCH_DUMPS of them, then renders those dumps with Render_Line, Render_Line_Cached and
+// Render_Line_Status
+
+#define VDP_BENCH_DUMPS 16
+#define VDP_BENCH_FRAMES 60
+
+struct VDP_Dump
+{
+	unsigned char VRam[0x10000];
+	unsigned short CRam[0x40];
+	unsigned char VSRam[0x50];
+	unsigned char Reg[24];
+};
+
+static void VDP_Bench_Load(const VDP_Dump *dump)
+{
+	int i;
+
+	memcpy(VRam, dump->VRam, sizeof(dump->VRam));
+	memcpy(CRam, dump->CRam, sizeof(dump->CRam));
+	memcpy(VSRam, dump->VSRam, sizeof(dump->VSRam));
+	for(i = 0; i < 24; i++) Set_VDP_Reg(i, dump->Reg[i]);
+	VDP_Tile_Cache_Invalidate();
+}
+
+// renders VDP_BENCH_FRAMES frames of the dump with Render_Line (mode 0), Render_Line_Cached (1) or
+// Render_Line_Status (2), every 4th frame rewrites a few patterns the way a game streaming graphics
+// would, returns the lines per second and leaves the last frame in screen
+static double VDP_Bench_Pass(const VDP_Dump *dump, int mode, unsigned short *screen, int *status)
+{
+	double start, ms;
+	unsigned int seed = 12345;
+	int frame, lines = 0;
+
+	VDP_Bench_Load(dump);
+	VDP_Status = 0;
+	memset(Screen_16X, 0, sizeof(Screen_16X));
+	start = Benchmark_Time();
+
+	for(frame = 0; frame < VDP_BENCH_FRAMES; frame++)
+	{
+		if ((frame & 3) == 3)
+		{
+			int i;
+
+			for(i = 0; i < 16; i++)
+			{
+				unsigned int adr;
+
+				seed = seed * 1103515245 + 12345;
+				adr = (seed >> 8) & 0xFFFF;
+				VRam[adr] ^= 0x5A;
+				VRam_Tile_Dirty[adr >> 5] = 1;
+			}
+		}
+
+		VRam_Flag = 1;
+		for(VDP_Current_Line = 0; VDP_Current_Line < VDP_Num_Vis_Lines; VDP_Current_Line++)
+		{
+			if (mode == 2) Render_Line_Status();
+			else if (mode) Render_Line_Cached();
+			else Render_Line();
+		}
+		lines += VDP_Num_Vis_Lines;
+	}
+
+	ms = Benchmark_Time() - start;
+	memcpy(screen, Screen_16X, sizeof(Screen_16X));
+	*status = VDP_Status;
+
+	return lines * 1000.0 / (ms > 0.0 ? ms : 0.001);
+}
+
+// times the cached renderers against Render_Line on the current VDP state and the ones saved by earlier runs
+int VDP_Render_Benchmark(char *summary)
+{
+	static VDP_Dump saved, dumps[VDP_BENCH_DUMPS];
+	static unsigned short screen[3][336 * 240];
+	static unsigned short savedScreen[336 * 240];
+	static unsigned char savedCtrl[sizeof(Ctrl)];
+	struct Reg_VDP_Type savedReg = VDP_Reg;
+	int savedLine = VDP_Current_Line, savedStatus = VDP_Status, savedFlag = VRam_Flag;
+	double asmRate = 0.0, cachedRate = 0.0, statusRate = 0.0;
+	int count = 0, mismatches = 0, d;
+	FILE *file;
+
+	memcpy(saved.VRam, VRam, sizeof(saved.VRam));
+	memcpy(saved.CRam, CRam, sizeof(saved.CRam));
+	memcpy(saved.VSRam, VSRam, sizeof(saved.VSRam));
+	for(d = 0; d < 24; d++) saved.Reg[d] = ((unsigned int *) &VDP_Reg)[d];
+	memcpy(savedScreen, Screen_16X, sizeof(savedScreen));
+	memcpy(savedCtrl, &Ctrl, sizeof(savedCtrl));		// setting register 23 changes the DMA mode
+
+	file = fopen("./Logs/vdp_dumps.bin", "rb");
+	if (file)
+	{
+		long total;
+
+		fseek(file, 0, SEEK_END);
+		total = ftell(file) / sizeof(VDP_Dump);
+		if (total > VDP_BENCH_DUMPS - 1)
+			fseek(file, (total - (VDP_BENCH_DUMPS - 1)) * sizeof(VDP_Dump), SEEK_SET);
+		else fseek(file, 0, SEEK_SET);
+		count = fread(dumps, sizeof(VDP_Dump), VDP_BENCH_DUMPS - 1, file);
+		fclose(file);
+	}
+	memcpy(&dumps[count++], &saved, sizeof(saved));
+
+	file = fopen("./Logs/vdp_dumps.bin", "wb");		// rewritten with only the dumps used, so it doesn't keep growing
+	if (file)
+	{
+		fwrite(dumps, sizeof(VDP_Dump), count, file);
+		fclose(file);
+	}
+
+	file = Benchmark_Log("vdp");
+	if (file) fprintf(file, "VDP line renderer, %d dumps of %d frames\n", count, VDP_BENCH_FRAMES);
+
+	for(d = 0; d < count; d++)
+	{
+		int status[3];
+		double rate[3];
+
+		rate[0] = VDP_Bench_Pass(&dumps[d], 0, screen[0], &status[0]);
+		rate[1] = VDP_Bench_Pass(&dumps[d], 1, screen[1], &status[1]);
+		rate[2] = VDP_Bench_Pass(&dumps[d], 2, screen[2], &status[2]);
+		asmRate += rate[0];
+		cachedRate += rate[1];
+		statusRate += rate[2];
+
+		if (memcmp(screen[0], screen[1], sizeof(screen[0])) || ((status[0] ^ status[1]) & 0x60)
+		 || ((status[0] ^ status[2]) & 0x60)) mismatches++;
+
+		if (file)
+			fprintf(file, "dump %2d (mode %02X %02X): asm %8.0f lines/s, cached %8.0f lines/s, status only %8.0f lines/s%s\n", d,
+				dumps[d].Reg[1], dumps[d].Reg[12], rate[0], rate[1], rate[2],
+				memcmp(screen[0], screen[1], sizeof(screen[0])) ? ", PIXELS DIFFER" :
+				(((status[0] ^ status[1]) | (status[0] ^ status[2])) & 0x60) ? ", SPRITE STATUS DIFFERS" : "");
+	}
+
+	asmRate /= count;
+	cachedRate /= count;
+	statusRate /= count;
+	if (file)
+	{
+		fprintf(file, "average: asm %.0f lines/s, cached %.0f lines/s, status only %.0f lines/s\n\n", asmRate, cachedRate, statusRate);
+		fclose(file);
+	}
+
+	VDP_Bench_Load(&saved);
+	VDP_Reg = savedReg;
+	memcpy(&Ctrl, savedCtrl, sizeof(savedCtrl));
+	VDP_Current_Line = savedLine;
+	VDP_Status = savedStatus;
+	VRam_Flag = savedFlag | 1;			// the sprite table was rebuilt from the dumps
+	memcpy(Screen_16X, savedScreen, sizeof(savedScreen));
+
+	sprintf(summary, "VDP: asm %.0f, cached %.0f, status only %.0f lines/s over %d dumps%s",
+		asmRate, cachedRate, statusRate, count, mismatches ? " (MISMATCH)" : "");
+
+	return mismatches;
+}
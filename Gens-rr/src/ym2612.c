@@ -13,7 +13,10 @@
 #include <stdio.h>
 #include <math.h>
 #include "ym2612.h"
+#include "benchmark.h"
+#include "misc.h"
 #include <memory.h>
+#include <emmintrin.h>
 
 
 /********************************************
@@ -247,6 +250,9 @@ int Update_GYM_Dump(char v0, char v1, char v2);
 
 int YM2612_Enable;
 int YM2612_Improv;
+int YM2612_SSE2;
+int YM2612_Lazy = 1;
+int YM2612_Unheard;
 int DAC_Enable;
 int *YM_Buf[2];
 int YM_Len = 0;
@@ -1844,6 +1850,311 @@ void Update_Chan_Algo7_LFO_Int(channel_ *CH, int **buf, int length)
 }
 
 
+/***********************************************
+ *        fonctions de gnration SSE2         *
+ ***********************************************/
+
+// same results as the Update_Chan_Algo* functions above, but the four slots of the channel
+// live in the four lanes of SSE2 registers (in S0, S1, S2, S3 order) for the whole update,
+// so the phase and envelope counters are advanced and tested for envelope events 4 at a time
+// and only the table lookups and the operator connections (DO_ALGO_*) are done slot by slot.
+// in0-in3 and en0-en3 are locals here instead of the globals above, so they can stay in registers.
+
+#define SSE2_LOAD_SLOTS(field)	_mm_setr_epi32(CH->SLOT[S0].field, CH->SLOT[S1].field, CH->SLOT[S2].field, CH->SLOT[S3].field)
+
+#define SSE2_STORE_SLOTS(field, v)			\
+_mm_storeu_si128((__m128i *) lanes, v);		\
+CH->SLOT[S0].field = lanes[0];				\
+CH->SLOT[S1].field = lanes[1];				\
+CH->SLOT[S2].field = lanes[2];				\
+CH->SLOT[S3].field = lanes[3];
+
+// low 32 bits of each lane times b (SSE2 has no 32-bit multiply, only 32x32->64 on lanes 0 and 2)
+#define SSE2_MUL_LO(a, b)																	\
+_mm_unpacklo_epi32(_mm_shuffle_epi32(_mm_mul_epu32(a, b), _MM_SHUFFLE(0, 0, 2, 0)),			\
+	_mm_shuffle_epi32(_mm_mul_epu32(_mm_srli_si128(a, 4), b), _MM_SHUFFLE(0, 0, 2, 0)))
+
+
+#define SSE2_GET_CURRENT_PHASE					\
+_mm_storeu_si128((__m128i *) lanes, fcnt);		\
+in0 = lanes[0];									\
+in1 = lanes[1];									\
+in2 = lanes[2];									\
+in3 = lanes[3];
+
+
+#define SSE2_UPDATE_PHASE						\
+fcnt = _mm_add_epi32(fcnt, finc);
+
+
+#define SSE2_UPDATE_PHASE_LFO																		\
+if (freq_LFO = (CH->FMS * LFO_FREQ_UP[i]) >> (LFO_HBITS - 1))										\
+	fcnt = _mm_add_epi32(fcnt, _mm_add_epi32(finc,													\
+		_mm_srai_epi32(SSE2_MUL_LO(finc, _mm_set1_epi32(freq_LFO)), LFO_FMS_LBITS)));				\
+else																								\
+	fcnt = _mm_add_epi32(fcnt, finc);
+
+
+#define SSE2_GET_CURRENT_ENV									\
+_mm_storeu_si128((__m128i *) lanes, ecnt);						\
+en0 = ENV_TAB[(lanes[0] >> ENV_LBITS)] + CH->SLOT[S0].TLL;		\
+en1 = ENV_TAB[(lanes[1] >> ENV_LBITS)] + CH->SLOT[S1].TLL;		\
+en2 = ENV_TAB[(lanes[2] >> ENV_LBITS)] + CH->SLOT[S2].TLL;		\
+en3 = ENV_TAB[(lanes[3] >> ENV_LBITS)] + CH->SLOT[S3].TLL;
+
+
+#define SSE2_GET_CURRENT_ENV_LFO																		\
+env_LFO = LFO_ENV_UP[i];																				\
+_mm_storeu_si128((__m128i *) lanes, ecnt);																\
+en0 = ENV_TAB[(lanes[0] >> ENV_LBITS)] + CH->SLOT[S0].TLL + (env_LFO >> CH->SLOT[S0].AMS);				\
+en1 = ENV_TAB[(lanes[1] >> ENV_LBITS)] + CH->SLOT[S1].TLL + (env_LFO >> CH->SLOT[S1].AMS);				\
+en2 = ENV_TAB[(lanes[2] >> ENV_LBITS)] + CH->SLOT[S2].TLL + (env_LFO >> CH->SLOT[S2].AMS);				\
+en3 = ENV_TAB[(lanes[3] >> ENV_LBITS)] + CH->SLOT[S3].TLL + (env_LFO >> CH->SLOT[S3].AMS);
+
+
+// envelope events are rare, so when one happens the counters go back to the slots,
+// the usual ENV_NEXT_EVENT functions handle it and everything they may have changed is reloaded
+#define SSE2_UPDATE_ENV																\
+ecnt = _mm_add_epi32(ecnt, einc);													\
+if (_mm_movemask_epi8(_mm_cmplt_epi32(ecnt, ecmp)) != 0xFFFF)						\
+{																					\
+	SSE2_STORE_SLOTS(Ecnt, ecnt)													\
+	if (CH->SLOT[S0].Ecnt >= CH->SLOT[S0].Ecmp)										\
+		ENV_NEXT_EVENT[CH->SLOT[S0].Ecurp](&(CH->SLOT[S0]));						\
+	if (CH->SLOT[S1].Ecnt >= CH->SLOT[S1].Ecmp)										\
+		ENV_NEXT_EVENT[CH->SLOT[S1].Ecurp](&(CH->SLOT[S1]));						\
+	if (CH->SLOT[S2].Ecnt >= CH->SLOT[S2].Ecmp)										\
+		ENV_NEXT_EVENT[CH->SLOT[S2].Ecurp](&(CH->SLOT[S2]));						\
+	if (CH->SLOT[S3].Ecnt >= CH->SLOT[S3].Ecmp)										\
+		ENV_NEXT_EVENT[CH->SLOT[S3].Ecurp](&(CH->SLOT[S3]));						\
+	ecnt = SSE2_LOAD_SLOTS(Ecnt);													\
+	einc = SSE2_LOAD_SLOTS(Einc);													\
+	ecmp = SSE2_LOAD_SLOTS(Ecmp);													\
+}
+
+
+#define SSE2_NO_LFO_VARS
+#define SSE2_LFO_VARS		int env_LFO; int freq_LFO;
+
+// slots that reach the output in each algorithm (bit n = Sn), the channel is silent once they have all ended
+const int ALGO_OUT_SLOTS[8] = { 0x8, 0x8, 0x8, 0x8, 0xA, 0xE, 0xE, 0xF };
+
+#define DEFINE_UPDATE_CHAN_SSE2(NAME, ALGO, LFO_VARS, UPDATE_PHASE_X, GET_CURRENT_ENV_X, DO_ALGO_X, DO_OUTPUT_X, INTERPOLATED)	\
+void NAME(channel_ *CH, int **buf, int length)																			\
+{																														\
+	int i;																												\
+	int in0, in1, in2, in3;																								\
+	int en0, en1, en2, en3;																								\
+	int lanes[4];																										\
+	__m128i fcnt, finc, ecnt, einc, ecmp;																				\
+	LFO_VARS																											\
+																														\
+	ecnt = SSE2_LOAD_SLOTS(Ecnt);																						\
+	if ((_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(ecnt, _mm_set1_epi32(ENV_END)))) & ALGO_OUT_SLOTS[ALGO])	\
+		== ALGO_OUT_SLOTS[ALGO]) return;																				\
+																														\
+	if (INTERPOLATED) int_cnt = YM2612.Inter_Cnt;																		\
+																														\
+	fcnt = SSE2_LOAD_SLOTS(Fcnt);																						\
+	finc = SSE2_LOAD_SLOTS(Finc);																						\
+	einc = SSE2_LOAD_SLOTS(Einc);																						\
+	ecmp = SSE2_LOAD_SLOTS(Ecmp);																						\
+																														\
+	for(i = 0; i < length; i++)																							\
+	{																													\
+		SSE2_GET_CURRENT_PHASE																							\
+		UPDATE_PHASE_X																									\
+		GET_CURRENT_ENV_X																								\
+		SSE2_UPDATE_ENV																									\
+		DO_ALGO_X																										\
+		DO_OUTPUT_X																										\
+	}																													\
+																														\
+	SSE2_STORE_SLOTS(Fcnt, fcnt)																						\
+	SSE2_STORE_SLOTS(Ecnt, ecnt)																						\
+}
+
+DEFINE_UPDATE_CHAN_SSE2(Update_Chan_Algo0_SSE2, 0, SSE2_NO_LFO_VARS, SSE2_UPDATE_PHASE, SSE2_GET_CURRENT_ENV, DO_ALGO_0, DO_OUTPUT, 0)
+DEFINE_UPDATE_CHAN_SSE2(Update_Chan_Algo1_SSE2, 1, SSE2_NO_LFO_VARS, SSE2_UPDATE_PHASE, SSE2_GET_CURRENT_ENV, DO_ALGO_1, DO_OUTPUT, 0)
+DEFINE_UPDATE_CHAN_SSE2(Update_Chan_Algo2_SSE2, 2, SSE2_NO_LFO_VARS, SSE2_UPDATE_PHASE, SSE2_GET_CURRENT_ENV, DO_ALGO_2, DO_OUTPUT, 0)
+DEFINE_UPDATE_CHAN_SSE2(Update_Chan_Algo3_SSE2, 3, SSE2_NO_LFO_VARS, SSE2_UPDATE_PHASE, SSE2_GET_CURRENT_ENV, DO_ALGO_3, DO_OUTPUT, 0)
+DEFINE_UPDATE_CHAN_SSE2(Update_Chan_Algo4_SSE2, 4, SSE2_NO_LFO_VARS, SSE2_UPDATE_PHASE, SSE2_GET_CURRENT_ENV, DO_ALGO_4, DO_OUTPUT, 0)
+DEFINE_UPDATE_CHAN_SSE2(Update_Chan_Algo5_SSE2, 5, SSE2_NO_LFO_VARS, SSE2_UPDATE_PHASE, SSE2_GET_CURRENT_ENV, DO_ALGO_5, DO_OUTPUT, 0)
+DEFINE_UPDATE_CHAN_SSE2(Update_Chan_Algo6_SSE2, 6, SSE2_NO_LFO_VARS, SSE2_UPDATE_PHASE, SSE2_GET_CURRENT_ENV, DO_ALGO_6, DO_OUTPUT, 0)
+DEFINE_UPDATE_CHAN_SSE2(Update_Chan_Algo7_SSE2, 7, SSE2_NO_LFO_VARS, SSE2_UPDATE_PHASE, SSE2_GET_CURRENT_ENV, DO_ALGO_7, DO_OUTPUT, 0)
+
+DEFINE_UPDATE_CHAN_SSE2(Update_Chan_Algo0_LFO_SSE2, 0, SSE2_LFO_VARS, SSE2_UPDATE_PHASE_LFO, SSE2_GET_CURRENT_ENV_LFO, DO_ALGO_0, DO_OUTPUT, 0)
+DEFINE_UPDATE_CHAN_SSE2(Update_Chan_Algo1_LFO_SSE2, 1, SSE2_LFO_VARS, SSE2_UPDATE_PHASE_LFO, SSE2_GET_CURRENT_ENV_LFO, DO_ALGO_1, DO_OUTPUT, 0)
+DEFINE_UPDATE_CHAN_SSE2(Update_Chan_Algo2_LFO_SSE2, 2, SSE2_LFO_VARS, SSE2_UPDATE_PHASE_LFO, SSE2_GET_CURRENT_ENV_LFO, DO_ALGO_2, DO_OUTPUT, 0)
+DEFINE_UPDATE_CHAN_SSE2(Update_Chan_Algo3_LFO_SSE2, 3, SSE2_LFO_VARS, SSE2_UPDATE_PHASE_LFO, SSE2_GET_CURRENT_ENV_LFO, DO_ALGO_3, DO_OUTPUT, 0)
+DEFINE_UPDATE_CHAN_SSE2(Update_Chan_Algo4_LFO_SSE2, 4, SSE2_LFO_VARS, SSE2_UPDATE_PHASE_LFO, SSE2_GET_CURRENT_ENV_LFO, DO_ALGO_4, DO_OUTPUT, 0)
+DEFINE_UPDATE_CHAN_SSE2(Update_Chan_Algo5_LFO_SSE2, 5, SSE2_LFO_VARS, SSE2_UPDATE_PHASE_LFO, SSE2_GET_CURRENT_ENV_LFO, DO_ALGO_5, DO_OUTPUT, 0)
+DEFINE_UPDATE_CHAN_SSE2(Update_Chan_Algo6_LFO_SSE2, 6, SSE2_LFO_VARS, SSE2_UPDATE_PHASE_LFO, SSE2_GET_CURRENT_ENV_LFO, DO_ALGO_6, DO_OUTPUT, 0)
+DEFINE_UPDATE_CHAN_SSE2(Update_Chan_Algo7_LFO_SSE2, 7, SSE2_LFO_VARS, SSE2_UPDATE_PHASE_LFO, SSE2_GET_CURRENT_ENV_LFO, DO_ALGO_7, DO_OUTPUT, 0)
+
+DEFINE_UPDATE_CHAN_SSE2(Update_Chan_Algo0_Int_SSE2, 0, SSE2_NO_LFO_VARS, SSE2_UPDATE_PHASE, SSE2_GET_CURRENT_ENV, DO_ALGO_0, DO_OUTPUT_INT, 1)
+DEFINE_UPDATE_CHAN_SSE2(Update_Chan_Algo1_Int_SSE2, 1, SSE2_NO_LFO_VARS, SSE2_UPDATE_PHASE, SSE2_GET_CURRENT_ENV, DO_ALGO_1, DO_OUTPUT_INT, 1)
+DEFINE_UPDATE_CHAN_SSE2(Update_Chan_Algo2_Int_SSE2, 2, SSE2_NO_LFO_VARS, SSE2_UPDATE_PHASE, SSE2_GET_CURRENT_ENV, DO_ALGO_2, DO_OUTPUT_INT, 1)
+DEFINE_UPDATE_CHAN_SSE2(Update_Chan_Algo3_Int_SSE2, 3, SSE2_NO_LFO_VARS, SSE2_UPDATE_PHASE, SSE2_GET_CURRENT_ENV, DO_ALGO_3, DO_OUTPUT_INT, 1)
+DEFINE_UPDATE_CHAN_SSE2(Update_Chan_Algo4_Int_SSE2, 4, SSE2_NO_LFO_VARS, SSE2_UPDATE_PHASE, SSE2_GET_CURRENT_ENV, DO_ALGO_4, DO_OUTPUT_INT, 1)
+DEFINE_UPDATE_CHAN_SSE2(Update_Chan_Algo5_Int_SSE2, 5, SSE2_NO_LFO_VARS, SSE2_UPDATE_PHASE, SSE2_GET_CURRENT_ENV, DO_ALGO_5, DO_OUTPUT_INT, 1)
+DEFINE_UPDATE_CHAN_SSE2(Update_Chan_Algo6_Int_SSE2, 6, SSE2_NO_LFO_VARS, SSE2_UPDATE_PHASE, SSE2_GET_CURRENT_ENV, DO_ALGO_6, DO_OUTPUT_INT, 1)
+DEFINE_UPDATE_CHAN_SSE2(Update_Chan_Algo7_Int_SSE2, 7, SSE2_NO_LFO_VARS, SSE2_UPDATE_PHASE, SSE2_GET_CURRENT_ENV, DO_ALGO_7, DO_OUTPUT_INT, 1)
+
+DEFINE_UPDATE_CHAN_SSE2(Update_Chan_Algo0_LFO_Int_SSE2, 0, SSE2_LFO_VARS, SSE2_UPDATE_PHASE_LFO, SSE2_GET_CURRENT_ENV_LFO, DO_ALGO_0, DO_OUTPUT_INT, 1)
+DEFINE_UPDATE_CHAN_SSE2(Update_Chan_Algo1_LFO_Int_SSE2, 1, SSE2_LFO_VARS, SSE2_UPDATE_PHASE_LFO, SSE2_GET_CURRENT_ENV_LFO, DO_ALGO_1, DO_OUTPUT_INT, 1)
+DEFINE_UPDATE_CHAN_SSE2(Update_Chan_Algo2_LFO_Int_SSE2, 2, SSE2_LFO_VARS, SSE2_UPDATE_PHASE_LFO, SSE2_GET_CURRENT_ENV_LFO, DO_ALGO_2, DO_OUTPUT_INT, 1)
+DEFINE_UPDATE_CHAN_SSE2(Update_Chan_Algo3_LFO_Int_SSE2, 3, SSE2_LFO_VARS, SSE2_UPDATE_PHASE_LFO, SSE2_GET_CURRENT_ENV_LFO, DO_ALGO_3, DO_OUTPUT_INT, 1)
+DEFINE_UPDATE_CHAN_SSE2(Update_Chan_Algo4_LFO_Int_SSE2, 4, SSE2_LFO_VARS, SSE2_UPDATE_PHASE_LFO, SSE2_GET_CURRENT_ENV_LFO, DO_ALGO_4, DO_OUTPUT_INT, 1)
+DEFINE_UPDATE_CHAN_SSE2(Update_Chan_Algo5_LFO_Int_SSE2, 5, SSE2_LFO_VARS, SSE2_UPDATE_PHASE_LFO, SSE2_GET_CURRENT_ENV_LFO, DO_ALGO_5, DO_OUTPUT_INT, 1)
+DEFINE_UPDATE_CHAN_SSE2(Update_Chan_Algo6_LFO_Int_SSE2, 6, SSE2_LFO_VARS, SSE2_UPDATE_PHASE_LFO, SSE2_GET_CURRENT_ENV_LFO, DO_ALGO_6, DO_OUTPUT_INT, 1)
+DEFINE_UPDATE_CHAN_SSE2(Update_Chan_Algo7_LFO_Int_SSE2, 7, SSE2_LFO_VARS, SSE2_UPDATE_PHASE_LFO, SSE2_GET_CURRENT_ENV_LFO, DO_ALGO_7, DO_OUTPUT_INT, 1)
+
+const void (*UPDATE_CHAN_SSE2[8 * 4])(channel_ *CH, int **buf, int length) =
+{
+	Update_Chan_Algo0_SSE2, Update_Chan_Algo1_SSE2, Update_Chan_Algo2_SSE2, Update_Chan_Algo3_SSE2,
+	Update_Chan_Algo4_SSE2, Update_Chan_Algo5_SSE2, Update_Chan_Algo6_SSE2, Update_Chan_Algo7_SSE2,
+
+	Update_Chan_Algo0_LFO_SSE2, Update_Chan_Algo1_LFO_SSE2, Update_Chan_Algo2_LFO_SSE2, Update_Chan_Algo3_LFO_SSE2,
+	Update_Chan_Algo4_LFO_SSE2, Update_Chan_Algo5_LFO_SSE2, Update_Chan_Algo6_LFO_SSE2, Update_Chan_Algo7_LFO_SSE2,
+
+	Update_Chan_Algo0_Int_SSE2, Update_Chan_Algo1_Int_SSE2, Update_Chan_Algo2_Int_SSE2, Update_Chan_Algo3_Int_SSE2,
+	Update_Chan_Algo4_Int_SSE2, Update_Chan_Algo5_Int_SSE2, Update_Chan_Algo6_Int_SSE2, Update_Chan_Algo7_Int_SSE2,
+
+	Update_Chan_Algo0_LFO_Int_SSE2, Update_Chan_Algo1_LFO_Int_SSE2, Update_Chan_Algo2_LFO_Int_SSE2, Update_Chan_Algo3_LFO_Int_SSE2,
+	Update_Chan_Algo4_LFO_Int_SSE2, Update_Chan_Algo5_LFO_Int_SSE2, Update_Chan_Algo6_LFO_Int_SSE2, Update_Chan_Algo7_LFO_Int_SSE2
+};
+
+
+
+/***********************************************
+ *        avance sans gnration               *
+ ***********************************************/
+
+// when nobody is going to hear the samples (YM2612_Unheard), YM2612_Advance is used instead of YM2612_Update.
+// the chip ends up in exactly the same state, so savestates, sync logs and later sound don't change,
+// but only what that state depends on gets computed: slot 0 every sample (its feedback goes into S0_OUT),
+// the other slots from one envelope event to the next, and the whole algorithm for the last sample (OUTd).
+
+// UPDATE_ENV for one slot, n samples in a row
+static void Advance_Env(slot_ *SL, int n)
+{
+	int k;
+
+	while (n > 0)
+	{
+		if (SL->Ecnt + SL->Einc >= SL->Ecmp) k = 1;
+		else if (SL->Einc <= 0) k = n + 1;
+		else k = (SL->Ecmp - SL->Ecnt + SL->Einc - 1) / SL->Einc;
+
+		if (k > n)
+		{
+			SL->Ecnt += SL->Einc * n;
+			return;
+		}
+
+		SL->Ecnt += SL->Einc * k;
+		n -= k;
+		ENV_NEXT_EVENT[SL->Ecurp](SL);
+	}
+}
+
+
+static void Advance_Chan(channel_ *CH, int length, int lfo, int interpolated)
+{
+	int i, last, ended = 0, skipped = 0, ic, env_LFO, freq_LFO;
+
+	if (CH->SLOT[S0].Ecnt == ENV_END) ended |= 1;
+	if (CH->SLOT[S1].Ecnt == ENV_END) ended |= 2;
+	if (CH->SLOT[S2].Ecnt == ENV_END) ended |= 4;
+	if (CH->SLOT[S3].Ecnt == ENV_END) ended |= 8;
+	if ((ended & ALGO_OUT_SLOTS[CH->ALGO]) == ALGO_OUT_SLOTS[CH->ALGO]) return;
+
+	ic = YM2612.Inter_Cnt;
+
+	for(i = 0; i < length; )
+	{
+		if (interpolated) last = (i == length - 1) && ((ic + YM2612.Inter_Step) & 0x04000);
+		else last = (i == length - 1);
+
+		if (!last)
+		{
+			in0 = CH->SLOT[S0].Fcnt;
+
+			if (lfo)
+			{
+				UPDATE_PHASE_LFO
+				env_LFO = LFO_ENV_UP[i];
+				en0 = ENV_TAB[(CH->SLOT[S0].Ecnt >> ENV_LBITS)] + CH->SLOT[S0].TLL + (env_LFO >> CH->SLOT[S0].AMS);
+			}
+			else
+			{
+				CH->SLOT[S0].Fcnt += CH->SLOT[S0].Finc;
+				en0 = ENV_TAB[(CH->SLOT[S0].Ecnt >> ENV_LBITS)] + CH->SLOT[S0].TLL;
+			}
+
+			if ((CH->SLOT[S0].Ecnt += CH->SLOT[S0].Einc) >= CH->SLOT[S0].Ecmp)
+				ENV_NEXT_EVENT[CH->SLOT[S0].Ecurp](&(CH->SLOT[S0]));
+
+			DO_FEEDBACK
+
+			skipped++;
+		}
+		else
+		{
+			// catch the other slots up, then one normal sample
+			if (!lfo)
+			{
+				CH->SLOT[S1].Fcnt += CH->SLOT[S1].Finc * skipped;
+				CH->SLOT[S2].Fcnt += CH->SLOT[S2].Finc * skipped;
+				CH->SLOT[S3].Fcnt += CH->SLOT[S3].Finc * skipped;
+			}
+			Advance_Env(&(CH->SLOT[S1]), skipped);
+			Advance_Env(&(CH->SLOT[S2]), skipped);
+			Advance_Env(&(CH->SLOT[S3]), skipped);
+
+			GET_CURRENT_PHASE
+			if (lfo)
+			{
+				UPDATE_PHASE_LFO
+				GET_CURRENT_ENV_LFO
+			}
+			else
+			{
+				UPDATE_PHASE
+				GET_CURRENT_ENV
+			}
+			UPDATE_ENV
+
+			switch(CH->ALGO)
+			{
+				case 0: DO_ALGO_0 break;
+				case 1: DO_ALGO_1 break;
+				case 2: DO_ALGO_2 break;
+				case 3: DO_ALGO_3 break;
+				case 4: DO_ALGO_4 break;
+				case 5: DO_ALGO_5 break;
+				case 6: DO_ALGO_6 break;
+				case 7: DO_ALGO_7 break;
+			}
+		}
+
+		if (!interpolated) i++;
+		else if ((ic += YM2612.Inter_Step) & 0x04000)
+		{
+			ic &= 0x3FFF;
+			i++;
+		}
+	}
+
+	if (interpolated)
+	{
+		int_cnt = ic;
+		CH->Old_OUTd = CH->OUTd;		// DO_OUTPUT_INT leaves it there after every sample
+	}
+}
+
+
 
 /***********************************************
  *            fonctions publiques              *
@@ -1860,6 +2171,8 @@ int YM2612_Init(int Clock, int Rate, int Interpolation)
 
 	memset(&YM2612, 0, sizeof(YM2612));
 
+	YM2612_SSE2 = CPU_Has_SSE2();
+
 #if YM_DEBUG_LEVEL > 0
 	if (debug_file == NULL)
 	{
@@ -2303,14 +2616,11 @@ int YM2612_Write(unsigned char adr, unsigned char data)
 }
 
 
-void YM2612_Update(int **buf, int length)
+// Finc, LFO and interpolation setup shared by YM2612_Update and YM2612_Advance, returns the UPDATE_CHAN offset
+static int Prepare_Update(int length)
 {
 	int i, j, algo_type;
 
-#if YM_DEBUG_LEVEL > 1
-	fprintf(debug_file, "\n\nStarting generating sound...\n\n");
-#endif
-
 	// Mise  jour des pas des compteurs-frquences s'ils ont t modifis
 
 	if (YM2612.CHANNEL[0].SLOT[0].Finc == -1) CALC_FINC_CH(&YM2612.CHANNEL[0]);
@@ -2374,12 +2684,30 @@ void YM2612_Update(int **buf, int length)
 		algo_type |= 8;
 	}
 
-	UPDATE_CHAN[YM2612.CHANNEL[0].ALGO + algo_type](&(YM2612.CHANNEL[0]), buf, length);
-	UPDATE_CHAN[YM2612.CHANNEL[1].ALGO + algo_type](&(YM2612.CHANNEL[1]), buf, length);
-	UPDATE_CHAN[YM2612.CHANNEL[2].ALGO + algo_type](&(YM2612.CHANNEL[2]), buf, length);
-	UPDATE_CHAN[YM2612.CHANNEL[3].ALGO + algo_type](&(YM2612.CHANNEL[3]), buf, length);
-	UPDATE_CHAN[YM2612.CHANNEL[4].ALGO + algo_type](&(YM2612.CHANNEL[4]), buf, length);
-	if (!(YM2612.DAC)) UPDATE_CHAN[YM2612.CHANNEL[5].ALGO + algo_type](&(YM2612.CHANNEL[5]), buf, length);
+	return algo_type;
+}
+
+
+void YM2612_Update(int **buf, int length)
+{
+	int algo_type;
+	const void (**update_chan)(channel_ *CH, int **buf, int length);
+
+#if YM_DEBUG_LEVEL > 1
+	fprintf(debug_file, "\n\nStarting generating sound...\n\n");
+#endif
+
+	algo_type = Prepare_Update(length);
+
+	if (YM2612_SSE2) update_chan = UPDATE_CHAN_SSE2;
+	else update_chan = UPDATE_CHAN;
+
+	update_chan[YM2612.CHANNEL[0].ALGO + algo_type](&(YM2612.CHANNEL[0]), buf, length);
+	update_chan[YM2612.CHANNEL[1].ALGO + algo_type](&(YM2612.CHANNEL[1]), buf, length);
+	update_chan[YM2612.CHANNEL[2].ALGO + algo_type](&(YM2612.CHANNEL[2]), buf, length);
+	update_chan[YM2612.CHANNEL[3].ALGO + algo_type](&(YM2612.CHANNEL[3]), buf, length);
+	update_chan[YM2612.CHANNEL[4].ALGO + algo_type](&(YM2612.CHANNEL[4]), buf, length);
+	if (!(YM2612.DAC)) update_chan[YM2612.CHANNEL[5].ALGO + algo_type](&(YM2612.CHANNEL[5]), buf, length);
 
 	YM2612.Inter_Cnt = int_cnt;
 
@@ -2388,6 +2716,22 @@ void YM2612_Update(int **buf, int length)
 #endif
 
 }
+
+
+// same state afterwards as YM2612_Update, without generating any sound
+void YM2612_Advance(int length)
+{
+	int algo_type = Prepare_Update(length);
+
+	Advance_Chan(&(YM2612.CHANNEL[0]), length, algo_type & 8, algo_type & 16);
+	Advance_Chan(&(YM2612.CHANNEL[1]), length, algo_type & 8, algo_type & 16);
+	Advance_Chan(&(YM2612.CHANNEL[2]), length, algo_type & 8, algo_type & 16);
+	Advance_Chan(&(YM2612.CHANNEL[3]), length, algo_type & 8, algo_type & 16);
+	Advance_Chan(&(YM2612.CHANNEL[4]), length, algo_type & 8, algo_type & 16);
+	if (!(YM2612.DAC)) Advance_Chan(&(YM2612.CHANNEL[5]), length, algo_type & 8, algo_type & 16);
+
+	YM2612.Inter_Cnt = int_cnt;
+}
 #ifdef _WIN32
    #include "BaseTsd.h"
    typedef INT_PTR intptr_t;
@@ -2475,7 +2819,7 @@ void YM2612_DacAndTimers_Update(int **buffer, int length)
 	int *bufL, *bufR;
 	int i;
 
-	if (YM2612.DAC && YM2612.DACdata && DAC_Enable)
+	if (YM2612.DAC && YM2612.DACdata && DAC_Enable && !YM2612_Unheard)
 	{
 		bufL = buffer[0];
 		bufR = buffer[1];
@@ -2525,7 +2869,8 @@ void YM2612_Special_Update(void)
 {
 	if (YM_Len && YM2612_Enable)
 	{
-		YM2612_Update(YM_Buf, YM_Len);
+		if (YM2612_Unheard) YM2612_Advance(YM_Len);
+		else YM2612_Update(YM_Buf, YM_Len);
 
 		YM_Buf[0] = LeftAudioBuffer() + Sound_Extrapol[VDP_Current_Line + 1][0];
 		YM_Buf[1] = RightAudioBuffer() + Sound_Extrapol[VDP_Current_Line + 1][0];
@@ -2533,4 +2878,193 @@ void YM2612_Special_Update(void)
 	}
 }
 
+
+/* Benchmark */
+
+#define BENCH_RATE		44100
+#define BENCH_BLOCK		735							// one NTSC frame at 44.1 kHz
+#define BENCH_BLOCKS	(60 * 60)					// one minute of sound
+
+static unsigned int Bench_Seed;
+
+static int Bench_Random(int range)
+{
+	Bench_Seed = Bench_Seed * 1103515245 + 12345;
+	return (Bench_Seed >> 16) % range;
+}
+
+static void Bench_Write(int port, int adr, int data)
+{
+	YM2612_Write((unsigned char) (port * 2), (unsigned char) adr);
+	YM2612_Write((unsigned char) (port * 2 + 1), (unsigned char) data);
+}
+
+// a new patch and note on every channel each 16 frames (cycling through all algorithms and feedback levels),
+// key off halfway through, the LFO on every other note and SSG-EG on some slots
+static void Bench_Registers(int block)
+{
+	int ch, sl;
+
+	if ((block & 15) == 8)
+	{
+		for(ch = 0; ch < 6; ch++) if (Bench_Random(2)) Bench_Write(0, 0x28, (ch / 3) * 4 + (ch % 3));
+		return;
+	}
+	if (block & 15) return;
+
+	Bench_Write(0, 0x22, (block & 32) ? 0x08 | Bench_Random(8) : 0);
+	Bench_Write(0, 0x27, (block & 64) ? 0x40 : 0);
+
+	for(ch = 0; ch < 6; ch++)
+	{
+		int port = ch / 3, c = ch % 3;
+
+		for(sl = 0; sl < 4; sl++)
+		{
+			Bench_Write(port, 0x30 + sl * 4 + c, Bench_Random(0x80));
+			Bench_Write(port, 0x40 + sl * 4 + c, Bench_Random(0x30));
+			Bench_Write(port, 0x50 + sl * 4 + c, 0x10 | Bench_Random(0xD0));
+			Bench_Write(port, 0x60 + sl * 4 + c, Bench_Random(0x100));
+			Bench_Write(port, 0x70 + sl * 4 + c, Bench_Random(0x20));
+			Bench_Write(port, 0x80 + sl * 4 + c, Bench_Random(0x100));
+			Bench_Write(port, 0x90 + sl * 4 + c, Bench_Random(4) ? 0 : 0x08 | Bench_Random(8));
+		}
+		Bench_Write(port, 0xA4 + c, Bench_Random(0x40));
+		Bench_Write(port, 0xA0 + c, Bench_Random(0x100));
+		Bench_Write(port, 0xAC + c, Bench_Random(0x40));
+		Bench_Write(port, 0xA8 + c, Bench_Random(0x100));
+		Bench_Write(port, 0xB0 + c, ((((block >> 4) + ch) & 7) << 3) | (((block >> 7) + ch) & 7));
+		Bench_Write(port, 0xB4 + c, 0xC0 | Bench_Random(0x40));
+		Bench_Write(0, 0x28, 0xF0 | (port * 4 + c));
+	}
+}
+
+#define BENCH_SCALAR	0
+#define BENCH_SSE2		1
+#define BENCH_ADVANCE	2							// YM2612_Advance, as used for unheard frames
+
+static unsigned int Bench_Hash(unsigned int hash, const int *data, int count)
+{
+	int i;
+
+	for(i = 0; i < count; i++) hash = (hash ^ data[i]) * 16777619u;
+	return hash;
+}
+
+// plays the register stream through one of the modes, hashing the output and the chip state after every frame
+// unless outHash is NULL, returns the time it took in ms
+static double Bench_Pass(int chipClock, int interpolation, int mode, unsigned int *outHash, unsigned int *stateHash)
+{
+	static int bufL[BENCH_BLOCK], bufR[BENCH_BLOCK];
+	int *buf[2];
+	int block;
+	double start;
+
+	buf[0] = bufL;
+	buf[1] = bufR;
+
+	YM2612_Init(chipClock, BENCH_RATE, interpolation);
+	YM2612_SSE2 = (mode == BENCH_SSE2);
+	Bench_Seed = 1;
+	start = Benchmark_Time();
+
+	for(block = 0; block < BENCH_BLOCKS; block++)
+	{
+		Bench_Registers(block);
+
+		if (mode == BENCH_ADVANCE) YM2612_Advance(BENCH_BLOCK);
+		else
+		{
+			memset(bufL, 0, sizeof(bufL));
+			memset(bufR, 0, sizeof(bufR));
+			YM2612_Update(buf, BENCH_BLOCK);
+		}
+
+		if (outHash)
+		{
+			outHash[block] = Bench_Hash(Bench_Hash(2166136261u, bufL, BENCH_BLOCK), bufR, BENCH_BLOCK);
+			stateHash[block] = Bench_Hash(2166136261u, (const int *) &YM2612, sizeof(YM2612) / sizeof(int));
+		}
+	}
+
+	return Benchmark_Time() - start;
+}
+
+// times the scalar and SSE2 channel functions and YM2612_Advance on the same register stream,
+// then checks that the SSE2 output and the state after every frame match the scalar run.
+// returns the number of frames that don't
+static int Bench_Run(int chipClock, int interpolation, int hasSSE2, double ms[3])
+{
+	static unsigned int outHash[3][BENCH_BLOCKS], stateHash[3][BENCH_BLOCKS];
+	int mode, block, mismatches = 0;
+
+	for(mode = BENCH_SCALAR; mode <= BENCH_ADVANCE; mode++)
+	{
+		ms[mode] = 0.0;
+		if (mode == BENCH_SSE2 && !hasSSE2) continue;
+
+		ms[mode] = Bench_Pass(chipClock, interpolation, mode, NULL, NULL);
+		Bench_Pass(chipClock, interpolation, mode, outHash[mode], stateHash[mode]);
+	}
+
+	for(block = 0; block < BENCH_BLOCKS; block++)
+	{
+		if (stateHash[BENCH_ADVANCE][block] != stateHash[BENCH_SCALAR][block]) mismatches++;
+		else if (hasSSE2 && (outHash[BENCH_SSE2][block] != outHash[BENCH_SCALAR][block]
+			|| stateHash[BENCH_SSE2][block] != stateHash[BENCH_SCALAR][block])) mismatches++;
+	}
+
+	return mismatches;
+}
+
+// times the SSE2 channel functions and YM2612_Advance against the scalar ones, with and without YM2612_Improv
+int YM2612_Benchmark(int chipClock, int rate, int interpolation, char *summary)
+{
+	static ym2612_ saved;
+	int savedIntCnt = int_cnt, savedLen = YM_Len, savedGYM = GYM_Dumping, savedUnheard = YM2612_Unheard;
+	int hasSSE2 = CPU_Has_SSE2();
+	double ms[2][3];
+	int mismatches[2];
+	int improv;
+	FILE *log;
+
+	saved = YM2612;
+	YM_Len = 0;						// register writes must not render into the real sound buffers
+	GYM_Dumping = 0;
+	YM2612_Unheard = 0;
+
+	for(improv = 0; improv < 2; improv++)
+		mismatches[improv] = Bench_Run(chipClock, improv, hasSSE2, ms[improv]);
+
+	YM2612_Init(chipClock, rate, interpolation);
+	YM2612 = saved;
+	int_cnt = savedIntCnt;
+	YM_Len = savedLen;
+	GYM_Dumping = savedGYM;
+	YM2612_Unheard = savedUnheard;
+
+	log = Benchmark_Log("ym2612");
+	if (log)
+	{
+		for(improv = 0; improv < 2; improv++)
+		{
+			double samples = (double) BENCH_BLOCK * BENCH_BLOCKS;
+			fprintf(log, "YM2612_Improv %d: scalar %.0f ms (%.0f samples/s), SSE2 %.0f ms (%.0f samples/s), unheard %.0f ms (%.0f samples/s), %d of %d frames differ\n",
+				improv, ms[improv][BENCH_SCALAR], samples * 1000.0 / (ms[improv][BENCH_SCALAR] ? ms[improv][BENCH_SCALAR] : 1),
+				ms[improv][BENCH_SSE2], samples * 1000.0 / (ms[improv][BENCH_SSE2] ? ms[improv][BENCH_SSE2] : 1),
+				ms[improv][BENCH_ADVANCE], samples * 1000.0 / (ms[improv][BENCH_ADVANCE] ? ms[improv][BENCH_ADVANCE] : 1),
+				mismatches[improv], BENCH_BLOCKS);
+		}
+		fprintf(log, "\n");
+		fclose(log);
+	}
+
+	sprintf(summary, "YM2612: scalar %.0f/%.0f ms, SSE2 %.0f/%.0f ms, unheard %.0f/%.0f ms%s",
+		ms[0][BENCH_SCALAR], ms[1][BENCH_SCALAR], ms[0][BENCH_SSE2], ms[1][BENCH_SSE2], ms[0][BENCH_ADVANCE], ms[1][BENCH_ADVANCE],
+		(mismatches[0] || mismatches[1]) ? " (MISMATCH)" : hasSSE2 ? "" : " (no SSE2)");
+
+	return mismatches[0] + mismatches[1];
+}
+
+
 /* end */
\ No newline at end of file
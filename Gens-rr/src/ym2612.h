@@ -104,6 +104,9 @@ typedef struct ym2612__ {
 
 extern int YM2612_Enable;
 extern int YM2612_Improv;
+extern int YM2612_SSE2;		// channels are rendered by the SSE2 functions (set by YM2612_Init when the CPU has SSE2)
+extern int YM2612_Lazy;		// option: only keep the chip state up to date when the sound of a frame won't be heard
+extern int YM2612_Unheard;	// set by the frame functions, YM2612_Special_Update then uses YM2612_Advance
 extern int DAC_Enable;
 extern int *YM_Buf[2];
 extern int YM_Len;
@@ -118,6 +121,7 @@ int YM2612_Reset(void);
 int YM2612_Read(void);
 int YM2612_Write(unsigned char adr, unsigned char data);
 void YM2612_Update(int **buf, int length);
+void YM2612_Advance(int length);
 int YM2612_Save_Full(unsigned char SAVE[0x14d0]);
 int YM2612_Restore_Full(const unsigned char SAVE[0x14d0]); 
 int YM2612_Save(unsigned char SAVE[0x200]);
@@ -127,6 +131,7 @@ int YM2612_Restore(unsigned char SAVE[0x200]);
 
 void YM2612_DacAndTimers_Update(int **buffer, int length);
 void YM2612_Special_Update(void);
+int YM2612_Benchmark(int chipClock, int rate, int interpolation, char *summary);
 
 /* end */
 